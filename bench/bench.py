@@ -0,0 +1,262 @@
+#!/usr/bin/python3
+"""
+Python-level throughput benchmarks for pypcap
+
+    python3 bench.py input.pcap [--repeat 5] [--interface eth0 --capture-packets 100000] [--json]
+
+Each benchmark reports packets/sec and bytes/sec (median over --repeat runs),
+per-packet latency percentiles, and allocations per packet:
+    pool_allocs   pypcap packet pool buffers taken per packet
+    py_blocks     python heap blocks still alive per packet after the run
+    peak_bytes    tracemalloc peak per packet
+"""
+import argparse
+import gc
+import json
+import os
+import statistics
+import sys
+import tempfile
+import time
+import tracemalloc
+
+import pypcap
+
+
+def percentiles(samples, points=(50, 90, 99, 99.9)):
+    if not samples:
+        return {}
+    samples = sorted(samples)
+    out = {}
+    for p in points:
+        i = min(len(samples) - 1, int(len(samples) * p / 100))
+        out["p%g" % p] = samples[i]
+    return out
+
+
+def open_reader(path):
+    # libpcap fcloses the descriptor on close(), so the python file must not close it again
+    return pypcap.PcapReader(open(os.open(path, os.O_RDONLY), "rb", closefd=False))
+
+
+def open_writer(path):
+    return pypcap.PcapWriter(open(os.open(path, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644), "wb", closefd=False))
+
+
+def pool_allocations():
+    return sum(p["allocations"] for p in pypcap.pool_stats())
+
+
+class Result:
+    def __init__(self, name):
+        self.name = name
+        self.packets = 0
+        self.bytes = 0
+        self.seconds = []
+        self.latency_ns = []
+        self.allocs = {}
+
+    def as_dict(self):
+        t = statistics.median(self.seconds)
+        return {
+            "name": self.name,
+            "packets": self.packets,
+            "bytes": self.bytes,
+            "pps": self.packets / t,
+            "bps": self.bytes / t,
+            "seconds": t,
+            "latency_ns": percentiles(self.latency_ns),
+            "allocs_per_packet": self.allocs,
+        }
+
+
+def measure_allocs(fn, packets):
+    """run fn once under tracemalloc and count what it allocated per packet"""
+    gc.collect()
+    pool_before = pool_allocations()
+    blocks_before = sys.getallocatedblocks()
+    tracemalloc.start()
+    fn()
+    _, peak = tracemalloc.get_traced_memory()
+    tracemalloc.stop()
+    gc.collect()
+    packets = max(packets, 1)
+    return {
+        "pool_allocs": (pool_allocations() - pool_before) / packets,
+        "py_blocks": (sys.getallocatedblocks() - blocks_before) / packets,
+        "peak_bytes": peak / packets,
+    }
+
+
+def file_totals(path):
+    packets = 0
+    size = 0
+    reader = open_reader(path)
+    while True:
+        batch = reader.read_batch(4096)
+        if not batch:
+            break
+        packets += len(batch)
+        size += sum(p.caplen for p in batch)
+    reader.close()
+    return packets, size
+
+
+def bench_read(path, repeat, totals):
+    """PcapReader.read: the whole file in one C loop, no per-packet objects"""
+    r = Result("reader.read")
+    r.packets, r.bytes = totals
+
+    def run():
+        reader = open_reader(path)
+        reader.read()
+        reader.close()
+
+    for _ in range(repeat):
+        start = time.perf_counter_ns()
+        run()
+        elapsed = time.perf_counter_ns() - start
+        r.seconds.append(elapsed / 1e9)
+        r.latency_ns.append(elapsed / max(r.packets, 1))
+    r.allocs = measure_allocs(run, r.packets)
+    return r
+
+
+def bench_read_batch(path, repeat, totals, batch_size):
+    """PcapReader.read_batch: latency is per packet, sampled once per batch"""
+    r = Result("reader.read_batch(%d)" % batch_size)
+    r.packets, r.bytes = totals
+
+    def run(latency=None):
+        reader = open_reader(path)
+        while True:
+            start = time.perf_counter_ns()
+            batch = reader.read_batch(batch_size)
+            if not batch:
+                break
+            if latency is not None:
+                latency.append((time.perf_counter_ns() - start) / len(batch))
+        reader.close()
+
+    for _ in range(repeat):
+        start = time.perf_counter()
+        run(r.latency_ns)
+        r.seconds.append(time.perf_counter() - start)
+    r.allocs = measure_allocs(run, r.packets)
+    return r
+
+
+def bench_iterate(path, repeat, totals):
+    """iterating a PcapReader one Packet at a time, touching the dissected fields"""
+    r = Result("reader iteration")
+    r.packets, r.bytes = totals
+
+    def run(latency=None):
+        reader = open_reader(path)
+        it = iter(reader)
+        while True:
+            start = time.perf_counter_ns()
+            try:
+                pkt = next(it)
+            except StopIteration:
+                break
+            pkt.sport
+            if latency is not None:
+                latency.append(time.perf_counter_ns() - start)
+        reader.close()
+
+    for _ in range(repeat):
+        start = time.perf_counter()
+        run(r.latency_ns)
+        r.seconds.append(time.perf_counter() - start)
+    r.allocs = measure_allocs(run, r.packets)
+    return r
+
+
+def bench_write(path, repeat, totals):
+    """PcapWriter.write_from_pcap_reader into a temporary file"""
+    r = Result("writer.write_from_pcap_reader")
+    r.packets, r.bytes = totals
+    fd, out = tempfile.mkstemp(suffix=".pcap")
+    os.close(fd)
+
+    def run():
+        reader = open_reader(path)
+        writer = open_writer(out)
+        writer.write_from_pcap_reader(reader)
+        writer.close()
+        reader.close()
+
+    try:
+        for _ in range(repeat):
+            start = time.perf_counter_ns()
+            run()
+            elapsed = time.perf_counter_ns() - start
+            r.seconds.append(elapsed / 1e9)
+            r.latency_ns.append(elapsed / max(r.packets, 1))
+        r.allocs = measure_allocs(run, r.packets)
+    finally:
+        os.remove(out)
+    return r
+
+
+def bench_capture(interface, packets, batch_size, repeat):
+    """PcapCapture.start in callback mode; latency is callback time per packet"""
+    r = Result("capture.start(%s)" % interface)
+
+    def run(latency=None):
+        def on_batch(batch):
+            start = time.perf_counter_ns()
+            r.packets += len(batch)
+            r.bytes += sum(batch.caplens)
+            if latency is not None:
+                latency.append((time.perf_counter_ns() - start) / len(batch))
+        capture = pypcap.PcapCapture(interface, None, packets)
+        capture.start(callback=on_batch, batch_size=batch_size)
+        capture.close()
+
+    for _ in range(repeat):
+        r.packets = r.bytes = 0
+        start = time.perf_counter()
+        run(r.latency_ns)
+        r.seconds.append(time.perf_counter() - start)
+    captured = (r.packets, r.bytes)
+    r.allocs = measure_allocs(run, r.packets)
+    r.packets, r.bytes = captured
+    return r
+
+
+def report(results, as_json):
+    rows = [r.as_dict() for r in results]
+    if as_json:
+        print(json.dumps(rows, indent=2))
+        return
+
+    for row in rows:
+        lat = " ".join("%s=%.0fns" % (k, v) for k, v in row["latency_ns"].items())
+        allocs = " ".join("%s=%.3f" % (k, v) for k, v in row["allocs_per_packet"].items())
+        print("%-34s %12.0f pkt/s %10.1f MB/s  %s" % (row["name"], row["pps"], row["bps"] / 1e6, lat))
+        print("%-34s allocs/pkt: %s" % ("", allocs))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="pypcap throughput benchmarks")
+    parser.add_argument("pcap", help="input file, see gen_pcap.py")
+    parser.add_argument("--repeat", type=int, default=5)
+    parser.add_argument("--batch-size", type=int, default=1024)
+    parser.add_argument("--interface", help="also benchmark live capture on this interface")
+    parser.add_argument("--capture-packets", type=int, default=100000)
+    parser.add_argument("--json", action="store_true")
+    args = parser.parse_args()
+
+    totals = file_totals(args.pcap)
+    results = [
+        bench_read(args.pcap, args.repeat, totals),
+        bench_read_batch(args.pcap, args.repeat, totals, args.batch_size),
+        bench_iterate(args.pcap, args.repeat, totals),
+        bench_write(args.pcap, args.repeat, totals),
+    ]
+    if args.interface:
+        results.append(bench_capture(args.interface, args.capture_packets, args.batch_size, args.repeat))
+
+    report(results, args.json)
@@ -0,0 +1,163 @@
+/*
+C-level benchmarks: the libpcap and pypcap C paths with no python in the loop
+
+    cbench input.pcap [repeat]
+
+read        pcap_next_ex over the file (the ceiling for PcapReader.read)
+read+copy   pcap_next_ex plus pkt_chunk_append into the packet pool (PcapReader.read_batch without objects)
+dissect     dissect_packet over pooled copies
+dump        pcap_dump of every packet to /dev/null (the ceiling for write_from_pcap_reader)
+
+Build with run.sh, or by hand:
+    cc -O2 -o cbench cbench.c ../source/pool.c ../source/dissect.c ../source/affinity.c \
+        $(python3-config --includes) $(python3-config --embed --ldflags) -lpcap -lpthread
+*/
+#include "../source/pool.h"
+#include "../source/dissect.h"
+
+#include <pcap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHUNK_BYTES 262144
+
+struct result{
+    const char *name;
+    unsigned long long packets;
+    unsigned long long bytes;
+    double seconds;
+    unsigned long long pool_allocs;
+    double *latency_ns; // per-packet, one sample per run
+    int runs;
+};
+
+static unsigned long long
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long
+pool_allocations(void)
+{
+    struct pkt_pool_stats stats;
+    pkt_pool_stats(pkt_pool_get(-1), &stats);
+    return stats.allocations;
+}
+
+static pcap_t *
+open_offline(const char *path)
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t *p = pcap_open_offline(path, errbuf);
+    if(p == NULL){
+        fprintf(stderr, "%s: %s\n", path, errbuf);
+        exit(1);
+    }
+    return p;
+}
+
+/* one pass over the file; mode 0 read, 1 read+copy, 2 read+copy+dissect, 3 dump */
+static void
+run_once(const char *path, int mode, struct result *r)
+{
+    pcap_t *p = open_offline(path);
+    pcap_dumper_t *dumper = NULL;
+    if(mode == 3){
+        dumper = pcap_dump_open(p, "/dev/null");
+        if(dumper == NULL){
+            fprintf(stderr, "pcap_dump_open: %s\n", pcap_geterr(p));
+            exit(1);
+        }
+    }
+
+    struct pkt_pool *pool = pkt_pool_get(-1);
+    struct pkt_buf *chunk = NULL;
+    int linktype = pcap_datalink(p);
+    struct pcap_pkthdr *hdr;
+    const u_char *data;
+    struct pkt_meta meta;
+    unsigned long long packets = 0, bytes = 0, sink = 0;
+
+    unsigned long long allocs = pool_allocations();
+    unsigned long long start = now_ns();
+    while(pcap_next_ex(p, &hdr, &data) == 1){
+        packets++;
+        bytes += hdr->caplen;
+        if(mode == 1 || mode == 2){
+            size_t offset;
+            struct pkt_buf *buf = pkt_chunk_append(&chunk, pool, CHUNK_BYTES, data, hdr->caplen, &offset);
+            if(buf == NULL){
+                fprintf(stderr, "pool exhausted\n");
+                exit(1);
+            }
+            if(mode == 2){
+                dissect_packet(linktype, buf->data + offset, hdr->caplen, &meta);
+                sink += meta.sport;
+            }
+        } else if(mode == 3){
+            pcap_dump((u_char *)dumper, hdr, data);
+        }
+    }
+    unsigned long long elapsed = now_ns() - start;
+
+    if(chunk != NULL)
+        pkt_buf_decref(chunk);
+    if(dumper != NULL)
+        pcap_dump_close(dumper);
+    pcap_close(p);
+
+    r->packets = packets;
+    r->bytes = bytes;
+    r->pool_allocs = pool_allocations() - allocs;
+    r->seconds += elapsed / 1e9;
+    r->latency_ns[r->runs++] = packets ? (double)elapsed / packets : 0;
+    if(sink == 1) // keep the dissector from being optimised out
+        fputc('\0', stderr);
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void
+report(struct result *r)
+{
+    double t = r->seconds / r->runs;
+    qsort(r->latency_ns, r->runs, sizeof(double), cmp_double);
+    printf("%-12s %12.0f pkt/s %10.1f MB/s  ns/pkt min=%.1f p50=%.1f max=%.1f  pool allocs/pkt=%.4f\n",
+        r->name, r->packets / t, r->bytes / t / 1e6,
+        r->latency_ns[0], r->latency_ns[r->runs / 2], r->latency_ns[r->runs - 1],
+        r->packets ? (double)r->pool_allocs / r->packets : 0.0);
+}
+
+int
+main(int argc, char **argv)
+{
+    if(argc < 2){
+        fprintf(stderr, "usage: %s input.pcap [repeat]\n", argv[0]);
+        return 2;
+    }
+    int repeat = argc > 2 ? atoi(argv[2]) : 5;
+    if(repeat <= 0)
+        repeat = 1;
+
+    const char *names[] = {"read", "read+copy", "dissect", "dump"};
+    for(int mode = 0; mode < 4; mode++){
+        struct result r = {0};
+        r.name = names[mode];
+        r.latency_ns = calloc(repeat, sizeof(double));
+        for(int i = 0; i < repeat; i++)
+            run_once(argv[1], mode, &r);
+        report(&r);
+        free(r.latency_ns);
+    }
+    return 0;
+}
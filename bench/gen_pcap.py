@@ -0,0 +1,117 @@
+#!/usr/bin/python3
+"""
+Deterministic synthetic pcap generator for the benchmarks
+
+The same arguments always produce a byte-identical file, so numbers from
+different runs and machines are comparable.
+
+    python3 gen_pcap.py out.pcap --count 1000000 --sizes imix --precision nano
+"""
+import argparse
+import random
+import struct
+
+MAGIC_MICRO = 0xa1b2c3d4
+MAGIC_NANO = 0xa1b23c4d
+LINKTYPE_ETHERNET = 1
+SNAPLEN = 262144
+
+ETH_LEN = 14
+IPV4_LEN = 20
+UDP_LEN = 8
+TCP_LEN = 20
+MIN_FRAME = ETH_LEN + IPV4_LEN + TCP_LEN
+
+# classic simple IMIX: 7 x 64B, 4 x 594B, 1 x 1518B
+IMIX = [64] * 7 + [594] * 4 + [1518]
+
+
+def size_sampler(spec, rng):
+    """
+    Return a function producing frame sizes from spec:
+        N        every frame is N bytes
+        A-B      uniform between A and B
+        imix     simple IMIX mix
+    """
+    if spec == "imix":
+        return lambda: rng.choice(IMIX)
+    if "-" in spec:
+        lo, hi = (int(x) for x in spec.split("-", 1))
+        return lambda: rng.randint(lo, hi)
+    n = int(spec)
+    return lambda: n
+
+
+def checksum(data):
+    if len(data) % 2:
+        data += b"\0"
+    s = sum(struct.unpack("!%dH" % (len(data) // 2), data))
+    while s >> 16:
+        s = (s & 0xffff) + (s >> 16)
+    return ~s & 0xffff
+
+
+def frame(rng, size, flows):
+    src, dst, sport, dport, proto = rng.choice(flows)
+    size = max(size, MIN_FRAME)
+    l4_len = TCP_LEN if proto == 6 else UDP_LEN
+    payload = bytes(rng.getrandbits(8) for _ in range(min(size - ETH_LEN - IPV4_LEN - l4_len, 16)))
+    payload = payload.ljust(size - ETH_LEN - IPV4_LEN - l4_len, b"\0")
+
+    if proto == 6:
+        l4 = struct.pack("!HHIIBBHHH", sport, dport, rng.getrandbits(32), 0, 5 << 4, 0x18, 65535, 0, 0)
+    else:
+        l4 = struct.pack("!HHHH", sport, dport, UDP_LEN + len(payload), 0)
+
+    ip = struct.pack("!BBHHHBBH4s4s", 0x45, 0, IPV4_LEN + len(l4) + len(payload), rng.getrandbits(16), 0, 64, proto, 0, src, dst)
+    ip = ip[:10] + struct.pack("!H", checksum(ip)) + ip[12:]
+
+    eth = b"\x02\x00\x00\x00\x00\x01" + b"\x02\x00\x00\x00\x00\x02" + b"\x08\x00"
+    return eth + ip + l4 + payload
+
+
+def generate(path, count, sizes="imix", precision="micro", snaplen=0, flows=1024, pps=1000000, seed=0):
+    rng = random.Random(seed)
+    sample = size_sampler(sizes, rng)
+    flow_table = [
+        (
+            struct.pack("!I", 0x0a000000 | rng.getrandbits(16)),
+            struct.pack("!I", 0xc0a80000 | rng.getrandbits(16)),
+            rng.randint(1024, 65535),
+            rng.choice([53, 80, 443, 8080]),
+            rng.choice([6, 17]),
+        )
+        for _ in range(flows)
+    ]
+
+    nano = precision == "nano"
+    magic = MAGIC_NANO if nano else MAGIC_MICRO
+    unit = 1000000000 if nano else 1000000
+    step = unit // pps if pps < unit else 1
+    ts = 1600000000 * unit
+
+    with open(path, "wb") as f:
+        f.write(struct.pack("<IHHiIII", magic, 2, 4, 0, 0, SNAPLEN, LINKTYPE_ETHERNET))
+        for _ in range(count):
+            data = frame(rng, sample(), flow_table)
+            wirelen = len(data)
+            if snaplen:
+                data = data[:snaplen]
+            f.write(struct.pack("<IIII", ts // unit, ts % unit, len(data), wirelen))
+            f.write(data)
+            ts += step
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("output")
+    parser.add_argument("--count", type=int, default=100000)
+    parser.add_argument("--sizes", default="imix", help="N, A-B or imix")
+    parser.add_argument("--precision", choices=["micro", "nano"], default="micro")
+    parser.add_argument("--snaplen", type=int, default=0, help="truncate frames to this many bytes, 0 for none")
+    parser.add_argument("--flows", type=int, default=1024)
+    parser.add_argument("--pps", type=int, default=1000000, help="packet rate the timestamps are spaced for")
+    parser.add_argument("--seed", type=int, default=0)
+    args = parser.parse_args()
+
+    generate(args.output, args.count, args.sizes, args.precision, args.snaplen, args.flows, args.pps, args.seed)
@@ -0,0 +1,21 @@
+cd ..
+python3 setup.py build_ext --inplace --force
+cd bench
+
+PCAP=${PCAP:-bench_imix.pcap}
+COUNT=${COUNT:-1000000}
+REPEAT=${REPEAT:-5}
+
+if [ ! -f "$PCAP" ]; then
+    python3 gen_pcap.py "$PCAP" --count "$COUNT" --sizes imix --seed 0
+fi
+
+cc -O2 -o cbench cbench.c ../source/pool.c ../source/dissect.c ../source/affinity.c \
+    $(python3-config --includes) $(python3-config --embed --ldflags) -lpcap -lpthread
+
+{
+    echo "== C =="
+    ./cbench "$PCAP" "$REPEAT"
+    echo "== python =="
+    PYTHONPATH=.. python3 bench.py "$PCAP" --repeat "$REPEAT" "$@"
+} | tee ../bench_output.txt
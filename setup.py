@@ -1,12 +1,37 @@
+import os
 from distutils.core import setup, Extension
 
+# PYPCAP_NO_METRICS=1 compiles the latency instrumentation out entirely
+define_macros = []
+if os.environ.get('PYPCAP_NO_METRICS'):
+    define_macros.append(('PYPCAP_NO_METRICS', '1'))
+
 pypcap = Extension(
     'pypcap',
     sources=[
         'source/pypcap.c',
         'source/util.c',
+        'source/affinity.c',
+        'source/pool.c',
+        'source/dissect.c',
+        'source/inject.c',
+        'source/metrics.c',
+        'source/sampling.c',
+        'source/truncate.c',
+        'source/flight.c',
+        'source/dedup.c',
+        'source/extract.c',
+        'source/netdev.c',
+        'source/arrow.c',
+        'source/stats.c',
+        'source/hll.c',
+        'source/bloom.c',
+        'source/recover.c',
+        'source/encap.c',
+        'source/shmring.c',
     ],
     libraries=['pcap'],
+    define_macros=define_macros,
 )
 
 setup(
@@ -0,0 +1,252 @@
+#ifndef PYPCAP_AFFINITY
+#include "affinity.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/* from linux/mempolicy.h, not always installed alongside libc headers */
+#define PYPCAP_MPOL_DEFAULT 0
+#define PYPCAP_MPOL_PREFERRED 1
+#define PYPCAP_NODEMASK_BITS (sizeof(((struct placement_saved *)0)->nodemask) * 8)
+
+/*
+Return the number of NUMA nodes on this machine
+
+Machines without /sys/devices/system/node are treated as a single node
+*/
+int numa_node_count(void){
+    DIR *d = opendir("/sys/devices/system/node");
+    if(d == NULL)
+        return 1;
+
+    int count = 0;
+    struct dirent *e;
+    while((e = readdir(d)) != NULL){
+        if(strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9')
+            count++;
+    }
+    closedir(d);
+
+    return count > 0 ? count : 1;
+}
+
+/*
+Fill set with the cpus belonging to a NUMA node, parsed from its cpulist ("0-3,8-11")
+
+Return 0 on success, -1 on failure
+*/
+int numa_node_cpus(int node, cpu_set_t *set){
+    char path[64];
+    char list[4096];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+
+    FILE *fp = fopen(path, "r");
+    if(fp == NULL)
+        return -1;
+    if(fgets(list, sizeof(list), fp) == NULL){
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    CPU_ZERO(set);
+    char *p = list;
+    while(*p != '\0' && *p != '\n'){
+        char *end;
+        long lo = strtol(p, &end, 10);
+        if(end == p)
+            return -1;
+        long hi = lo;
+        if(*end == '-'){
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if(end == p)
+                return -1;
+        }
+        for(long c = lo; c <= hi && c < CPU_SETSIZE; c++)
+            CPU_SET((int)c, set);
+        p = (*end == ',') ? end + 1 : end;
+    }
+
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+/*
+Return the NUMA node the calling thread is running on, and store its cpu in *cpu
+*/
+int numa_current_node(int *cpu){
+    unsigned int c = 0, node = 0;
+    if(syscall(SYS_getcpu, &c, &node, NULL) != 0)
+        return -1;
+    if(cpu != NULL)
+        *cpu = (int)c;
+    return (int)node;
+}
+
+/*
+Ask the kernel to back [addr, addr+len) with pages from node
+
+Best effort: returns -1 (with errno set) if the kernel refuses, but memory stays usable
+*/
+int numa_bind_region(void *addr, size_t len, int node){
+    if(node < 0)
+        return 0;
+    if((size_t)node >= PYPCAP_NODEMASK_BITS){
+        errno = EINVAL;
+        return -1;
+    }
+
+    unsigned long mask[PYPCAP_NODEMASK_BITS / (8 * sizeof(unsigned long))] = {0};
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+
+    return (int)syscall(SYS_mbind, addr, len, PYPCAP_MPOL_PREFERRED, mask, PYPCAP_NODEMASK_BITS, 0);
+}
+
+/*
+Build a placement from the python cpu_affinity argument (None, int or iterable of ints)
+
+If only numa_node is given, the placement is pinned to all cpus of that node
+Return 0 on success, -1 with a python exception set on failure
+*/
+int placement_parse(PyObject *cpu_affinity, int numa_node, struct placement *pl){
+    memset(pl, 0, sizeof(*pl));
+    pl->numa_node = -1;
+
+    if(numa_node < -1 || numa_node >= numa_node_count()){
+        PyErr_Format(PyExc_ValueError, "numa_node must be -1 or between 0 and %d", numa_node_count() - 1);
+        return -1;
+    }
+    pl->numa_node = numa_node;
+
+    if(cpu_affinity == NULL || cpu_affinity == Py_None){
+        if(numa_node >= 0){
+            if(numa_node_cpus(numa_node, &pl->cpus) != 0){
+                PyErr_Format(PyExc_SystemError, "Could not read cpu list of numa node %d", numa_node);
+                return -1;
+            }
+            pl->has_cpus = 1;
+        }
+        return 0;
+    }
+
+    CPU_ZERO(&pl->cpus);
+    long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+
+    if(PyLong_Check(cpu_affinity)){
+        long cpu = PyLong_AsLong(cpu_affinity);
+        if(cpu == -1 && PyErr_Occurred())
+            return -1;
+        if(cpu < 0 || cpu >= ncpus || cpu >= CPU_SETSIZE){
+            PyErr_Format(PyExc_ValueError, "cpu_affinity entry %ld is not a valid cpu", cpu);
+            return -1;
+        }
+        CPU_SET((int)cpu, &pl->cpus);
+        pl->has_cpus = 1;
+        return 0;
+    }
+
+    PyObject *iter = PyObject_GetIter(cpu_affinity);
+    if(iter == NULL){
+        PyErr_SetString(PyExc_TypeError, "cpu_affinity must be None, an int or an iterable of ints");
+        return -1;
+    }
+
+    PyObject *item;
+    while((item = PyIter_Next(iter)) != NULL){
+        long cpu = PyLong_AsLong(item);
+        Py_DECREF(item);
+        if(cpu == -1 && PyErr_Occurred()){
+            Py_DECREF(iter);
+            return -1;
+        }
+        if(cpu < 0 || cpu >= ncpus || cpu >= CPU_SETSIZE){
+            Py_DECREF(iter);
+            PyErr_Format(PyExc_ValueError, "cpu_affinity entry %ld is not a valid cpu", cpu);
+            return -1;
+        }
+        CPU_SET((int)cpu, &pl->cpus);
+    }
+    Py_DECREF(iter);
+    if(PyErr_Occurred())
+        return -1;
+
+    if(CPU_COUNT(&pl->cpus) == 0){
+        PyErr_SetString(PyExc_ValueError, "cpu_affinity must contain at least one cpu");
+        return -1;
+    }
+    pl->has_cpus = 1;
+
+    return 0;
+}
+
+/*
+Move the calling thread onto the placement and make its new allocations prefer the numa node
+
+Return 0 on success, -1 on failure (errno set); whatever was applied is recorded in saved
+*/
+int placement_apply(const struct placement *pl, struct placement_saved *saved){
+    memset(saved, 0, sizeof(*saved));
+
+    if(pl->numa_node >= 0 && (size_t)pl->numa_node < PYPCAP_NODEMASK_BITS){
+        if(syscall(SYS_get_mempolicy, &saved->mode, saved->nodemask, PYPCAP_NODEMASK_BITS, NULL, 0) == 0){
+            unsigned long mask[PYPCAP_NODEMASK_BITS / (8 * sizeof(unsigned long))] = {0};
+            mask[pl->numa_node / (8 * sizeof(unsigned long))] |= 1UL << (pl->numa_node % (8 * sizeof(unsigned long)));
+            if(syscall(SYS_set_mempolicy, PYPCAP_MPOL_PREFERRED, mask, PYPCAP_NODEMASK_BITS) == 0)
+                saved->has_policy = 1;
+        }
+    }
+
+    if(pl->has_cpus){
+        if(pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &saved->cpus) != 0)
+            return -1;
+        int s = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &pl->cpus);
+        if(s != 0){
+            errno = s;
+            return -1;
+        }
+        saved->has_cpus = 1;
+    }
+
+    return 0;
+}
+
+/* undo placement_apply on the calling thread */
+void placement_restore(const struct placement_saved *saved){
+    if(saved->has_cpus)
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &saved->cpus);
+
+    if(saved->has_policy){
+        if(saved->mode == PYPCAP_MPOL_DEFAULT)
+            syscall(SYS_set_mempolicy, PYPCAP_MPOL_DEFAULT, NULL, 0);
+        else
+            syscall(SYS_set_mempolicy, saved->mode, saved->nodemask, PYPCAP_NODEMASK_BITS);
+    }
+}
+
+/* Return a tuple of the cpu numbers in set */
+PyObject *placement_cpus_to_tuple(const cpu_set_t *set){
+    PyObject *cpus = PyTuple_New(CPU_COUNT(set));
+    if(cpus == NULL)
+        return NULL;
+
+    Py_ssize_t i = 0;
+    for(int c = 0; c < CPU_SETSIZE && i < PyTuple_GET_SIZE(cpus); c++){
+        if(!CPU_ISSET(c, set))
+            continue;
+        PyObject *py_cpu = PyLong_FromLong(c);
+        if(py_cpu == NULL){
+            Py_DECREF(cpus);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(cpus, i++, py_cpu);
+    }
+
+    return cpus;
+}
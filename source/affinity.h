@@ -0,0 +1,34 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <sched.h>
+
+#define PYPCAP_AFFINITY // header guard
+
+/*
+Where a native thread is allowed to run and where its memory should live.
+numa_node == -1 means "no preference".
+*/
+struct placement{
+    int has_cpus;
+    cpu_set_t cpus;
+    int numa_node;
+};
+
+/* state saved by placement_apply so the calling thread can be put back */
+struct placement_saved{
+    int has_cpus;
+    cpu_set_t cpus;
+    int has_policy;
+    int mode;
+    unsigned long nodemask[4];
+};
+
+int placement_parse(PyObject *cpu_affinity, int numa_node, struct placement *pl);
+int placement_apply(const struct placement *pl, struct placement_saved *saved);
+void placement_restore(const struct placement_saved *saved);
+PyObject *placement_cpus_to_tuple(const cpu_set_t *set);
+
+int numa_node_count(void);
+int numa_node_cpus(int node, cpu_set_t *set);
+int numa_current_node(int *cpu);
+int numa_bind_region(void *addr, size_t len, int node);
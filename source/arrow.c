@@ -0,0 +1,630 @@
+#include "arrow.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PYPCAP_DISSECT
+#include "dissect.h"
+#endif
+
+/* Arrow IPC flatbuffer enums, see format/Schema.fbs and format/Message.fbs */
+#define IPC_V5 4
+#define IPC_HEADER_SCHEMA 1
+#define IPC_HEADER_RECORD_BATCH 3
+#define IPC_TYPE_INT 2
+#define IPC_TYPE_BINARY 4
+#define IPC_TYPE_UTF8 5
+#define IPC_TYPE_TIMESTAMP 10
+#define IPC_NANOSECOND 3
+#define IPC_CONTINUATION 0xFFFFFFFFu
+
+#define COL_PAYLOAD 10
+
+static const struct{
+    const char *name;
+    const char *format; // C data interface format string
+    int nullable;
+    enum arrow_kind kind;
+    int width; // bytes per value of a fixed column
+    int ipc_type;
+} columns[] = {
+    {"timestamp", "tsn:UTC", 0, ARROW_FIXED, 8, IPC_TYPE_TIMESTAMP},
+    {"caplen", "I", 0, ARROW_FIXED, 4, IPC_TYPE_INT},
+    {"wirelen", "I", 0, ARROW_FIXED, 4, IPC_TYPE_INT},
+    {"ip_version", "C", 1, ARROW_FIXED, 1, IPC_TYPE_INT},
+    {"protocol", "C", 1, ARROW_FIXED, 1, IPC_TYPE_INT},
+    {"src", "u", 1, ARROW_BINARY, 0, IPC_TYPE_UTF8},
+    {"dst", "u", 1, ARROW_BINARY, 0, IPC_TYPE_UTF8},
+    {"sport", "S", 1, ARROW_FIXED, 2, IPC_TYPE_INT},
+    {"dport", "S", 1, ARROW_FIXED, 2, IPC_TYPE_INT},
+    {"vlan", "S", 1, ARROW_FIXED, 2, IPC_TYPE_INT},
+    {"payload", "z", 1, ARROW_BINARY, 0, IPC_TYPE_BINARY},
+};
+
+static int ncols(int payload){
+    return payload != 0 ? COL_PAYLOAD + 1 : COL_PAYLOAD;
+}
+
+static size_t round_up(size_t n, size_t align){
+    return (n + align - 1) & ~(align - 1);
+}
+
+/* zeroed buffer of at least n bytes, padded to ARROW_ALIGN */
+static void *buf_alloc(size_t n){
+    void *p;
+    size_t size = round_up(n ? n : 1, ARROW_ALIGN);
+    if(posix_memalign(&p, ARROW_ALIGN, size) != 0)
+        return NULL;
+    memset(p, 0, size);
+    return p;
+}
+
+static void col_free(struct arrow_col *c){
+    free(c->validity);
+    free(c->values);
+    free(c->data);
+    memset(c, 0, sizeof(*c));
+}
+
+static int col_init(struct arrow_col *c, int i, int64_t capacity){
+    memset(c, 0, sizeof(*c));
+    if(columns[i].nullable && (c->validity = buf_alloc((size_t)(capacity + 7) / 8)) == NULL)
+        return -1;
+    if(columns[i].kind == ARROW_FIXED)
+        c->values = buf_alloc((size_t)capacity * columns[i].width);
+    else {
+        c->values = buf_alloc((size_t)(capacity + 1) * sizeof(int32_t));
+        c->data_cap = (size_t)capacity * 16;
+        c->data = buf_alloc(c->data_cap);
+    }
+    if(c->values == NULL || (columns[i].kind == ARROW_BINARY && c->data == NULL)){
+        col_free(c);
+        return -1;
+    }
+    return 0;
+}
+
+/* Return 0, or -1 with errno set */
+int arrow_batch_init(struct arrow_batch *b, int64_t capacity, int linktype, int payload){
+    memset(b, 0, sizeof(*b));
+    b->capacity = capacity;
+    b->linktype = linktype;
+    b->payload = payload;
+    b->ncols = ncols(payload);
+    for(int i = 0; i < b->ncols; i++){
+        if(col_init(&b->cols[i], i, capacity) != 0){
+            arrow_batch_free(b);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void arrow_batch_free(struct arrow_batch *b){
+    for(int i = 0; i < b->ncols; i++)
+        col_free(&b->cols[i]);
+    b->length = 0;
+}
+
+/* empty b for reuse, keeping its buffers */
+void arrow_batch_clear(struct arrow_batch *b){
+    for(int i = 0; i < b->ncols; i++){
+        struct arrow_col *c = &b->cols[i];
+        if(c->validity != NULL)
+            memset(c->validity, 0, (size_t)(b->capacity + 7) / 8);
+        if(columns[i].kind == ARROW_FIXED)
+            memset(c->values, 0, (size_t)b->capacity * columns[i].width);
+        c->data_len = 0;
+        c->null_count = 0;
+    }
+    b->length = 0;
+}
+
+static void set_valid(struct arrow_col *c, int64_t i, int valid){
+    if(valid)
+        c->validity[i / 8] |= (uint8_t)(1 << (i % 8));
+    else
+        c->null_count++;
+}
+
+static void put_fixed(struct arrow_batch *b, int col, int64_t i, const void *v, int valid){
+    struct arrow_col *c = &b->cols[col];
+    if(columns[col].nullable)
+        set_valid(c, i, valid);
+    if(valid)
+        memcpy(c->values + i * columns[col].width, v, columns[col].width);
+}
+
+static int put_binary(struct arrow_batch *b, int col, int64_t i, const void *v, size_t n, int valid){
+    struct arrow_col *c = &b->cols[col];
+    int32_t *offsets = (int32_t *)c->values;
+    set_valid(c, i, valid);
+    if(!valid)
+        n = 0;
+    if(c->data_len + n > INT32_MAX)
+        return -1;
+    if(c->data_len + n > c->data_cap){
+        size_t cap = c->data_cap * 2;
+        while(cap < c->data_len + n)
+            cap *= 2;
+        uint8_t *data = buf_alloc(cap);
+        if(data == NULL)
+            return -1;
+        memcpy(data, c->data, c->data_len);
+        free(c->data);
+        c->data = data;
+        c->data_cap = cap;
+    }
+    memcpy(c->data + c->data_len, v, n);
+    c->data_len += n;
+    offsets[i + 1] = (int32_t)c->data_len;
+    return 0;
+}
+
+/*
+Add one packet, hdr->ts.tv_usec in nanoseconds. Return 0, or -1 with errno set
+(ENOSPC when the batch is full, ENOMEM or EOVERFLOW if a column can't grow)
+*/
+int arrow_batch_append(struct arrow_batch *b, const struct pcap_pkthdr *hdr, const u_char *data){
+    if(b->length == b->capacity){
+        errno = ENOSPC;
+        return -1;
+    }
+    int64_t i = b->length;
+    struct pkt_meta meta;
+    dissect_packet(b->linktype, data, hdr->caplen, &meta);
+    int ip = meta.l3_offset >= 0;
+    int ports = meta.l4_offset >= 0 && (meta.sport != 0 || meta.dport != 0);
+
+    int64_t ts = (int64_t)hdr->ts.tv_sec * 1000000000LL + hdr->ts.tv_usec;
+    uint32_t caplen = hdr->caplen, wirelen = hdr->len;
+    put_fixed(b, 0, i, &ts, 1);
+    put_fixed(b, 1, i, &caplen, 1);
+    put_fixed(b, 2, i, &wirelen, 1);
+    put_fixed(b, 3, i, &meta.ip_version, ip);
+    put_fixed(b, 4, i, &meta.ip_proto, ip);
+
+    char host[64];
+    int res = 0;
+    for(int col = 5; col <= 6; col++){
+        int ok = ip && dissect_addr_string(&meta, col == 5 ? meta.src : meta.dst, host, sizeof(host)) == 0;
+        res |= put_binary(b, col, i, host, ok ? strlen(host) : 0, ok);
+    }
+
+    put_fixed(b, 7, i, &meta.sport, ports);
+    put_fixed(b, 8, i, &meta.dport, ports);
+    put_fixed(b, 9, i, &meta.vlan, meta.vlan != 0);
+
+    if(b->payload != 0){
+        int has = meta.payload_offset >= 0;
+        size_t n = has ? hdr->caplen - (size_t)meta.payload_offset : 0;
+        if(b->payload > 0 && n > (size_t)b->payload)
+            n = (size_t)b->payload;
+        res |= put_binary(b, COL_PAYLOAD, i, has ? data + meta.payload_offset : NULL, n, has);
+    }
+
+    b->length++;
+    if(res != 0){
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/* C data interface export */
+
+static void release_child_schema(struct ArrowSchema *s){
+    s->release = NULL; // names and formats are static
+}
+
+struct schema_private{
+    struct ArrowSchema children[COL_PAYLOAD + 1];
+    struct ArrowSchema *pointers[COL_PAYLOAD + 1];
+};
+
+static void release_schema(struct ArrowSchema *s){
+    struct schema_private *p = s->private_data;
+    for(int i = 0; i < s->n_children; i++)
+        if(p->children[i].release != NULL)
+            p->children[i].release(&p->children[i]);
+    free(p);
+    s->release = NULL;
+}
+
+/* struct schema of the batch columns; Return 0, or -1 with errno set */
+int arrow_export_schema(int payload, struct ArrowSchema *out){
+    struct schema_private *p = calloc(1, sizeof(*p));
+    if(p == NULL){
+        errno = ENOMEM;
+        return -1;
+    }
+    int n = ncols(payload);
+    for(int i = 0; i < n; i++){
+        struct ArrowSchema *c = &p->children[i];
+        c->format = columns[i].format;
+        c->name = columns[i].name;
+        c->flags = columns[i].nullable ? ARROW_FLAG_NULLABLE : 0;
+        c->release = release_child_schema;
+        p->pointers[i] = c;
+    }
+    memset(out, 0, sizeof(*out));
+    out->format = "+s";
+    out->name = "";
+    out->n_children = n;
+    out->children = p->pointers;
+    out->release = release_schema;
+    out->private_data = p;
+    return 0;
+}
+
+struct child_private{
+    const void *buffers[3];
+    void *owned[3];
+};
+
+static void release_child_array(struct ArrowArray *a){
+    struct child_private *p = a->private_data;
+    for(int i = 0; i < 3; i++)
+        free(p->owned[i]);
+    free(p);
+    a->release = NULL;
+}
+
+struct array_private{
+    struct ArrowArray children[COL_PAYLOAD + 1];
+    struct ArrowArray *pointers[COL_PAYLOAD + 1];
+    const void *buffers[1];
+};
+
+static void release_array(struct ArrowArray *a){
+    struct array_private *p = a->private_data;
+    for(int i = 0; i < a->n_children; i++)
+        if(p->children[i].release != NULL)
+            p->children[i].release(&p->children[i]);
+    free(p);
+    a->release = NULL;
+}
+
+/*
+Hand the rows of b over as a struct array and start b over, empty, with fresh
+buffers. Return 0, or -1 with errno set, b untouched
+*/
+int arrow_export_batch(struct arrow_batch *b, struct ArrowArray *out){
+    struct array_private *p = calloc(1, sizeof(*p));
+    struct child_private *cp[COL_PAYLOAD + 1] = {NULL};
+    struct arrow_batch next;
+    int ok = p != NULL && arrow_batch_init(&next, b->capacity, b->linktype, b->payload) == 0;
+    for(int i = 0; ok && i < b->ncols; i++)
+        ok = (cp[i] = calloc(1, sizeof(*cp[i]))) != NULL;
+    if(!ok){
+        for(int i = 0; i < b->ncols; i++)
+            free(cp[i]);
+        if(p != NULL && next.ncols > 0)
+            arrow_batch_free(&next);
+        free(p);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for(int i = 0; i < b->ncols; i++){
+        struct arrow_col *c = &b->cols[i];
+        struct ArrowArray *a = &p->children[i];
+        cp[i]->owned[0] = c->validity;
+        cp[i]->owned[1] = c->values;
+        cp[i]->owned[2] = c->data;
+        cp[i]->buffers[0] = c->null_count > 0 ? c->validity : NULL;
+        cp[i]->buffers[1] = c->values;
+        cp[i]->buffers[2] = c->data;
+        a->length = b->length;
+        a->null_count = c->null_count;
+        a->n_buffers = columns[i].kind == ARROW_FIXED ? 2 : 3;
+        a->buffers = cp[i]->buffers;
+        a->release = release_child_array;
+        a->private_data = cp[i];
+        p->pointers[i] = a;
+        memset(c, 0, sizeof(*c)); // owned by the array now
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->length = b->length;
+    out->n_buffers = 1;
+    out->n_children = b->ncols;
+    out->buffers = p->buffers;
+    out->children = p->pointers;
+    out->release = release_array;
+    out->private_data = p;
+
+    *b = next;
+    return 0;
+}
+
+/*
+Arrow IPC stream format, https://arrow.apache.org/docs/format/Columnar.html#ipc-streaming-format
+
+Message metadata are flatbuffers, built here back to front the way the
+flatbuffers library does it: children before the tables that point to them,
+offsets counted from the end of the buffer until it is finished.
+*/
+struct fb{
+    uint8_t *buf;
+    size_t cap;
+    size_t head; // bytes in use, at the end of buf
+    size_t minalign;
+    size_t table_start;
+    int nfields;
+    uint16_t field_id[8];
+    size_t field_head[8];
+    int err;
+};
+
+static int fb_reserve(struct fb *f, size_t n){
+    if(f->err)
+        return -1;
+    if(f->cap - f->head >= n)
+        return 0;
+    size_t cap = f->cap ? f->cap * 2 : 1024;
+    while(cap - f->head < n)
+        cap *= 2;
+    uint8_t *buf = malloc(cap);
+    if(buf == NULL){
+        f->err = 1;
+        return -1;
+    }
+    memcpy(buf + cap - f->head, f->buf + f->cap - f->head, f->head);
+    free(f->buf);
+    f->buf = buf;
+    f->cap = cap;
+    return 0;
+}
+
+static void fb_push(struct fb *f, const void *p, size_t n){
+    if(fb_reserve(f, n) != 0)
+        return;
+    f->head += n;
+    if(p != NULL)
+        memcpy(f->buf + f->cap - f->head, p, n);
+    else
+        memset(f->buf + f->cap - f->head, 0, n);
+}
+
+/* pad so that after extra more bytes the head is a multiple of align */
+static void fb_align(struct fb *f, size_t align, size_t extra){
+    if(align > f->minalign)
+        f->minalign = align;
+    fb_push(f, NULL, (align - ((f->head + extra) & (align - 1))) & (align - 1));
+}
+
+static void fb_scalar(struct fb *f, const void *v, size_t n){
+    fb_align(f, n, 0);
+    fb_push(f, v, n);
+}
+
+/* uoffset from here to what was written when the head was at target */
+static void fb_uoffset(struct fb *f, size_t target){
+    fb_align(f, 4, 0);
+    uint32_t off = (uint32_t)(f->head + 4 - target);
+    fb_push(f, &off, 4);
+}
+
+static size_t fb_string(struct fb *f, const char *s){
+    size_t n = strlen(s);
+    fb_align(f, 4, n + 1);
+    fb_push(f, NULL, 1);
+    fb_push(f, s, n);
+    uint32_t len = (uint32_t)n;
+    fb_push(f, &len, 4);
+    return f->head;
+}
+
+static size_t fb_vector_structs(struct fb *f, const void *elems, size_t size, size_t n){
+    fb_align(f, 8, size * n);
+    fb_push(f, elems, size * n);
+    uint32_t len = (uint32_t)n;
+    fb_scalar(f, &len, 4);
+    return f->head;
+}
+
+static size_t fb_vector_offsets(struct fb *f, const size_t *targets, size_t n){
+    for(size_t i = n; i-- > 0;)
+        fb_uoffset(f, targets[i]);
+    uint32_t len = (uint32_t)n;
+    fb_scalar(f, &len, 4);
+    return f->head;
+}
+
+static void fb_start(struct fb *f){
+    f->table_start = f->head;
+    f->nfields = 0;
+}
+
+static void fb_mark(struct fb *f, int id){
+    f->field_id[f->nfields] = (uint16_t)id;
+    f->field_head[f->nfields++] = f->head;
+}
+
+static void fb_field(struct fb *f, int id, const void *v, size_t n){
+    fb_scalar(f, v, n);
+    fb_mark(f, id);
+}
+
+static void fb_field_offset(struct fb *f, int id, size_t target){
+    fb_uoffset(f, target);
+    fb_mark(f, id);
+}
+
+static size_t fb_end(struct fb *f){
+    int32_t placeholder = 0;
+    fb_scalar(f, &placeholder, 4);
+    size_t table = f->head;
+
+    uint16_t vt[2 + 8] = {0};
+    int nslots = 0;
+    for(int i = 0; i < f->nfields; i++){
+        if(f->field_id[i] + 1 > nslots)
+            nslots = f->field_id[i] + 1;
+        vt[2 + f->field_id[i]] = (uint16_t)(table - f->field_head[i]);
+    }
+    vt[0] = (uint16_t)((2 + nslots) * 2);
+    vt[1] = (uint16_t)(table - f->table_start);
+    fb_push(f, vt, vt[0]);
+
+    if(!f->err){
+        int32_t soffset = (int32_t)(f->head - table);
+        memcpy(f->buf + f->cap - table, &soffset, 4);
+    }
+    return table;
+}
+
+static size_t fb_finish(struct fb *f, size_t root){
+    fb_align(f, f->minalign, 4);
+    fb_uoffset(f, root);
+    return f->head;
+}
+
+/* Message table around header, then the framed message: continuation, length, metadata */
+static int ipc_write_message(FILE *fp, struct fb *f, uint8_t header_type, size_t header, int64_t body_length){
+    int16_t version = IPC_V5;
+    fb_start(f);
+    fb_field(f, 3, &body_length, 8);
+    fb_field_offset(f, 2, header);
+    fb_field(f, 0, &version, 2);
+    fb_field(f, 1, &header_type, 1);
+    size_t size = fb_finish(f, fb_end(f));
+    if(f->err){
+        errno = ENOMEM;
+        return -1;
+    }
+
+    uint32_t prefix[2] = {IPC_CONTINUATION, (uint32_t)size}; // size is a multiple of 8, so the body stays aligned
+    if(fwrite(prefix, sizeof(prefix), 1, fp) != 1 || fwrite(f->buf + f->cap - size, size, 1, fp) != 1)
+        return -1;
+    return 0;
+}
+
+/* Return 0, or -1 with errno set */
+int arrow_ipc_write_schema(FILE *fp, int payload){
+    struct fb f = {0};
+    size_t fields[COL_PAYLOAD + 1];
+    int n = ncols(payload);
+
+    for(int i = 0; i < n; i++){
+        size_t name = fb_string(&f, columns[i].name);
+        size_t children = fb_vector_offsets(&f, NULL, 0);
+
+        size_t type;
+        size_t tz = columns[i].ipc_type == IPC_TYPE_TIMESTAMP ? fb_string(&f, "UTC") : 0;
+        fb_start(&f);
+        if(columns[i].ipc_type == IPC_TYPE_INT){
+            int32_t bits = columns[i].width * 8;
+            uint8_t is_signed = 0;
+            fb_field(&f, 0, &bits, 4);
+            fb_field(&f, 1, &is_signed, 1);
+        } else if(columns[i].ipc_type == IPC_TYPE_TIMESTAMP){
+            int16_t unit = IPC_NANOSECOND;
+            fb_field_offset(&f, 1, tz);
+            fb_field(&f, 0, &unit, 2);
+        }
+        type = fb_end(&f);
+
+        uint8_t nullable = (uint8_t)columns[i].nullable, type_type = (uint8_t)columns[i].ipc_type;
+        fb_start(&f);
+        fb_field_offset(&f, 0, name);
+        fb_field_offset(&f, 3, type);
+        fb_field_offset(&f, 5, children);
+        fb_field(&f, 1, &nullable, 1);
+        fb_field(&f, 2, &type_type, 1);
+        fields[i] = fb_end(&f);
+    }
+
+    size_t vec = fb_vector_offsets(&f, fields, (size_t)n);
+    int16_t little_endian = 0;
+    fb_start(&f);
+    fb_field_offset(&f, 1, vec);
+    fb_field(&f, 0, &little_endian, 2);
+    size_t schema = fb_end(&f);
+
+    int res = ipc_write_message(fp, &f, IPC_HEADER_SCHEMA, schema, 0);
+    free(f.buf);
+    return res;
+}
+
+struct ipc_buffer{
+    int64_t offset;
+    int64_t length;
+};
+
+struct ipc_node{
+    int64_t length;
+    int64_t null_count;
+};
+
+/* body buffers of column i in the order IPC lists them */
+static int col_buffers(const struct arrow_batch *b, int i, const void **ptr, int64_t *len){
+    const struct arrow_col *c = &b->cols[i];
+    ptr[0] = c->validity;
+    len[0] = c->null_count > 0 ? (b->length + 7) / 8 : 0;
+    ptr[1] = c->values;
+    if(columns[i].kind == ARROW_FIXED){
+        len[1] = b->length * columns[i].width;
+        return 2;
+    }
+    len[1] = (b->length + 1) * (int64_t)sizeof(int32_t);
+    ptr[2] = c->data;
+    len[2] = (int64_t)c->data_len;
+    return 3;
+}
+
+/* Return 0, or -1 with errno set */
+int arrow_ipc_write_batch(FILE *fp, const struct arrow_batch *b){
+    struct ipc_node nodes[COL_PAYLOAD + 1];
+    struct ipc_buffer buffers[3 * (COL_PAYLOAD + 1)];
+    const void *ptrs[3 * (COL_PAYLOAD + 1)];
+    int nbuffers = 0;
+    int64_t body = 0;
+
+    for(int i = 0; i < b->ncols; i++){
+        nodes[i].length = b->length;
+        nodes[i].null_count = b->cols[i].null_count;
+        int64_t len[3];
+        int n = col_buffers(b, i, &ptrs[nbuffers], len);
+        for(int k = 0; k < n; k++){
+            buffers[nbuffers].offset = body;
+            buffers[nbuffers].length = len[k];
+            body += (int64_t)round_up((size_t)len[k], 8);
+            nbuffers++;
+        }
+    }
+
+    struct fb f = {0};
+    size_t vbuffers = fb_vector_structs(&f, buffers, sizeof(buffers[0]), (size_t)nbuffers);
+    size_t vnodes = fb_vector_structs(&f, nodes, sizeof(nodes[0]), (size_t)b->ncols);
+    fb_start(&f);
+    fb_field(&f, 0, &b->length, 8);
+    fb_field_offset(&f, 1, vnodes);
+    fb_field_offset(&f, 2, vbuffers);
+    size_t batch = fb_end(&f);
+
+    int res = ipc_write_message(fp, &f, IPC_HEADER_RECORD_BATCH, batch, body);
+    free(f.buf);
+    if(res != 0)
+        return -1;
+
+    static const uint8_t zeros[8] = {0};
+    for(int k = 0; k < nbuffers; k++){
+        size_t len = (size_t)buffers[k].length;
+        if(len > 0 && fwrite(ptrs[k], len, 1, fp) != 1)
+            return -1;
+        size_t pad = round_up(len, 8) - len;
+        if(pad > 0 && fwrite(zeros, pad, 1, fp) != 1)
+            return -1;
+    }
+    return 0;
+}
+
+/* end-of-stream marker; Return 0, or -1 with errno set */
+int arrow_ipc_write_end(FILE *fp){
+    uint32_t eos[2] = {IPC_CONTINUATION, 0};
+    return fwrite(eos, sizeof(eos), 1, fp) == 1 ? 0 : -1;
+}
@@ -0,0 +1,102 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pcap.h>
+
+#define PYPCAP_ARROW // header guard
+#define ARROW_BATCH_SIZE 65536 // default rows per record batch
+#define ARROW_ALIGN 64 // buffer alignment Arrow recommends
+
+/*
+Packet metadata as Arrow record batches, built in C
+
+One row per packet: timestamp (ns, UTC), caplen, wirelen and the dissected
+ip_version, protocol, src, dst, sport, dport and vlan, which are null when the
+packet has no such header. With a payload slice length set, a binary payload
+column holds up to that many bytes of each transport payload.
+
+Batches leave as Arrow C Data Interface structs (for pyarrow, polars, duckdb
+and the like) or as messages of the Arrow IPC stream format written to a file.
+*/
+
+/* Arrow C Data Interface, https://arrow.apache.org/docs/format/CDataInterface.html */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema{
+    const char *format;
+    const char *name;
+    const char *metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema **children;
+    struct ArrowSchema *dictionary;
+    void (*release)(struct ArrowSchema *);
+    void *private_data;
+};
+
+struct ArrowArray{
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void **buffers;
+    struct ArrowArray **children;
+    struct ArrowArray *dictionary;
+    void (*release)(struct ArrowArray *);
+    void *private_data;
+};
+
+#endif
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream{
+    int (*get_schema)(struct ArrowArrayStream *, struct ArrowSchema *out);
+    int (*get_next)(struct ArrowArrayStream *, struct ArrowArray *out);
+    const char *(*get_last_error)(struct ArrowArrayStream *);
+    void (*release)(struct ArrowArrayStream *);
+    void *private_data;
+};
+
+#endif
+
+enum arrow_kind{
+    ARROW_FIXED, // validity + values
+    ARROW_BINARY, // validity + int32 offsets + data
+};
+
+struct arrow_col{
+    uint8_t *validity;
+    uint8_t *values; // fixed width values, or the offsets of a binary column
+    uint8_t *data; // binary bytes
+    size_t data_len;
+    size_t data_cap;
+    int64_t null_count;
+};
+
+struct arrow_batch{
+    int64_t length;
+    int64_t capacity;
+    int linktype;
+    int payload; // bytes of payload kept per packet, 0 for no payload column
+    int ncols;
+    struct arrow_col cols[11];
+};
+
+int arrow_batch_init(struct arrow_batch *b, int64_t capacity, int linktype, int payload);
+void arrow_batch_free(struct arrow_batch *b);
+void arrow_batch_clear(struct arrow_batch *b);
+int arrow_batch_append(struct arrow_batch *b, const struct pcap_pkthdr *hdr, const u_char *data);
+int arrow_export_schema(int payload, struct ArrowSchema *out);
+int arrow_export_batch(struct arrow_batch *b, struct ArrowArray *out);
+int arrow_ipc_write_schema(FILE *fp, int payload);
+int arrow_ipc_write_batch(FILE *fp, const struct arrow_batch *b);
+int arrow_ipc_write_end(FILE *fp);
@@ -0,0 +1,184 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#include <structmember.h>
+
+#ifndef PYPCAP_PACKET
+#include "packet.h"
+#endif
+
+#define PYPCAP_BATCH
+
+/*
+Columnar batch of packets
+
+All columns share one pooled buffer laid out as
+    int64 timestamps_ns[capacity] | uint32 caplens[capacity] | uint32 wirelens[capacity] | uint32 offsets[capacity]
+and packet bytes sit back to back in a second pooled buffer, at offsets[i].
+*/
+struct batch_columns{
+    long long *ts;
+    uint32_t *caplen;
+    uint32_t *wirelen;
+    uint32_t *offset;
+};
+
+#define BATCH_COLUMN_BYTES (sizeof(long long) + 3 * sizeof(uint32_t))
+
+static void
+batch_columns_map(struct pkt_buf *columns, size_t capacity, struct batch_columns *cols)
+{
+    cols->ts = (long long *)columns->data;
+    cols->caplen = (uint32_t *)(columns->data + capacity * sizeof(long long));
+    cols->wirelen = cols->caplen + capacity;
+    cols->offset = cols->wirelen + capacity;
+}
+
+typedef struct{
+    PyObject_HEAD
+    struct pkt_buf *columns;
+    struct pkt_buf *data;
+    Py_ssize_t count;
+    Py_ssize_t capacity;
+    int linktype;
+    PyObject *interface;
+} PacketBatch;
+
+static PyTypeObject PacketBatchType;
+
+/*
+Return a new PacketBatch of count packets
+
+Steals the references on columns and data; takes a new reference on interface (may be NULL)
+*/
+static PyObject *
+PacketBatch_New(struct pkt_buf *columns, struct pkt_buf *data, Py_ssize_t count, Py_ssize_t capacity, int linktype, PyObject *interface)
+{
+    PacketBatch *self = PyObject_New(PacketBatch, &PacketBatchType);
+    if(self == NULL){
+        pkt_buf_decref(columns);
+        pkt_buf_decref(data);
+        return NULL;
+    }
+
+    self->columns = columns;
+    self->data = data;
+    self->count = count;
+    self->capacity = capacity;
+    self->linktype = linktype;
+    Py_XINCREF(interface);
+    self->interface = interface;
+
+    return (PyObject *)self;
+}
+
+static void
+PacketBatch_dealloc(PacketBatch *self)
+{
+    pkt_buf_decref(self->columns);
+    pkt_buf_decref(self->data);
+    Py_XDECREF(self->interface);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/* sequence protocol: len(batch), batch[i] -> Packet sharing the batch's memory */
+static Py_ssize_t
+PacketBatch_length(PacketBatch *self)
+{
+    return self->count;
+}
+
+static PyObject *
+PacketBatch_item(PacketBatch *self, Py_ssize_t i)
+{
+    if(i < 0 || i >= self->count){
+        PyErr_SetString(PyExc_IndexError, "PacketBatch index out of range");
+        return NULL;
+    }
+
+    struct batch_columns cols;
+    batch_columns_map(self->columns, self->capacity, &cols);
+
+    return Packet_New(self->data, cols.offset[i], cols.ts[i], cols.caplen[i], cols.wirelen[i], self->linktype, self->interface);
+}
+
+static PySequenceMethods PacketBatch_as_sequence = {
+    .sq_length = (lenfunc) PacketBatch_length,
+    .sq_item = (ssizeargfunc) PacketBatch_item,
+};
+
+/* column getters, each a typed memoryview over the pooled column buffer */
+static PyObject *
+PacketBatch_column(PacketBatch *self, size_t offset, const char *format, size_t itemsize)
+{
+    PyObject *pb = PacketBuffer_New(self->columns, offset, self->count, format, itemsize);
+    if(pb == NULL)
+        return NULL;
+
+    PyObject *view = PyMemoryView_FromObject(pb);
+    Py_DECREF(pb);
+    return view;
+}
+
+static PyObject *
+PacketBatch_get_timestamps(PacketBatch *self, void *closure)
+{
+    return PacketBatch_column(self, 0, "q", sizeof(long long));
+}
+
+static PyObject *
+PacketBatch_get_caplens(PacketBatch *self, void *closure)
+{
+    return PacketBatch_column(self, self->capacity * sizeof(long long), "I", sizeof(uint32_t));
+}
+
+static PyObject *
+PacketBatch_get_wirelens(PacketBatch *self, void *closure)
+{
+    return PacketBatch_column(self, self->capacity * (sizeof(long long) + sizeof(uint32_t)), "I", sizeof(uint32_t));
+}
+
+static PyObject *
+PacketBatch_get_offsets(PacketBatch *self, void *closure)
+{
+    return PacketBatch_column(self, self->capacity * (sizeof(long long) + 2 * sizeof(uint32_t)), "I", sizeof(uint32_t));
+}
+
+static PyObject *
+PacketBatch_get_data(PacketBatch *self, void *closure)
+{
+    return PacketBuffer_MemoryView(self->data, 0, self->data->len);
+}
+
+static PyObject *
+PacketBatch_get_linktype(PacketBatch *self, void *closure)
+{
+    return PyLong_FromLong(self->linktype);
+}
+
+static PyGetSetDef PacketBatch_getsetters[] = {
+    {"timestamps", (getter) PacketBatch_get_timestamps, NULL, "int64 capture times in nanoseconds", NULL},
+    {"caplens", (getter) PacketBatch_get_caplens, NULL, "uint32 captured lengths", NULL},
+    {"wirelens", (getter) PacketBatch_get_wirelens, NULL, "uint32 lengths on the wire", NULL},
+    {"offsets", (getter) PacketBatch_get_offsets, NULL, "uint32 offset of each packet in data", NULL},
+    {"data", (getter) PacketBatch_get_data, NULL, "packet bytes, back to back", NULL},
+    {"linktype", (getter) PacketBatch_get_linktype, NULL, "link-layer header type of the packets", NULL},
+    {NULL}
+};
+
+/*
+PacketBatch Type construction
+
+Only created from C; holds no references that can form cycles, so no GC
+*/
+static PyTypeObject PacketBatchType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.PacketBatch",
+    .tp_doc = "Columnar batch of captured packets over pooled memory",
+    .tp_basicsize = sizeof(PacketBatch),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor) PacketBatch_dealloc,
+    .tp_as_sequence = &PacketBatch_as_sequence,
+    .tp_getset = PacketBatch_getsetters,
+};
@@ -0,0 +1,279 @@
+#include "bloom.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef PYPCAP_DISSECT
+#include "dissect.h"
+#endif
+
+#ifndef PYPCAP_HLL
+#include "hll.h"
+#endif
+
+#define BLOOM_VERSION 2
+#define BLOOM_MAX_BITS (1ULL << 32) // 512MiB, far past what one file needs
+#define BLOOM_MAX_K 16
+
+/* Return 0, or -1 if out of memory */
+int bloom_init(struct bloom *b, uint64_t keys, double fp_rate){
+    memset(b, 0, sizeof(*b));
+    if(keys == 0)
+        keys = 1;
+    // m = -n ln p / (ln 2)^2, rounded up to a power of two so positions are a mask
+    double m = -(double)keys * log(fp_rate) / (M_LN2 * M_LN2);
+    uint64_t nbits = 64;
+    while(nbits < m && nbits < BLOOM_MAX_BITS)
+        nbits <<= 1;
+    int k = (int)lround((double)nbits / keys * M_LN2);
+    b->k = (uint8_t)(k < 1 ? 1 : k > BLOOM_MAX_K ? BLOOM_MAX_K : k);
+    b->nbits = nbits;
+    b->bits = calloc(nbits / 8, 1);
+    return b->bits == NULL ? -1 : 0;
+}
+
+/*
+Size b from a python index argument: False or None for no index (b->bits
+stays NULL), True for BLOOM_DEFAULT_KEYS, or the number of distinct keys
+expected per file
+
+Return 0 on success, -1 with a python exception set
+*/
+int bloom_parse(PyObject *index, struct bloom *b){
+    memset(b, 0, sizeof(*b));
+    if(index == NULL || index == Py_None || index == Py_False)
+        return 0;
+    long long keys = BLOOM_DEFAULT_KEYS;
+    if(index != Py_True){
+        keys = PyLong_AsLongLong(index);
+        if(keys == -1 && PyErr_Occurred()){
+            PyErr_SetString(PyExc_TypeError, "index must be a bool or a number of keys");
+            return -1;
+        }
+        if(keys <= 0 || keys > (1LL << 28)){
+            PyErr_SetString(PyExc_ValueError, "index must be between 1 and 2**28 keys");
+            return -1;
+        }
+    }
+    if(bloom_init(b, (uint64_t)keys, BLOOM_FP_RATE) != 0){
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+void bloom_free(struct bloom *b){
+    free(b->bits);
+    memset(b, 0, sizeof(*b));
+}
+
+void bloom_reset(struct bloom *b){
+    memset(b->bits, 0, b->nbits / 8);
+    b->items = 0;
+}
+
+/* k positions from one 64 bit hash by double hashing, h1 + i * h2 */
+void bloom_add(struct bloom *b, const void *key, size_t len){
+    uint64_t h1 = hll_hash(key, len);
+    uint64_t h2 = ((h1 >> 32) | (h1 << 32)) | 1;
+    uint64_t mask = b->nbits - 1;
+    for(uint8_t i = 0; i < b->k; i++, h1 += h2)
+        b->bits[(h1 & mask) >> 3] |= (uint8_t)(1 << (h1 & 7));
+    b->items++;
+}
+
+/* Return 1 if key may have been added, 0 if it certainly wasn't */
+int bloom_check(const struct bloom *b, const void *key, size_t len){
+    uint64_t h1 = hll_hash(key, len);
+    uint64_t h2 = ((h1 >> 32) | (h1 << 32)) | 1;
+    uint64_t mask = b->nbits - 1;
+    for(uint8_t i = 0; i < b->k; i++, h1 += h2)
+        if(!(b->bits[(h1 & mask) >> 3] & (1 << (h1 & 7))))
+            return 0;
+    return 1;
+}
+
+/* keys are tagged, so a port can't match the start of an address; key holds 17 bytes */
+size_t bloom_key_addr(uint8_t *key, const uint8_t *addr, uint8_t addr_len){
+    key[0] = 'a';
+    memcpy(key + 1, addr, addr_len);
+    return 1 + (size_t)addr_len;
+}
+
+size_t bloom_key_port(uint8_t *key, uint16_t port){
+    key[0] = 'p';
+    key[1] = (uint8_t)(port >> 8);
+    key[2] = (uint8_t)port;
+    return 3;
+}
+
+/* index the addresses and ports of one packet of b->linktype */
+void bloom_add_packet(struct bloom *b, const unsigned char *data, uint32_t caplen){
+    struct pkt_meta meta;
+    uint8_t key[17];
+
+    dissect_packet(b->linktype, data, caplen, &meta);
+    if(meta.l3_offset < 0)
+        return;
+    bloom_add(b, key, bloom_key_addr(key, meta.src, meta.addr_len));
+    bloom_add(b, key, bloom_key_addr(key, meta.dst, meta.addr_len));
+    // ICMP has an L4 header but no ports
+    if(meta.l4_offset < 0 || meta.ip_proto == 1 || meta.ip_proto == 58)
+        return;
+    bloom_add(b, key, bloom_key_port(key, meta.sport));
+    if(meta.dport != meta.sport)
+        bloom_add(b, key, bloom_key_port(key, meta.dport));
+}
+
+static void put_le64(uint8_t *p, uint64_t v){
+    for(int i = 0; i < 8; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get_le64(const uint8_t *p){
+    uint64_t v = 0;
+    for(int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static int sidecar_path(const char *pcap_path, const char *suffix, char *out, size_t outlen){
+    if(snprintf(out, outlen, "%s.bloom%s", pcap_path, suffix) >= (int)outlen){
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+static uint64_t mtime_ns(const struct stat *st){
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000ULL + (uint64_t)st->st_mtim.tv_nsec;
+}
+
+/*
+Write b next to a pcap file, as <pcap_path>.bloom, once everything b
+indexes is on disk
+
+The sidecar is written to a temporary name and renamed over the old one, so
+a query running while a capture flushes sees one whole index or the other.
+Return 0, or -1 with errno set
+*/
+int bloom_write(const struct bloom *b, const char *pcap_path){
+    char path[4096], tmp[4096];
+    if(sidecar_path(pcap_path, "", path, sizeof(path)) != 0 || sidecar_path(pcap_path, ".tmp", tmp, sizeof(tmp)) != 0)
+        return -1;
+    struct stat st;
+    if(stat(pcap_path, &st) != 0)
+        return -1;
+
+    uint8_t header[BLOOM_HEADER] = {0};
+    memcpy(header, BLOOM_MAGIC, 4);
+    header[4] = BLOOM_VERSION;
+    header[5] = b->k;
+    put_le64(header + 8, b->nbits);
+    put_le64(header + 16, b->items);
+    put_le64(header + 24, (uint64_t)st.st_size);
+    put_le64(header + 32, mtime_ns(&st));
+
+    FILE *fp = fopen(tmp, "wb");
+    if(fp == NULL)
+        return -1;
+    int ok = fwrite(header, sizeof(header), 1, fp) == 1 && fwrite(b->bits, b->nbits / 8, 1, fp) == 1;
+    int err = errno;
+    if(fclose(fp) != 0 && ok){
+        ok = 0;
+        err = errno;
+    }
+    if(ok && rename(tmp, path) != 0){
+        ok = 0;
+        err = errno;
+    }
+    if(!ok){
+        remove(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+Remove the sidecar of a pcap file, if it has one
+
+Return 0, or -1 with errno set
+*/
+int bloom_remove(const char *pcap_path){
+    char path[4096];
+    if(sidecar_path(pcap_path, "", path, sizeof(path)) != 0)
+        return -1;
+    if(remove(path) != 0 && errno != ENOENT)
+        return -1;
+    return 0;
+}
+
+/*
+Load the sidecar of a pcap file into b, which must not be initialized
+
+Return 0, or -1 with errno set; EINVAL for a file that isn't a sidecar, and
+ESTALE for one from another version or that no longer describes the pcap
+file, which has changed size or mtime since
+*/
+int bloom_read(struct bloom *b, const char *pcap_path){
+    char path[4096];
+    if(sidecar_path(pcap_path, "", path, sizeof(path)) != 0)
+        return -1;
+    memset(b, 0, sizeof(*b));
+
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL)
+        return -1;
+    uint8_t header[BLOOM_HEADER];
+    if(fread(header, sizeof(header), 1, fp) != 1)
+        goto invalid;
+    if(memcmp(header, BLOOM_MAGIC, 4) != 0)
+        goto invalid;
+    if(header[4] != BLOOM_VERSION){
+        fclose(fp);
+        errno = ESTALE;
+        return -1;
+    }
+    struct stat st;
+    if(stat(pcap_path, &st) != 0){
+        int err = errno;
+        fclose(fp);
+        errno = err;
+        return -1;
+    }
+    if(get_le64(header + 24) != (uint64_t)st.st_size || get_le64(header + 32) != mtime_ns(&st)){
+        fclose(fp);
+        errno = ESTALE;
+        return -1;
+    }
+    uint64_t nbits = get_le64(header + 8);
+    if(header[5] < 1 || header[5] > BLOOM_MAX_K
+        || nbits < 64 || nbits > BLOOM_MAX_BITS || (nbits & (nbits - 1)) != 0)
+        goto invalid;
+
+    b->bits = malloc(nbits / 8);
+    if(b->bits == NULL){
+        fclose(fp);
+        errno = ENOMEM;
+        return -1;
+    }
+    if(fread(b->bits, nbits / 8, 1, fp) != 1){
+        bloom_free(b);
+        goto invalid;
+    }
+    fclose(fp);
+    b->nbits = nbits;
+    b->k = header[5];
+    b->items = get_le64(header + 16);
+    return 0;
+
+invalid:
+    fclose(fp);
+    errno = EINVAL;
+    return -1;
+}
@@ -0,0 +1,44 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PYPCAP_BLOOM // header guard
+#define BLOOM_DEFAULT_KEYS 65536 // distinct addresses and ports a file's index is sized for
+#define BLOOM_FP_RATE 0.01 // false positive rate at that many keys
+#define BLOOM_MAGIC "PBLM"
+#define BLOOM_HEADER 40 // sidecar: magic, version, k, 2 reserved bytes, then nbits, items and the pcap file's size and mtime in ns as little endian u64, then the bits
+
+/*
+Bloom filter of the addresses and ports seen in one capture file
+
+Written next to the file as <pcap_path>.bloom, so "which of these thousand
+files could hold host X" is answered by reading one small sidecar per file
+(128KiB at the default size) instead of the files themselves. Keys are an address (4 or 16 bytes) or a
+TCP/UDP/SCTP port, tagged so that neither can collide with the other; both
+source and destination of every indexed packet go in. Lookups can be false
+positives, at about fp_rate once the filter holds the keys it was sized
+for, but never false negatives. The sidecar records the size and mtime the
+pcap file had when it was written; a file changed since then has outgrown
+its index, which is then not trusted.
+*/
+struct bloom{
+    uint8_t *bits;
+    uint64_t nbits; // a power of two
+    uint64_t items; // keys added, counting repeats
+    uint8_t k; // bits set per key
+    int linktype; // of the packets bloom_add_packet is given
+};
+
+int bloom_init(struct bloom *b, uint64_t keys, double fp_rate);
+int bloom_parse(PyObject *index, struct bloom *b);
+void bloom_free(struct bloom *b);
+void bloom_reset(struct bloom *b);
+void bloom_add(struct bloom *b, const void *key, size_t len);
+int bloom_check(const struct bloom *b, const void *key, size_t len);
+size_t bloom_key_addr(uint8_t *key, const uint8_t *addr, uint8_t addr_len);
+size_t bloom_key_port(uint8_t *key, uint16_t port);
+void bloom_add_packet(struct bloom *b, const unsigned char *data, uint32_t caplen);
+int bloom_write(const struct bloom *b, const char *pcap_path);
+int bloom_remove(const char *pcap_path);
+int bloom_read(struct bloom *b, const char *pcap_path);
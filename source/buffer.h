@@ -0,0 +1,118 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#include <structmember.h>
+
+#ifndef PYPCAP_POOL
+#include "pool.h"
+#endif
+
+#define PYPCAP_BUFFER
+
+/*
+Read-only buffer-protocol view over a slice of a pooled pkt_buf
+
+Holds one reference on the pkt_buf for as long as the object (or any memoryview of it) lives
+*/
+typedef struct{
+    PyObject_HEAD
+    struct pkt_buf *buf;
+    Py_ssize_t offset;
+    Py_ssize_t shape[1];
+    Py_ssize_t itemsize;
+    const char *format;
+} PacketBuffer;
+
+static PyTypeObject PacketBufferType;
+
+/* buffer protocol: export a 1-d, read-only, C-contiguous view */
+static int
+PacketBuffer_getbuffer(PacketBuffer *self, Py_buffer *view, int flags)
+{
+    if(flags & PyBUF_WRITABLE){
+        PyErr_SetString(PyExc_BufferError, "PacketBuffer is read-only");
+        view->obj = NULL;
+        return -1;
+    }
+
+    view->obj = (PyObject *)self;
+    Py_INCREF(self);
+    view->buf = self->buf->data + self->offset;
+    view->len = self->shape[0] * self->itemsize;
+    view->readonly = 1;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? (char *)self->format : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? &self->itemsize : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+
+    return 0;
+}
+
+static PyBufferProcs PacketBuffer_as_buffer = {
+    .bf_getbuffer = (getbufferproc) PacketBuffer_getbuffer,
+    .bf_releasebuffer = NULL,
+};
+
+/* deallocation method */
+static void
+PacketBuffer_dealloc(PacketBuffer *self)
+{
+    pkt_buf_decref(self->buf);
+    self->buf = NULL;
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/*
+PacketBuffer Type construction
+
+Only created from C, so no tp_new / tp_init; never holds python references so no GC
+*/
+static PyTypeObject PacketBufferType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.PacketBuffer",
+    .tp_doc = "Read-only view of pooled packet memory",
+    .tp_basicsize = sizeof(PacketBuffer),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor) PacketBuffer_dealloc,
+    .tp_as_buffer = &PacketBuffer_as_buffer,
+};
+
+/*
+Return a new PacketBuffer over count items of buf starting at offset bytes
+
+Takes a new reference on buf. format is a struct-module format string with static storage
+*/
+static PyObject *
+PacketBuffer_New(struct pkt_buf *buf, size_t offset, size_t count, const char *format, size_t itemsize)
+{
+    PacketBuffer *self = PyObject_New(PacketBuffer, &PacketBufferType);
+    if(self == NULL)
+        return NULL;
+
+    pkt_buf_incref(buf);
+    self->buf = buf;
+    self->offset = (Py_ssize_t)offset;
+    self->shape[0] = (Py_ssize_t)count;
+    self->itemsize = (Py_ssize_t)itemsize;
+    self->format = format;
+
+    return (PyObject *)self;
+}
+
+/* Return a memoryview of len bytes of buf starting at offset */
+static PyObject *
+PacketBuffer_MemoryView(struct pkt_buf *buf, size_t offset, size_t len)
+{
+    PyObject *pb = PacketBuffer_New(buf, offset, len, "B", 1);
+    if(pb == NULL)
+        return NULL;
+
+    PyObject *view = PyMemoryView_FromObject(pb);
+    Py_DECREF(pb);
+
+    return view;
+}
@@ -4,13 +4,44 @@
 #include <string.h>
 #include <structmember.h>
 #include <stdio.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
 
 #ifndef PYPCAP_UTIL
 #include "util.h"
 #endif
 
+#ifndef PYPCAP_AFFINITY
+#include "affinity.h"
+#endif
+
+#ifndef PYPCAP_PACKET
+#include "packet.h"
+#endif
+
+#ifndef PYPCAP_BATCH
+#include "batch.h"
+#endif
+
+#ifndef PYPCAP_METRICS
+#include "metrics.h"
+#endif
+
+#ifndef PYPCAP_SAMPLING
+#include "sampling.h"
+#endif
+
+#ifndef PYPCAP_FLIGHT
+#include "flight.h"
+#endif
+
 #define PYPCAP_CAPTURE
 #define LINKTYPE_ETHERNET 1
+#define CAPTURE_CHUNK 262144 // bytes of pooled memory shared by consecutive packets
+#define CAPTURE_BATCH 64 // default packets per nonblocking dispatch in async iteration
+#define RECORD_RING_BYTES (64 * 1024 * 1024) // default flight recorder ring
+#define RECORD_POLL_MS 100 // longest record() goes without checking for triggers and stop()
 
 #ifndef MAX_PACKET_SIZE
 #define MAX_PACKET_SIZE 65535
@@ -27,6 +58,26 @@ typedef struct{
     int _max_packets;
     char _errbuf[PCAP_ERRBUF_SIZE];
     pcap_t *_pcap;
+    pcap_dumper_t *_dumper;
+    int _linktype;
+    int _want_precision; // PCAP_TSTAMP_PRECISION_ asked for
+    int _want_tstamp_type; // PCAP_TSTAMP_ asked for, -1 for libpcap's default
+    int _tstamp_precision; // the one the open handle delivers, or the one asked for until opened
+    int _tstamp_type; // the one in effect, or the one asked for until opened
+    int _usec_ns; // nanoseconds per pcap_pkthdr ts.tv_usec unit of the open handle
+    long _captured;
+    struct pkt_buf *_chunk;
+    struct placement _placement;
+    int _numa_node;
+    int _last_cpu;
+    int _last_numa_node;
+    long long _cpu_ns; // cpu time the capturing thread spent in start()
+    struct sampler _sampler;
+    struct truncator _truncator;
+    struct bloom _bloom; // bits is NULL unless indexing output files
+    struct shm_ring _shm; // name is NULL unless publishing to a shared ring, hdr NULL unless open
+    int _trigger; // set by trigger(), consumed by a running record()
+    int _stop; // set by stop() to end a running record()
     /* Python properties */
     PyObject *interface_name;
     PyObject *packet_len;
@@ -34,6 +85,8 @@ typedef struct{
     PyObject *timeout_ms;
     PyObject *output_filename;
     PyObject *max_packets;
+    PyObject *cpu_affinity;
+    PyObject *numa_node;
 } PcapCapture;
 
 /* creation method */
@@ -55,23 +108,73 @@ PcapCapture_init(PcapCapture *self, PyObject *args, PyObject *kwds)
         "max_packets",
         "promiscuous",
         "timeout_ms",
+        "cpu_affinity",
+        "numa_node",
+        "sampling",
+        "truncate",
+        "index",
+        "precision",
+        "tstamp_type",
+        "shared_ring",
         NULL
     };
 
-    PyObject *interface_name=NULL, *output_filename=NULL, *tmp;
-    int promiscuous=0, timeout_ms=1000, max_packets;
+    PyObject *interface_name=NULL, *output_filename=NULL, *cpu_affinity=NULL, *sampling=NULL, *truncate=NULL, *index=NULL, *shared_ring=NULL, *tmp;
+    int promiscuous=0, timeout_ms=1000, max_packets, numa_node=-1;
+    const char *precision = "nano", *tstamp_type = NULL;
 
     if(!PyArg_ParseTupleAndKeywords(
         args,
         kwds,
-        "OOi|ii",
+        "OOi|iiOiOOOszO",
         kwlist,
         &interface_name, &output_filename, &max_packets,
-        &promiscuous, &timeout_ms
+        &promiscuous, &timeout_ms, &cpu_affinity, &numa_node, &sampling, &truncate, &index,
+        &precision, &tstamp_type, &shared_ring
     )){
         return -1;
     }
 
+    // timestamps are delivered, dumped and handed to python in the unit asked for, never rescaled
+    if(strcmp(precision, "nano") == 0)
+        self->_want_precision = PCAP_TSTAMP_PRECISION_NANO;
+    else if(strcmp(precision, "micro") == 0)
+        self->_want_precision = PCAP_TSTAMP_PRECISION_MICRO;
+    else{
+        PyErr_SetString(PyExc_ValueError, "precision must be 'nano' or 'micro'");
+        return -1;
+    }
+    self->_tstamp_precision = self->_want_precision;
+    self->_usec_ns = self->_tstamp_precision == PCAP_TSTAMP_PRECISION_NANO ? 1 : 1000;
+
+    // a timestamp source the interface lacks falls back to the host clock when opened
+    self->_want_tstamp_type = -1;
+    if(tstamp_type != NULL){
+        self->_want_tstamp_type = pcap_tstamp_type_name_to_val(tstamp_type);
+        if(self->_want_tstamp_type < 0){
+            PyErr_Format(PyExc_ValueError, "Unknown tstamp_type %s, expected e.g. 'host', 'host_hiprec' or 'adapter'", tstamp_type);
+            return -1;
+        }
+    }
+    self->_tstamp_type = self->_want_tstamp_type;
+
+    // only what is written to output_filename is truncated, callbacks still see whole packets
+    if(truncator_parse(truncate, &self->_truncator) != 0)
+        return -1;
+
+    // addresses and ports of what is written to output_filename (and to each record() dump), in a .bloom sidecar
+    bloom_free(&self->_bloom);
+    if(bloom_parse(index, &self->_bloom) != 0)
+        return -1;
+
+    // every packet sampling keeps, untruncated, for PcapSharedReader consumers in other processes
+    shm_ring_free(&self->_shm);
+    if(shm_ring_parse(shared_ring, &self->_shm) != 0)
+        return -1;
+
+    if(sampler_parse(sampling, self->_usec_ns, &self->_sampler) != 0)
+        return -1;
+
     // interface name
     if(interface_name){
         char *iface_name = PyUnicode_ToString(interface_name);
@@ -88,7 +191,14 @@ PcapCapture_init(PcapCapture *self, PyObject *args, PyObject *kwds)
     }
 
     // output filename
-    if(output_filename){
+    // None is allowed when packets are consumed from python instead of dumped
+    if(output_filename == Py_None){
+        self->_output_filename = NULL;
+        tmp = self->output_filename;
+        Py_INCREF(Py_None);
+        self->output_filename = Py_None;
+        Py_XDECREF(tmp);
+    } else if(output_filename){
         char *fname = PyUnicode_ToString(output_filename);
         if(fname == NULL){
             PyErr_SetString(PyExc_ValueError, "Could not convert output_filename into C string");
@@ -160,180 +270,1636 @@ PcapCapture_init(PcapCapture *self, PyObject *args, PyObject *kwds)
     self->packet_len = packet_length;
     Py_XDECREF(tmp);
 
+    // thread placement
+    // numa_node alone pins to every cpu of that node
+    if(placement_parse(cpu_affinity, numa_node, &self->_placement) != 0)
+        return -1;
+    self->_numa_node = self->_placement.numa_node;
+    self->_last_cpu = -1;
+    self->_last_numa_node = -1;
+
+    PyObject *py_cpu_affinity;
+    if(self->_placement.has_cpus){
+        py_cpu_affinity = placement_cpus_to_tuple(&self->_placement.cpus);
+        if(py_cpu_affinity == NULL)
+            return -1;
+    } else {
+        Py_INCREF(Py_None);
+        py_cpu_affinity = Py_None;
+    }
+    tmp = self->cpu_affinity;
+    self->cpu_affinity = py_cpu_affinity;
+    Py_XDECREF(tmp);
+
+    PyObject *py_numa_node = PyLong_FromLong((long)self->_numa_node);
+    if(py_numa_node == NULL){
+        PyErr_NoMemory();
+        return -1;
+    }
+    tmp = self->numa_node;
+    self->numa_node = py_numa_node;
+    Py_XDECREF(tmp);
+
     return 0;
 }
 
-static PyObject *
-PcapCapture_start(PcapCapture *self, PyObject *args)
-{
-    // open live pcap captures on interface
-    pcap_t *pcap = pcap_open_live(
-        self->_interface_name,
-        self->_packet_len,
-        self->_promisc,
-        self->_timeout_ms,
-        self->_errbuf
-    );
+/*
+create a handle on the interface set up as asked, with timestamps from tstamp_type (-1 for libpcap's default)
 
+Return the handle, not yet activated, or NULL with a python exception set
+*/
+static pcap_t *
+PcapCapture_create(PcapCapture *self, int tstamp_type)
+{
+    pcap_t *pcap = pcap_create(self->_interface_name, self->_errbuf);
     if(pcap == NULL){
         PyErr_Format(PyExc_SystemError, "Could not open interface %s for packet capture: %s", self->_interface_name, self->_errbuf);
         return NULL;
     }
+    pcap_set_snaplen(pcap, self->_packet_len);
+    pcap_set_promisc(pcap, self->_promisc);
+    pcap_set_timeout(pcap, self->_timeout_ms);
+
+    // an unsupported precision or timestamp source leaves libpcap's default, microseconds from the host clock;
+    // the precision in effect is read back once activated
+    pcap_set_tstamp_precision(pcap, self->_want_precision);
+    self->_tstamp_type = tstamp_type;
+    if(tstamp_type >= 0 && pcap_set_tstamp_type(pcap, tstamp_type) != 0)
+        self->_tstamp_type = PCAP_TSTAMP_HOST;
+    return pcap;
+}
+
+/*
+open the interface, and the output file if there is one and dump is set, unless already open
+
+Return 0 on success, -1 with a python exception set
+*/
+static int
+PcapCapture_open_live(PcapCapture *self, int dump)
+{
+    if(self->_pcap != NULL)
+        return 0;
+
+    // open live pcap captures on interface
+    pcap_t *pcap = PcapCapture_create(self, self->_want_tstamp_type);
+    if(pcap == NULL)
+        return -1;
+    int status = pcap_activate(pcap);
+    // a timestamp source accepted when set can still be refused on activation, with a warning or an error;
+    // the host clock is always there to fall back to
+    if(status == PCAP_WARNING_TSTAMP_TYPE_NOTSUP)
+        self->_tstamp_type = PCAP_TSTAMP_HOST;
+    else if(status < 0 && self->_tstamp_type >= 0 && self->_tstamp_type != PCAP_TSTAMP_HOST){
+        pcap_close(pcap);
+        pcap = PcapCapture_create(self, -1);
+        if(pcap == NULL)
+            return -1;
+        self->_tstamp_type = PCAP_TSTAMP_HOST;
+        status = pcap_activate(pcap);
+    }
+    if(status < 0){
+        PyErr_Format(
+            PyExc_SystemError, "Could not open interface %s for packet capture: %s", self->_interface_name,
+            status == PCAP_ERROR ? pcap_geterr(pcap) : pcap_statustostr(status)
+        );
+        pcap_close(pcap);
+        return -1;
+    }
+    self->_tstamp_precision = pcap_get_tstamp_precision(pcap);
+    self->_usec_ns = self->_tstamp_precision == PCAP_TSTAMP_PRECISION_NANO ? 1 : 1000;
+    self->_sampler.usec_ns = self->_usec_ns;
+
+    // the ring is made anew each time the interface is opened, consumers attach after that
+    if(self->_shm.name != NULL && shm_ring_create(&self->_shm, self->_interface_name, pcap_datalink(pcap), self->_usec_ns) != 0){
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, self->_shm.name);
+        pcap_close(pcap);
+        return -1;
+    }
+
+    if(dump && self->_output_filename != NULL){
+        pcap_dumper_t *d = pcap_dump_open(pcap, self->_output_filename);
+        if(d == NULL){
+            PyErr_Format(PyExc_SystemError, "Could not open pcap dumper for %s", self->_output_filename);
+            shm_ring_close(&self->_shm);
+            pcap_close(pcap);
+            return -1;
+        }
+        // the dumper starts the file over, so an index left by an earlier run no longer describes it
+        if(bloom_remove(self->_output_filename) != 0){
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, self->_output_filename);
+            pcap_dump_close(d);
+            shm_ring_close(&self->_shm);
+            pcap_close(pcap);
+            return -1;
+        }
+        self->_dumper = d;
+        if(self->_bloom.bits != NULL)
+            bloom_reset(&self->_bloom);
+    }
+
     self->_pcap = pcap;
+    self->_linktype = pcap_datalink(pcap);
+    self->_captured = 0;
+    self->_cpu_ns = 0;
+    sampler_restart(&self->_sampler, self->_linktype);
+    self->_truncator.linktype = self->_linktype;
+    self->_bloom.linktype = self->_linktype;
 
-    pcap_dumper_t *d = pcap_dump_open(self->_pcap, self->_output_filename);
-    if(d == NULL){
-        PyErr_Format(PyExc_SystemError, "Could not open pcap dumper for %s", self->_output_filename);
+    return 0;
+}
+
+/* open the interface and the output file if there is one, unless already open */
+static int
+PcapCapture_open(PcapCapture *self)
+{
+    return PcapCapture_open_live(self, 1);
+}
+
+/*
+open the capture on self's numa placement and switch it to nonblocking mode
+
+Return the selectable file descriptor, or -1 with a python exception set
+*/
+static int
+PcapCapture_open_nonblocking(PcapCapture *self)
+{
+    if(self->_pcap == NULL){
+        struct placement_saved saved;
+        if(placement_apply(&self->_placement, &saved) != 0){
+            placement_restore(&saved);
+            PyErr_SetFromErrno(PyExc_OSError);
+            return -1;
+        }
+        int res = PcapCapture_open(self);
+        placement_restore(&saved);
+        if(res != 0)
+            return -1;
+    }
+
+    if(pcap_setnonblock(self->_pcap, 1, self->_errbuf) != 0){
+        PyErr_Format(PyExc_SystemError, "Could not make capture on %s nonblocking: %s", self->_interface_name, self->_errbuf);
+        return -1;
+    }
+
+    int fd = pcap_get_selectable_fd(self->_pcap);
+    if(fd < 0){
+        PyErr_Format(PyExc_SystemError, "Capture on %s has no selectable file descriptor", self->_interface_name);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+flush the dumper, if any, to disk, along with the sampling and index sidecars
+
+Return 0 on success, -1 with errno set if a sidecar could not be written
+*/
+static int
+PcapCapture_flush(PcapCapture *self)
+{
+    if(self->_dumper == NULL)
+        return 0;
+    METRICS_BEGIN(t0);
+    pcap_dump_flush(self->_dumper);
+    METRICS_END(METRICS_FLUSH, t0);
+    if(self->_bloom.bits != NULL && bloom_write(&self->_bloom, self->_output_filename) != 0)
+        return -1;
+    return sampler_write_meta(&self->_sampler, self->_output_filename);
+}
+
+/* dump one packet, truncated if asked to, to the output file if there is one, and whole to the shared ring if there is one */
+static inline void
+PcapCapture_dump(PcapCapture *self, const struct pcap_pkthdr *hdr, const u_char *packet)
+{
+    if(self->_shm.hdr != NULL)
+        shm_ring_publish(&self->_shm, hdr, packet);
+    if(self->_dumper == NULL)
+        return;
+    METRICS_BEGIN(t0);
+    struct pcap_pkthdr h = *hdr;
+    truncator_apply(&self->_truncator, &h, packet);
+    pcap_dump((u_char *)self->_dumper, &h, packet);
+    if(self->_bloom.bits != NULL)
+        bloom_add_packet(&self->_bloom, packet, h.caplen);
+    METRICS_END(METRICS_DUMP, t0);
+}
+
+/* open the interface and run pcap_loop on the calling thread */
+static PyObject *
+PcapCapture_loop(PcapCapture *self)
+{
+    if(self->_output_filename == NULL){
+        PyErr_SetString(PyExc_ValueError, "start() requires an output_filename");
         return NULL;
     }
 
-    int processed = pcap_loop(
+    if(PcapCapture_open(self) != 0)
+        return NULL;
+    // a count of 0 would make pcap_loop run forever
+    if(self->_captured >= self->_max_packets)
+        return Py_BuildValue("");
+
+    struct dump_target target = {self->_dumper, &self->_sampler, &self->_truncator, self->_bloom.bits ? &self->_bloom : NULL, self->_shm.hdr ? &self->_shm : NULL, 0};
+    int res = pcap_loop(
         self->_pcap,
-        self->_max_packets,
+        (int)(self->_max_packets - self->_captured),
         pcap_dump_handler,
-        (u_char *)d
+        (u_char *)&target
     );
+    // pcap_loop returns early at the end of a savefile or on pcap_breakloop, so count what it handled
+    self->_captured += target.packets;
+    int flushed = PcapCapture_flush(self);
 
-    // TODO: call get_error for better alert here
-    if(processed != 0){
-        PyErr_Format(PyExc_SystemError, "Problem processing pcaps on interface %s", self->_interface_name);
+    if(res == PCAP_ERROR){
+        PyErr_Format(PyExc_SystemError, "Problem processing pcaps on interface %s: %s", self->_interface_name, pcap_geterr(self->_pcap));
         return NULL;
     }
+    if(flushed != 0)
+        return PyErr_SetFromErrno(PyExc_OSError);
 
     return Py_BuildValue("");
 }
-/* expose attributes as custom members */
-static PyMemberDef PcapCapture_members[] = {
-    {"_interface_name", T_STRING, offsetof(PcapCapture, _interface_name), 0, "c string for interface name"},
-    {"_packet_len", T_INT, offsetof(PcapCapture, _packet_len), 0, "c int for packet length"},
-    {"_promisc", T_INT, offsetof(PcapCapture, _promisc), 0, "c int for promiscuous mode"},
-    {"_timeout_ms", T_INT, offsetof(PcapCapture, _timeout_ms), 0, "c int for timeout in ms"},
-    {"_output_filename", T_STRING, offsetof(PcapCapture, _output_filename), 0, "c string for output filename"},
-    {"_max_packets", T_INT, offsetof(PcapCapture, _max_packets), 0, "c int for max packets"},
-    {"_errbuf", T_STRING, offsetof(PcapCapture, _errbuf), 0, "pcap errbuf"},
-    {"_pcap", T_OBJECT_EX, offsetof(PcapCapture, _pcap), 0, "pcap_t pointer"},
-    {NULL}
-};
-
-/* expose methods */
-static PyMethodDef PcapCapture_methods[] = {
-    {"start", (PyCFunction) PcapCapture_start, METH_NOARGS, "Start capturing pcaps on self.interface_name and write them to self.output_filename"},
-    {NULL}
-};
 
-/* custom getter/setter methods to control member types */
+/* Return a new Packet holding a copy of a captured packet */
 static PyObject *
-PcapCapture_get_interface_name(PcapCapture *self, void *closure)
+PcapCapture_packet(PcapCapture *self, const struct pcap_pkthdr *hdr, const u_char *data)
 {
-    Py_INCREF(self->interface_name);
-    return self->interface_name;
-}
+    size_t offset;
+    struct pkt_buf *chunk = pkt_chunk_append(&self->_chunk, pkt_pool_get(self->_numa_node), CAPTURE_CHUNK, data, hdr->caplen, &offset);
+    if(chunk == NULL)
+        return PyErr_NoMemory();
 
-static int
-PcapCapture_set_interface_name(PcapCapture *self, PyObject *value, void *closure){
-    PyErr_SetString(PyExc_AttributeError, "interface_name attribute is read-only");
-    return -1;
+    long long ts = (long long)hdr->ts.tv_sec * 1000000000LL + (long long)hdr->ts.tv_usec * self->_usec_ns;
+    return Packet_New(chunk, offset, ts, hdr->caplen, hdr->len, self->_linktype, self->interface_name);
 }
 
-static PyObject *
-PcapCapture_get_output_filename(PcapCapture *self, void *closure)
+/* pcap_dispatch callback state for collecting Packet objects */
+struct capture_batch{
+    PcapCapture *self;
+    PyObject *packets;
+    int failed;
+};
+
+static void
+PcapCapture_packet_handler(u_char *args, const struct pcap_pkthdr *hdr, const u_char *packet)
 {
-    Py_INCREF(self->output_filename);
-    return self->output_filename;
+    struct capture_batch *batch = (struct capture_batch *)args;
+    PcapCapture *self = batch->self;
+    if(batch->failed)
+        return;
+
+    METRICS_BEGIN(t0);
+    self->_captured++;
+    if(!sampler_keep(&self->_sampler, hdr, packet)){
+        METRICS_END(METRICS_CAPTURE_CALLBACK, t0);
+        return;
+    }
+    PcapCapture_dump(self, hdr, packet);
+
+    PyObject *pkt = PcapCapture_packet(self, hdr, packet);
+    if(pkt == NULL || PyList_Append(batch->packets, pkt) != 0){
+        batch->failed = 1;
+        pcap_breakloop(self->_pcap);
+    }
+    Py_XDECREF(pkt);
+    METRICS_END(METRICS_CAPTURE_CALLBACK, t0);
 }
 
+/*
+run one pcap_dispatch appending up to max_packets Packets (all buffered ones if <= 0) to packets
+
+never hands out more than self->max_packets over the life of the capture
+Return the number of packets read, -2 if the loop was broken, or -1 with a python exception set
+*/
 static int
-PcapCapture_set_output_filename(PcapCapture *self, PyObject *value, void *closure){
-    PyErr_SetString(PyExc_AttributeError, "output_filename attribute is read-only");
-    return -1;
+PcapCapture_dispatch_into(PcapCapture *self, int max_packets, PyObject *packets)
+{
+    long remaining = self->_max_packets - self->_captured;
+    if(remaining <= 0)
+        return 0;
+    if(max_packets <= 0 || max_packets > remaining)
+        max_packets = (int)remaining;
+
+    struct capture_batch batch = {self, packets, 0};
+    int n = pcap_dispatch(self->_pcap, max_packets, PcapCapture_packet_handler, (u_char *)&batch);
+
+    if(batch.failed)
+        return -1;
+    if(n == PCAP_ERROR){
+        PyErr_Format(PyExc_SystemError, "Problem processing pcaps on interface %s: %s", self->_interface_name, pcap_geterr(self->_pcap));
+        return -1;
+    }
+
+    return n;
 }
 
+/* selectable file descriptor of the capture, opening it in nonblocking mode */
 static PyObject *
-PcapCapture_get_max_packets(PcapCapture *self, void *closure)
+PcapCapture_fileno(PcapCapture *self, PyObject *Py_UNUSED(ignored))
 {
-    Py_INCREF(self->max_packets);
-    return self->max_packets;
+    int fd = PcapCapture_open_nonblocking(self);
+    if(fd < 0)
+        return NULL;
+    return PyLong_FromLong((long) fd);
 }
 
-static int
-PcapCapture_set_max_packets(PcapCapture *self, PyObject *value, void *closure){
-    PyErr_SetString(PyExc_AttributeError, "max_packets attribute is read-only");
-    return -1;
+/* nonblocking read of the packets currently buffered, as a list of Packet objects */
+static PyObject *
+PcapCapture_dispatch(PcapCapture *self, PyObject *args)
+{
+    int max_packets = -1;
+    if(!PyArg_ParseTuple(args, "|i", &max_packets))
+        return NULL;
+
+    if(PcapCapture_open_nonblocking(self) < 0)
+        return NULL;
+
+    PyObject *packets = PyList_New(0);
+    if(packets == NULL)
+        return NULL;
+
+    if(PcapCapture_dispatch_into(self, max_packets, packets) == -1){
+        Py_DECREF(packets);
+        return NULL;
+    }
+
+    return packets;
 }
 
+/* close the interface and flush the output file */
 static PyObject *
-PcapCapture_get_promisc(PcapCapture *self, void *closure)
+PcapCapture_close(PcapCapture *self, PyObject *Py_UNUSED(ignored))
 {
-    Py_INCREF(self->promisc);
-    return self->promisc;
-}
+    int flushed = PcapCapture_flush(self);
+    if(self->_dumper != NULL){
+        pcap_dump_close(self->_dumper);
+        self->_dumper = NULL;
+    }
+    if(self->_pcap != NULL){
+        pcap_close(self->_pcap);
+        self->_pcap = NULL;
+    }
+    shm_ring_close(&self->_shm);
+    pkt_buf_decref(self->_chunk);
+    self->_chunk = NULL;
 
-static int
-PcapCapture_set_promisc(PcapCapture *self, PyObject *value, void *closure){
-    PyErr_SetString(PyExc_AttributeError, "promisc attribute is read-only");
-    return -1;
+    if(flushed != 0)
+        return PyErr_SetFromErrno(PyExc_OSError);
+    return Py_BuildValue("");
 }
 
+/*
+Awaitable that completes immediately with a value
+
+Returned by CaptureIterator.__anext__ when a packet is already buffered,
+so the fast path costs no future or event loop round trip
+*/
+typedef struct{
+    PyObject_HEAD
+    PyObject *value;
+} CaptureReady;
+
+static PyTypeObject CaptureReadyType;
+
 static PyObject *
-PcapCapture_get_timeout_ms(PcapCapture *self, void *closure)
+CaptureReady_New(PyObject *value)
 {
-    Py_INCREF(self->timeout_ms);
-    return self->timeout_ms;
+    CaptureReady *self = PyObject_New(CaptureReady, &CaptureReadyType);
+    if(self == NULL){
+        Py_DECREF(value);
+        return NULL;
+    }
+    self->value = value; // steals the reference
+    return (PyObject *)self;
 }
 
-static int
-PcapCapture_set_timeout_ms(PcapCapture *self, PyObject *value, void *closure){
-    PyErr_SetString(PyExc_AttributeError, "timeout_ms attribute is read-only");
-    return -1;
+static PyObject *
+CaptureReady_await(CaptureReady *self)
+{
+    Py_INCREF(self);
+    return (PyObject *)self;
 }
 
 static PyObject *
-PcapCapture_get_packet_len(PcapCapture *self, void *closure)
+CaptureReady_iternext(CaptureReady *self)
 {
-    Py_INCREF(self->packet_len);
-    return self->packet_len;
+    if(self->value == NULL){
+        PyErr_SetNone(PyExc_StopIteration);
+        return NULL;
+    }
+
+    // the awaited result travels as StopIteration.value
+    PyObject *stop = PyObject_CallOneArg(PyExc_StopIteration, self->value);
+    Py_CLEAR(self->value);
+    if(stop != NULL){
+        PyErr_SetObject(PyExc_StopIteration, stop);
+        Py_DECREF(stop);
+    }
+    return NULL;
 }
 
-static int
-PcapCapture_set_packet_len(PcapCapture *self, PyObject *value, void *closure){
-    PyErr_SetString(PyExc_AttributeError, "packet_len attribute is read-only");
-    return -1;
+static void
+CaptureReady_dealloc(CaptureReady *self)
+{
+    Py_XDECREF(self->value);
+    Py_TYPE(self)->tp_free((PyObject *)self);
 }
 
-static PyGetSetDef PcapCapture_getsetters[] = {
-    {"interface_name", (getter) PcapCapture_get_interface_name, (setter) PcapCapture_set_interface_name, "interface_name", NULL},
-    {"output_filename", (getter) PcapCapture_get_output_filename, (setter) PcapCapture_set_output_filename, "output_filename", NULL},
-    {"max_packets", (getter) PcapCapture_get_max_packets, (setter) PcapCapture_set_max_packets, "max_packets", NULL},
-    {"promisc", (getter) PcapCapture_get_promisc, (setter) PcapCapture_set_promisc, "promisc", NULL},
-    {"timeout_ms", (getter) PcapCapture_get_timeout_ms, (setter) PcapCapture_set_timeout_ms, "timeout_ms", NULL},
-    {"packet_length", (getter) PcapCapture_get_packet_len, (setter) PcapCapture_set_packet_len, "packet_length", NULL},
-    {NULL}
+static PyAsyncMethods CaptureReady_as_async = {
+    .am_await = (unaryfunc) CaptureReady_await,
 };
 
-/* avoid cyclic references / enable cyclic GC */
-static int
-PcapCapture_traverse(PcapCapture *self, visitproc visit, void *arg)
-{
+static PyTypeObject CaptureReadyType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap._CaptureReady",
+    .tp_doc = "Awaitable that completes immediately with a buffered packet",
+    .tp_basicsize = sizeof(CaptureReady),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor) CaptureReady_dealloc,
+    .tp_as_async = &CaptureReady_as_async,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc) CaptureReady_iternext,
+};
 
-    Py_VISIT(self->interface_name);
-    Py_VISIT(self->output_filename);
-    Py_VISIT(self->max_packets);
-    Py_VISIT(self->promisc);
-    Py_VISIT(self->timeout_ms);
-    Py_VISIT(self->packet_len);
+/*
+Async iterator over a PcapCapture
 
-    return 0;
-}
+Packets are read with nonblocking pcap_dispatch in batches of batch_size and handed out one at a time.
+The capture fd is only registered with the event loop while a consumer is awaiting and nothing is
+buffered, so a slow consumer leaves packets queued in the kernel instead of in python (backpressure).
+Cancelling the awaiting task unregisters the fd; buffered packets are kept for the next __anext__.
+*/
+typedef struct{
+    PyObject_HEAD
+    PcapCapture *capture;
+    PyObject *loop;
+    PyObject *waiter; // future handed to the consumer while waiting for the fd
+    PyObject *packets; // read but not yet handed out
+    Py_ssize_t pos;
+    int batch_size;
+    int fd;
+    int reading; // fd registered with loop.add_reader
+} CaptureIterator;
 
-static int
-PcapCapture_clear(PcapCapture *self)
-{
+static PyTypeObject CaptureIteratorType;
+
+static PyObject *
+CaptureIterator_New(PcapCapture *capture, int batch_size)
+{
+    CaptureIterator *self = PyObject_GC_New(CaptureIterator, &CaptureIteratorType);
+    if(self == NULL)
+        return NULL;
+
+    self->packets = PyList_New(0);
+    if(self->packets == NULL){
+        Py_DECREF(self);
+        return NULL;
+    }
+    Py_INCREF(capture);
+    self->capture = capture;
+    self->loop = NULL;
+    self->waiter = NULL;
+    self->pos = 0;
+    self->batch_size = batch_size;
+    self->fd = -1;
+    self->reading = 0;
+
+    PyObject_GC_Track(self);
+    return (PyObject *)self;
+}
+
+/* next buffered packet (new reference), or NULL without an exception set if none */
+static PyObject *
+CaptureIterator_pop(CaptureIterator *self)
+{
+    if(self->pos >= PyList_GET_SIZE(self->packets))
+        return NULL;
+
+    PyObject *pkt = PyList_GET_ITEM(self->packets, self->pos);
+    Py_INCREF(pkt);
+    self->pos++;
+    return pkt;
+}
+
+/* refill the buffer with one nonblocking dispatch; same return values as PcapCapture_dispatch_into */
+static int
+CaptureIterator_fill(CaptureIterator *self)
+{
+    if(PyList_SetSlice(self->packets, 0, PyList_GET_SIZE(self->packets), NULL) != 0)
+        return -1;
+    self->pos = 0;
+
+    if(self->fd < 0){
+        self->fd = PcapCapture_open_nonblocking(self->capture);
+        if(self->fd < 0)
+            return -1;
+    }
+
+    return PcapCapture_dispatch_into(self->capture, self->batch_size, self->packets);
+}
+
+static int
+CaptureIterator_finished(CaptureIterator *self)
+{
+    PcapCapture *capture = self->capture;
+    // closed under us, or max_packets handed out
+    return (self->fd >= 0 && capture->_pcap == NULL) || capture->_captured >= capture->_max_packets;
+}
+
+static int
+CaptureIterator_stop_reading(CaptureIterator *self)
+{
+    if(!self->reading)
+        return 0;
+    self->reading = 0;
+
+    PyObject *res = PyObject_CallMethod(self->loop, "remove_reader", "i", self->fd);
+    if(res == NULL)
+        return -1;
+    Py_DECREF(res);
+    return 0;
+}
+
+/* complete the pending future with the current exception */
+static void
+CaptureIterator_fail_waiter(CaptureIterator *self)
+{
+    PyObject *type, *value, *tb;
+    PyErr_Fetch(&type, &value, &tb);
+    PyErr_NormalizeException(&type, &value, &tb);
+    if(tb != NULL)
+        PyException_SetTraceback(value, tb);
+
+    PyObject *waiter = self->waiter;
+    self->waiter = NULL;
+    PyObject *res = PyObject_CallMethod(waiter, "set_exception", "O", value);
+    Py_XDECREF(res);
+    Py_DECREF(waiter);
+    Py_XDECREF(type);
+    Py_XDECREF(value);
+    Py_XDECREF(tb);
+}
+
+/* loop.add_reader callback: the capture fd is readable */
+static PyObject *
+CaptureIterator_on_readable(CaptureIterator *self, PyObject *Py_UNUSED(ignored))
+{
+    if(self->waiter == NULL){
+        if(CaptureIterator_stop_reading(self) != 0)
+            return NULL;
+        return Py_BuildValue("");
+    }
+
+    PyObject *pkt = NULL;
+    int n = CaptureIterator_fill(self);
+    if(n >= 0)
+        pkt = CaptureIterator_pop(self);
+
+    if(pkt == NULL && n != -1 && n != -2 && !CaptureIterator_finished(self))
+        return Py_BuildValue(""); // spurious wakeup, keep waiting
+
+    if(CaptureIterator_stop_reading(self) != 0){
+        Py_XDECREF(pkt);
+        return NULL;
+    }
+
+    if(pkt == NULL){
+        if(!PyErr_Occurred())
+            PyErr_SetNone(PyExc_StopAsyncIteration);
+        CaptureIterator_fail_waiter(self);
+        return Py_BuildValue("");
+    }
+
+    PyObject *waiter = self->waiter;
+    self->waiter = NULL;
+    PyObject *res = PyObject_CallMethod(waiter, "set_result", "O", pkt);
+    Py_DECREF(waiter);
+    Py_DECREF(pkt);
+    if(res == NULL)
+        return NULL;
+    Py_DECREF(res);
+
+    return Py_BuildValue("");
+}
+
+/* future done callback: stop watching the fd if the consumer gave up (cancellation) */
+static PyObject *
+CaptureIterator_on_done(CaptureIterator *self, PyObject *fut)
+{
+    if(fut != self->waiter)
+        return Py_BuildValue("");
+
+    Py_CLEAR(self->waiter);
+    if(CaptureIterator_stop_reading(self) != 0)
+        return NULL;
+
+    return Py_BuildValue("");
+}
+
+static PyObject *
+CaptureIterator_aiter(CaptureIterator *self)
+{
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *
+CaptureIterator_anext(CaptureIterator *self)
+{
+    if(self->waiter != NULL){
+        PyErr_SetString(PyExc_RuntimeError, "anext() called while another anext() is still pending");
+        return NULL;
+    }
+
+    PyObject *pkt = CaptureIterator_pop(self);
+    if(pkt == NULL && !CaptureIterator_finished(self)){
+        int n = CaptureIterator_fill(self);
+        if(n == -1)
+            return NULL;
+        if(n == -2){
+            PyErr_SetNone(PyExc_StopAsyncIteration);
+            return NULL;
+        }
+        pkt = CaptureIterator_pop(self);
+    }
+    if(pkt != NULL)
+        return CaptureReady_New(pkt);
+
+    if(CaptureIterator_finished(self)){
+        PyErr_SetNone(PyExc_StopAsyncIteration);
+        return NULL;
+    }
+
+    // nothing buffered: hand out a future completed once the fd turns readable
+    static PyObject *asyncio = NULL;
+    if(asyncio == NULL){
+        asyncio = PyImport_ImportModule("asyncio");
+        if(asyncio == NULL)
+            return NULL;
+    }
+
+    PyObject *loop = PyObject_CallMethod(asyncio, "get_running_loop", NULL);
+    if(loop == NULL)
+        return NULL;
+    Py_XSETREF(self->loop, loop);
+
+    PyObject *fut = PyObject_CallMethod(loop, "create_future", NULL);
+    if(fut == NULL)
+        return NULL;
+
+    PyObject *on_done = PyObject_GetAttrString((PyObject *)self, "_on_done");
+    if(on_done == NULL){
+        Py_DECREF(fut);
+        return NULL;
+    }
+    PyObject *res = PyObject_CallMethod(fut, "add_done_callback", "O", on_done);
+    Py_DECREF(on_done);
+    if(res == NULL){
+        Py_DECREF(fut);
+        return NULL;
+    }
+    Py_DECREF(res);
+
+    PyObject *on_readable = PyObject_GetAttrString((PyObject *)self, "_on_readable");
+    if(on_readable == NULL){
+        Py_DECREF(fut);
+        return NULL;
+    }
+    res = PyObject_CallMethod(loop, "add_reader", "iO", self->fd, on_readable);
+    Py_DECREF(on_readable);
+    if(res == NULL){
+        Py_DECREF(fut);
+        return NULL;
+    }
+    Py_DECREF(res);
+    self->reading = 1;
+
+    Py_INCREF(fut);
+    self->waiter = fut;
+    return fut;
+}
+
+static PyMethodDef CaptureIterator_methods[] = {
+    {"_on_readable", (PyCFunction) CaptureIterator_on_readable, METH_NOARGS, "Event loop callback for a readable capture fd"},
+    {"_on_done", (PyCFunction) CaptureIterator_on_done, METH_O, "Done callback of the future handed to the consumer"},
+    {NULL}
+};
+
+static int
+CaptureIterator_traverse(CaptureIterator *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->capture);
+    Py_VISIT(self->loop);
+    Py_VISIT(self->waiter);
+    Py_VISIT(self->packets);
+    return 0;
+}
+
+static int
+CaptureIterator_clear(CaptureIterator *self)
+{
+    Py_CLEAR(self->capture);
+    Py_CLEAR(self->loop);
+    Py_CLEAR(self->waiter);
+    Py_CLEAR(self->packets);
+    return 0;
+}
+
+static void
+CaptureIterator_dealloc(CaptureIterator *self)
+{
+    PyObject_GC_UnTrack(self);
+    CaptureIterator_clear(self);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyAsyncMethods CaptureIterator_as_async = {
+    .am_aiter = (unaryfunc) CaptureIterator_aiter,
+    .am_anext = (unaryfunc) CaptureIterator_anext,
+};
+
+static PyTypeObject CaptureIteratorType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.CaptureIterator",
+    .tp_doc = "Async iterator over the packets of a PcapCapture",
+    .tp_basicsize = sizeof(CaptureIterator),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_dealloc = (destructor) CaptureIterator_dealloc,
+    .tp_methods = CaptureIterator_methods,
+    .tp_traverse = (traverseproc) CaptureIterator_traverse,
+    .tp_clear = (inquiry) CaptureIterator_clear,
+    .tp_as_async = &CaptureIterator_as_async,
+};
+
+/* async iterator over the capture, reading batch_size packets per wakeup */
+static PyObject *
+PcapCapture_packets(PcapCapture *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"batch_size", NULL};
+    int batch_size = CAPTURE_BATCH;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &batch_size))
+        return NULL;
+    if(batch_size <= 0){
+        PyErr_SetString(PyExc_ValueError, "batch_size must be > 0");
+        return NULL;
+    }
+
+    return CaptureIterator_New(self, batch_size);
+}
+
+static PyObject *
+PcapCapture_aiter(PcapCapture *self)
+{
+    return CaptureIterator_New(self, CAPTURE_BATCH);
+}
+
+static long long
+thread_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long
+monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/*
+packets accumulated for the next PacketBatch
+
+filled by PcapCapture_batch_handler with the GIL released, so it must not touch python objects
+*/
+struct capture_accum{
+    PcapCapture *self;
+    struct pkt_pool *pool;
+    struct pkt_buf *columns;
+    struct pkt_buf *data;
+    struct batch_columns cols;
+    size_t count;
+    size_t capacity;
+    int failed;
+};
+
+static int
+capture_accum_reset(struct capture_accum *acc)
+{
+    acc->columns = pkt_buf_alloc(acc->pool, acc->capacity * BATCH_COLUMN_BYTES);
+    acc->data = pkt_buf_alloc(acc->pool, CAPTURE_CHUNK);
+    if(acc->columns == NULL || acc->data == NULL){
+        pkt_buf_decref(acc->columns);
+        pkt_buf_decref(acc->data);
+        acc->columns = acc->data = NULL;
+        return -1;
+    }
+    batch_columns_map(acc->columns, acc->capacity, &acc->cols);
+    acc->count = 0;
+    return 0;
+}
+
+static void
+PcapCapture_batch_handler(u_char *args, const struct pcap_pkthdr *hdr, const u_char *packet)
+{
+    struct capture_accum *acc = (struct capture_accum *)args;
+    PcapCapture *self = acc->self;
+    if(acc->failed || acc->count >= acc->capacity)
+        return;
+
+    METRICS_BEGIN(t0);
+    if(!sampler_keep(&self->_sampler, hdr, packet)){
+        self->_captured++;
+        METRICS_END(METRICS_CAPTURE_CALLBACK, t0);
+        return;
+    }
+    PcapCapture_dump(self, hdr, packet);
+
+    struct pkt_buf *data = acc->data;
+    if(data->size - data->len < hdr->caplen){
+        data = pkt_buf_grow(data, data->len + hdr->caplen);
+        if(data == NULL){
+            acc->failed = 1;
+            pcap_breakloop(self->_pcap);
+            return;
+        }
+        acc->data = data;
+    }
+
+    size_t i = acc->count++;
+    acc->cols.ts[i] = (long long)hdr->ts.tv_sec * 1000000000LL + (long long)hdr->ts.tv_usec * acc->self->_usec_ns;
+    acc->cols.caplen[i] = hdr->caplen;
+    acc->cols.wirelen[i] = hdr->len;
+    acc->cols.offset[i] = (uint32_t)data->len;
+    memcpy(data->data + data->len, packet, hdr->caplen);
+    data->len += hdr->caplen;
+    self->_captured++;
+    METRICS_END(METRICS_CAPTURE_CALLBACK, t0);
+}
+
+/* hand the accumulated packets to callback as one PacketBatch and start a new one */
+static int
+PcapCapture_deliver(PcapCapture *self, struct capture_accum *acc, PyObject *callback)
+{
+    PyObject *batch = PacketBatch_New(acc->columns, acc->data, (Py_ssize_t)acc->count, (Py_ssize_t)acc->capacity, self->_linktype, self->interface_name);
+    acc->columns = acc->data = NULL;
+    if(batch == NULL)
+        return -1;
+
+    PyObject *res = PyObject_CallOneArg(callback, batch);
+    Py_DECREF(batch);
+    if(res == NULL)
+        return -1;
+    Py_DECREF(res);
+
+    if(capture_accum_reset(acc) != 0){
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+/*
+capture max_packets packets, calling callback with a PacketBatch every batch_size packets
+or batch_timeout_ms after the first packet of a batch, whichever comes first
+
+packets are accumulated in C with the GIL released; python only runs once per batch
+*/
+static PyObject *
+PcapCapture_loop_callback(PcapCapture *self, PyObject *callback, int batch_size, int batch_timeout_ms)
+{
+    if(PcapCapture_open(self) != 0)
+        return NULL;
+    if(pcap_setnonblock(self->_pcap, 1, self->_errbuf) != 0){
+        PyErr_Format(PyExc_SystemError, "Could not make capture on %s nonblocking: %s", self->_interface_name, self->_errbuf);
+        return NULL;
+    }
+    int fd = pcap_get_selectable_fd(self->_pcap);
+
+    struct capture_accum acc = {0};
+    acc.self = self;
+    acc.pool = pkt_pool_get(self->_numa_node);
+    acc.capacity = (size_t)batch_size;
+    if(capture_accum_reset(&acc) != 0)
+        return PyErr_NoMemory();
+
+    long long batch_started = 0;
+    int error = 0;
+    int n = 0, idle = 0;
+
+    while(self->_captured < self->_max_packets){
+        long long remaining_ms = batch_timeout_ms;
+        if(acc.count > 0)
+            remaining_ms = batch_started + batch_timeout_ms - monotonic_ms();
+
+        size_t had = acc.count;
+        if(remaining_ms > 0){
+            int want = (int)(acc.capacity - acc.count);
+            if(want > self->_max_packets - self->_captured)
+                want = (int)(self->_max_packets - self->_captured);
+
+            Py_BEGIN_ALLOW_THREADS
+            if(fd >= 0){
+                struct pollfd pfd = {fd, POLLIN, 0};
+                poll(&pfd, 1, (int)remaining_ms);
+            } else if(idle){
+                // nothing to wait on, so sleep out the batch timeout instead of spinning
+                poll(NULL, 0, (int)remaining_ms);
+            }
+            n = pcap_dispatch(self->_pcap, want, PcapCapture_batch_handler, (u_char *)&acc);
+            Py_END_ALLOW_THREADS
+            idle = n == 0;
+        }
+
+        if(acc.failed){
+            PyErr_NoMemory();
+            error = 1;
+            break;
+        }
+        if(n == PCAP_ERROR){
+            PyErr_Format(PyExc_SystemError, "Problem processing pcaps on interface %s: %s", self->_interface_name, pcap_geterr(self->_pcap));
+            error = 1;
+            break;
+        }
+        if(had == 0 && acc.count > 0)
+            batch_started = monotonic_ms();
+
+        // let ctrl-c and other signal handlers run between dispatches
+        if(PyErr_CheckSignals() != 0){
+            error = 1;
+            break;
+        }
+
+        if(acc.count > 0 && (acc.count >= acc.capacity || monotonic_ms() - batch_started >= batch_timeout_ms)){
+            if(PcapCapture_deliver(self, &acc, callback) != 0){
+                error = 1;
+                break;
+            }
+        }
+        if(n == PCAP_ERROR_BREAK)
+            break;
+    }
+
+    if(!error && acc.count > 0 && PcapCapture_deliver(self, &acc, callback) != 0)
+        error = 1;
+
+    pkt_buf_decref(acc.columns);
+    pkt_buf_decref(acc.data);
+    if(PcapCapture_flush(self) != 0 && !error){
+        PyErr_SetFromErrno(PyExc_OSError);
+        error = 1;
+    }
+
+    if(error)
+        return NULL;
+    return Py_BuildValue("");
+}
+
+/*
+Start the capture with the calling thread moved onto self's cpu/numa placement
+
+Without a callback packets are dumped to output_filename; with one, they are
+delivered in PacketBatch objects (and still dumped if there is an output file).
+The thread's previous affinity and memory policy are restored afterwards
+*/
+static PyObject *
+PcapCapture_start(PcapCapture *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"callback", "batch_size", "batch_timeout_ms", NULL};
+    PyObject *callback = NULL;
+    int batch_size = 1024, batch_timeout_ms = 100;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|Oii", kwlist, &callback, &batch_size, &batch_timeout_ms))
+        return NULL;
+
+    if(callback == Py_None)
+        callback = NULL;
+    if(callback != NULL && !PyCallable_Check(callback)){
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return NULL;
+    }
+    if(batch_size <= 0){
+        PyErr_SetString(PyExc_ValueError, "batch_size must be > 0");
+        return NULL;
+    }
+    if(batch_timeout_ms <= 0){
+        PyErr_SetString(PyExc_ValueError, "batch_timeout_ms must be > 0");
+        return NULL;
+    }
+
+    struct placement_saved saved;
+    if(placement_apply(&self->_placement, &saved) != 0){
+        placement_restore(&saved);
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    long long cpu_start = thread_cpu_ns();
+    PyObject *res;
+    if(callback != NULL)
+        res = PcapCapture_loop_callback(self, callback, batch_size, batch_timeout_ms);
+    else
+        res = PcapCapture_loop(self);
+    self->_cpu_ns += thread_cpu_ns() - cpu_start;
+
+    self->_last_numa_node = numa_current_node(&self->_last_cpu);
+    placement_restore(&saved);
+
+    return res;
+}
+
+/* counted by the trigger_signal handler of record(), shared by every capture; each recorder remembers how many it has seen */
+static unsigned long record_signals = 0;
+
+static void
+record_signal_handler(int sig)
+{
+    __atomic_add_fetch(&record_signals, 1, __ATOMIC_RELAXED);
+}
+
+/* pcap_dispatch state of a flight recorder, touched with the GIL released */
+struct record_state{
+    PcapCapture *self;
+    struct flight_ring ring;
+    struct bpf_program filter;
+    int has_filter;
+    int filter_hit;
+    int has_signal;
+    unsigned long signals_seen; // record_signals when last looked at
+};
+
+static void
+PcapCapture_record_handler(u_char *args, const struct pcap_pkthdr *hdr, const u_char *packet)
+{
+    struct record_state *st = (struct record_state *)args;
+    PcapCapture *self = st->self;
+
+    METRICS_BEGIN(t0);
+    self->_captured++;
+    // the trigger sees every packet, the ring only what sampling keeps
+    if(st->has_filter && pcap_offline_filter(&st->filter, hdr, packet) != 0)
+        st->filter_hit = 1;
+    if(sampler_keep(&self->_sampler, hdr, packet)){
+        if(self->_shm.hdr != NULL)
+            shm_ring_publish(&self->_shm, hdr, packet);
+        struct pcap_pkthdr h = *hdr;
+        truncator_apply(&self->_truncator, &h, packet);
+        flight_ring_push(&st->ring, &h, packet);
+    }
+    METRICS_END(METRICS_CAPTURE_CALLBACK, t0);
+}
+
+/* output_filename with -NNNN inserted before its extension */
+static void
+record_dump_path(const char *base, unsigned seq, char *out, size_t outlen)
+{
+    const char *name = strrchr(base, '/');
+    name = (name != NULL) ? name + 1 : base;
+    const char *ext = strrchr(name, '.');
+    if(ext == NULL || ext == name)
+        ext = name + strlen(name);
+    snprintf(out, outlen, "%.*s-%04u%s", (int)(ext - base), base, seq, ext);
+}
+
+/* write the ring to the seq-th dump file and add its description to dumps */
+static int
+PcapCapture_record_dump(PcapCapture *self, struct record_state *st, unsigned seq, const char *reason, PyObject *dumps)
+{
+    char path[4096];
+    record_dump_path(self->_output_filename, seq, path, sizeof(path));
+
+    pcap_dumper_t *d = pcap_dump_open(self->_pcap, path);
+    if(d == NULL){
+        PyErr_Format(PyExc_OSError, "Could not open %s for a flight recorder dump: %s", path, pcap_geterr(self->_pcap));
+        return -1;
+    }
+    // each dump gets an index of its own, and an unindexed one loses whatever was left by that name
+    if(self->_bloom.bits == NULL && bloom_remove(path) != 0){
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+        pcap_dump_close(d);
+        return -1;
+    }
+    struct bloom *bloom = NULL;
+    if(self->_bloom.bits != NULL){
+        bloom_reset(&self->_bloom);
+        bloom = &self->_bloom;
+    }
+    long n;
+    Py_BEGIN_ALLOW_THREADS
+    n = flight_ring_dump(&st->ring, d, bloom);
+    pcap_dump_close(d);
+    Py_END_ALLOW_THREADS
+
+    if((bloom != NULL && bloom_write(bloom, path) != 0) || sampler_write_meta(&self->_sampler, path) != 0){
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+        return -1;
+    }
+
+    PyObject *item = Py_BuildValue("{s:s, s:s, s:l}", "path", path, "reason", reason, "packets", n);
+    if(item == NULL || PyList_Append(dumps, item) != 0){
+        Py_XDECREF(item);
+        return -1;
+    }
+    Py_DECREF(item);
+    return 0;
+}
+
+/*
+capture into the flight recorder ring, dumping it whenever a trigger fires
+
+Returns the dump descriptions, or NULL with a python exception set.
+Runs on the calling thread with self's interface already open
+*/
+static PyObject *
+PcapCapture_record_loop(PcapCapture *self, struct record_state *st, double post_seconds, double duration, int max_dumps)
+{
+    int fd = pcap_get_selectable_fd(self->_pcap);
+    long long started = monotonic_ms();
+    long long dump_at = -1; // when the pending dump is due, -1 if none
+    const char *reason = NULL;
+    unsigned seq = 0;
+
+    PyObject *dumps = PyList_New(0);
+    if(dumps == NULL)
+        return NULL;
+
+    int idle = 0;
+    while(!__atomic_load_n(&self->_stop, __ATOMIC_ACQUIRE)){
+        long long now = monotonic_ms();
+        if(duration > 0 && now - started >= (long long)(duration * 1000))
+            break;
+
+        long long wait = RECORD_POLL_MS;
+        if(dump_at >= 0 && dump_at - now < wait)
+            wait = dump_at > now ? dump_at - now : 0;
+
+        int n;
+        Py_BEGIN_ALLOW_THREADS
+        if(fd >= 0){
+            struct pollfd pfd = {fd, POLLIN, 0};
+            poll(&pfd, 1, (int)wait);
+        } else if(idle){
+            poll(NULL, 0, (int)wait); // nothing to wait on, so sleep instead of spinning
+        }
+        n = pcap_dispatch(self->_pcap, -1, PcapCapture_record_handler, (u_char *)st);
+        Py_END_ALLOW_THREADS
+        idle = n == 0;
+
+        if(n == PCAP_ERROR){
+            PyErr_Format(PyExc_SystemError, "Problem processing pcaps on interface %s: %s", self->_interface_name, pcap_geterr(self->_pcap));
+            goto error;
+        }
+        if(PyErr_CheckSignals() != 0)
+            goto error;
+
+        // triggers that fire while a dump is pending are folded into it
+        const char *fired = NULL;
+        if(__atomic_exchange_n(&self->_trigger, 0, __ATOMIC_ACQ_REL))
+            fired = "call";
+        unsigned long signals = __atomic_load_n(&record_signals, __ATOMIC_RELAXED);
+        if(st->has_signal && signals != st->signals_seen){
+            st->signals_seen = signals;
+            fired = "signal";
+        }
+        if(st->filter_hit){
+            st->filter_hit = 0;
+            fired = "filter";
+        }
+        if(fired != NULL && dump_at < 0){
+            reason = fired;
+            dump_at = monotonic_ms() + (long long)(post_seconds * 1000);
+        }
+
+        if(dump_at >= 0 && monotonic_ms() >= dump_at){
+            if(PcapCapture_record_dump(self, st, ++seq, reason, dumps) != 0)
+                goto error;
+            dump_at = -1;
+            if(max_dumps > 0 && seq >= (unsigned)max_dumps)
+                break;
+        }
+    }
+
+    return dumps;
+
+error:
+    Py_DECREF(dumps);
+    return NULL;
+}
+
+/*
+Flight recorder: keep the last ring_bytes / ring_seconds of traffic in memory and
+only write it out, to output_filename with -0001, -0002... inserted, when triggered
+
+Triggers are trigger() from another thread, a packet matching trigger_filter, or
+trigger_signal arriving; each dump also holds post_trigger_seconds of traffic after
+the trigger. Runs until stop(), duration seconds, max_dumps dumps, or an exception
+raised by a signal handler. max_packets does not apply. A trigger() or stop()
+made before the call takes effect as soon as it starts.
+*/
+static PyObject *
+PcapCapture_record(PcapCapture *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {
+        "ring_bytes",
+        "ring_seconds",
+        "trigger_filter",
+        "trigger_signal",
+        "post_trigger_seconds",
+        "duration",
+        "max_dumps",
+        NULL
+    };
+    Py_ssize_t ring_bytes = RECORD_RING_BYTES;
+    double ring_seconds = 0.0, post_seconds = 0.0, duration = 0.0;
+    const char *trigger_filter = NULL;
+    int trigger_signal = 0, max_dumps = 0;
+
+    if(!PyArg_ParseTupleAndKeywords(
+        args, kwds, "|ndziddi", kwlist,
+        &ring_bytes, &ring_seconds, &trigger_filter, &trigger_signal,
+        &post_seconds, &duration, &max_dumps
+    ))
+        return NULL;
+
+    if(self->_output_filename == NULL){
+        PyErr_SetString(PyExc_ValueError, "record() requires an output_filename to name its dumps");
+        return NULL;
+    }
+    if(self->_pcap != NULL){
+        PyErr_SetString(PyExc_ValueError, "record() needs a capture that is not already open");
+        return NULL;
+    }
+    if(ring_bytes < 65536){
+        PyErr_SetString(PyExc_ValueError, "ring_bytes must be at least 65536");
+        return NULL;
+    }
+    if(ring_seconds < 0 || post_seconds < 0 || duration < 0 || max_dumps < 0){
+        PyErr_SetString(PyExc_ValueError, "ring_seconds, post_trigger_seconds, duration and max_dumps must be >= 0");
+        return NULL;
+    }
+    if(trigger_signal < 0 || trigger_signal >= NSIG){
+        PyErr_Format(PyExc_ValueError, "trigger_signal must be 0 or a signal number below %d", NSIG);
+        return NULL;
+    }
+
+    struct placement_saved saved;
+    if(placement_apply(&self->_placement, &saved) != 0){
+        placement_restore(&saved);
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    long long cpu_start = thread_cpu_ns();
+
+    PyObject *res = NULL;
+    struct record_state st = {0};
+    st.self = self;
+    struct sigaction old_action;
+    int have_signal = 0;
+
+    if(PcapCapture_open_live(self, 0) != 0)
+        goto done;
+    if(pcap_setnonblock(self->_pcap, 1, self->_errbuf) != 0){
+        PyErr_Format(PyExc_SystemError, "Could not make capture on %s nonblocking: %s", self->_interface_name, self->_errbuf);
+        goto done;
+    }
+    if(flight_ring_init(&st.ring, (size_t)ring_bytes, ring_seconds, self->_usec_ns, self->_numa_node) != 0){
+        PyErr_NoMemory();
+        goto done;
+    }
+    if(trigger_filter != NULL){
+        if(pcap_compile(self->_pcap, &st.filter, trigger_filter, 1, PCAP_NETMASK_UNKNOWN) != 0){
+            PyErr_Format(PyExc_ValueError, "Could not compile trigger_filter: %s", pcap_geterr(self->_pcap));
+            goto done;
+        }
+        st.has_filter = 1;
+    }
+    if(trigger_signal != 0){
+        st.signals_seen = __atomic_load_n(&record_signals, __ATOMIC_RELAXED);
+        struct sigaction action = {0};
+        action.sa_handler = record_signal_handler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if(sigaction(trigger_signal, &action, &old_action) != 0){
+            PyErr_SetFromErrno(PyExc_OSError);
+            goto done;
+        }
+        have_signal = st.has_signal = 1;
+    }
+
+    PyObject *dumps = PcapCapture_record_loop(self, &st, post_seconds, duration, max_dumps);
+    if(dumps != NULL){
+        res = Py_BuildValue(
+            "{s:N, s:l, s:K, s:K, s:n, s:K, s:K, s:O}",
+            "dumps", dumps,
+            "packets_seen", self->_captured,
+            "ring_packets", (unsigned long long)st.ring.packets,
+            "ring_bytes_used", (unsigned long long)(st.ring.tail - st.ring.head),
+            "ring_bytes", (Py_ssize_t)st.ring.size,
+            "evicted", (unsigned long long)st.ring.evicted,
+            "oversized", (unsigned long long)st.ring.oversized,
+            "locked", st.ring.locked ? Py_True : Py_False
+        );
+    }
+
+done:
+    if(have_signal)
+        sigaction(trigger_signal, &old_action, NULL);
+    // a trigger() or stop() made before this call applied to it; none carries over to the next
+    __atomic_store_n(&self->_trigger, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&self->_stop, 0, __ATOMIC_RELEASE);
+    if(st.has_filter)
+        pcap_freecode(&st.filter);
+    flight_ring_free(&st.ring);
+    // the handle has no dumper, so don't leave it open for start() to pick up
+    if(self->_pcap != NULL){
+        pcap_close(self->_pcap);
+        self->_pcap = NULL;
+    }
+    shm_ring_close(&self->_shm);
+
+    self->_cpu_ns += thread_cpu_ns() - cpu_start;
+    self->_last_numa_node = numa_current_node(&self->_last_cpu);
+    placement_restore(&saved);
+
+    return res;
+}
+
+/* make a running record() dump its ring; safe from any thread */
+static PyObject *
+PcapCapture_trigger(PcapCapture *self, PyObject *Py_UNUSED(ignored))
+{
+    __atomic_store_n(&self->_trigger, 1, __ATOMIC_RELEASE);
+    return Py_BuildValue("");
+}
+
+/* make a running record() return within RECORD_POLL_MS; safe from any thread */
+static PyObject *
+PcapCapture_stop(PcapCapture *self, PyObject *Py_UNUSED(ignored))
+{
+    __atomic_store_n(&self->_stop, 1, __ATOMIC_RELEASE);
+    return Py_BuildValue("");
+}
+
+/* capture counters and where the capture thread actually ran */
+static PyObject *
+PcapCapture_stats(PcapCapture *self, PyObject *Py_UNUSED(ignored))
+{
+    struct pcap_stat ps = {0};
+    if(self->_pcap != NULL && pcap_stats(self->_pcap, &ps) != 0){
+        PyErr_Format(PyExc_SystemError, "Could not read capture statistics: %s", pcap_geterr(self->_pcap));
+        return NULL;
+    }
+
+    PyObject *last_cpu = (self->_last_cpu >= 0) ? PyLong_FromLong(self->_last_cpu) : Py_BuildValue("");
+    PyObject *last_node = (self->_last_numa_node >= 0) ? PyLong_FromLong(self->_last_numa_node) : Py_BuildValue("");
+    double cpu_per_packet = self->_captured > 0 ? (double)self->_cpu_ns / self->_captured : 0.0;
+
+    return Py_BuildValue(
+        "{s:I, s:I, s:I, s:l, s:K, s:K, s:d, s:d, s:O, s:i, s:N, s:N}",
+        "packets_received", ps.ps_recv,
+        "packets_dropped", ps.ps_drop,
+        "packets_if_dropped", ps.ps_ifdrop,
+        "packets_captured", self->_captured,
+        "packets_shared", (unsigned long long)self->_shm.seq,
+        "packets_too_big_to_share", (unsigned long long)self->_shm.oversized,
+        "cpu_seconds", self->_cpu_ns / 1e9,
+        "cpu_ns_per_packet", cpu_per_packet,
+        "cpu_affinity", self->cpu_affinity,
+        "numa_node", self->_numa_node,
+        "cpu", last_cpu,
+        "cpu_numa_node", last_node
+    );
+}
+
+/*
+sampling settings and how many packets were seen and kept
+
+max_packets counts packets seen, so a sampled capture stops after the same
+stretch of traffic as an unsampled one
+*/
+static PyObject *
+PcapCapture_sampling_stats(PcapCapture *self, PyObject *Py_UNUSED(ignored))
+{
+    return sampler_stats(&self->_sampler);
+}
+
+/* packets and bytes written to output_filename before and after truncation */
+static PyObject *
+PcapCapture_truncation_stats(PcapCapture *self, PyObject *Py_UNUSED(ignored))
+{
+    return truncator_stats(&self->_truncator);
+}
+
+/* expose attributes as custom members */
+static PyMemberDef PcapCapture_members[] = {
+    {"_interface_name", T_STRING, offsetof(PcapCapture, _interface_name), 0, "c string for interface name"},
+    {"_packet_len", T_INT, offsetof(PcapCapture, _packet_len), 0, "c int for packet length"},
+    {"_promisc", T_INT, offsetof(PcapCapture, _promisc), 0, "c int for promiscuous mode"},
+    {"_timeout_ms", T_INT, offsetof(PcapCapture, _timeout_ms), 0, "c int for timeout in ms"},
+    {"_output_filename", T_STRING, offsetof(PcapCapture, _output_filename), 0, "c string for output filename"},
+    {"_max_packets", T_INT, offsetof(PcapCapture, _max_packets), 0, "c int for max packets"},
+    {"_numa_node", T_INT, offsetof(PcapCapture, _numa_node), 0, "c int for numa node, -1 if unset"},
+    {"_errbuf", T_STRING, offsetof(PcapCapture, _errbuf), 0, "pcap errbuf"},
+    {"_pcap", T_OBJECT_EX, offsetof(PcapCapture, _pcap), 0, "pcap_t pointer"},
+    {NULL}
+};
+
+/* expose methods */
+static PyMethodDef PcapCapture_methods[] = {
+    {"start", (PyCFunction) PcapCapture_start, METH_VARARGS | METH_KEYWORDS, "Start capturing pcaps on self.interface_name and write them to self.output_filename, or pass PacketBatch objects to callback"},
+    {"record", (PyCFunction) PcapCapture_record, METH_VARARGS | METH_KEYWORDS, "Flight recorder: keep recent packets in a memory ring and dump it to a pcap file when triggered"},
+    {"trigger", (PyCFunction) PcapCapture_trigger, METH_NOARGS, "Make a running record() dump its ring"},
+    {"stop", (PyCFunction) PcapCapture_stop, METH_NOARGS, "Make a running record() return"},
+    {"stats", (PyCFunction) PcapCapture_stats, METH_NOARGS, "Return capture counters and the cpu/numa placement of the capture thread"},
+    {"sampling_stats", (PyCFunction) PcapCapture_sampling_stats, METH_NOARGS, "Return the sampling mode, rate, and packets seen and kept"},
+    {"truncation_stats", (PyCFunction) PcapCapture_truncation_stats, METH_NOARGS, "Return packets and bytes written before and after truncation"},
+    {"fileno", (PyCFunction) PcapCapture_fileno, METH_NOARGS, "Open the capture in nonblocking mode and return its selectable file descriptor"},
+    {"dispatch", (PyCFunction) PcapCapture_dispatch, METH_VARARGS, "Nonblocking read of up to max_packets buffered packets as Packet objects"},
+    {"packets", (PyCFunction) PcapCapture_packets, METH_VARARGS | METH_KEYWORDS, "Async iterator over captured packets, reading batch_size packets per wakeup"},
+    {"close", (PyCFunction) PcapCapture_close, METH_NOARGS, "Close the interface and the output file"},
+    {NULL}
+};
+
+/* custom getter/setter methods to control member types */
+static PyObject *
+PcapCapture_get_interface_name(PcapCapture *self, void *closure)
+{
+    Py_INCREF(self->interface_name);
+    return self->interface_name;
+}
+
+static int
+PcapCapture_set_interface_name(PcapCapture *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "interface_name attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapCapture_get_output_filename(PcapCapture *self, void *closure)
+{
+    Py_INCREF(self->output_filename);
+    return self->output_filename;
+}
+
+static int
+PcapCapture_set_output_filename(PcapCapture *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "output_filename attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapCapture_get_max_packets(PcapCapture *self, void *closure)
+{
+    Py_INCREF(self->max_packets);
+    return self->max_packets;
+}
+
+static int
+PcapCapture_set_max_packets(PcapCapture *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "max_packets attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapCapture_get_promisc(PcapCapture *self, void *closure)
+{
+    Py_INCREF(self->promisc);
+    return self->promisc;
+}
+
+static int
+PcapCapture_set_promisc(PcapCapture *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "promisc attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapCapture_get_timeout_ms(PcapCapture *self, void *closure)
+{
+    Py_INCREF(self->timeout_ms);
+    return self->timeout_ms;
+}
+
+static int
+PcapCapture_set_timeout_ms(PcapCapture *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "timeout_ms attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapCapture_get_packet_len(PcapCapture *self, void *closure)
+{
+    Py_INCREF(self->packet_len);
+    return self->packet_len;
+}
+
+static int
+PcapCapture_set_packet_len(PcapCapture *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "packet_len attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapCapture_get_cpu_affinity(PcapCapture *self, void *closure)
+{
+    Py_INCREF(self->cpu_affinity);
+    return self->cpu_affinity;
+}
+
+static int
+PcapCapture_set_cpu_affinity(PcapCapture *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "cpu_affinity attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapCapture_get_numa_node(PcapCapture *self, void *closure)
+{
+    Py_INCREF(self->numa_node);
+    return self->numa_node;
+}
+
+static int
+PcapCapture_set_numa_node(PcapCapture *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "numa_node attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapCapture_get_precision(PcapCapture *self, void *closure)
+{
+    return PyUnicode_FromString(self->_tstamp_precision == PCAP_TSTAMP_PRECISION_NANO ? "nano" : "micro");
+}
+
+static int
+PcapCapture_set_precision(PcapCapture *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "precision attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapCapture_get_tstamp_type(PcapCapture *self, void *closure)
+{
+    const char *name = self->_tstamp_type < 0 ? NULL : pcap_tstamp_type_val_to_name(self->_tstamp_type);
+    if(name == NULL)
+        return Py_BuildValue("");
+    return PyUnicode_FromString(name);
+}
+
+static int
+PcapCapture_set_tstamp_type(PcapCapture *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "tstamp_type attribute is read-only");
+    return -1;
+}
+
+static PyGetSetDef PcapCapture_getsetters[] = {
+    {"interface_name", (getter) PcapCapture_get_interface_name, (setter) PcapCapture_set_interface_name, "interface_name", NULL},
+    {"output_filename", (getter) PcapCapture_get_output_filename, (setter) PcapCapture_set_output_filename, "output_filename", NULL},
+    {"max_packets", (getter) PcapCapture_get_max_packets, (setter) PcapCapture_set_max_packets, "max_packets", NULL},
+    {"promisc", (getter) PcapCapture_get_promisc, (setter) PcapCapture_set_promisc, "promisc", NULL},
+    {"timeout_ms", (getter) PcapCapture_get_timeout_ms, (setter) PcapCapture_set_timeout_ms, "timeout_ms", NULL},
+    {"packet_length", (getter) PcapCapture_get_packet_len, (setter) PcapCapture_set_packet_len, "packet_length", NULL},
+    {"cpu_affinity", (getter) PcapCapture_get_cpu_affinity, (setter) PcapCapture_set_cpu_affinity, "cpu_affinity", NULL},
+    {"numa_node", (getter) PcapCapture_get_numa_node, (setter) PcapCapture_set_numa_node, "numa_node", NULL},
+    {"precision", (getter) PcapCapture_get_precision, (setter) PcapCapture_set_precision, "precision", NULL},
+    {"tstamp_type", (getter) PcapCapture_get_tstamp_type, (setter) PcapCapture_set_tstamp_type, "tstamp_type", NULL},
+    {NULL}
+};
+
+/* avoid cyclic references / enable cyclic GC */
+static int
+PcapCapture_traverse(PcapCapture *self, visitproc visit, void *arg)
+{
+
+    Py_VISIT(self->interface_name);
+    Py_VISIT(self->output_filename);
+    Py_VISIT(self->max_packets);
+    Py_VISIT(self->promisc);
+    Py_VISIT(self->timeout_ms);
+    Py_VISIT(self->packet_len);
+    Py_VISIT(self->cpu_affinity);
+    Py_VISIT(self->numa_node);
+
+    return 0;
+}
+
+static int
+PcapCapture_clear(PcapCapture *self)
+{
     Py_CLEAR(self->interface_name);
     Py_CLEAR(self->output_filename);
     Py_CLEAR(self->max_packets);
     Py_CLEAR(self->promisc);
     Py_CLEAR(self->timeout_ms);
     Py_CLEAR(self->packet_len);
+    Py_CLEAR(self->cpu_affinity);
+    Py_CLEAR(self->numa_node);
 
     return 0;
 }
@@ -343,6 +1909,21 @@ static void
 PcapCapture_dealloc(PcapCapture *self)
 {
     /* close all C objects */
+    if(self->_dumper != NULL){
+        pcap_dump_close(self->_dumper);
+        self->_dumper = NULL;
+        // index the file as close() would; failing that, leave no index for it at all
+        if(self->_bloom.bits != NULL && bloom_write(&self->_bloom, self->_output_filename) != 0)
+            bloom_remove(self->_output_filename);
+    }
+    if(self->_pcap != NULL){
+        pcap_close(self->_pcap);
+        self->_pcap = NULL;
+    }
+    pkt_buf_decref(self->_chunk);
+    self->_chunk = NULL;
+    bloom_free(&self->_bloom);
+    shm_ring_free(&self->_shm);
 
     /* dealloc with cyclic GC check */
     PyObject_GC_UnTrack(self);
@@ -360,6 +1941,10 @@ PcapWriter Type construction
     Py_TPFLAGS_BASETYPE = allows to be subclassed. do this only if methods don't care about type of object created/used
     Py_TPFLAGS_HAVE_GC = cyclic GC causes segfault if this isn't set
 */
+static PyAsyncMethods PcapCapture_as_async = {
+    .am_aiter = (unaryfunc) PcapCapture_aiter, // async for pkt in capture
+};
+
 static PyTypeObject PcapCaptureType = {
     PyVarObject_HEAD_INIT(NULL, 0)
     .tp_name = "pypcap.PcapCapture",
@@ -375,4 +1960,5 @@ static PyTypeObject PcapCaptureType = {
     .tp_traverse = (traverseproc) PcapCapture_traverse, // cyclic GC enable
     .tp_clear = (inquiry) PcapCapture_clear,
     .tp_getset = PcapCapture_getsetters, // custom getter/setter methods
+    .tp_as_async = &PcapCapture_as_async,
 };
@@ -0,0 +1,734 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <math.h>
+#include <string.h>
+#include <structmember.h>
+
+#ifndef PYPCAP_HLL
+#include "hll.h"
+#endif
+
+#ifndef PYPCAP_READER
+#include "reader.h"
+#endif
+
+#ifndef PYPCAP_BATCH
+#include "batch.h"
+#endif
+
+#define PYPCAP_CARDINALITY
+#define CARDINALITY_PRECISION 14 // 16KiB per sketch, ~0.8% standard error
+
+/*
+HyperLogLog sketch, see hll.h
+
+add() takes bytes-like values (str as UTF-8); CardinalityTracker feeds its
+sketches the same way, with the packed address bytes for hosts, so a sketch
+filled from Python and one from a tracker count the same things alike.
+to_bytes() / HyperLogLog.from_bytes() move sketches between processes and
+hosts, merge() combines them.
+*/
+typedef struct{
+    PyObject_HEAD
+    /* C-style properties*/
+    struct hll _hll;
+    /* Python properties */
+    PyObject *precision;
+} HyperLogLog;
+
+static PyTypeObject HyperLogLogType;
+
+/* creation method */
+static PyObject *
+HyperLogLog_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    HyperLogLog *self;
+    self = (HyperLogLog *) type->tp_alloc(type,0);
+    return (PyObject *) self;
+}
+
+static int
+HyperLogLog_set_up(HyperLogLog *self, int precision)
+{
+    if(precision < HLL_MIN_PRECISION || precision > HLL_MAX_PRECISION){
+        PyErr_Format(PyExc_ValueError, "precision must be between %d and %d", HLL_MIN_PRECISION, HLL_MAX_PRECISION);
+        return -1;
+    }
+    if(self->_hll.reg != NULL){
+        PyErr_SetString(PyExc_SystemError, "HyperLogLog is already initialized");
+        return -1;
+    }
+    if(hll_init(&self->_hll, precision) != 0){
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    PyObject *tmp = self->precision;
+    self->precision = PyLong_FromLong(precision);
+    Py_XDECREF(tmp);
+    return 0;
+}
+
+/* initialization method */
+static int
+HyperLogLog_init(HyperLogLog *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"precision", NULL};
+    int precision = CARDINALITY_PRECISION;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &precision))
+        return -1;
+
+    return HyperLogLog_set_up(self, precision);
+}
+
+/* Return a new HyperLogLog holding a copy of h */
+static PyObject *
+HyperLogLog_FromHll(const struct hll *h)
+{
+    HyperLogLog *self = (HyperLogLog *)HyperLogLog_new(&HyperLogLogType, NULL, NULL);
+    if(self == NULL)
+        return NULL;
+    if(HyperLogLog_set_up(self, h->precision) != 0){
+        Py_DECREF(self);
+        return NULL;
+    }
+    memcpy(self->_hll.reg, h->reg, h->m);
+    return (PyObject *)self;
+}
+
+static int
+HyperLogLog_ready(HyperLogLog *self)
+{
+    if(self->_hll.reg == NULL){
+        PyErr_SetString(PyExc_SystemError, "HyperLogLog is not initialized");
+        return -1;
+    }
+    return 0;
+}
+
+/* add one bytes-like or str value */
+static PyObject *
+HyperLogLog_add(HyperLogLog *self, PyObject *value)
+{
+    if(HyperLogLog_ready(self) != 0)
+        return NULL;
+
+    if(PyUnicode_Check(value)){
+        Py_ssize_t len;
+        const char *s = PyUnicode_AsUTF8AndSize(value, &len);
+        if(s == NULL)
+            return NULL;
+        hll_add_hash(&self->_hll, hll_hash(s, (size_t)len));
+        return Py_BuildValue("");
+    }
+
+    Py_buffer view;
+    if(PyObject_GetBuffer(value, &view, PyBUF_SIMPLE) != 0)
+        return NULL;
+    hll_add_hash(&self->_hll, hll_hash(view.buf, (size_t)view.len));
+    PyBuffer_Release(&view);
+    return Py_BuildValue("");
+}
+
+/* fold another sketch of the same precision into this one */
+static PyObject *
+HyperLogLog_merge(HyperLogLog *self, PyObject *other)
+{
+    if(HyperLogLog_ready(self) != 0)
+        return NULL;
+    if(!PyObject_TypeCheck(other, &HyperLogLogType)){
+        PyErr_SetString(PyExc_TypeError, "merge requires a HyperLogLog");
+        return NULL;
+    }
+    HyperLogLog *o = (HyperLogLog *)other;
+    if(HyperLogLog_ready(o) != 0)
+        return NULL;
+    if(o->_hll.precision != self->_hll.precision){
+        PyErr_SetString(PyExc_ValueError, "merge requires a HyperLogLog of the same precision");
+        return NULL;
+    }
+    hll_merge(&self->_hll, &o->_hll);
+    return Py_BuildValue("");
+}
+
+static PyObject *
+HyperLogLog_estimate(HyperLogLog *self, PyObject *Py_UNUSED(ignored))
+{
+    if(HyperLogLog_ready(self) != 0)
+        return NULL;
+    return PyFloat_FromDouble(hll_estimate(&self->_hll));
+}
+
+static PyObject *
+HyperLogLog_to_bytes(HyperLogLog *self, PyObject *Py_UNUSED(ignored))
+{
+    if(HyperLogLog_ready(self) != 0)
+        return NULL;
+    PyObject *b = PyBytes_FromStringAndSize(NULL, HLL_HEADER + self->_hll.m);
+    if(b == NULL)
+        return NULL;
+    hll_serialize(&self->_hll, (uint8_t *)PyBytes_AS_STRING(b));
+    return b;
+}
+
+/* classmethod: sketch back from to_bytes() output */
+static PyObject *
+HyperLogLog_from_bytes(PyTypeObject *type, PyObject *data)
+{
+    Py_buffer view;
+    if(PyObject_GetBuffer(data, &view, PyBUF_SIMPLE) != 0)
+        return NULL;
+
+    struct hll h;
+    int res = hll_deserialize(&h, view.buf, (size_t)view.len);
+    PyBuffer_Release(&view);
+    if(res == -1)
+        return PyErr_NoMemory();
+    if(res != 0){
+        PyErr_SetString(PyExc_ValueError, "data is not a serialized HyperLogLog");
+        return NULL;
+    }
+    PyObject *self = HyperLogLog_FromHll(&h);
+    hll_free(&h);
+    return self;
+}
+
+static PyObject *
+HyperLogLog_reset(HyperLogLog *self, PyObject *Py_UNUSED(ignored))
+{
+    if(HyperLogLog_ready(self) != 0)
+        return NULL;
+    hll_reset(&self->_hll);
+    return Py_BuildValue("");
+}
+
+/* len(sketch) is the estimate rounded */
+static Py_ssize_t
+HyperLogLog_len(HyperLogLog *self)
+{
+    if(HyperLogLog_ready(self) != 0)
+        return -1;
+    return (Py_ssize_t)llround(hll_estimate(&self->_hll));
+}
+
+static PySequenceMethods HyperLogLog_as_sequence = {
+    .sq_length = (lenfunc) HyperLogLog_len,
+};
+
+/* expose methods */
+static PyMethodDef HyperLogLog_methods[] = {
+    {"add", (PyCFunction) HyperLogLog_add, METH_O, "Add a bytes-like or str value"},
+    {"merge", (PyCFunction) HyperLogLog_merge, METH_O, "Fold another HyperLogLog of the same precision into this one"},
+    {"estimate", (PyCFunction) HyperLogLog_estimate, METH_NOARGS, "Return the estimated number of distinct values added"},
+    {"to_bytes", (PyCFunction) HyperLogLog_to_bytes, METH_NOARGS, "Return the sketch serialized, for HyperLogLog.from_bytes"},
+    {"from_bytes", (PyCFunction) HyperLogLog_from_bytes, METH_O | METH_CLASS, "Return the HyperLogLog serialized by to_bytes"},
+    {"reset", (PyCFunction) HyperLogLog_reset, METH_NOARGS, "Forget every value added"},
+    {NULL}
+};
+
+/* custom getter/setter methods to control member types */
+static PyObject *
+HyperLogLog_get_precision(HyperLogLog *self, void *closure)
+{
+    Py_INCREF(self->precision);
+    return self->precision;
+}
+
+static int
+HyperLogLog_set_precision(HyperLogLog *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "precision attribute is read-only");
+    return -1;
+}
+
+static PyGetSetDef HyperLogLog_getsetters[] = {
+    {"precision", (getter) HyperLogLog_get_precision, (setter) HyperLogLog_set_precision, "log2 of the number of registers", NULL},
+    {NULL}
+};
+
+/* avoid cyclic references / enable cyclic GC */
+static int
+HyperLogLog_traverse(HyperLogLog *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->precision);
+    return 0;
+}
+
+static int
+HyperLogLog_clear(HyperLogLog *self)
+{
+    Py_CLEAR(self->precision);
+    return 0;
+}
+
+/* deallocation method */
+static void
+HyperLogLog_dealloc(HyperLogLog *self)
+{
+    /* close all C objects */
+    hll_free(&self->_hll);
+
+    /* dealloc with cyclic GC check */
+    PyObject_GC_UnTrack(self);
+    HyperLogLog_clear(self);
+
+    /* deallocate the object itself */
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/*
+HyperLogLog Type construction
+
+.tp_flags:
+    Py_TPFLAGS_DEFAULT = always use
+    Py_TPFLAGS_BASETYPE = allows to be subclassed. do this only if methods don't care about type of object created/used
+    Py_TPFLAGS_HAVE_GC = cyclic GC causes segfault if this isn't set
+*/
+static PyTypeObject HyperLogLogType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.HyperLogLog",
+    .tp_doc = "Mergeable, serializable HyperLogLog distinct value counter",
+    .tp_basicsize = sizeof(HyperLogLog),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_new = HyperLogLog_new,
+    .tp_dealloc = (destructor) HyperLogLog_dealloc,
+    .tp_init = (initproc) HyperLogLog_init,
+    .tp_methods = HyperLogLog_methods, // expose custom methods
+    .tp_traverse = (traverseproc) HyperLogLog_traverse, // cyclic GC enable
+    .tp_clear = (inquiry) HyperLogLog_clear,
+    .tp_getset = HyperLogLog_getsetters, // custom getter/setter methods
+    .tp_as_sequence = &HyperLogLog_as_sequence,
+};
+
+/*
+Distinct source hosts, destination ports and flows, per time window
+
+Packets are dissected in C and their keys hashed into three HyperLogLog
+sketches: the source address; (protocol, destination port) for TCP/UDP/SCTP;
+(source, destination, protocol, ports) for flows. With an interval, the
+sketches start over at every window boundary of packet time and the finished
+windows queue up for windows() to collect; memory stays at three sketches
+plus whatever windows are left uncollected, however big the attack.
+*/
+enum{
+    CARDINALITY_SOURCES,
+    CARDINALITY_PORTS,
+    CARDINALITY_FLOWS,
+    CARDINALITY_SKETCHES,
+};
+
+static const char *cardinality_names[CARDINALITY_SKETCHES] = {"sources", "ports", "flows"};
+
+typedef struct{
+    PyObject_HEAD
+    /* C-style properties*/
+    struct hll _hll[CARDINALITY_SKETCHES];
+    int64_t _interval_ns; // 0 for a single window
+    int64_t _window; // number of the current window
+    uint64_t _packets; // in the current window
+    PyObject *_finished; // list of finished window dicts
+    /* Python properties */
+    PyObject *precision;
+    PyObject *interval;
+} CardinalityTracker;
+
+/* creation method */
+static PyObject *
+CardinalityTracker_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    CardinalityTracker *self;
+    self = (CardinalityTracker *) type->tp_alloc(type,0);
+    return (PyObject *) self;
+}
+
+/* initialization method */
+static int
+CardinalityTracker_init(CardinalityTracker *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"precision", "interval", NULL};
+    int precision = CARDINALITY_PRECISION;
+    PyObject *interval = Py_None, *tmp;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|iO", kwlist, &precision, &interval))
+        return -1;
+
+    if(self->_hll[0].reg != NULL){
+        PyErr_SetString(PyExc_SystemError, "CardinalityTracker is already initialized");
+        return -1;
+    }
+    if(precision < HLL_MIN_PRECISION || precision > HLL_MAX_PRECISION){
+        PyErr_Format(PyExc_ValueError, "precision must be between %d and %d", HLL_MIN_PRECISION, HLL_MAX_PRECISION);
+        return -1;
+    }
+    double seconds = 0.0;
+    if(interval != Py_None){
+        seconds = PyFloat_AsDouble(interval);
+        if(seconds == -1.0 && PyErr_Occurred())
+            return -1;
+        if(!(seconds >= 1e-6) || seconds > 86400.0 * 365){
+            PyErr_SetString(PyExc_ValueError, "interval must be None or between 1e-6 seconds and a year");
+            return -1;
+        }
+    }
+
+    for(int i = 0; i < CARDINALITY_SKETCHES; i++){
+        if(hll_init(&self->_hll[i], precision) != 0){
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+    self->_interval_ns = llround(seconds * 1e9);
+    self->_finished = PyList_New(0);
+    if(self->_finished == NULL)
+        return -1;
+
+    tmp = self->precision;
+    self->precision = PyLong_FromLong(precision);
+    Py_XDECREF(tmp);
+
+    tmp = self->interval;
+    Py_INCREF(interval);
+    self->interval = interval;
+    Py_XDECREF(tmp);
+
+    return 0;
+}
+
+static int
+CardinalityTracker_ready(CardinalityTracker *self)
+{
+    if(self->_hll[0].reg == NULL){
+        PyErr_SetString(PyExc_SystemError, "CardinalityTracker is not initialized");
+        return -1;
+    }
+    return 0;
+}
+
+/* dict of the current window, estimates or sketch copies */
+static PyObject *
+CardinalityTracker_window(CardinalityTracker *self, int sketches)
+{
+    PyObject *d = PyDict_New();
+    if(d == NULL)
+        return NULL;
+    for(int i = 0; i < CARDINALITY_SKETCHES; i++){
+        PyObject *v = sketches ? HyperLogLog_FromHll(&self->_hll[i]) : PyFloat_FromDouble(hll_estimate(&self->_hll[i]));
+        if(v == NULL || PyDict_SetItemString(d, cardinality_names[i], v) != 0){
+            Py_XDECREF(v);
+            Py_DECREF(d);
+            return NULL;
+        }
+        Py_DECREF(v);
+    }
+    PyObject *packets = PyLong_FromUnsignedLongLong(self->_packets);
+    if(packets == NULL || PyDict_SetItemString(d, "packets", packets) != 0){
+        Py_XDECREF(packets);
+        Py_DECREF(d);
+        return NULL;
+    }
+    Py_DECREF(packets);
+    if(self->_interval_ns > 0){
+        PyObject *start = PyFloat_FromDouble((double)(self->_window * self->_interval_ns) / 1e9);
+        PyObject *end = PyFloat_FromDouble((double)((self->_window + 1) * self->_interval_ns) / 1e9);
+        int res = start == NULL || end == NULL || PyDict_SetItemString(d, "start", start) != 0 || PyDict_SetItemString(d, "end", end) != 0;
+        Py_XDECREF(start);
+        Py_XDECREF(end);
+        if(res){
+            Py_DECREF(d);
+            return NULL;
+        }
+    }
+    return d;
+}
+
+/* queue the current window, if it saw anything, and start over; Return 0, or -1 with a python exception set */
+static int
+CardinalityTracker_roll(CardinalityTracker *self)
+{
+    if(self->_packets > 0){
+        PyObject *d = CardinalityTracker_window(self, 1);
+        if(d == NULL || PyList_Append(self->_finished, d) != 0){
+            Py_XDECREF(d);
+            return -1;
+        }
+        Py_DECREF(d);
+    }
+    for(int i = 0; i < CARDINALITY_SKETCHES; i++)
+        hll_reset(&self->_hll[i]);
+    self->_packets = 0;
+    return 0;
+}
+
+/* one dissected packet; Return 0, or -1 with a python exception set */
+static int
+CardinalityTracker_add(CardinalityTracker *self, int64_t ts_ns, const struct pkt_meta *meta)
+{
+    if(self->_interval_ns > 0){
+        int64_t w = ts_ns / self->_interval_ns - (ts_ns % self->_interval_ns < 0);
+        if(self->_packets == 0)
+            self->_window = w;
+        else if(w > self->_window){
+            if(CardinalityTracker_roll(self) != 0)
+                return -1;
+            self->_window = w;
+        }
+        // packets out of order by more than a window are counted in the current one
+    }
+    self->_packets++;
+    if(meta->l3_offset < 0)
+        return 0;
+
+    hll_add_hash(&self->_hll[CARDINALITY_SOURCES], hll_hash(meta->src, meta->addr_len));
+
+    int ports = meta->l4_offset >= 0 && (meta->sport != 0 || meta->dport != 0);
+    if(ports){
+        uint8_t key[3] = {meta->ip_proto, (uint8_t)(meta->dport >> 8), (uint8_t)meta->dport};
+        hll_add_hash(&self->_hll[CARDINALITY_PORTS], hll_hash(key, sizeof(key)));
+    }
+
+    uint8_t flow[38] = {0};
+    flow[0] = meta->addr_len;
+    flow[1] = meta->ip_proto;
+    memcpy(flow + 2, meta->src, meta->addr_len);
+    memcpy(flow + 18, meta->dst, meta->addr_len);
+    if(ports){
+        memcpy(flow + 34, &meta->sport, 2);
+        memcpy(flow + 36, &meta->dport, 2);
+    }
+    hll_add_hash(&self->_hll[CARDINALITY_FLOWS], hll_hash(flow, sizeof(flow)));
+    return 0;
+}
+
+/* count a Packet or the packets of a PacketBatch; Return how many, or -1 with a python exception set */
+static Py_ssize_t
+CardinalityTracker_add_one(CardinalityTracker *self, PyObject *obj)
+{
+    if(PyObject_TypeCheck(obj, &PacketType)){
+        Packet *pkt = (Packet *)obj;
+        return CardinalityTracker_add(self, pkt->ts_ns, Packet_meta(pkt)) == 0 ? 1 : -1;
+    }
+    if(PyObject_TypeCheck(obj, &PacketBatchType)){
+        PacketBatch *batch = (PacketBatch *)obj;
+        struct batch_columns cols;
+        batch_columns_map(batch->columns, batch->capacity, &cols);
+        for(Py_ssize_t i = 0; i < batch->count; i++){
+            struct pkt_meta meta;
+            dissect_packet(batch->linktype, batch->data->data + cols.offset[i], cols.caplen[i], &meta);
+            if(CardinalityTracker_add(self, cols.ts[i], &meta) != 0)
+                return -1;
+        }
+        return batch->count;
+    }
+    PyErr_SetString(PyExc_TypeError, "CardinalityTracker counts Packet and PacketBatch objects");
+    return -1;
+}
+
+/*
+count packets from a PcapReader (read to its end), a Packet, a PacketBatch,
+or an iterable of Packets and PacketBatches; Return the number counted
+*/
+static PyObject *
+CardinalityTracker_update(CardinalityTracker *self, PyObject *source)
+{
+    if(CardinalityTracker_ready(self) != 0)
+        return NULL;
+
+    if(PyObject_TypeCheck(source, &PcapReaderType)){
+        PcapReader *reader = (PcapReader *)source;
+        if(reader->_pcap == NULL){
+            PyErr_SetString(PyExc_SystemError, "Cannot read; pcap reader is already closed.");
+            return NULL;
+        }
+        long long count = 0;
+        struct pcap_pkthdr hdr;
+        const u_char *data;
+        while((data = PcapReader_next(reader, &hdr)) != NULL){
+            struct pkt_meta meta;
+            dissect_packet(reader->_linktype, data, hdr.caplen, &meta);
+            // reader is opened with nanosecond precision, so tv_usec holds nanoseconds
+            if(CardinalityTracker_add(self, (int64_t)hdr.ts.tv_sec * 1000000000LL + hdr.ts.tv_usec, &meta) != 0)
+                return NULL;
+            count++;
+        }
+        return PyLong_FromLongLong(count);
+    }
+
+    if(PyObject_TypeCheck(source, &PacketType) || PyObject_TypeCheck(source, &PacketBatchType)){
+        Py_ssize_t n = CardinalityTracker_add_one(self, source);
+        return n < 0 ? NULL : PyLong_FromSsize_t(n);
+    }
+
+    PyObject *iter = PyObject_GetIter(source);
+    if(iter == NULL)
+        return NULL;
+    long long count = 0;
+    PyObject *item;
+    while((item = PyIter_Next(iter)) != NULL){
+        Py_ssize_t n = CardinalityTracker_add_one(self, item);
+        Py_DECREF(item);
+        if(n < 0){
+            Py_DECREF(iter);
+            return NULL;
+        }
+        count += n;
+    }
+    Py_DECREF(iter);
+    if(PyErr_Occurred())
+        return NULL;
+    return PyLong_FromLongLong(count);
+}
+
+/* estimates of the current window */
+static PyObject *
+CardinalityTracker_estimate(CardinalityTracker *self, PyObject *Py_UNUSED(ignored))
+{
+    if(CardinalityTracker_ready(self) != 0)
+        return NULL;
+    return CardinalityTracker_window(self, 0);
+}
+
+/* copies of the current window's sketches, to serialize or merge */
+static PyObject *
+CardinalityTracker_sketches(CardinalityTracker *self, PyObject *Py_UNUSED(ignored))
+{
+    if(CardinalityTracker_ready(self) != 0)
+        return NULL;
+    return CardinalityTracker_window(self, 1);
+}
+
+/* take the finished windows, oldest first; flush=True finishes the current one too */
+static PyObject *
+CardinalityTracker_windows(CardinalityTracker *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"flush", NULL};
+    int flush = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|p", kwlist, &flush))
+        return NULL;
+    if(CardinalityTracker_ready(self) != 0)
+        return NULL;
+    if(flush && CardinalityTracker_roll(self) != 0)
+        return NULL;
+
+    PyObject *finished = PyList_New(0);
+    if(finished == NULL)
+        return NULL;
+    PyObject *tmp = self->_finished;
+    self->_finished = finished;
+    return tmp;
+}
+
+static PyObject *
+CardinalityTracker_reset(CardinalityTracker *self, PyObject *Py_UNUSED(ignored))
+{
+    if(CardinalityTracker_ready(self) != 0)
+        return NULL;
+    for(int i = 0; i < CARDINALITY_SKETCHES; i++)
+        hll_reset(&self->_hll[i]);
+    self->_packets = 0;
+    if(PyList_SetSlice(self->_finished, 0, PyList_GET_SIZE(self->_finished), NULL) != 0)
+        return NULL;
+    return Py_BuildValue("");
+}
+
+/* expose methods */
+static PyMethodDef CardinalityTracker_methods[] = {
+    {"update", (PyCFunction) CardinalityTracker_update, METH_O, "Count the packets of a PcapReader, Packet, PacketBatch or iterable of them; Return how many"},
+    {"estimate", (PyCFunction) CardinalityTracker_estimate, METH_NOARGS, "Return estimated distinct sources, ports and flows of the current window"},
+    {"sketches", (PyCFunction) CardinalityTracker_sketches, METH_NOARGS, "Return copies of the current window's HyperLogLog sketches"},
+    {"windows", (PyCFunction) CardinalityTracker_windows, METH_VARARGS | METH_KEYWORDS, "Take the finished windows and their sketches, oldest first"},
+    {"reset", (PyCFunction) CardinalityTracker_reset, METH_NOARGS, "Forget the current and finished windows"},
+    {NULL}
+};
+
+/* custom getter/setter methods to control member types */
+static PyObject *
+CardinalityTracker_get_precision(CardinalityTracker *self, void *closure)
+{
+    Py_INCREF(self->precision);
+    return self->precision;
+}
+
+static int
+CardinalityTracker_set_precision(CardinalityTracker *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "precision attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+CardinalityTracker_get_interval(CardinalityTracker *self, void *closure)
+{
+    Py_INCREF(self->interval);
+    return self->interval;
+}
+
+static int
+CardinalityTracker_set_interval(CardinalityTracker *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "interval attribute is read-only");
+    return -1;
+}
+
+static PyGetSetDef CardinalityTracker_getsetters[] = {
+    {"precision", (getter) CardinalityTracker_get_precision, (setter) CardinalityTracker_set_precision, "log2 of the registers per sketch", NULL},
+    {"interval", (getter) CardinalityTracker_get_interval, (setter) CardinalityTracker_set_interval, "window length in seconds, or None", NULL},
+    {NULL}
+};
+
+/* avoid cyclic references / enable cyclic GC */
+static int
+CardinalityTracker_traverse(CardinalityTracker *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->_finished);
+    Py_VISIT(self->precision);
+    Py_VISIT(self->interval);
+    return 0;
+}
+
+static int
+CardinalityTracker_clear(CardinalityTracker *self)
+{
+    Py_CLEAR(self->_finished);
+    Py_CLEAR(self->precision);
+    Py_CLEAR(self->interval);
+    return 0;
+}
+
+/* deallocation method */
+static void
+CardinalityTracker_dealloc(CardinalityTracker *self)
+{
+    /* close all C objects */
+    for(int i = 0; i < CARDINALITY_SKETCHES; i++)
+        hll_free(&self->_hll[i]);
+
+    /* dealloc with cyclic GC check */
+    PyObject_GC_UnTrack(self);
+    CardinalityTracker_clear(self);
+
+    /* deallocate the object itself */
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/*
+CardinalityTracker Type construction
+
+.tp_flags:
+    Py_TPFLAGS_DEFAULT = always use
+    Py_TPFLAGS_BASETYPE = allows to be subclassed. do this only if methods don't care about type of object created/used
+    Py_TPFLAGS_HAVE_GC = cyclic GC causes segfault if this isn't set
+*/
+static PyTypeObject CardinalityTrackerType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.CardinalityTracker",
+    .tp_doc = "HyperLogLog estimates of distinct source hosts, destination ports and flows per time window",
+    .tp_basicsize = sizeof(CardinalityTracker),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_new = CardinalityTracker_new,
+    .tp_dealloc = (destructor) CardinalityTracker_dealloc,
+    .tp_init = (initproc) CardinalityTracker_init,
+    .tp_methods = CardinalityTracker_methods, // expose custom methods
+    .tp_traverse = (traverseproc) CardinalityTracker_traverse, // cyclic GC enable
+    .tp_clear = (inquiry) CardinalityTracker_clear,
+    .tp_getset = CardinalityTracker_getsetters, // custom getter/setter methods
+};
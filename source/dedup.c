@@ -0,0 +1,188 @@
+#include "dedup.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <string.h>
+
+#ifndef PYPCAP_DISSECT
+#include "dissect.h"
+#endif
+
+#ifndef PYPCAP_POOL
+#include "pool.h"
+#endif
+
+#define DEDUP_HEADER_MAX 128 // header bytes copied so their variable fields can be masked
+
+/* xxh64 primes; the hash below is xxh64's structure, four independent lanes the compiler can vectorize */
+#define P1 0x9E3779B185EBCA87ULL
+#define P2 0xC2B2AE3D27D4EB4FULL
+#define P3 0x165667B19E3779F9ULL
+#define P4 0x85EBCA77C2B2AE63ULL
+#define P5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl(uint64_t x, int r){
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t rd64(const unsigned char *p){
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t lane(uint64_t acc, uint64_t in){
+    acc += in * P2;
+    acc = rotl(acc, 31);
+    return acc * P1;
+}
+
+static inline uint64_t merge(uint64_t h, uint64_t acc){
+    h ^= lane(0, acc);
+    return h * P1 + P4;
+}
+
+static uint64_t hash64(const unsigned char *p, size_t len, uint64_t seed){
+    const unsigned char *end = p + len;
+    uint64_t h;
+
+    if(len >= 32){
+        uint64_t v[4] = {seed + P1 + P2, seed + P2, seed, seed - P1};
+        for(; p + 32 <= end; p += 32)
+            for(int i = 0; i < 4; i++)
+                v[i] = lane(v[i], rd64(p + 8 * i));
+        h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+        for(int i = 0; i < 4; i++)
+            h = merge(h, v[i]);
+    } else {
+        h = seed + P5;
+    }
+
+    h += (uint64_t)len;
+    for(; p + 8 <= end; p += 8){
+        h ^= lane(0, rd64(p));
+        h = rotl(h, 27) * P1 + P4;
+    }
+    for(; p < end; p++){
+        h ^= (*p) * P5;
+        h = rotl(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+static void zero(unsigned char *buf, size_t buflen, int off, size_t n){
+    if(off >= 0 && (size_t)off + n <= buflen)
+        memset(buf + off, 0, n);
+}
+
+/*
+Hash of a packet as seen by every tap: from the network header on, with TTL and
+checksums zeroed and the network-layer length mixed in. Never 0
+*/
+uint64_t dedup_hash(int linktype, const unsigned char *data, size_t caplen, uint32_t wirelen){
+    struct pkt_meta meta;
+    size_t start = 0;
+
+    if(dissect_packet(linktype, data, caplen, &meta) == 0)
+        start = (size_t)meta.l3_offset;
+
+    const unsigned char *p = data + start;
+    size_t len = caplen - start;
+    size_t hlen = len < DEDUP_HEADER_MAX ? len : DEDUP_HEADER_MAX;
+    unsigned char hdr[DEDUP_HEADER_MAX];
+    memcpy(hdr, p, hlen);
+
+    if(meta.ip_version == 4){
+        zero(hdr, hlen, 8, 1); // ttl
+        zero(hdr, hlen, 10, 2); // header checksum
+    } else if(meta.ip_version == 6){
+        zero(hdr, hlen, 7, 1); // hop limit
+    }
+    if(meta.l4_offset >= 0){
+        int l4 = meta.l4_offset - (int)start;
+        if(meta.ip_proto == 6)
+            zero(hdr, hlen, l4 + 16, 2);
+        else if(meta.ip_proto == 17)
+            zero(hdr, hlen, l4 + 6, 2);
+    }
+
+    uint64_t h = hash64(hdr, hlen, (uint64_t)(wirelen - start));
+    if(len > hlen)
+        h = hash64(p + hlen, len - hlen, h);
+    return h ? h : 1;
+}
+
+/* capacity is rounded up to a power of two of at least DEDUP_PROBE; Return 0, or -1 if out of memory */
+int dedup_init(struct dedup *d, size_t capacity, int64_t window_ns){
+    memset(d, 0, sizeof(*d));
+    size_t n = DEDUP_PROBE;
+    while(n < capacity)
+        n <<= 1;
+
+    d->table = pool_region_alloc(n * sizeof(struct dedup_entry), -1);
+    if(d->table == NULL)
+        return -1;
+    d->capacity = n;
+    d->window_ns = window_ns;
+    return 0;
+}
+
+void dedup_free(struct dedup *d){
+    pool_region_free(d->table, d->capacity * sizeof(struct dedup_entry));
+    d->table = NULL;
+}
+
+void dedup_reset(struct dedup *d){
+    memset(d->table, 0, d->capacity * sizeof(struct dedup_entry));
+    d->packets = 0;
+    d->duplicates = 0;
+    d->evictions = 0;
+}
+
+static inline int64_t ts_distance(int64_t a, int64_t b){
+    return a > b ? a - b : b - a;
+}
+
+/*
+Return 1 if a packet with this hash was seen within the window of ts_ns,
+otherwise remember it and Return 0
+
+Timestamps may arrive slightly out of order, as they do when merging taps.
+*/
+int dedup_check(struct dedup *d, uint64_t hash, int64_t ts_ns){
+    struct dedup_entry *bucket = &d->table[hash & (d->capacity - 1) & ~(size_t)(DEDUP_PROBE - 1)];
+    struct dedup_entry *victim = NULL;
+    int victim_live = 1;
+
+    d->packets++;
+    for(int i = 0; i < DEDUP_PROBE; i++){
+        struct dedup_entry *e = &bucket[i];
+        if(e->hash == 0){
+            if(victim_live){
+                victim = e;
+                victim_live = 0;
+            }
+            continue;
+        }
+        int live = ts_distance(e->ts_ns, ts_ns) <= d->window_ns;
+        if(live && e->hash == hash){
+            d->duplicates++;
+            return 1;
+        }
+        if(!live && victim_live){
+            victim = e;
+            victim_live = 0;
+        } else if(victim_live && (victim == NULL || e->ts_ns < victim->ts_ns)){
+            victim = e;
+        }
+    }
+
+    d->evictions += victim_live;
+    victim->hash = hash;
+    victim->ts_ns = ts_ns;
+    return 0;
+}
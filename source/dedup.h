@@ -0,0 +1,38 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PYPCAP_DEDUP // header guard
+#define DEDUP_PROBE 8 // entries per bucket, two cache lines
+
+/*
+Duplicate packet detection for captures merged from redundant taps
+
+A packet is reduced to a 64 bit hash of everything from its network header on,
+with the fields that legitimately differ between taps zeroed: TTL / hop limit
+and the IPv4, TCP and UDP checksums. Link-layer headers are skipped because
+taps often disagree on VLAN tags. The hash is checked against a fixed-size
+table of (hash, timestamp) entries; a match within window_ns is a duplicate.
+Buckets evict expired entries first and the oldest entry otherwise, so the
+table never grows and a full table degrades into missed duplicates, not errors.
+*/
+struct dedup_entry{
+    uint64_t hash; // 0 marks an empty entry
+    int64_t ts_ns;
+};
+
+struct dedup{
+    struct dedup_entry *table;
+    size_t capacity; // entries, a power of two
+    int64_t window_ns;
+    uint64_t packets;
+    uint64_t duplicates;
+    uint64_t evictions; // live entries overwritten before their window ran out
+};
+
+int dedup_init(struct dedup *d, size_t capacity, int64_t window_ns);
+void dedup_free(struct dedup *d);
+void dedup_reset(struct dedup *d);
+uint64_t dedup_hash(int linktype, const unsigned char *data, size_t caplen, uint32_t wirelen);
+int dedup_check(struct dedup *d, uint64_t hash, int64_t ts_ns);
@@ -0,0 +1,275 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#include <structmember.h>
+
+#ifndef PYPCAP_DEDUP
+#include "dedup.h"
+#endif
+
+#ifndef PYPCAP_PACKET
+#include "packet.h"
+#endif
+
+#define PYPCAP_DEDUPLICATOR
+#define DEDUPLICATOR_CAPACITY 65536 // default table entries, 1MiB
+
+/*
+Drops packets already seen on another tap within window seconds
+
+Usable on its own over Packet objects (is_duplicate, filter) when merging
+captures, or handed to PcapWriter.write_from_pcap_reader(reader, dedup=...)
+where the check runs in C before each pcap_dump.
+*/
+typedef struct{
+    PyObject_HEAD
+    /* C-style properties*/
+    struct dedup _dedup;
+    /* Python properties */
+    PyObject *window;
+    PyObject *capacity;
+} PcapDeduplicator;
+
+/* creation method */
+static PyObject *
+PcapDeduplicator_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PcapDeduplicator *self;
+    self = (PcapDeduplicator *) type->tp_alloc(type,0);
+    return (PyObject *) self;
+}
+
+/* initialization method */
+static int
+PcapDeduplicator_init(PcapDeduplicator *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"window", "capacity", NULL};
+    double window = 0.001;
+    Py_ssize_t capacity = DEDUPLICATOR_CAPACITY;
+    PyObject *tmp;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|dn", kwlist, &window, &capacity))
+        return -1;
+
+    if(self->_dedup.table != NULL){
+        PyErr_SetString(PyExc_SystemError, "PcapDeduplicator is already initialized");
+        return -1;
+    }
+    if(!(window >= 0.0) || window > 3600.0){
+        PyErr_SetString(PyExc_ValueError, "window must be between 0 and 3600 seconds");
+        return -1;
+    }
+    if(capacity <= 0 || capacity > ((Py_ssize_t)1 << 32)){
+        PyErr_SetString(PyExc_ValueError, "capacity must be between 1 and 2**32 entries");
+        return -1;
+    }
+
+    if(dedup_init(&self->_dedup, (size_t)capacity, (int64_t)(window * 1e9)) != 0){
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    tmp = self->window;
+    self->window = PyFloat_FromDouble(window);
+    Py_XDECREF(tmp);
+
+    tmp = self->capacity;
+    self->capacity = PyLong_FromSize_t(self->_dedup.capacity);
+    Py_XDECREF(tmp);
+
+    return 0;
+}
+
+static int
+PcapDeduplicator_ready(PcapDeduplicator *self)
+{
+    if(self->_dedup.table == NULL){
+        PyErr_SetString(PyExc_SystemError, "PcapDeduplicator is not initialized");
+        return -1;
+    }
+    return 0;
+}
+
+/* check one Packet; Return 1 if duplicate, 0 if not, -1 with a python exception set */
+static int
+PcapDeduplicator_check(PcapDeduplicator *self, PyObject *obj)
+{
+    if(!PyObject_TypeCheck(obj, &PacketType)){
+        PyErr_SetString(PyExc_TypeError, "PcapDeduplicator expects Packet objects");
+        return -1;
+    }
+    Packet *pkt = (Packet *)obj;
+    const unsigned char *data = pkt->buf->data + pkt->offset;
+    uint64_t h = dedup_hash(pkt->linktype, data, pkt->caplen, pkt->wirelen);
+    return dedup_check(&self->_dedup, h, pkt->ts_ns);
+}
+
+/* True if packet was already seen within the window */
+static PyObject *
+PcapDeduplicator_is_duplicate(PcapDeduplicator *self, PyObject *packet)
+{
+    if(PcapDeduplicator_ready(self) != 0)
+        return NULL;
+    int dup = PcapDeduplicator_check(self, packet);
+    if(dup < 0)
+        return NULL;
+    return PyBool_FromLong(dup);
+}
+
+/* list of the packets of an iterable that are not duplicates, in order */
+static PyObject *
+PcapDeduplicator_filter(PcapDeduplicator *self, PyObject *packets)
+{
+    if(PcapDeduplicator_ready(self) != 0)
+        return NULL;
+
+    PyObject *iter = PyObject_GetIter(packets);
+    if(iter == NULL)
+        return NULL;
+    PyObject *unique = PyList_New(0);
+    if(unique == NULL){
+        Py_DECREF(iter);
+        return NULL;
+    }
+
+    PyObject *pkt;
+    while((pkt = PyIter_Next(iter)) != NULL){
+        int dup = PcapDeduplicator_check(self, pkt);
+        if(dup < 0 || (dup == 0 && PyList_Append(unique, pkt) != 0)){
+            Py_DECREF(pkt);
+            Py_DECREF(iter);
+            Py_DECREF(unique);
+            return NULL;
+        }
+        Py_DECREF(pkt);
+    }
+    Py_DECREF(iter);
+
+    if(PyErr_Occurred()){
+        Py_DECREF(unique);
+        return NULL;
+    }
+    return unique;
+}
+
+/* forget every packet seen so far */
+static PyObject *
+PcapDeduplicator_reset(PcapDeduplicator *self, PyObject *Py_UNUSED(ignored))
+{
+    if(PcapDeduplicator_ready(self) != 0)
+        return NULL;
+    dedup_reset(&self->_dedup);
+    return Py_BuildValue("");
+}
+
+/* packets checked, duplicates dropped and table pressure */
+static PyObject *
+PcapDeduplicator_stats(PcapDeduplicator *self, PyObject *Py_UNUSED(ignored))
+{
+    const struct dedup *d = &self->_dedup;
+    return Py_BuildValue(
+        "{s:K, s:K, s:K, s:K}",
+        "packets", (unsigned long long)d->packets,
+        "duplicates", (unsigned long long)d->duplicates,
+        "unique", (unsigned long long)(d->packets - d->duplicates),
+        "evictions", (unsigned long long)d->evictions
+    );
+}
+
+/* expose methods */
+static PyMethodDef PcapDeduplicator_methods[] = {
+    {"is_duplicate", (PyCFunction) PcapDeduplicator_is_duplicate, METH_O, "Return True if the Packet was already seen within the window, remembering it otherwise"},
+    {"filter", (PyCFunction) PcapDeduplicator_filter, METH_O, "Return the Packets of an iterable that are not duplicates"},
+    {"reset", (PyCFunction) PcapDeduplicator_reset, METH_NOARGS, "Forget every packet seen so far"},
+    {"stats", (PyCFunction) PcapDeduplicator_stats, METH_NOARGS, "Return packets checked, duplicates found and live entries evicted early"},
+    {NULL}
+};
+
+/* custom getter/setter methods to control member types */
+static PyObject *
+PcapDeduplicator_get_window(PcapDeduplicator *self, void *closure)
+{
+    Py_INCREF(self->window);
+    return self->window;
+}
+
+static int
+PcapDeduplicator_set_window(PcapDeduplicator *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "window attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapDeduplicator_get_capacity(PcapDeduplicator *self, void *closure)
+{
+    Py_INCREF(self->capacity);
+    return self->capacity;
+}
+
+static int
+PcapDeduplicator_set_capacity(PcapDeduplicator *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "capacity attribute is read-only");
+    return -1;
+}
+
+static PyGetSetDef PcapDeduplicator_getsetters[] = {
+    {"window", (getter) PcapDeduplicator_get_window, (setter) PcapDeduplicator_set_window, "window", NULL},
+    {"capacity", (getter) PcapDeduplicator_get_capacity, (setter) PcapDeduplicator_set_capacity, "capacity", NULL},
+    {NULL}
+};
+
+/* avoid cyclic references / enable cyclic GC */
+static int
+PcapDeduplicator_traverse(PcapDeduplicator *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->window);
+    Py_VISIT(self->capacity);
+    return 0;
+}
+
+static int
+PcapDeduplicator_clear(PcapDeduplicator *self)
+{
+    Py_CLEAR(self->window);
+    Py_CLEAR(self->capacity);
+    return 0;
+}
+
+/* deallocation method */
+static void
+PcapDeduplicator_dealloc(PcapDeduplicator *self)
+{
+    /* close all C objects */
+    dedup_free(&self->_dedup);
+
+    /* dealloc with cyclic GC check */
+    PyObject_GC_UnTrack(self);
+    PcapDeduplicator_clear(self);
+
+    /* deallocate the object itself */
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/*
+PcapDeduplicator Type construction
+
+.tp_flags:
+    Py_TPFLAGS_DEFAULT = always use
+    Py_TPFLAGS_BASETYPE = allows to be subclassed. do this only if methods don't care about type of object created/used
+    Py_TPFLAGS_HAVE_GC = cyclic GC causes segfault if this isn't set
+*/
+static PyTypeObject PcapDeduplicatorType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.PcapDeduplicator",
+    .tp_doc = "Time-windowed duplicate packet filter for captures merged from several taps",
+    .tp_basicsize = sizeof(PcapDeduplicator),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_new = PcapDeduplicator_new,
+    .tp_dealloc = (destructor) PcapDeduplicator_dealloc,
+    .tp_init = (initproc) PcapDeduplicator_init,
+    .tp_methods = PcapDeduplicator_methods, // expose custom methods
+    .tp_traverse = (traverseproc) PcapDeduplicator_traverse, // cyclic GC enable
+    .tp_clear = (inquiry) PcapDeduplicator_clear,
+    .tp_getset = PcapDeduplicator_getsetters, // custom getter/setter methods
+};
@@ -0,0 +1,527 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#include <structmember.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#ifndef PYPCAP_UTIL
+#include "util.h"
+#endif
+
+#ifndef PYPCAP_NETDEV
+#include "netdev.h"
+#endif
+
+#define PYPCAP_DEVMONITOR
+
+/*
+Cached view of the network interfaces, updated from rtnetlink
+
+devices() returns the same read-only mapping for as long as nothing changes,
+so polling it is cheap. poll() waits for changes and hands each one to the
+callables registered with subscribe(); fileno() can be given to select or
+an asyncio loop to learn when to call poll() instead of polling at all.
+*/
+typedef struct{
+    PyObject_HEAD
+    /* C-style properties*/
+    struct netdev_registry _registry;
+    uint64_t _snapshot_generation;
+    int _polling; // poll() is passing events to subscribers
+    /* Python properties */
+    PyObject *snapshot;
+    PyObject *subscribers;
+} DeviceMonitor;
+
+/* creation method */
+static PyObject *
+DeviceMonitor_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    DeviceMonitor *self;
+    self = (DeviceMonitor *) type->tp_alloc(type,0);
+    if(self != NULL)
+        self->_registry.fd = -1;
+    return (PyObject *) self;
+}
+
+/* initialization method */
+static int
+DeviceMonitor_init(DeviceMonitor *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {NULL};
+    PyObject *tmp;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "", kwlist))
+        return -1;
+
+    if(self->_registry.fd >= 0){
+        PyErr_SetString(PyExc_SystemError, "DeviceMonitor is already initialized");
+        return -1;
+    }
+    if(netdev_open(&self->_registry) != 0){
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+
+    tmp = self->subscribers;
+    self->subscribers = PyList_New(0);
+    Py_XDECREF(tmp);
+    if(self->subscribers == NULL)
+        return -1;
+
+    return 0;
+}
+
+static int
+DeviceMonitor_ready(DeviceMonitor *self)
+{
+    if(self->_registry.fd < 0){
+        PyErr_SetString(PyExc_SystemError, "DeviceMonitor is closed");
+        return -1;
+    }
+    return 0;
+}
+
+/* flags as pcap_findalldevs reports them */
+static bpf_u_int32
+DeviceMonitor_pcap_flags(unsigned int flags)
+{
+    bpf_u_int32 pflags = 0;
+    if(flags & IFF_LOOPBACK)
+        pflags |= PCAP_IF_LOOPBACK;
+    if(flags & IFF_UP)
+        pflags |= PCAP_IF_UP;
+    if(flags & IFF_RUNNING)
+        pflags |= PCAP_IF_RUNNING;
+    return pflags;
+}
+
+static PyObject *
+DeviceMonitor_flag_tuple(bpf_u_int32 pflags)
+{
+    struct pflags pf = pcap_flags(pflags);
+    PyObject *flags = PyTuple_New(pf.size);
+    if(flags == NULL)
+        return NULL;
+    for(Py_ssize_t i=0; i<pf.size; i++){
+        PyObject *f = PyUnicode_FromString(pf.flags[i]);
+        if(f == NULL){
+            Py_DECREF(flags);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(flags, i, f);
+    }
+    return flags;
+}
+
+/* numeric string of an address of family, formatted as find_all_devs formats them */
+static PyObject *
+DeviceMonitor_addr_string(int family, const unsigned char *bytes, int index)
+{
+    struct sockaddr_storage ss;
+    memset(&ss, 0, sizeof(ss));
+    if(family == AF_INET){
+        struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+        sin->sin_family = AF_INET;
+        memcpy(&sin->sin_addr, bytes, 4);
+    } else {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+        sin6->sin6_family = AF_INET6;
+        memcpy(&sin6->sin6_addr, bytes, 16);
+        if(IN6_IS_ADDR_LINKLOCAL(&sin6->sin6_addr))
+            sin6->sin6_scope_id = (uint32_t)index;
+    }
+    char host[NI_MAXHOST];
+    if(sockaddr_addr((struct sockaddr *)&ss, host) != 0)
+        Py_RETURN_NONE;
+    return PyUnicode_FromString(host);
+}
+
+/* read-only {"af", "addr", "netmask"[, "broadaddr"]} of one address */
+static PyObject *
+DeviceMonitor_addr(const struct netdev_addr *a, int index)
+{
+    unsigned char mask[16] = {0};
+    for(int bit = 0; bit < a->prefixlen && bit < 128; bit++)
+        mask[bit / 8] |= 0x80 >> (bit % 8);
+
+    PyObject *d = Py_BuildValue(
+        "{s:s, s:N, s:N}",
+        "af", af_to_string(a->family),
+        "addr", DeviceMonitor_addr_string(a->family, a->addr, index),
+        "netmask", DeviceMonitor_addr_string(a->family, mask, 0)
+    );
+    if(d == NULL)
+        return NULL;
+    if(a->has_broadcast){
+        PyObject *brd = DeviceMonitor_addr_string(a->family, a->broadcast, 0);
+        if(brd == NULL || PyDict_SetItemString(d, "broadaddr", brd) != 0){
+            Py_XDECREF(brd);
+            Py_DECREF(d);
+            return NULL;
+        }
+        Py_DECREF(brd);
+    }
+    PyObject *proxy = PyDictProxy_New(d);
+    Py_DECREF(d);
+    return proxy;
+}
+
+/* read-only dict of one interface, with the keys find_all_devs uses plus its index */
+static PyObject *
+DeviceMonitor_device(const struct netdev *dev)
+{
+    PyObject *addrs = PyTuple_New(dev->naddrs);
+    if(addrs == NULL)
+        return NULL;
+    for(int i = 0; i < dev->naddrs; i++){
+        PyObject *a = DeviceMonitor_addr(&dev->addrs[i], dev->index);
+        if(a == NULL){
+            Py_DECREF(addrs);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(addrs, i, a);
+    }
+
+    bpf_u_int32 pflags = DeviceMonitor_pcap_flags(dev->flags);
+    PyObject *d = Py_BuildValue(
+        "{s:s, s:i, s:O, s:I, s:N, s:N}",
+        "name", dev->name,
+        "index", dev->index,
+        "description", Py_None,
+        "flags_int", (unsigned int)pflags,
+        "flags", DeviceMonitor_flag_tuple(pflags),
+        "addresses", addrs
+    );
+    if(d == NULL)
+        return NULL;
+    PyObject *proxy = PyDictProxy_New(d);
+    Py_DECREF(d);
+    return proxy;
+}
+
+/* rebuild the snapshot if the registry changed since it was built */
+static int
+DeviceMonitor_refresh(DeviceMonitor *self)
+{
+    struct netdev_registry *r = &self->_registry;
+    if(netdev_update(r) != 0){
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    if(self->snapshot != NULL && self->_snapshot_generation == r->generation)
+        return 0;
+
+    PyObject *devs = PyDict_New();
+    if(devs == NULL)
+        return -1;
+    for(int i = 0; i < r->ndevs; i++){
+        PyObject *dev = DeviceMonitor_device(&r->devs[i]);
+        if(dev == NULL || PyDict_SetItemString(devs, r->devs[i].name, dev) != 0){
+            Py_XDECREF(dev);
+            Py_DECREF(devs);
+            return -1;
+        }
+        Py_DECREF(dev);
+    }
+    PyObject *snapshot = PyDictProxy_New(devs);
+    Py_DECREF(devs);
+    if(snapshot == NULL)
+        return -1;
+
+    Py_XSETREF(self->snapshot, snapshot);
+    self->_snapshot_generation = r->generation;
+    return 0;
+}
+
+/* current interfaces; the same object until one of them changes */
+static PyObject *
+DeviceMonitor_devices(DeviceMonitor *self, PyObject *Py_UNUSED(ignored))
+{
+    if(DeviceMonitor_ready(self) != 0 || DeviceMonitor_refresh(self) != 0)
+        return NULL;
+    Py_INCREF(self->snapshot);
+    return self->snapshot;
+}
+
+static PyObject *
+DeviceMonitor_event(const struct netdev_event *e)
+{
+    bpf_u_int32 pflags = DeviceMonitor_pcap_flags(e->flags);
+    PyObject *d = Py_BuildValue(
+        "{s:s, s:s, s:i, s:N, s:O}",
+        "event", netdev_event_names[e->type],
+        "name", e->name,
+        "index", e->index,
+        "flags", DeviceMonitor_flag_tuple(pflags),
+        "up", (e->flags & (IFF_UP | IFF_RUNNING)) == (IFF_UP | IFF_RUNNING) ? Py_True : Py_False
+    );
+    if(d == NULL)
+        return NULL;
+
+    PyObject *extra = NULL;
+    const char *key = NULL;
+    if(e->type == NETDEV_RENAMED){
+        key = "old_name";
+        extra = PyUnicode_FromString(e->old_name);
+    } else if(e->type == NETDEV_ADDR_ADDED || e->type == NETDEV_ADDR_REMOVED){
+        key = "address";
+        extra = DeviceMonitor_addr(&e->addr, e->index);
+    } else {
+        return d;
+    }
+    if(extra == NULL || PyDict_SetItemString(d, key, extra) != 0){
+        Py_XDECREF(extra);
+        Py_DECREF(d);
+        return NULL;
+    }
+    Py_DECREF(extra);
+    return d;
+}
+
+/*
+wait up to timeout seconds (None: until something changes) and Return the
+list of changes, after passing each one to every subscriber; if a subscriber
+raises, the change it was given and those after it come again from the next poll()
+*/
+static PyObject *
+DeviceMonitor_poll(DeviceMonitor *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"timeout", NULL};
+    PyObject *timeout = NULL;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &timeout))
+        return NULL;
+    if(DeviceMonitor_ready(self) != 0)
+        return NULL;
+    if(self->_polling){
+        PyErr_SetString(PyExc_RuntimeError, "poll() called from a subscriber of the same DeviceMonitor");
+        return NULL;
+    }
+
+    int timeout_ms = 0;
+    if(timeout == Py_None){
+        timeout_ms = -1;
+    } else if(timeout != NULL){
+        double t = PyFloat_AsDouble(timeout);
+        if(t == -1.0 && PyErr_Occurred())
+            return NULL;
+        if(!(t >= 0.0) || t > INT_MAX / 1000){
+            PyErr_SetString(PyExc_ValueError, "timeout must be None or between 0 and 2147483 seconds");
+            return NULL;
+        }
+        timeout_ms = (int)(t * 1000);
+    }
+
+    struct netdev_registry *r = &self->_registry;
+    if(r->nevents == 0 && timeout_ms != 0){
+        int ready;
+        Py_BEGIN_ALLOW_THREADS
+        ready = netdev_wait(r, timeout_ms);
+        Py_END_ALLOW_THREADS
+        if(ready < 0 && errno != EINTR)
+            return PyErr_SetFromErrno(PyExc_OSError);
+        if(PyErr_CheckSignals() != 0)
+            return NULL;
+    }
+    if(DeviceMonitor_refresh(self) != 0)
+        return NULL;
+
+    PyObject *events = PyList_New(r->nevents);
+    if(events == NULL)
+        return NULL;
+    for(int i = 0; i < r->nevents; i++){
+        PyObject *e = DeviceMonitor_event(&r->events[i]);
+        if(e == NULL){
+            Py_DECREF(events);
+            return NULL;
+        }
+        PyList_SET_ITEM(events, i, e);
+    }
+
+    // a copy, so callbacks may subscribe or unsubscribe
+    PyObject *subscribers = PyList_GetSlice(self->subscribers, 0, PyList_GET_SIZE(self->subscribers));
+    if(subscribers == NULL){
+        Py_DECREF(events);
+        return NULL;
+    }
+    // an event stays pending until every subscriber has taken it, so when a
+    // callback raises, the next poll() starts over from that event
+    int delivered = 0, failed = 0;
+    self->_polling = 1;
+    for(Py_ssize_t i = 0; i < PyList_GET_SIZE(events) && !failed; i++){
+        for(Py_ssize_t j = 0; j < PyList_GET_SIZE(subscribers) && !failed; j++){
+            PyObject *res = PyObject_CallOneArg(PyList_GET_ITEM(subscribers, j), PyList_GET_ITEM(events, i));
+            failed = res == NULL;
+            Py_XDECREF(res);
+        }
+        delivered += !failed;
+    }
+    self->_polling = 0;
+    Py_DECREF(subscribers);
+
+    // callbacks may have found more changes, which come after these, or closed the monitor
+    if(delivered > r->nevents)
+        delivered = r->nevents;
+    if(r->events != NULL){
+        memmove(r->events, r->events + delivered, (size_t)(r->nevents - delivered) * sizeof(*r->events));
+        r->nevents -= delivered;
+    }
+    if(failed){
+        Py_DECREF(events);
+        return NULL;
+    }
+    return events;
+}
+
+/* call callback(event) for every change found by poll() */
+static PyObject *
+DeviceMonitor_subscribe(DeviceMonitor *self, PyObject *callback)
+{
+    if(!PyCallable_Check(callback)){
+        PyErr_SetString(PyExc_TypeError, "subscribe requires a callable");
+        return NULL;
+    }
+    if(DeviceMonitor_ready(self) != 0 || PyList_Append(self->subscribers, callback) != 0)
+        return NULL;
+    return Py_BuildValue("");
+}
+
+static PyObject *
+DeviceMonitor_unsubscribe(DeviceMonitor *self, PyObject *callback)
+{
+    if(DeviceMonitor_ready(self) != 0)
+        return NULL;
+    // equality, not identity: each obj.method access makes a new bound method
+    for(Py_ssize_t i = 0; i < PyList_GET_SIZE(self->subscribers); i++){
+        int eq = PyObject_RichCompareBool(PyList_GET_ITEM(self->subscribers, i), callback, Py_EQ);
+        if(eq < 0)
+            return NULL;
+        if(eq)
+            return PyList_SetSlice(self->subscribers, i, i + 1, NULL) == 0 ? Py_BuildValue("") : NULL;
+    }
+    PyErr_SetString(PyExc_ValueError, "callback is not subscribed");
+    return NULL;
+}
+
+/* netlink socket, readable when poll() has changes to report */
+static PyObject *
+DeviceMonitor_fileno(DeviceMonitor *self, PyObject *Py_UNUSED(ignored))
+{
+    if(DeviceMonitor_ready(self) != 0)
+        return NULL;
+    return PyLong_FromLong(self->_registry.fd);
+}
+
+static PyObject *
+DeviceMonitor_stats(DeviceMonitor *self, PyObject *Py_UNUSED(ignored))
+{
+    const struct netdev_registry *r = &self->_registry;
+    return Py_BuildValue(
+        "{s:i, s:K, s:K, s:K, s:K, s:i}",
+        "devices", r->ndevs,
+        "generation", (unsigned long long)r->generation,
+        "messages", (unsigned long long)r->messages,
+        "resyncs", (unsigned long long)r->resyncs,
+        "events_dropped", (unsigned long long)r->events_dropped,
+        "events_pending", r->nevents
+    );
+}
+
+/* close method */
+static PyObject *
+DeviceMonitor_close(DeviceMonitor *self, PyObject *Py_UNUSED(ignored))
+{
+    if(self->_registry.fd >= 0)
+        netdev_close(&self->_registry);
+    return Py_BuildValue("");
+}
+
+/* expose methods */
+static PyMethodDef DeviceMonitor_methods[] = {
+    {"devices", (PyCFunction) DeviceMonitor_devices, METH_NOARGS, "Read-only mapping of interface name to details, the same object while nothing changes"},
+    {"poll", (PyCFunction) DeviceMonitor_poll, METH_VARARGS | METH_KEYWORDS, "Wait up to timeout seconds for interface changes, pass them to subscribers and return them"},
+    {"subscribe", (PyCFunction) DeviceMonitor_subscribe, METH_O, "Call callback(event) for every change poll() finds"},
+    {"unsubscribe", (PyCFunction) DeviceMonitor_unsubscribe, METH_O, "Stop calling a subscribed callback"},
+    {"fileno", (PyCFunction) DeviceMonitor_fileno, METH_NOARGS, "File descriptor that becomes readable when there are changes to poll()"},
+    {"stats", (PyCFunction) DeviceMonitor_stats, METH_NOARGS, "Return netlink messages handled, resyncs after overruns and queued events"},
+    {"close", (PyCFunction) DeviceMonitor_close, METH_NOARGS, "Close the netlink socket"},
+    {NULL}
+};
+
+/* custom getter/setter methods to control member types */
+static PyObject *
+DeviceMonitor_get_closed(DeviceMonitor *self, void *closure)
+{
+    return PyBool_FromLong(self->_registry.fd < 0);
+}
+
+static int
+DeviceMonitor_set_closed(DeviceMonitor *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "closed attribute is read-only");
+    return -1;
+}
+
+static PyGetSetDef DeviceMonitor_getsetters[] = {
+    {"closed", (getter) DeviceMonitor_get_closed, (setter) DeviceMonitor_set_closed, "closed", NULL},
+    {NULL}
+};
+
+/* avoid cyclic references / enable cyclic GC */
+static int
+DeviceMonitor_traverse(DeviceMonitor *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->snapshot);
+    Py_VISIT(self->subscribers);
+    return 0;
+}
+
+static int
+DeviceMonitor_clear(DeviceMonitor *self)
+{
+    Py_CLEAR(self->snapshot);
+    Py_CLEAR(self->subscribers);
+    return 0;
+}
+
+/* deallocation method */
+static void
+DeviceMonitor_dealloc(DeviceMonitor *self)
+{
+    /* close all C objects */
+    if(self->_registry.fd >= 0)
+        netdev_close(&self->_registry);
+
+    /* dealloc with cyclic GC check */
+    PyObject_GC_UnTrack(self);
+    DeviceMonitor_clear(self);
+
+    /* deallocate the object itself */
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/*
+DeviceMonitor Type construction
+
+.tp_flags:
+    Py_TPFLAGS_DEFAULT = always use
+    Py_TPFLAGS_BASETYPE = allows to be subclassed. do this only if methods don't care about type of object created/used
+    Py_TPFLAGS_HAVE_GC = cyclic GC causes segfault if this isn't set
+*/
+static PyTypeObject DeviceMonitorType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.DeviceMonitor",
+    .tp_doc = "Network interfaces cached from rtnetlink, with change notifications",
+    .tp_basicsize = sizeof(DeviceMonitor),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_new = DeviceMonitor_new,
+    .tp_dealloc = (destructor) DeviceMonitor_dealloc,
+    .tp_init = (initproc) DeviceMonitor_init,
+    .tp_methods = DeviceMonitor_methods, // expose custom methods
+    .tp_traverse = (traverseproc) DeviceMonitor_traverse, // cyclic GC enable
+    .tp_clear = (inquiry) DeviceMonitor_clear,
+    .tp_getset = DeviceMonitor_getsetters, // custom getter/setter methods
+};
@@ -0,0 +1,212 @@
+#include <arpa/inet.h>
+#include <string.h>
+
+#ifndef PYPCAP_DISSECT
+#include "dissect.h"
+#endif
+
+#define IPPROTO_NUM_ICMP 1
+#define IPPROTO_NUM_TCP 6
+#define IPPROTO_NUM_UDP 17
+#define IPPROTO_NUM_ICMPV6 58
+#define IPPROTO_NUM_SCTP 132
+
+static uint16_t rd16(const unsigned char *p){
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+/* parse the L4 header at off, filling ports and the payload offset */
+static void dissect_l4(const unsigned char *data, size_t caplen, size_t off, struct pkt_meta *meta){
+    size_t hlen;
+
+    switch(meta->ip_proto){
+    case IPPROTO_NUM_TCP:
+        if(off + 20 > caplen)
+            return;
+        hlen = (size_t)(data[off + 12] >> 4) * 4;
+        if(hlen < 20)
+            return;
+        meta->sport = rd16(data + off);
+        meta->dport = rd16(data + off + 2);
+        meta->tcp_flags = data[off + 13];
+        break;
+    case IPPROTO_NUM_UDP:
+        if(off + 8 > caplen)
+            return;
+        hlen = 8;
+        meta->sport = rd16(data + off);
+        meta->dport = rd16(data + off + 2);
+        break;
+    case IPPROTO_NUM_SCTP:
+        if(off + 12 > caplen)
+            return;
+        hlen = 12;
+        meta->sport = rd16(data + off);
+        meta->dport = rd16(data + off + 2);
+        break;
+    case IPPROTO_NUM_ICMP:
+    case IPPROTO_NUM_ICMPV6:
+        if(off + 8 > caplen)
+            return;
+        hlen = 8;
+        break;
+    default:
+        return;
+    }
+
+    meta->l4_offset = (int)off;
+    if(off + hlen <= caplen)
+        meta->payload_offset = (int)(off + hlen);
+}
+
+static void dissect_ipv4(const unsigned char *data, size_t caplen, size_t off, struct pkt_meta *meta){
+    if(off + 20 > caplen || (data[off] >> 4) != 4)
+        return;
+    size_t ihl = (size_t)(data[off] & 0x0f) * 4;
+    if(ihl < 20 || off + ihl > caplen)
+        return;
+
+    meta->l3_offset = (int)off;
+    meta->ip_version = 4;
+    meta->ttl = data[off + 8];
+    meta->ip_proto = data[off + 9];
+    meta->addr_len = 4;
+    memcpy(meta->src, data + off + 12, 4);
+    memcpy(meta->dst, data + off + 16, 4);
+
+    // only the first fragment carries the L4 header
+    if((rd16(data + off + 6) & 0x1fff) != 0)
+        return;
+
+    dissect_l4(data, caplen, off + ihl, meta);
+}
+
+static void dissect_ipv6(const unsigned char *data, size_t caplen, size_t off, struct pkt_meta *meta){
+    if(off + 40 > caplen || (data[off] >> 4) != 6)
+        return;
+
+    meta->l3_offset = (int)off;
+    meta->ip_version = 6;
+    meta->ttl = data[off + 7];
+    meta->addr_len = 16;
+    memcpy(meta->src, data + off + 8, 16);
+    memcpy(meta->dst, data + off + 24, 16);
+
+    uint8_t next = data[off + 6];
+    size_t pos = off + 40;
+
+    // walk extension headers, bounded so a crafted chain can't loop forever
+    for(int i = 0; i < 8; i++){
+        if(next == 0 || next == 43 || next == 60){ // hop-by-hop, routing, destination options
+            if(pos + 8 > caplen)
+                return;
+            next = data[pos];
+            pos += ((size_t)data[pos + 1] + 1) * 8;
+        } else if(next == 44){ // fragment
+            if(pos + 8 > caplen)
+                return;
+            if((rd16(data + pos + 2) & 0xfff8) != 0)
+                return;
+            next = data[pos];
+            pos += 8;
+        } else if(next == 51){ // authentication header
+            if(pos + 8 > caplen)
+                return;
+            next = data[pos];
+            pos += ((size_t)data[pos + 1] + 2) * 4;
+        } else {
+            break;
+        }
+    }
+
+    meta->ip_proto = next;
+    dissect_l4(data, caplen, pos, meta);
+}
+
+static void dissect_l3(uint16_t ethertype, const unsigned char *data, size_t caplen, size_t off, struct pkt_meta *meta){
+    meta->ethertype = ethertype;
+    if(ethertype == ETHERTYPE_IPV4)
+        dissect_ipv4(data, caplen, off, meta);
+    else if(ethertype == ETHERTYPE_IPV6)
+        dissect_ipv6(data, caplen, off, meta);
+}
+
+/* link types that carry a bare IP packet, told apart by the version nibble */
+static void dissect_raw_ip(const unsigned char *data, size_t caplen, size_t off, struct pkt_meta *meta){
+    if(off >= caplen)
+        return;
+    if((data[off] >> 4) == 4)
+        dissect_l3(ETHERTYPE_IPV4, data, caplen, off, meta);
+    else if((data[off] >> 4) == 6)
+        dissect_l3(ETHERTYPE_IPV6, data, caplen, off, meta);
+}
+
+/*
+Fill meta with the headers found in a captured packet
+
+Never reads past caplen. Return 0 if an IP header was found, -1 otherwise
+*/
+int dissect_packet(int linktype, const unsigned char *data, size_t caplen, struct pkt_meta *meta){
+    memset(meta, 0, sizeof(*meta));
+    meta->l3_offset = -1;
+    meta->l4_offset = -1;
+    meta->payload_offset = -1;
+
+    switch(linktype){
+    case LINKTYPE_ETHERNET: {
+        if(caplen < 14)
+            break;
+        size_t off = 12;
+        uint16_t ethertype = rd16(data + off);
+        // 802.1Q / 802.1ad tags, at most two
+        for(int i = 0; i < 2 && (ethertype == 0x8100 || ethertype == 0x88a8); i++){
+            if(off + 6 > caplen)
+                return -1;
+            if(meta->vlan == 0)
+                meta->vlan = rd16(data + off + 2) & 0x0fff;
+            off += 4;
+            ethertype = rd16(data + off);
+        }
+        dissect_l3(ethertype, data, caplen, off + 2, meta);
+        break;
+    }
+    case LINKTYPE_LINUX_SLL:
+        if(caplen < 16)
+            break;
+        dissect_l3(rd16(data + 14), data, caplen, 16, meta);
+        break;
+    case LINKTYPE_LINUX_SLL2:
+        if(caplen < 20)
+            break;
+        dissect_l3(rd16(data), data, caplen, 20, meta);
+        break;
+    case LINKTYPE_NULL:
+    case LINKTYPE_LOOP:
+        dissect_raw_ip(data, caplen, 4, meta);
+        break;
+    case LINKTYPE_RAW:
+    case LINKTYPE_IPV4:
+    case LINKTYPE_IPV6:
+    case 12: // DLT_RAW as some writers store it
+    case 14:
+        dissect_raw_ip(data, caplen, 0, meta);
+        break;
+    default:
+        break;
+    }
+
+    return meta->l3_offset >= 0 ? 0 : -1;
+}
+
+/*
+Format addr (meta->src or meta->dst) as a numeric address string
+
+Return 0 on success, -1 if the packet had no IP header
+*/
+int dissect_addr_string(const struct pkt_meta *meta, const uint8_t *addr, char *out, size_t outlen){
+    if(meta->addr_len == 4)
+        return inet_ntop(AF_INET, addr, out, (socklen_t)outlen) ? 0 : -1;
+    if(meta->addr_len == 16)
+        return inet_ntop(AF_INET6, addr, out, (socklen_t)outlen) ? 0 : -1;
+    return -1;
+}
@@ -0,0 +1,43 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#define PYPCAP_DISSECT // header guard
+
+/* link types as stored in pcap file headers, see https://www.tcpdump.org/linktypes.html */
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LOOP 108
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_IPV6 229
+#define LINKTYPE_LINUX_SLL2 276
+
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_IPV6 0x86dd
+
+/*
+Offsets and fields of one packet's L2-L4 headers
+
+Offsets are -1 when the layer is absent or truncated. IPv4 addresses occupy the
+first 4 bytes of src/dst, with addr_len telling them apart from IPv6.
+*/
+struct pkt_meta{
+    uint16_t ethertype;
+    uint16_t vlan;
+    int l3_offset;
+    int l4_offset;
+    int payload_offset;
+    uint8_t ip_version;
+    uint8_t ip_proto;
+    uint8_t ttl;
+    uint8_t addr_len;
+    uint8_t src[16];
+    uint8_t dst[16];
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t tcp_flags;
+};
+
+int dissect_packet(int linktype, const unsigned char *data, size_t caplen, struct pkt_meta *meta);
+int dissect_addr_string(const struct pkt_meta *meta, const uint8_t *addr, char *out, size_t outlen);
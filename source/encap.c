@@ -0,0 +1,123 @@
+#include "encap.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <string.h>
+
+#ifndef PYPCAP_DISSECT
+#include "dissect.h"
+#endif
+
+static const struct{
+    const char *name;
+    int linktype;
+} linktype_names[] = {
+    {"null", LINKTYPE_NULL},
+    {"ethernet", LINKTYPE_ETHERNET},
+    {"raw", LINKTYPE_RAW},
+    {"loop", LINKTYPE_LOOP},
+    {"linux_sll", LINKTYPE_LINUX_SLL},
+    {"ipv4", LINKTYPE_IPV4},
+    {"ipv6", LINKTYPE_IPV6},
+    {"linux_sll2", LINKTYPE_LINUX_SLL2},
+};
+
+/*
+Link type from a LINKTYPE_ number or one of the names above
+
+Return 0 on success, -1 with a python exception set
+*/
+int encap_parse_linktype(PyObject *obj, int *linktype){
+    if(PyUnicode_Check(obj)){
+        const char *s = PyUnicode_AsUTF8(obj);
+        if(s == NULL)
+            return -1;
+        for(size_t i = 0; i < sizeof(linktype_names) / sizeof(linktype_names[0]); i++){
+            if(strcmp(s, linktype_names[i].name) == 0){
+                *linktype = linktype_names[i].linktype;
+                return 0;
+            }
+        }
+        PyErr_Format(PyExc_ValueError, "Unknown link type %s", s);
+        return -1;
+    }
+    long v = PyLong_AsLong(obj);
+    if(v == -1 && PyErr_Occurred()){
+        PyErr_SetString(PyExc_TypeError, "linktype must be a LINKTYPE_ number or a name such as 'ethernet' or 'linux_sll'");
+        return -1;
+    }
+    if(v < 0 || v > 65535){
+        PyErr_SetString(PyExc_ValueError, "linktype must be between 0 and 65535");
+        return -1;
+    }
+    *linktype = (int)v;
+    return 0;
+}
+
+static int is_source(int linktype){
+    switch(linktype){
+    case LINKTYPE_NULL:
+    case LINKTYPE_ETHERNET:
+    case LINKTYPE_RAW:
+    case LINKTYPE_LOOP:
+    case LINKTYPE_LINUX_SLL:
+    case LINKTYPE_IPV4:
+    case LINKTYPE_IPV6:
+    case LINKTYPE_LINUX_SLL2:
+    case 12: // DLT_RAW as some writers store it
+    case 14:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Return 1 if packets of from can be written as to, by encap_convert or as they are */
+int encap_supported(int from, int to){
+    if(from == to)
+        return 1;
+    if(!is_source(from))
+        return 0;
+    return to == LINKTYPE_ETHERNET || to == LINKTYPE_LINUX_SLL || to == LINKTYPE_RAW
+        || to == LINKTYPE_IPV4 || to == LINKTYPE_IPV6;
+}
+
+static void wr16(uint8_t *p, uint16_t v){
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+/*
+The packet of link type from in data, as link type to: prefix (prefix_len
+bytes, at most ENCAP_MAX_PREFIX) followed by data from skip on
+
+Return 0, or -1 if the packet can't be converted
+*/
+int encap_convert(int from, int to, const unsigned char *data, uint32_t caplen, uint8_t *prefix, size_t *prefix_len, size_t *skip){
+    struct pkt_meta meta;
+    if(dissect_packet(from, data, caplen, &meta) != 0)
+        return -1;
+    uint16_t ethertype = meta.ip_version == 4 ? ETHERTYPE_IPV4 : ETHERTYPE_IPV6;
+
+    *skip = (size_t)meta.l3_offset;
+    switch(to){
+    case LINKTYPE_ETHERNET:
+        memset(prefix, 0, 12);
+        wr16(prefix + 12, ethertype);
+        *prefix_len = 14;
+        return 0;
+    case LINKTYPE_LINUX_SLL:
+        memset(prefix, 0, 14); // packet type 0 (to us), no link address
+        wr16(prefix + 2, 0xffff); // ARPHRD_VOID, the link type is unknown
+        wr16(prefix + 14, ethertype);
+        *prefix_len = 16;
+        return 0;
+    case LINKTYPE_RAW:
+        *prefix_len = 0;
+        return 0;
+    case LINKTYPE_IPV4:
+    case LINKTYPE_IPV6:
+        *prefix_len = 0;
+        return meta.ip_version == (to == LINKTYPE_IPV4 ? 4 : 6) ? 0 : -1;
+    default:
+        return -1;
+    }
+}
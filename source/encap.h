@@ -0,0 +1,23 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PYPCAP_ENCAP // header guard
+#define ENCAP_MAX_PREFIX 16 // longest link header encap_convert makes, Linux cooked
+
+/*
+Rewriting packets from one link type to another
+
+Only the link header changes: it is cut off up to the IP header, and the
+target's own is put in front, so a packet is written as a new prefix plus
+the tail of the original and never copied. Targets are Ethernet (zero MAC
+addresses), Linux cooked (SLL, as an incoming packet without a link address),
+raw IP and the IPv4/IPv6-only raw types; sources are whatever dissect_packet
+finds an IP header in. Packets without one, and packets of the wrong version
+for an IPv4 or IPv6 target, can't be converted.
+*/
+
+int encap_parse_linktype(PyObject *obj, int *linktype);
+int encap_supported(int from, int to);
+int encap_convert(int from, int to, const unsigned char *data, uint32_t caplen, uint8_t *prefix, size_t *prefix_len, size_t *skip);
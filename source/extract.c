@@ -0,0 +1,297 @@
+#include "extract.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define EXTRACT_MAX_CAPLEN 262144 // libpcap's limit; a bigger record means a corrupt file
+#define MAGIC_USEC 0xa1b2c3d4
+#define MAGIC_NSEC 0xa1b23c4d
+
+/* on-disk record header of a classic pcap file */
+struct rec_hdr{
+    uint32_t sec;
+    uint32_t frac;
+    uint32_t caplen;
+    uint32_t len;
+};
+
+/*
+Nanoseconds per timestamp unit of the classic pcap file in: 1000 or 1, with
+*swapped set if its byte order isn't the host's. Return 0 for anything else
+(pcapng, pipes), which the caller reads through libpcap instead. The read
+position of in is left alone
+*/
+int extract_file_format(FILE *in, int *swapped){
+    off_t pos = ftello(in);
+    if(pos < 0)
+        return 0;
+    uint32_t hdr[6];
+    int usec_ns = 0;
+    if(fseeko(in, 0, SEEK_SET) == 0 && fread(hdr, sizeof(hdr), 1, in) == 1){
+        *swapped = hdr[0] == __builtin_bswap32(MAGIC_USEC) || hdr[0] == __builtin_bswap32(MAGIC_NSEC);
+        uint32_t magic = *swapped ? __builtin_bswap32(hdr[0]) : hdr[0];
+        if(magic == MAGIC_USEC)
+            usec_ns = 1000;
+        else if(magic == MAGIC_NSEC)
+            usec_ns = 1;
+    }
+    if(fseeko(in, pos, SEEK_SET) != 0)
+        return 0;
+    return usec_ns;
+}
+
+/* extract_file_format of files whose records can be copied as they are into a nanosecond file in host byte order */
+static int bulk_format(FILE *in){
+    int swapped;
+    int usec_ns = extract_file_format(in, &swapped);
+    return swapped ? 0 : usec_ns;
+}
+
+/*
+Seconds since the epoch as the first nanosecond at or after them, unset for None
+
+A double can't hold every nanosecond of a current timestamp, so the bound is
+placed where Packet.timestamp (ns / 1e9) crosses it: passing a packet's
+timestamp as start includes that packet. Return 0, or -1 with a python exception set
+*/
+int extract_parse_time(PyObject *obj, int64_t unset, int64_t *ns){
+    if(obj == NULL || obj == Py_None){
+        *ns = unset;
+        return 0;
+    }
+    double t = PyFloat_AsDouble(obj);
+    if(t == -1.0 && PyErr_Occurred())
+        return -1;
+    if(!isfinite(t) || fabs(t) > 9e9){
+        PyErr_SetString(PyExc_ValueError, "start and end must be seconds since the epoch");
+        return -1;
+    }
+    double sec = floor(t);
+    int64_t n = (int64_t)sec * 1000000000LL + llround((t - sec) * 1e9);
+    while((double)(n - 1) / 1e9 >= t)
+        n--;
+    while((double)n / 1e9 < t)
+        n++;
+    *ns = n;
+    return 0;
+}
+
+static int write_all(FILE *out, const void *p, size_t n){
+    return n == 0 || fwrite(p, n, 1, out) == 1 ? 0 : -1;
+}
+
+/*
+Write one kept packet, with hdr->ts.tv_usec in nanoseconds, to out as a
+record of x->out_linktype with x->out_usec_ns timestamp units
+
+Return 1 if written, 0 if it had to be left out because it can't be converted
+(counted in x->unconverted), or -1 with errno set if writing failed
+*/
+int extract_write(struct extract *x, FILE *out, const struct pcap_pkthdr *hdr, const u_char *data){
+    uint8_t prefix[ENCAP_MAX_PREFIX];
+    size_t prefix_len = 0, skip = 0;
+    if(x->out_linktype != x->linktype
+        && encap_convert(x->linktype, x->out_linktype, data, hdr->caplen, prefix, &prefix_len, &skip) != 0){
+        x->unconverted++;
+        return 0;
+    }
+
+    // the wire length changes by as much as the link header did
+    uint32_t len = hdr->len >= skip ? hdr->len - (uint32_t)skip : hdr->caplen - (uint32_t)skip;
+    // snaplen is the output file's, so it applies to the record with its new link header
+    size_t keep = prefix_len, caplen = hdr->caplen - skip;
+    if(x->snaplen > 0 && keep + caplen > x->snaplen){
+        if(keep > x->snaplen)
+            keep = x->snaplen;
+        caplen = x->snaplen - keep;
+    }
+    struct rec_hdr rec = {
+        (uint32_t)hdr->ts.tv_sec,
+        (uint32_t)(hdr->ts.tv_usec / x->out_usec_ns),
+        (uint32_t)(keep + caplen),
+        len + (uint32_t)prefix_len,
+    };
+    if(write_all(out, &rec, sizeof(rec)) != 0 || write_all(out, prefix, keep) != 0
+        || write_all(out, data + skip, caplen) != 0)
+        return -1;
+    return 1;
+}
+
+/*
+Copy the rest of in to out by pcap record, without a libpcap call per packet
+
+Records are read in EXTRACT_BULK blocks and runs of kept, unmodified records
+written back with one fwrite; the others go through extract_write. Return the number of packets written, -2 if in
+is not a file extract_bulk can read (nothing is consumed then), or -1 with
+errno set if reading or writing failed. On return in is positioned at the first record
+not consumed, so the reader can carry on from there.
+*/
+long extract_bulk(struct extract *x, FILE *in, FILE *out){
+    int usec_ns = bulk_format(in);
+    if(usec_ns == 0)
+        return -2;
+    int verbatim = usec_ns == x->out_usec_ns && x->linktype == x->out_linktype;
+    off_t pos = ftello(in);
+
+    unsigned char *buf = malloc(EXTRACT_BULK);
+    if(buf == NULL)
+        return -1;
+
+    long written = 0;
+    size_t have = 0; // bytes in buf
+    int stop = 0, eof = 0;
+
+    while(!stop && !eof){
+        size_t n = fread(buf + have, 1, EXTRACT_BULK - have, in);
+        if(n < EXTRACT_BULK - have){
+            if(ferror(in))
+                goto error;
+            eof = 1;
+        }
+        have += n;
+
+        size_t off = 0, run = 0; // run: start of the pending span of kept records
+        while(off + sizeof(struct rec_hdr) <= have){
+            struct rec_hdr rec;
+            memcpy(&rec, buf + off, sizeof(rec));
+            if(rec.caplen > EXTRACT_MAX_CAPLEN){
+                stop = 1; // corrupt, end the copy as pcap_next would
+                break;
+            }
+            size_t size = sizeof(rec) + rec.caplen;
+            if(off + size > have)
+                break;
+
+            const u_char *data = buf + off + sizeof(rec);
+            struct pcap_pkthdr hdr;
+            hdr.ts.tv_sec = rec.sec;
+            hdr.ts.tv_usec = (suseconds_t)rec.frac * usec_ns;
+            hdr.caplen = rec.caplen;
+            hdr.len = rec.len;
+
+            enum extract_verdict v = extract_packet(x, &hdr, data);
+            if(v == EXTRACT_KEEP && verbatim && hdr.caplen == rec.caplen){
+                off += size;
+                written++;
+                continue;
+            }
+
+            // anything but a verbatim copy ends the pending run
+            if(write_all(out, buf + run, off - run) != 0)
+                goto error;
+            if(v == EXTRACT_STOP){
+                x->index--; // not consumed
+                stop = 1;
+                run = off;
+                break;
+            }
+            if(v == EXTRACT_KEEP){
+                int w = extract_write(x, out, &hdr, data);
+                if(w < 0)
+                    goto error;
+                written += w;
+            }
+            off += size;
+            run = off;
+        }
+        if(write_all(out, buf + run, off - run) != 0)
+            goto error;
+
+        pos += off;
+        memmove(buf, buf + off, have - off);
+        have -= off;
+    }
+
+    free(buf);
+    // the reader reads on from the first record not consumed; a truncated tail is left for it to report
+    fseeko(in, pos, SEEK_SET);
+    return written;
+
+error:
+    free(buf);
+    return -1;
+}
+
+/*
+Read the record headers of up to max more packets of in, without their data
+
+Headers are picked out of EXTRACT_BULK blocks; a record running past the end
+of a block has the rest of its data seeked over instead of read, so files of
+large packets cost little more than their headers. Return the number of
+packets read, -2 if in is not a file extract_headers can read (nothing is
+consumed then), or -1 with errno set. On return in is positioned at the first
+record not consumed, as after extract_bulk.
+*/
+long extract_headers(FILE *in, int64_t *ts, uint32_t *caplen, uint32_t *wirelen, size_t max){
+    int swapped = 0;
+    int usec_ns = extract_file_format(in, &swapped);
+    struct stat st;
+    if(usec_ns == 0 || fstat(fileno(in), &st) != 0 || !S_ISREG(st.st_mode))
+        return -2;
+    off_t pos = ftello(in);
+
+    unsigned char *buf = malloc(EXTRACT_BULK);
+    if(buf == NULL)
+        return -1;
+
+    size_t count = 0, have = 0;
+    int eof = 0;
+    while(count < max && !eof){
+        size_t n = fread(buf + have, 1, EXTRACT_BULK - have, in);
+        if(n < EXTRACT_BULK - have){
+            if(ferror(in)){
+                free(buf);
+                return -1;
+            }
+            eof = 1;
+        }
+        have += n;
+
+        size_t off = 0;
+        while(count < max && off + sizeof(struct rec_hdr) <= have){
+            struct rec_hdr rec;
+            memcpy(&rec, buf + off, sizeof(rec));
+            if(swapped){
+                rec.sec = __builtin_bswap32(rec.sec);
+                rec.frac = __builtin_bswap32(rec.frac);
+                rec.caplen = __builtin_bswap32(rec.caplen);
+                rec.len = __builtin_bswap32(rec.len);
+            }
+            if(rec.caplen > EXTRACT_MAX_CAPLEN){
+                eof = 1; // corrupt, stop here and leave it to the reader to report
+                break;
+            }
+            size_t size = sizeof(rec) + rec.caplen;
+            if(off + size > have){
+                if(eof || pos + (off_t)(off + size) > st.st_size){
+                    eof = 1; // truncated tail, also the reader's to report
+                    break;
+                }
+                // data runs past the block: skip the rest of it, header is already taken
+                if(fseeko(in, (off_t)(off + size - have), SEEK_CUR) != 0){
+                    free(buf);
+                    return -1;
+                }
+                have = off + size;
+            }
+            ts[count] = (int64_t)rec.sec * 1000000000LL + (int64_t)rec.frac * usec_ns;
+            caplen[count] = rec.caplen;
+            wirelen[count] = rec.len;
+            count++;
+            off += size;
+        }
+
+        pos += off;
+        if(off < have)
+            memmove(buf, buf + off, have - off);
+        have -= off;
+    }
+
+    free(buf);
+    fseeko(in, pos, SEEK_SET);
+    return (long)count;
+}
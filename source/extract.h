@@ -0,0 +1,94 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pcap.h>
+
+#ifndef PYPCAP_DEDUP
+#include "dedup.h"
+#endif
+
+#ifndef PYPCAP_TRUNCATE
+#include "truncate.h"
+#endif
+
+#ifndef PYPCAP_BLOOM
+#include "bloom.h"
+#endif
+
+#ifndef PYPCAP_ENCAP
+#include "encap.h"
+#endif
+
+#define PYPCAP_EXTRACT // header guard
+#define EXTRACT_BULK 1048576 // bytes read per block by the bulk copy path
+
+/*
+Selection of the packets copied from a reader to a writer
+
+Packets are numbered from 0 in the order the reader returns them. A packet is
+kept when its number is in [first, last) and its timestamp in [start_ns, end_ns),
+it matches the BPF filter and dedup hasn't seen it; kept packets are cut to
+snaplen (by extract_write, after a link header conversion) and then to what the truncator keeps, and go into the bloom index if
+there is one. They are written as out_linktype packets with out_usec_ns
+nanoseconds per timestamp unit, see extract_write. Input is assumed to be in time
+order, as capture files are written, so the first packet at or past end_ns or
+last ends the copy instead of the whole file being read.
+*/
+enum extract_verdict{
+    EXTRACT_SKIP,
+    EXTRACT_KEEP,
+    EXTRACT_STOP,
+};
+
+struct extract{
+    int64_t start_ns;
+    int64_t end_ns;
+    uint64_t first;
+    uint64_t last;
+    struct bpf_program filter;
+    int has_filter;
+    uint32_t snaplen; // 0 keeps whole packets
+    int linktype;
+    int out_linktype;
+    int out_usec_ns; // 1 for a nanosecond output file, 1000 for microseconds
+    uint64_t unconverted; // kept packets that couldn't be written as out_linktype
+    struct dedup *dedup; // optional
+    struct truncator *truncator;
+    struct bloom *bloom; // optional
+    uint64_t index; // number of the next packet
+};
+
+int extract_parse_time(PyObject *obj, int64_t unset, int64_t *ns);
+int extract_file_format(FILE *in, int *swapped);
+int extract_write(struct extract *x, FILE *out, const struct pcap_pkthdr *hdr, const u_char *data);
+long extract_bulk(struct extract *x, FILE *in, FILE *out);
+long extract_headers(FILE *in, int64_t *ts, uint32_t *caplen, uint32_t *wirelen, size_t max);
+
+/*
+Decide on one packet, with hdr->ts.tv_usec in nanoseconds; hdr->caplen is
+shortened in place when a kept packet is cut
+*/
+static inline enum extract_verdict
+extract_packet(struct extract *x, struct pcap_pkthdr *hdr, const u_char *data)
+{
+    uint64_t index = x->index++;
+    if(index >= x->last)
+        return EXTRACT_STOP;
+    int64_t ts = (int64_t)hdr->ts.tv_sec * 1000000000LL + hdr->ts.tv_usec;
+    if(ts >= x->end_ns)
+        return EXTRACT_STOP;
+    if(index < x->first || ts < x->start_ns)
+        return EXTRACT_SKIP;
+    if(x->has_filter && pcap_offline_filter(&x->filter, hdr, data) == 0)
+        return EXTRACT_SKIP;
+    if(x->dedup != NULL && dedup_check(x->dedup, dedup_hash(x->linktype, data, hdr->caplen, hdr->len), ts))
+        return EXTRACT_SKIP;
+    // a converted packet's link header changes size, extract_write cuts it to snaplen instead
+    if(x->snaplen > 0 && hdr->caplen > x->snaplen && x->linktype == x->out_linktype)
+        hdr->caplen = x->snaplen;
+    truncator_apply(x->truncator, hdr, data);
+    if(x->bloom != NULL)
+        bloom_add_packet(x->bloom, data, hdr->caplen);
+    return EXTRACT_KEEP;
+}
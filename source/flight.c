@@ -0,0 +1,153 @@
+#include "flight.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <string.h>
+#include <sys/mman.h>
+
+#ifndef PYPCAP_POOL
+#include "pool.h"
+#endif
+
+#define FLIGHT_ALIGN 8
+
+static size_t rec_bytes(uint32_t caplen){
+    return (sizeof(struct flight_rec) + caplen + FLIGHT_ALIGN - 1) & ~(size_t)(FLIGHT_ALIGN - 1);
+}
+
+static uint64_t rec_ns(const struct flight_ring *r, const struct flight_rec *rec){
+    return (uint64_t)rec->sec * 1000000000ULL + (uint64_t)rec->usec * r->usec_ns;
+}
+
+/*
+Record at pos, or NULL if pos is in the padding at the end of the region;
+in that case *skip is the number of bytes to the front
+*/
+static const struct flight_rec *rec_at(const struct flight_ring *r, uint64_t pos, size_t *skip){
+    size_t off = pos % r->size;
+    size_t room = r->size - off;
+    if(room < sizeof(struct flight_rec)){
+        *skip = room;
+        return NULL;
+    }
+    const struct flight_rec *rec = (const struct flight_rec *)(r->mem + off);
+    if(rec->caplen == FLIGHT_PAD){
+        *skip = room;
+        return NULL;
+    }
+    *skip = rec_bytes(rec->caplen);
+    return rec;
+}
+
+/* drop the oldest record, and any padding in front of it */
+static void evict_oldest(struct flight_ring *r){
+    size_t skip;
+    while(rec_at(r, r->head, &skip) == NULL)
+        r->head += skip;
+    r->head += skip;
+    r->packets--;
+    r->evicted++;
+    if(r->packets == 0)
+        r->head = r->tail;
+}
+
+/*
+Map, lock and fault in size bytes for r
+
+Locking can fail under RLIMIT_MEMLOCK; the ring still works but may be swapped.
+Return 0 on success, -1 if the memory could not be mapped
+*/
+int flight_ring_init(struct flight_ring *r, size_t size, double max_age_seconds, int usec_ns, int numa_node){
+    memset(r, 0, sizeof(*r));
+    size = (size + FLIGHT_ALIGN - 1) & ~(size_t)(FLIGHT_ALIGN - 1);
+
+    r->mem = pool_region_alloc(size, numa_node);
+    if(r->mem == NULL)
+        return -1;
+    r->size = size;
+    r->usec_ns = usec_ns;
+    r->max_age_ns = max_age_seconds > 0 ? (uint64_t)(max_age_seconds * 1e9) : 0;
+    r->locked = mlock(r->mem, size) == 0;
+    memset(r->mem, 0, size); // fault every page in now rather than mid-capture
+    return 0;
+}
+
+void flight_ring_free(struct flight_ring *r){
+    if(r->mem == NULL)
+        return;
+    if(r->locked)
+        munlock(r->mem, r->size);
+    pool_region_free(r->mem, r->size);
+    r->mem = NULL;
+}
+
+/* append one packet, evicting whatever is too old or in the way */
+void flight_ring_push(struct flight_ring *r, const struct pcap_pkthdr *hdr, const u_char *data){
+    size_t need = rec_bytes(hdr->caplen);
+    if(need > r->size){
+        r->oversized++;
+        return;
+    }
+
+    struct flight_rec rec = {hdr->ts.tv_sec, (uint32_t)hdr->ts.tv_usec, hdr->caplen, hdr->len, 0};
+
+    if(r->max_age_ns > 0){
+        uint64_t now = rec_ns(r, &rec);
+        size_t skip;
+        const struct flight_rec *old;
+        while(r->packets > 0){
+            while((old = rec_at(r, r->head, &skip)) == NULL)
+                r->head += skip;
+            if(now < r->max_age_ns || rec_ns(r, old) >= now - r->max_age_ns)
+                break;
+            evict_oldest(r);
+        }
+    }
+
+    // records never straddle the end of the region
+    size_t off = r->tail % r->size;
+    size_t pad = (r->size - off < need) ? r->size - off : 0;
+    while(r->packets > 0 && r->size - (r->tail - r->head) < pad + need)
+        evict_oldest(r);
+    if(r->packets == 0){
+        // empty: restart at the front so the whole region is usable
+        r->head = r->tail = r->tail + (r->size - off) % r->size;
+        pad = 0;
+    }
+
+    if(pad > 0){
+        if(pad >= sizeof(struct flight_rec))
+            ((struct flight_rec *)(r->mem + off))->caplen = FLIGHT_PAD;
+        r->tail += pad;
+    }
+
+    unsigned char *dst = r->mem + r->tail % r->size;
+    memcpy(dst, &rec, sizeof(rec));
+    memcpy(dst + sizeof(rec), data, hdr->caplen);
+    r->tail += need;
+    r->packets++;
+}
+
+/* write every record in the ring, oldest first, also into bloom if not NULL; Return the number written */
+long flight_ring_dump(const struct flight_ring *r, pcap_dumper_t *dumper, struct bloom *bloom){
+    long n = 0;
+    uint64_t pos = r->head;
+    size_t skip;
+
+    for(uint64_t i = 0; i < r->packets; i++){
+        const struct flight_rec *rec;
+        while((rec = rec_at(r, pos, &skip)) == NULL)
+            pos += skip;
+
+        struct pcap_pkthdr hdr;
+        hdr.ts.tv_sec = rec->sec;
+        hdr.ts.tv_usec = rec->usec;
+        hdr.caplen = rec->caplen;
+        hdr.len = rec->len;
+        pcap_dump((u_char *)dumper, &hdr, (const u_char *)(rec + 1));
+        if(bloom != NULL)
+            bloom_add_packet(bloom, (const u_char *)(rec + 1), rec->caplen);
+
+        pos += skip;
+        n++;
+    }
+    return n;
+}
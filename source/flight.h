@@ -0,0 +1,48 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pcap.h>
+
+#ifndef PYPCAP_BLOOM
+#include "bloom.h"
+#endif
+
+#define PYPCAP_FLIGHT // header guard
+
+/*
+Flight recorder ring: the most recent packets, oldest overwritten first
+
+One preallocated, locked region holds whole records (header + captured bytes)
+back to back; a record that would straddle the end of the region starts over
+at the front instead. Positions only ever grow, so head/tail modulo size
+give the physical offsets and tail - head is the number of bytes in use.
+Records older than max_age_ns (if set) are dropped as new ones arrive.
+*/
+struct flight_rec{
+    int64_t sec;
+    uint32_t usec;
+    uint32_t caplen; // FLIGHT_PAD marks the unused end of the region
+    uint32_t len;
+    uint32_t pad;
+};
+
+#define FLIGHT_PAD UINT32_MAX
+
+struct flight_ring{
+    unsigned char *mem;
+    size_t size;
+    uint64_t head; // position of the oldest record
+    uint64_t tail; // position the next record goes to
+    uint64_t packets; // records between head and tail
+    uint64_t max_age_ns; // 0 keeps records until their space is needed
+    int usec_ns; // nanoseconds per pcap_pkthdr ts.tv_usec unit
+    int locked; // mlock succeeded, the ring can't be swapped out
+    uint64_t evicted;
+    uint64_t oversized; // packets bigger than the whole ring, never stored
+};
+
+int flight_ring_init(struct flight_ring *r, size_t size, double max_age_seconds, int usec_ns, int numa_node);
+void flight_ring_free(struct flight_ring *r);
+void flight_ring_push(struct flight_ring *r, const struct pcap_pkthdr *hdr, const u_char *data);
+long flight_ring_dump(const struct flight_ring *r, pcap_dumper_t *dumper, struct bloom *bloom);
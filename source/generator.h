@@ -0,0 +1,486 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#include <structmember.h>
+
+#ifndef PYPCAP_UTIL
+#include "util.h"
+#endif
+
+#ifndef PYPCAP_INJECT
+#include "inject.h"
+#endif
+
+#ifndef PYPCAP_POOL
+#include "pool.h"
+#endif
+
+#define PYPCAP_GENERATOR
+#define GENERATOR_MAX_SIZES 64
+#define GENERATOR_MAX_FRAMES 4096
+#define GENERATOR_SLICE_NS 50000000ULL // how long run() goes without the GIL between signal checks
+#define GENERATOR_SPIN_NS 20000ULL
+
+/*
+Synthetic traffic source for capture benchmarks
+
+Frames are built once into a preallocated region when run() first opens
+the socket, then sent in sendmmsg batches: nothing is allocated or
+written per packet while running.
+*/
+typedef struct{
+    PyObject_HEAD
+    /* C-style properties*/
+    char *_interface_name;
+    unsigned int _sizes[GENERATOR_MAX_SIZES];
+    int _nsizes;
+    long _rate_pps;
+    int _flows;
+    int _batch_size;
+    struct inject _inject;
+    int _opened;
+    unsigned char *_frames;
+    size_t _frames_bytes;
+    size_t _frame_stride;
+    int _nframes;
+    int _next;
+    /* Python properties */
+    PyObject *interface_name;
+    PyObject *sizes;
+    PyObject *rate_pps;
+    PyObject *flows;
+    PyObject *batch_size;
+} PcapGenerator;
+
+/* creation method */
+static PyObject *
+PcapGenerator_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PcapGenerator *self;
+    self = (PcapGenerator *) type->tp_alloc(type,0);
+    if(self != NULL)
+        self->_inject.fd = -1;
+    return (PyObject *) self;
+}
+
+/* initialization method */
+static int
+PcapGenerator_init(PcapGenerator *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"interface_name", "sizes", "rate_pps", "flows", "batch_size", NULL};
+    PyObject *interface_name = NULL, *sizes = NULL, *tmp;
+    long rate_pps = 0;
+    int flows = 1, batch_size = 64;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|Olii", kwlist, &interface_name, &sizes, &rate_pps, &flows, &batch_size))
+        return -1;
+
+    if(self->_opened){
+        PyErr_SetString(PyExc_SystemError, "PcapGenerator is already initialized");
+        return -1;
+    }
+    if(rate_pps < 0){
+        PyErr_SetString(PyExc_ValueError, "rate_pps must be >= 0, 0 for as fast as possible");
+        return -1;
+    }
+    if(flows <= 0 || batch_size <= 0 || batch_size > 1024){
+        PyErr_SetString(PyExc_ValueError, "flows must be > 0 and batch_size between 1 and 1024");
+        return -1;
+    }
+
+    // frame size mix, cycled in order
+    self->_nsizes = 0;
+    if(sizes == NULL || sizes == Py_None){
+        self->_sizes[self->_nsizes++] = 64;
+    } else {
+        PyObject *seq = PySequence_Fast(sizes, "sizes must be a sequence of frame sizes");
+        if(seq == NULL)
+            return -1;
+        Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+        if(n == 0 || n > GENERATOR_MAX_SIZES){
+            Py_DECREF(seq);
+            PyErr_Format(PyExc_ValueError, "sizes must hold between 1 and %d frame sizes", GENERATOR_MAX_SIZES);
+            return -1;
+        }
+        for(Py_ssize_t i = 0; i < n; i++){
+            long size = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+            if(size == -1 && PyErr_Occurred()){
+                Py_DECREF(seq);
+                return -1;
+            }
+            if(size < 60 || size > 65535){
+                Py_DECREF(seq);
+                PyErr_Format(PyExc_ValueError, "frame size %ld is not between 60 and 65535", size);
+                return -1;
+            }
+            self->_sizes[self->_nsizes++] = (unsigned int)size;
+        }
+        Py_DECREF(seq);
+    }
+
+    char *iface_name = PyUnicode_ToString(interface_name);
+    if(iface_name == NULL){
+        PyErr_SetString(PyExc_ValueError, "Could not convert interface_name into C string");
+        return -1;
+    }
+    self->_interface_name = iface_name;
+    self->_rate_pps = rate_pps;
+    self->_flows = flows;
+    self->_batch_size = batch_size;
+
+    PyObject *py_sizes = PyTuple_New(self->_nsizes);
+    if(py_sizes == NULL)
+        return -1;
+    for(int i = 0; i < self->_nsizes; i++)
+        PyTuple_SET_ITEM(py_sizes, i, PyLong_FromUnsignedLong(self->_sizes[i]));
+
+    // set pyobject attributes
+    tmp = self->interface_name;
+    Py_INCREF(interface_name);
+    self->interface_name = interface_name;
+    Py_XDECREF(tmp);
+
+    tmp = self->sizes;
+    self->sizes = py_sizes;
+    Py_XDECREF(tmp);
+
+    tmp = self->rate_pps;
+    self->rate_pps = PyLong_FromLong(rate_pps);
+    Py_XDECREF(tmp);
+
+    tmp = self->flows;
+    self->flows = PyLong_FromLong(flows);
+    Py_XDECREF(tmp);
+
+    tmp = self->batch_size;
+    self->batch_size = PyLong_FromLong(batch_size);
+    Py_XDECREF(tmp);
+
+    return 0;
+}
+
+/* open the raw socket and build every frame up front */
+static int
+PcapGenerator_open(PcapGenerator *self)
+{
+    if(self->_opened)
+        return 0;
+
+    char errbuf[INJECT_ERRBUF_SIZE];
+    if(inject_open(&self->_inject, self->_interface_name, self->_batch_size, errbuf) != 0){
+        PyErr_SetString(PyExc_OSError, errbuf);
+        return -1;
+    }
+
+    unsigned int largest = 0;
+    for(int i = 0; i < self->_nsizes; i++)
+        if(self->_sizes[i] > largest)
+            largest = self->_sizes[i];
+
+    // enough frames that every size meets every flow once, up to a cap
+    int nframes = self->_nsizes * self->_flows;
+    if(nframes < self->_batch_size)
+        nframes = self->_batch_size;
+    if(nframes > GENERATOR_MAX_FRAMES)
+        nframes = GENERATOR_MAX_FRAMES;
+
+    self->_frame_stride = (largest + 63) & ~(size_t)63;
+    self->_frames_bytes = self->_frame_stride * nframes;
+    self->_frames = pool_region_alloc(self->_frames_bytes, -1);
+    if(self->_frames == NULL){
+        inject_close(&self->_inject);
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->_nframes = nframes;
+
+    for(int i = 0; i < nframes; i++){
+        unsigned char *frame = self->_frames + (size_t)i * self->_frame_stride;
+        inject_build_udp(frame, self->_sizes[i % self->_nsizes], i % self->_flows, i);
+    }
+    self->_opened = 1;
+    return 0;
+}
+
+/*
+send up to count frames, or until deadline_ns, paced at rate_pps when set
+
+Called without the GIL. Returns frames sent, or -1 with errno set.
+*/
+static long
+PcapGenerator_send(PcapGenerator *self, long count, uint64_t start_ns, uint64_t sent_before, uint64_t deadline_ns)
+{
+    long sent = 0;
+    while(count < 0 || sent < count){
+        uint64_t now = inject_now_ns();
+        if(now >= deadline_ns)
+            break;
+
+        unsigned int n = self->_batch_size;
+        if(count >= 0 && count - sent < (long)n)
+            n = (unsigned int)(count - sent);
+
+        if(self->_rate_pps > 0){
+            uint64_t due = start_ns + (uint64_t)((unsigned __int128)(sent_before + sent) * 1000000000ULL / self->_rate_pps);
+            if(due >= deadline_ns)
+                break;
+            inject_wait_until(due, GENERATOR_SPIN_NS);
+            // don't send ahead of the schedule by more than what's already due
+            uint64_t behind = (uint64_t)((unsigned __int128)(inject_now_ns() - start_ns) * self->_rate_pps / 1000000000ULL) + 1;
+            if(behind > sent_before + sent && behind - (sent_before + sent) < n)
+                n = (unsigned int)(behind - (sent_before + sent));
+        }
+
+        for(unsigned int i = 0; i < n; i++){
+            int f = (self->_next + i) % self->_nframes;
+            self->_inject.iov[i].iov_base = self->_frames + (size_t)f * self->_frame_stride;
+            self->_inject.iov[i].iov_len = self->_sizes[f % self->_nsizes];
+        }
+        int r = inject_send(&self->_inject, n);
+        if(r < 0)
+            return -1;
+        self->_next = (self->_next + n) % self->_nframes;
+        sent += n;
+    }
+    return sent;
+}
+
+/*
+Send count frames (0 = no limit) for at most duration seconds (0 = no limit)
+
+Returns what was offered: packets_sent, bytes_sent, send_errors, seconds,
+offered_pps, offered_bps and cpu_ns_per_packet of the sending thread.
+*/
+static PyObject *
+PcapGenerator_run(PcapGenerator *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"count", "duration", NULL};
+    long count = 0;
+    double duration = 0.0;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|ld", kwlist, &count, &duration))
+        return NULL;
+    if(count < 0 || duration < 0){
+        PyErr_SetString(PyExc_ValueError, "count and duration must be >= 0");
+        return NULL;
+    }
+    if(count == 0 && duration == 0){
+        PyErr_SetString(PyExc_ValueError, "run() needs a count, a duration or both");
+        return NULL;
+    }
+    if(PcapGenerator_open(self) != 0)
+        return NULL;
+
+    uint64_t sent_before = self->_inject.sent;
+    uint64_t bytes_before = self->_inject.bytes;
+    uint64_t errors_before = self->_inject.errors;
+    uint64_t cpu_start = inject_thread_cpu_ns();
+    uint64_t start = inject_now_ns();
+    uint64_t end = duration > 0 ? start + (uint64_t)(duration * 1e9) : UINT64_MAX;
+    long remaining = count > 0 ? count : -1;
+    uint64_t offered = 0;
+    int err = 0;
+
+    // send in slices so ctrl-c is noticed while running for a long time
+    while(remaining != 0){
+        uint64_t slice_end = inject_now_ns() + GENERATOR_SLICE_NS;
+        if(slice_end > end)
+            slice_end = end;
+
+        long sent;
+        Py_BEGIN_ALLOW_THREADS
+        sent = PcapGenerator_send(self, remaining, start, offered, slice_end);
+        Py_END_ALLOW_THREADS
+        if(sent < 0){
+            err = errno;
+            break;
+        }
+        offered += sent;
+        if(remaining > 0)
+            remaining -= sent;
+        if(slice_end >= end)
+            break;
+        if(PyErr_CheckSignals() != 0)
+            return NULL;
+    }
+
+    uint64_t elapsed = inject_now_ns() - start;
+    uint64_t cpu = inject_thread_cpu_ns() - cpu_start;
+    if(err != 0){
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+
+    uint64_t packets = self->_inject.sent - sent_before;
+    uint64_t bytes = self->_inject.bytes - bytes_before;
+    double seconds = elapsed / 1e9;
+    return Py_BuildValue(
+        "{s:K, s:K, s:K, s:d, s:d, s:d, s:d}",
+        "packets_sent", (unsigned long long)packets,
+        "bytes_sent", (unsigned long long)bytes,
+        "send_errors", (unsigned long long)(self->_inject.errors - errors_before),
+        "seconds", seconds,
+        "offered_pps", seconds > 0 ? packets / seconds : 0.0,
+        "offered_bps", seconds > 0 ? bytes * 8 / seconds : 0.0,
+        "cpu_ns_per_packet", packets ? (double)cpu / packets : 0.0
+    );
+}
+
+/* close method */
+static PyObject *
+PcapGenerator_close(PcapGenerator *self, PyObject *Py_UNUSED(ignored))
+{
+    inject_close(&self->_inject);
+    if(self->_frames != NULL){
+        pool_region_free(self->_frames, self->_frames_bytes);
+        self->_frames = NULL;
+    }
+    self->_opened = 0;
+    return Py_BuildValue("");
+}
+
+static PyMethodDef PcapGenerator_methods[] = {
+    {"run", (PyCFunction) PcapGenerator_run, METH_VARARGS | METH_KEYWORDS, "Send count frames and/or for duration seconds, return the offered rate"},
+    {"close", (PyCFunction) PcapGenerator_close, METH_NOARGS, "Close the raw socket and free the frames"},
+    {NULL}
+};
+
+/* custom getter/setter methods to control member types */
+static PyObject *
+PcapGenerator_get_interface_name(PcapGenerator *self, void *closure)
+{
+    Py_INCREF(self->interface_name);
+    return self->interface_name;
+}
+
+static int
+PcapGenerator_set_interface_name(PcapGenerator *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "interface_name attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapGenerator_get_sizes(PcapGenerator *self, void *closure)
+{
+    Py_INCREF(self->sizes);
+    return self->sizes;
+}
+
+static int
+PcapGenerator_set_sizes(PcapGenerator *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "sizes attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapGenerator_get_rate_pps(PcapGenerator *self, void *closure)
+{
+    Py_INCREF(self->rate_pps);
+    return self->rate_pps;
+}
+
+static int
+PcapGenerator_set_rate_pps(PcapGenerator *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "rate_pps attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapGenerator_get_flows(PcapGenerator *self, void *closure)
+{
+    Py_INCREF(self->flows);
+    return self->flows;
+}
+
+static int
+PcapGenerator_set_flows(PcapGenerator *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "flows attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapGenerator_get_batch_size(PcapGenerator *self, void *closure)
+{
+    Py_INCREF(self->batch_size);
+    return self->batch_size;
+}
+
+static int
+PcapGenerator_set_batch_size(PcapGenerator *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "batch_size attribute is read-only");
+    return -1;
+}
+
+static PyGetSetDef PcapGenerator_getsetters[] = {
+    {"interface_name", (getter) PcapGenerator_get_interface_name, (setter) PcapGenerator_set_interface_name, "interface_name", NULL},
+    {"sizes", (getter) PcapGenerator_get_sizes, (setter) PcapGenerator_set_sizes, "sizes", NULL},
+    {"rate_pps", (getter) PcapGenerator_get_rate_pps, (setter) PcapGenerator_set_rate_pps, "rate_pps", NULL},
+    {"flows", (getter) PcapGenerator_get_flows, (setter) PcapGenerator_set_flows, "flows", NULL},
+    {"batch_size", (getter) PcapGenerator_get_batch_size, (setter) PcapGenerator_set_batch_size, "batch_size", NULL},
+    {NULL}
+};
+
+/* avoid cyclic references / enable cyclic GC */
+static int
+PcapGenerator_traverse(PcapGenerator *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->interface_name);
+    Py_VISIT(self->sizes);
+    Py_VISIT(self->rate_pps);
+    Py_VISIT(self->flows);
+    Py_VISIT(self->batch_size);
+    return 0;
+}
+
+static int
+PcapGenerator_clear(PcapGenerator *self)
+{
+    Py_CLEAR(self->interface_name);
+    Py_CLEAR(self->sizes);
+    Py_CLEAR(self->rate_pps);
+    Py_CLEAR(self->flows);
+    Py_CLEAR(self->batch_size);
+    return 0;
+}
+
+/* deallocation method */
+static void
+PcapGenerator_dealloc(PcapGenerator *self)
+{
+    /* close all C objects */
+    inject_close(&self->_inject);
+    if(self->_frames != NULL)
+        pool_region_free(self->_frames, self->_frames_bytes);
+    self->_frames = NULL;
+
+    /* dealloc with cyclic GC check */
+    PyObject_GC_UnTrack(self);
+    PcapGenerator_clear(self);
+
+    /* deallocate the object itself */
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/*
+PcapGenerator Type construction
+
+.tp_flags:
+    Py_TPFLAGS_DEFAULT = always use
+    Py_TPFLAGS_BASETYPE = allows to be subclassed. do this only if methods don't care about type of object created/used
+    Py_TPFLAGS_HAVE_GC = cyclic GC causes segfault if this isn't set
+*/
+static PyTypeObject PcapGeneratorType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.PcapGenerator",
+    .tp_doc = "Raw socket traffic generator for capture benchmarks",
+    .tp_basicsize = sizeof(PcapGenerator),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_new = PcapGenerator_new,
+    .tp_dealloc = (destructor) PcapGenerator_dealloc,
+    .tp_init = (initproc) PcapGenerator_init,
+    .tp_methods = PcapGenerator_methods, // expose custom methods
+    .tp_traverse = (traverseproc) PcapGenerator_traverse, // cyclic GC enable
+    .tp_clear = (inquiry) PcapGenerator_clear,
+    .tp_getset = PcapGenerator_getsetters, // custom getter/setter methods
+};
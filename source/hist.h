@@ -0,0 +1,98 @@
+#include <stdint.h>
+#include <string.h>
+
+#define PYPCAP_HIST // header guard
+
+/*
+Log-linear latency histogram
+
+Values below 8 get a bucket each; above that every power of two is split
+into 8 linear sub-buckets, so any recorded value is known to within 12.5%
+with a fixed 4KiB of counters and no allocation.
+*/
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct hist{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+};
+
+static inline void
+hist_reset(struct hist *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+static inline int
+hist_bucket(uint64_t v)
+{
+    if(v < HIST_SUB)
+        return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB + (int)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* smallest value that lands in bucket b */
+static inline uint64_t
+hist_bucket_low(int b)
+{
+    if(b < HIST_SUB)
+        return (uint64_t)b;
+    int e = b / HIST_SUB + HIST_SUB_BITS - 1;
+    return ((uint64_t)(HIST_SUB + b % HIST_SUB)) << (e - HIST_SUB_BITS);
+}
+
+static inline void
+hist_record(struct hist *h, uint64_t v)
+{
+    h->buckets[hist_bucket(v)]++;
+    h->count++;
+    h->sum += v;
+    if(v < h->min)
+        h->min = v;
+    if(v > h->max)
+        h->max = v;
+}
+
+static inline void
+hist_merge(struct hist *into, const struct hist *from)
+{
+    for(int i = 0; i < HIST_BUCKETS; i++)
+        into->buckets[i] += from->buckets[i];
+    into->count += from->count;
+    into->sum += from->sum;
+    if(from->min < into->min)
+        into->min = from->min;
+    if(from->max > into->max)
+        into->max = from->max;
+}
+
+/* value at quantile q (0..1), reported as the middle of its bucket and clamped to [min, max] */
+static inline uint64_t
+hist_quantile(const struct hist *h, double q)
+{
+    if(h->count == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(q * (double)(h->count - 1)) + 1;
+    uint64_t seen = 0;
+    for(int b = 0; b < HIST_BUCKETS; b++){
+        seen += h->buckets[b];
+        if(seen >= rank){
+            uint64_t low = hist_bucket_low(b);
+            uint64_t high = b + 1 < HIST_BUCKETS ? hist_bucket_low(b + 1) : h->max;
+            uint64_t v = low + (high - low) / 2;
+            if(v < h->min)
+                v = h->min;
+            if(v > h->max)
+                v = h->max;
+            return v;
+        }
+    }
+    return h->max;
+}
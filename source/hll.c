@@ -0,0 +1,112 @@
+#include "hll.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define HLL_VERSION 1
+
+/* Return 0, or -1 if out of memory */
+int hll_init(struct hll *h, int precision){
+    h->precision = (uint8_t)precision;
+    h->m = 1u << precision;
+    h->reg = calloc(h->m, 1);
+    return h->reg == NULL ? -1 : 0;
+}
+
+void hll_free(struct hll *h){
+    free(h->reg);
+    h->reg = NULL;
+}
+
+void hll_reset(struct hll *h){
+    memset(h->reg, 0, h->m);
+}
+
+static inline uint64_t fmix64(uint64_t k){
+    k ^= k >> 33;
+    k *= 0xFF51AFD7ED558CCDULL;
+    k ^= k >> 33;
+    k *= 0xC4CEB9FE1A85EC53ULL;
+    return k ^ (k >> 33);
+}
+
+/* 64 bit hash of a short key (addresses, ports, flow tuples) */
+uint64_t hll_hash(const void *data, size_t len){
+    const unsigned char *p = data;
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ (len * 0x87C37B91114253D5ULL);
+    for(; len >= 8; p += 8, len -= 8){
+        uint64_t k;
+        memcpy(&k, p, 8);
+        h = fmix64(h ^ k) + 0x52DCE729;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, p, len);
+    return fmix64(h ^ tail);
+}
+
+void hll_add_hash(struct hll *h, uint64_t hash){
+    uint32_t idx = (uint32_t)(hash >> (64 - h->precision));
+    uint64_t rest = (hash << h->precision) | (1ULL << (h->precision - 1)); // guard bit bounds the rank
+    uint8_t rank = (uint8_t)(__builtin_clzll(rest) + 1);
+    if(rank > h->reg[idx])
+        h->reg[idx] = rank;
+}
+
+double hll_estimate(const struct hll *h){
+    double m = h->m, sum = 0.0;
+    uint32_t zeros = 0;
+    for(uint32_t i = 0; i < h->m; i++){
+        sum += ldexp(1.0, -h->reg[i]);
+        zeros += h->reg[i] == 0;
+    }
+    double alpha = h->m == 16 ? 0.673 : h->m == 32 ? 0.697 : h->m == 64 ? 0.709 : 0.7213 / (1.0 + 1.079 / m);
+    double e = alpha * m * m / sum;
+    if(e <= 2.5 * m && zeros > 0)
+        e = m * log(m / zeros); // linear counting
+    return e;
+}
+
+/* dst becomes the sketch of the union; both must have the same precision */
+void hll_merge(struct hll *dst, const struct hll *src){
+    uint32_t i = 0;
+#ifdef __SSE2__
+    for(; i + 16 <= dst->m; i += 16){
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst->reg + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src->reg + i));
+        _mm_storeu_si128((__m128i *)(dst->reg + i), _mm_max_epu8(a, b));
+    }
+#endif
+    for(; i < dst->m; i++)
+        if(src->reg[i] > dst->reg[i])
+            dst->reg[i] = src->reg[i];
+}
+
+/* write HLL_HEADER + h->m bytes to out */
+void hll_serialize(const struct hll *h, uint8_t *out){
+    memcpy(out, HLL_MAGIC, 4);
+    out[4] = HLL_VERSION;
+    out[5] = h->precision;
+    out[6] = out[7] = 0;
+    memcpy(out + HLL_HEADER, h->reg, h->m);
+}
+
+/* init h from hll_serialize output; Return 0, -1 if out of memory, -2 if data is not a sketch */
+int hll_deserialize(struct hll *h, const uint8_t *data, size_t len){
+    if(len < HLL_HEADER || memcmp(data, HLL_MAGIC, 4) != 0 || data[4] != HLL_VERSION)
+        return -2;
+    int precision = data[5];
+    if(precision < HLL_MIN_PRECISION || precision > HLL_MAX_PRECISION || len != HLL_HEADER + ((size_t)1 << precision))
+        return -2;
+    for(size_t i = HLL_HEADER; i < len; i++)
+        if(data[i] > 64 - precision + 1)
+            return -2;
+    if(hll_init(h, precision) != 0)
+        return -1;
+    memcpy(h->reg, data + HLL_HEADER, h->m);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PYPCAP_HLL // header guard
+#define HLL_MIN_PRECISION 4
+#define HLL_MAX_PRECISION 18
+#define HLL_MAGIC "PHLL"
+#define HLL_HEADER 8 // serialized: magic, version, precision, 2 reserved bytes, then the registers
+
+/*
+HyperLogLog distinct counting in 2**precision one-byte registers
+
+Standard error is about 1.04 / sqrt(2**precision): 0.8% at the default 14,
+in 16KiB. Values are reduced to 64 bit hashes first, so there is no large
+range correction; small counts use linear counting. Two sketches of the same
+precision merge by taking the larger of each register pair, so sketches made
+on different sensors, serialized and shipped, combine into the sketch of the
+union of what they saw.
+*/
+struct hll{
+    uint8_t *reg;
+    uint32_t m; // registers, 2**precision
+    uint8_t precision;
+};
+
+int hll_init(struct hll *h, int precision);
+void hll_free(struct hll *h);
+void hll_reset(struct hll *h);
+uint64_t hll_hash(const void *data, size_t len);
+void hll_add_hash(struct hll *h, uint64_t hash);
+double hll_estimate(const struct hll *h);
+void hll_merge(struct hll *dst, const struct hll *src);
+void hll_serialize(const struct hll *h, uint8_t *out);
+int hll_deserialize(struct hll *h, const uint8_t *data, size_t len);
@@ -0,0 +1,307 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#include <structmember.h>
+
+#ifndef PYPCAP_NETDEV
+#include "netdev.h"
+#endif
+
+#define PYPCAP_IFCOUNTERS
+
+/*
+Snapshot of the kernel's traffic counters for every interface
+
+Taken with one rtnetlink dump when the object is created, so it costs about
+as much as reading one sysfs file and needs no capture handle. Two snapshots
+give per-second rates through newer.rates(older).
+*/
+typedef struct{
+    PyObject_HEAD
+    /* C-style properties*/
+    struct netdev_counters *_counters;
+    int _n;
+    uint64_t _ts_ns;
+    /* Python properties */
+    PyObject *timestamp;
+} InterfaceCounters;
+
+/* field name and offset of every counter, in the order they are reported */
+static const struct{
+    const char *name;
+    size_t offset;
+} InterfaceCounters_fields[] = {
+    {"rx_packets", offsetof(struct netdev_counters, rx_packets)},
+    {"tx_packets", offsetof(struct netdev_counters, tx_packets)},
+    {"rx_bytes", offsetof(struct netdev_counters, rx_bytes)},
+    {"tx_bytes", offsetof(struct netdev_counters, tx_bytes)},
+    {"rx_errors", offsetof(struct netdev_counters, rx_errors)},
+    {"tx_errors", offsetof(struct netdev_counters, tx_errors)},
+    {"rx_dropped", offsetof(struct netdev_counters, rx_dropped)},
+    {"tx_dropped", offsetof(struct netdev_counters, tx_dropped)},
+    {"rx_missed", offsetof(struct netdev_counters, rx_missed)},
+    {"multicast", offsetof(struct netdev_counters, multicast)},
+};
+
+#define IFCOUNTERS_NFIELDS (sizeof(InterfaceCounters_fields) / sizeof(InterfaceCounters_fields[0]))
+
+static inline uint64_t
+InterfaceCounters_field(const struct netdev_counters *c, size_t i)
+{
+    return *(const uint64_t *)((const char *)c + InterfaceCounters_fields[i].offset);
+}
+
+/* creation method */
+static PyObject *
+InterfaceCounters_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    InterfaceCounters *self;
+    self = (InterfaceCounters *) type->tp_alloc(type,0);
+    return (PyObject *) self;
+}
+
+/* initialization method */
+static int
+InterfaceCounters_init(InterfaceCounters *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {NULL};
+    PyObject *tmp;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "", kwlist))
+        return -1;
+
+    struct netdev_counters *counters;
+    int n, res;
+    uint64_t ts_ns;
+    Py_BEGIN_ALLOW_THREADS
+    res = netdev_read_counters(&counters, &n, &ts_ns);
+    Py_END_ALLOW_THREADS
+    if(res != 0){
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    free(self->_counters);
+    self->_counters = counters;
+    self->_n = n;
+    self->_ts_ns = ts_ns;
+
+    tmp = self->timestamp;
+    self->timestamp = PyFloat_FromDouble((double)ts_ns / 1e9);
+    Py_XDECREF(tmp);
+
+    return 0;
+}
+
+/* dict of one interface's counters */
+static PyObject *
+InterfaceCounters_entry(const struct netdev_counters *c)
+{
+    PyObject *d = PyDict_New();
+    if(d == NULL)
+        return NULL;
+    for(size_t i = 0; i < IFCOUNTERS_NFIELDS; i++){
+        PyObject *v = PyLong_FromUnsignedLongLong(InterfaceCounters_field(c, i));
+        if(v == NULL || PyDict_SetItemString(d, InterfaceCounters_fields[i].name, v) != 0){
+            Py_XDECREF(v);
+            Py_DECREF(d);
+            return NULL;
+        }
+        Py_DECREF(v);
+    }
+    return d;
+}
+
+/* counters of the interface called name, or NULL */
+static const struct netdev_counters *
+InterfaceCounters_find(const InterfaceCounters *self, const char *name)
+{
+    for(int i = 0; i < self->_n; i++)
+        if(strcmp(self->_counters[i].name, name) == 0)
+            return &self->_counters[i];
+    return NULL;
+}
+
+/* dict of interface name to its counters */
+static PyObject *
+InterfaceCounters_counters(InterfaceCounters *self, PyObject *Py_UNUSED(ignored))
+{
+    PyObject *all = PyDict_New();
+    if(all == NULL)
+        return NULL;
+    for(int i = 0; i < self->_n; i++){
+        PyObject *d = InterfaceCounters_entry(&self->_counters[i]);
+        if(d == NULL || PyDict_SetItemString(all, self->_counters[i].name, d) != 0){
+            Py_XDECREF(d);
+            Py_DECREF(all);
+            return NULL;
+        }
+        Py_DECREF(d);
+    }
+    return all;
+}
+
+/*
+dict of interface name to per-second rates since an older snapshot
+
+Interfaces are matched by index, so a renamed interface keeps its history and
+one recreated under an old name does not. A counter that went backwards was
+reset (driver reload, interface recreated) and its rate is counted from zero.
+*/
+static PyObject *
+InterfaceCounters_rates(InterfaceCounters *self, PyObject *older)
+{
+    if(!PyObject_TypeCheck(older, Py_TYPE(self))){
+        PyErr_SetString(PyExc_TypeError, "rates requires an older InterfaceCounters snapshot");
+        return NULL;
+    }
+    const InterfaceCounters *prev = (const InterfaceCounters *)older;
+    if(prev->_ts_ns >= self->_ts_ns){
+        PyErr_SetString(PyExc_ValueError, "rates requires a snapshot taken before this one");
+        return NULL;
+    }
+    double seconds = (double)(self->_ts_ns - prev->_ts_ns) / 1e9;
+
+    PyObject *all = PyDict_New();
+    if(all == NULL)
+        return NULL;
+    for(int i = 0; i < self->_n; i++){
+        const struct netdev_counters *c = &self->_counters[i];
+        const struct netdev_counters *p = NULL;
+        for(int j = 0; j < prev->_n && p == NULL; j++)
+            if(prev->_counters[j].index == c->index)
+                p = &prev->_counters[j];
+        if(p == NULL)
+            continue;
+
+        PyObject *d = PyDict_New();
+        if(d == NULL){
+            Py_DECREF(all);
+            return NULL;
+        }
+        for(size_t k = 0; k < IFCOUNTERS_NFIELDS; k++){
+            uint64_t now = InterfaceCounters_field(c, k), then = InterfaceCounters_field(p, k);
+            uint64_t delta = now >= then ? now - then : now;
+            PyObject *v = PyFloat_FromDouble((double)delta / seconds);
+            if(v == NULL || PyDict_SetItemString(d, InterfaceCounters_fields[k].name, v) != 0){
+                Py_XDECREF(v);
+                Py_DECREF(d);
+                Py_DECREF(all);
+                return NULL;
+            }
+            Py_DECREF(v);
+        }
+        if(PyDict_SetItemString(all, c->name, d) != 0){
+            Py_DECREF(d);
+            Py_DECREF(all);
+            return NULL;
+        }
+        Py_DECREF(d);
+    }
+    return all;
+}
+
+/* mapping protocol: snapshot[name] is that interface's counters */
+static Py_ssize_t
+InterfaceCounters_len(InterfaceCounters *self)
+{
+    return self->_n;
+}
+
+static PyObject *
+InterfaceCounters_getitem(InterfaceCounters *self, PyObject *key)
+{
+    const char *name = PyUnicode_Check(key) ? PyUnicode_AsUTF8(key) : NULL;
+    const struct netdev_counters *c = name != NULL ? InterfaceCounters_find(self, name) : NULL;
+    if(c == NULL){
+        if(!PyErr_Occurred())
+            PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+    }
+    return InterfaceCounters_entry(c);
+}
+
+static PyMappingMethods InterfaceCounters_mapping = {
+    .mp_length = (lenfunc) InterfaceCounters_len,
+    .mp_subscript = (binaryfunc) InterfaceCounters_getitem,
+};
+
+/* expose methods */
+static PyMethodDef InterfaceCounters_methods[] = {
+    {"counters", (PyCFunction) InterfaceCounters_counters, METH_NOARGS, "Return a dict of interface name to its counters"},
+    {"rates", (PyCFunction) InterfaceCounters_rates, METH_O, "Return a dict of interface name to per-second rates since an older snapshot"},
+    {NULL}
+};
+
+/* custom getter/setter methods to control member types */
+static PyObject *
+InterfaceCounters_get_timestamp(InterfaceCounters *self, void *closure)
+{
+    Py_INCREF(self->timestamp);
+    return self->timestamp;
+}
+
+static int
+InterfaceCounters_set_timestamp(InterfaceCounters *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "timestamp attribute is read-only");
+    return -1;
+}
+
+static PyGetSetDef InterfaceCounters_getsetters[] = {
+    {"timestamp", (getter) InterfaceCounters_get_timestamp, (setter) InterfaceCounters_set_timestamp, "CLOCK_MONOTONIC seconds when the counters were read", NULL},
+    {NULL}
+};
+
+/* avoid cyclic references / enable cyclic GC */
+static int
+InterfaceCounters_traverse(InterfaceCounters *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->timestamp);
+    return 0;
+}
+
+static int
+InterfaceCounters_clear(InterfaceCounters *self)
+{
+    Py_CLEAR(self->timestamp);
+    return 0;
+}
+
+/* deallocation method */
+static void
+InterfaceCounters_dealloc(InterfaceCounters *self)
+{
+    /* close all C objects */
+    free(self->_counters);
+
+    /* dealloc with cyclic GC check */
+    PyObject_GC_UnTrack(self);
+    InterfaceCounters_clear(self);
+
+    /* deallocate the object itself */
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/*
+InterfaceCounters Type construction
+
+.tp_flags:
+    Py_TPFLAGS_DEFAULT = always use
+    Py_TPFLAGS_BASETYPE = allows to be subclassed. do this only if methods don't care about type of object created/used
+    Py_TPFLAGS_HAVE_GC = cyclic GC causes segfault if this isn't set
+*/
+static PyTypeObject InterfaceCountersType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.InterfaceCounters",
+    .tp_doc = "Kernel rx/tx packet, byte, error and drop counters of every interface, read in one netlink dump",
+    .tp_basicsize = sizeof(InterfaceCounters),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_new = InterfaceCounters_new,
+    .tp_dealloc = (destructor) InterfaceCounters_dealloc,
+    .tp_init = (initproc) InterfaceCounters_init,
+    .tp_methods = InterfaceCounters_methods, // expose custom methods
+    .tp_traverse = (traverseproc) InterfaceCounters_traverse, // cyclic GC enable
+    .tp_clear = (inquiry) InterfaceCounters_clear,
+    .tp_getset = InterfaceCounters_getsetters, // custom getter/setter methods
+    .tp_as_mapping = &InterfaceCounters_mapping,
+};
@@ -0,0 +1,204 @@
+#include "inject.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <errno.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+Open a raw socket on ifname for sending whole link-layer frames
+
+Needs CAP_NET_RAW. Returns 0, or -1 with a message in errbuf.
+*/
+int inject_open(struct inject *inj, const char *ifname, unsigned int batch, char *errbuf){
+    memset(inj, 0, sizeof(*inj));
+    inj->fd = -1;
+
+    inj->ifindex = if_nametoindex(ifname);
+    if(inj->ifindex == 0){
+        snprintf(errbuf, INJECT_ERRBUF_SIZE, "No such interface %s", ifname);
+        return -1;
+    }
+
+    // protocol 0: transmit only, the socket never queues received frames
+    inj->fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if(inj->fd < 0){
+        snprintf(errbuf, INJECT_ERRBUF_SIZE, "Could not open raw socket: %s", strerror(errno));
+        return -1;
+    }
+
+    struct sockaddr_ll addr = {0};
+    addr.sll_family = AF_PACKET;
+    addr.sll_ifindex = inj->ifindex;
+    if(bind(inj->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+        snprintf(errbuf, INJECT_ERRBUF_SIZE, "Could not bind raw socket to %s: %s", ifname, strerror(errno));
+        inject_close(inj);
+        return -1;
+    }
+
+#ifdef PACKET_QDISC_BYPASS
+    // skip the qdisc layer where the kernel allows it; fine to fail
+    int one = 1;
+    setsockopt(inj->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+#endif
+
+    inj->batch = batch;
+    inj->msgs = calloc(batch, sizeof(struct mmsghdr));
+    inj->iov = calloc(batch, sizeof(struct iovec));
+    if(inj->msgs == NULL || inj->iov == NULL){
+        snprintf(errbuf, INJECT_ERRBUF_SIZE, "Out of memory");
+        inject_close(inj);
+        return -1;
+    }
+    for(unsigned int i = 0; i < batch; i++){
+        inj->msgs[i].msg_hdr.msg_iov = &inj->iov[i];
+        inj->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    return 0;
+}
+
+/*
+Send the first n prepared frames
+
+Partial sendmmsg results are resumed; a frame the kernel rejects with a
+transient error (ENOBUFS/EAGAIN) or as too big for the interface is counted
+in errors and skipped.
+Returns frames sent, or -1 with errno set on a hard error.
+*/
+int inject_send(struct inject *inj, unsigned int n){
+    unsigned int done = 0;
+    int sent_now = 0;
+    while(done < n){
+        int r = sendmmsg(inj->fd, inj->msgs + done, n - done, 0);
+        if(r < 0){
+            if(errno == EINTR)
+                continue;
+            if(errno == ENOBUFS || errno == EAGAIN || errno == EWOULDBLOCK || errno == EMSGSIZE){
+                inj->errors++;
+                done++;
+                continue;
+            }
+            return -1;
+        }
+        for(int i = 0; i < r; i++)
+            inj->bytes += inj->msgs[done + i].msg_len;
+        done += r;
+        sent_now += r;
+    }
+    inj->sent += sent_now;
+    return sent_now;
+}
+
+void inject_close(struct inject *inj){
+    if(inj->fd >= 0)
+        close(inj->fd);
+    inj->fd = -1;
+    free(inj->msgs);
+    free(inj->iov);
+    inj->msgs = NULL;
+    inj->iov = NULL;
+}
+
+uint64_t inject_now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t inject_thread_cpu_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__("yield")
+#else
+#define cpu_relax() do{}while(0)
+#endif
+
+/*
+Block until CLOCK_MONOTONIC reaches deadline_ns
+
+Sleeps until spin_ns before the deadline, then busy-polls the clock: sleeping
+alone overshoots by tens of microseconds, spinning alone burns a core.
+*/
+void inject_wait_until(uint64_t deadline_ns, uint64_t spin_ns){
+    uint64_t now = inject_now_ns();
+    if(now >= deadline_ns)
+        return;
+    if(deadline_ns - now > spin_ns){
+        uint64_t wake = deadline_ns - spin_ns;
+        struct timespec ts = {(time_t)(wake / 1000000000ULL), (long)(wake % 1000000000ULL)};
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+    }
+    while(inject_now_ns() < deadline_ns)
+        cpu_relax();
+}
+
+static uint16_t ip_checksum(const unsigned char *p, size_t len){
+    uint32_t sum = 0;
+    for(size_t i = 0; i + 1 < len; i += 2)
+        sum += (p[i] << 8) | p[i + 1];
+    while(sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum & 0xffff;
+}
+
+/*
+Write a size byte Ethernet/IPv4/UDP test frame into frame
+
+flow picks the source address/port so captures see distinct flows, and seq
+goes in the first payload bytes. Sizes below the 42 header bytes are raised
+to 60, the Ethernet minimum without FCS. Returns the frame length.
+*/
+size_t inject_build_udp(unsigned char *frame, size_t size, uint32_t flow, uint32_t seq){
+    const size_t hdrs = 14 + 20 + 8;
+    if(size < 60)
+        size = 60;
+    memset(frame, 0, size);
+
+    // locally administered unicast macs
+    static const unsigned char dst_mac[6] = {0x02, 0, 0, 0, 0, 0x02};
+    static const unsigned char src_mac[6] = {0x02, 0, 0, 0, 0, 0x01};
+    memcpy(frame, dst_mac, 6);
+    memcpy(frame + 6, src_mac, 6);
+    frame[12] = 0x08;
+    frame[13] = 0x00;
+
+    unsigned char *ip = frame + 14;
+    size_t ip_len = size - 14;
+    ip[0] = 0x45;
+    ip[2] = ip_len >> 8;
+    ip[3] = ip_len & 0xff;
+    ip[8] = 64;
+    ip[9] = IPPROTO_UDP;
+    // 198.18.0.0/15 is reserved for benchmarking (RFC 2544)
+    ip[12] = 198; ip[13] = 18; ip[14] = (flow >> 8) & 0xff; ip[15] = flow & 0xff;
+    ip[16] = 198; ip[17] = 19; ip[18] = 0; ip[19] = 1;
+    uint16_t csum = ip_checksum(ip, 20);
+    ip[10] = csum >> 8;
+    ip[11] = csum & 0xff;
+
+    unsigned char *udp = ip + 20;
+    uint16_t sport = 1024 + (flow % 64512);
+    size_t udp_len = ip_len - 20;
+    udp[0] = sport >> 8; udp[1] = sport & 0xff;
+    udp[2] = 0x23; udp[3] = 0x28; // 9000
+    udp[4] = udp_len >> 8; udp[5] = udp_len & 0xff;
+
+    if(size >= hdrs + 4){
+        unsigned char *payload = udp + 8;
+        payload[0] = seq >> 24; payload[1] = seq >> 16; payload[2] = seq >> 8; payload[3] = seq;
+    }
+    return size;
+}
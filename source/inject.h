@@ -0,0 +1,36 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define PYPCAP_INJECT // header guard
+
+#define INJECT_ERRBUF_SIZE 256
+
+/*
+Raw AF_PACKET transmit socket bound to one interface
+
+msgs/iov hold batch preallocated entries; the caller points iov[i] at a frame
+and sends msgs[0..n) with inject_send, one sendmmsg per call where possible.
+*/
+struct inject{
+    int fd;
+    int ifindex;
+    unsigned int batch;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+    uint64_t sent;
+    uint64_t bytes;
+    uint64_t errors; // frames the kernel refused (ENOBUFS, EMSGSIZE etc.), not retried
+};
+
+int inject_open(struct inject *inj, const char *ifname, unsigned int batch, char *errbuf);
+int inject_send(struct inject *inj, unsigned int n);
+void inject_close(struct inject *inj);
+
+uint64_t inject_now_ns(void);
+uint64_t inject_thread_cpu_ns(void);
+void inject_wait_until(uint64_t deadline_ns, uint64_t spin_ns);
+
+size_t inject_build_udp(unsigned char *frame, size_t size, uint32_t flow, uint32_t seq);
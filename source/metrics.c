@@ -0,0 +1,184 @@
+#include "metrics.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CALIBRATE_MIN_NS 10000000ULL // shortest tsc/clock comparison worth trusting
+#define CALIBRATE_STABLE_NS 1000000000ULL // after this the ratio is good enough to keep
+
+const char *metrics_stage_names[METRICS_NSTAGES] = {
+    "capture_callback",
+    "dump",
+    "reader_next",
+    "flush",
+};
+
+__thread struct metrics_thread *metrics_self = NULL;
+uint64_t metrics_generation = 0; // moved by metrics_reset() under registry_lock
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct metrics_thread *registry = NULL;
+static struct hist retired[METRICS_NSTAGES]; // what threads that have exited recorded
+static int retired_init = 0;
+static pthread_key_t thread_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t calibrate_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t calibrate_tsc0, calibrate_ns0;
+static double calibrate_ratio = 0;
+static int calibrate_stable = 0;
+
+static uint64_t monotonic_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void calibrate_start(void){
+    pthread_mutex_lock(&calibrate_lock);
+    if(calibrate_ns0 == 0){
+        calibrate_ns0 = monotonic_ns();
+        calibrate_tsc0 = metrics_ticks();
+    }
+    pthread_mutex_unlock(&calibrate_lock);
+}
+
+static void retired_reset(void){
+    for(int i = 0; i < METRICS_NSTAGES; i++)
+        hist_reset(&retired[i]);
+    retired_init = 1;
+}
+
+/* t's histograms, unless a reset has emptied them since t last recorded; call with registry_lock held */
+static int thread_current(const struct metrics_thread *t){
+    return __atomic_load_n(&t->generation, __ATOMIC_ACQUIRE) == metrics_generation;
+}
+
+/* fold an exiting thread's histograms into retired so its samples aren't lost */
+static void thread_exit(void *arg){
+    struct metrics_thread *t = arg;
+    pthread_mutex_lock(&registry_lock);
+    if(!retired_init)
+        retired_reset();
+    struct metrics_thread **p = &registry;
+    while(*p != NULL && *p != t)
+        p = &(*p)->next;
+    if(*p == t)
+        *p = t->next;
+    if(thread_current(t))
+        for(int i = 0; i < METRICS_NSTAGES; i++)
+            hist_merge(&retired[i], &t->stages[i]);
+    pthread_mutex_unlock(&registry_lock);
+    free(t);
+}
+
+static void thread_key_init(void){
+    pthread_key_create(&thread_key, thread_exit);
+}
+
+/* first sample on a thread: give it histograms and add them to the registry */
+struct metrics_thread *metrics_thread_register(void){
+    pthread_once(&thread_key_once, thread_key_init);
+    calibrate_start();
+
+    struct metrics_thread *t = malloc(sizeof(*t));
+    if(t == NULL)
+        return NULL;
+    for(int i = 0; i < METRICS_NSTAGES; i++)
+        hist_reset(&t->stages[i]);
+
+    pthread_mutex_lock(&registry_lock);
+    if(!retired_init)
+        retired_reset();
+    t->generation = metrics_generation;
+    t->next = registry;
+    registry = t;
+    pthread_mutex_unlock(&registry_lock);
+
+    pthread_setspecific(thread_key, t);
+    metrics_self = t;
+    return t;
+}
+
+/*
+Merge every thread's histograms into out[METRICS_NSTAGES]
+
+Threads keep recording while this runs, so a snapshot can be a few samples
+behind, but never blocks them.
+*/
+void metrics_snapshot(struct hist *out){
+    pthread_mutex_lock(&registry_lock);
+    if(!retired_init)
+        retired_reset();
+    for(int i = 0; i < METRICS_NSTAGES; i++)
+        out[i] = retired[i];
+    for(struct metrics_thread *t = registry; t != NULL; t = t->next)
+        if(thread_current(t))
+            for(int i = 0; i < METRICS_NSTAGES; i++)
+                hist_merge(&out[i], &t->stages[i]);
+    pthread_mutex_unlock(&registry_lock);
+}
+
+/*
+Empty every histogram
+
+Other threads' histograms are left for their owners to zero, see metrics.h;
+samples recorded while it runs may or may not be kept.
+*/
+void metrics_reset(void){
+    pthread_mutex_lock(&registry_lock);
+    retired_reset();
+    __atomic_store_n(&metrics_generation, metrics_generation + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&registry_lock);
+}
+
+int metrics_uses_tsc(void){
+#if defined(__x86_64__) || defined(__i386__)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/*
+TSC ticks per nanosecond
+
+Calibrated against CLOCK_MONOTONIC from the first call onwards, so the
+longer the process has been running the better the ratio; the first caller
+sleeps at most CALIBRATE_MIN_NS for a usable one, without holding the lock.
+*/
+double metrics_ticks_per_ns(void){
+    if(!metrics_uses_tsc())
+        return 1.0;
+
+    calibrate_start();
+    pthread_mutex_lock(&calibrate_lock);
+    double r = calibrate_ratio;
+    int stable = calibrate_stable;
+    uint64_t ns0 = calibrate_ns0, tsc0 = calibrate_tsc0;
+    pthread_mutex_unlock(&calibrate_lock);
+    if(stable)
+        return r;
+
+    uint64_t ns = monotonic_ns();
+    while(r == 0 && ns - ns0 < CALIBRATE_MIN_NS){
+        uint64_t left = CALIBRATE_MIN_NS - (ns - ns0);
+        struct timespec ts = {0, (long)left};
+        nanosleep(&ts, NULL);
+        ns = monotonic_ns();
+    }
+    if(ns - ns0 < CALIBRATE_MIN_NS)
+        return r;
+    uint64_t tsc = metrics_ticks();
+    ns = monotonic_ns();
+
+    pthread_mutex_lock(&calibrate_lock);
+    if(!calibrate_stable){
+        calibrate_ratio = (double)(tsc - tsc0) / (double)(ns - ns0);
+        calibrate_stable = (ns - ns0) >= CALIBRATE_STABLE_NS;
+    }
+    r = calibrate_ratio;
+    pthread_mutex_unlock(&calibrate_lock);
+    return r;
+}
@@ -0,0 +1,87 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifndef PYPCAP_HIST
+#include "hist.h"
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define PYPCAP_METRICS // header guard
+
+/*
+Hot-path latency instrumentation
+
+Each native thread records into its own histograms (no locks, no atomics on
+the hot path); metrics_snapshot() merges every thread's histograms on demand.
+Only the owning thread ever writes them: metrics_reset() bumps a generation
+number, and a thread whose histograms are from an older generation zeroes
+them itself before its next sample; until then they read as empty.
+Durations are taken in TSC ticks where available and converted to ns when read.
+
+Build with -DPYPCAP_NO_METRICS (PYPCAP_NO_METRICS=1 python3 setup.py build)
+to compile every METRICS_BEGIN/METRICS_END down to nothing.
+*/
+enum metrics_stage{
+    METRICS_CAPTURE_CALLBACK, // per packet handed to a pcap_loop/pcap_dispatch callback
+    METRICS_DUMP, // pcap_dump of one packet, capture or writer
+    METRICS_READER_NEXT, // pcap_next behind PcapReader_next
+    METRICS_FLUSH, // pcap_dump_flush / pcap_dump_close
+    METRICS_NSTAGES,
+};
+
+extern const char *metrics_stage_names[METRICS_NSTAGES];
+
+struct metrics_thread{
+    struct metrics_thread *next;
+    uint64_t generation; // of metrics_generation the histograms belong to
+    struct hist stages[METRICS_NSTAGES];
+};
+
+extern __thread struct metrics_thread *metrics_self;
+extern uint64_t metrics_generation;
+
+struct metrics_thread *metrics_thread_register(void);
+void metrics_snapshot(struct hist *out);
+void metrics_reset(void);
+double metrics_ticks_per_ns(void);
+int metrics_uses_tsc(void);
+
+static inline uint64_t
+metrics_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline void
+metrics_record(enum metrics_stage stage, uint64_t ticks)
+{
+    struct metrics_thread *t = metrics_self;
+    if(t == NULL && (t = metrics_thread_register()) == NULL)
+        return;
+    uint64_t generation = __atomic_load_n(&metrics_generation, __ATOMIC_RELAXED);
+    if(t->generation != generation){
+        for(int i = 0; i < METRICS_NSTAGES; i++)
+            hist_reset(&t->stages[i]);
+        __atomic_store_n(&t->generation, generation, __ATOMIC_RELEASE);
+    }
+    hist_record(&t->stages[stage], ticks);
+}
+
+#ifndef PYPCAP_NO_METRICS
+#define METRICS_BEGIN(var) uint64_t var = metrics_ticks()
+#define METRICS_END(stage, var) metrics_record((stage), metrics_ticks() - (var))
+#else
+#define METRICS_BEGIN(var) do{}while(0)
+#define METRICS_END(stage, var) do{}while(0)
+#endif
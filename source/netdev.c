@@ -0,0 +1,523 @@
+#include "netdev.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#define NETDEV_RCVBUF (1 << 20) // socket buffer requested so bursts of changes don't overrun it
+#define NETDEV_DUMP_MS 5000 // longest wait for a dump reply
+#define NETDEV_DUMP_TRIES 5 // dumps interrupted by concurrent changes or an overrun are retried
+
+const char *netdev_event_names[] = {
+    "added",
+    "removed",
+    "up",
+    "down",
+    "renamed",
+    "address_added",
+    "address_removed",
+};
+
+static int is_up(unsigned int flags){
+    return (flags & (IFF_UP | IFF_RUNNING)) == (IFF_UP | IFF_RUNNING);
+}
+
+static int addr_eq(const struct netdev_addr *a, const struct netdev_addr *b){
+    return a->family == b->family && a->prefixlen == b->prefixlen && memcmp(a->addr, b->addr, sizeof(a->addr)) == 0;
+}
+
+static struct netdev *find(struct netdev_registry *r, int index){
+    for(int i = 0; i < r->ndevs; i++)
+        if(r->devs[i].index == index)
+            return &r->devs[i];
+    return NULL;
+}
+
+static void push_event(struct netdev_registry *r, enum netdev_event_type type, const struct netdev *d, const struct netdev_addr *a, const char *old_name){
+    if(r->quiet)
+        return;
+    if(r->nevents == NETDEV_EVENTS_MAX){
+        r->events_dropped++;
+        return;
+    }
+    struct netdev_event *e = &r->events[r->nevents++];
+    memset(e, 0, sizeof(*e));
+    e->type = type;
+    e->index = d->index;
+    e->flags = d->flags;
+    memcpy(e->name, d->name, sizeof(e->name));
+    if(old_name != NULL)
+        memcpy(e->old_name, old_name, sizeof(e->old_name));
+    if(a != NULL)
+        e->addr = *a;
+}
+
+static void free_devs(struct netdev *devs, int n){
+    for(int i = 0; i < n; i++)
+        free(devs[i].addrs);
+    free(devs);
+}
+
+static void apply_link(struct netdev_registry *r, struct nlmsghdr *h){
+    struct ifinfomsg *ifi = NLMSG_DATA(h);
+    if(h->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)) || ifi->ifi_family == AF_BRIDGE)
+        return; // bridge port messages repeat links already reported
+
+    struct netdev *d = find(r, ifi->ifi_index);
+    if(h->nlmsg_type == RTM_DELLINK){
+        if(d == NULL)
+            return;
+        push_event(r, NETDEV_REMOVED, d, NULL, NULL);
+        free(d->addrs);
+        memmove(d, d + 1, (size_t)(r->devs + r->ndevs - (d + 1)) * sizeof(*d));
+        r->ndevs--;
+        r->generation++;
+        return;
+    }
+
+    char name[IF_NAMESIZE] = "";
+    int len = IFLA_PAYLOAD(h);
+    for(struct rtattr *a = IFLA_RTA(ifi); RTA_OK(a, len); a = RTA_NEXT(a, len)){
+        if(a->rta_type == IFLA_IFNAME){
+            size_t n = RTA_PAYLOAD(a) < IF_NAMESIZE ? RTA_PAYLOAD(a) : IF_NAMESIZE - 1;
+            memcpy(name, RTA_DATA(a), n);
+            name[n] = '\0';
+        }
+    }
+
+    if(d == NULL){
+        if(r->ndevs == r->devs_cap){
+            int cap = r->devs_cap ? r->devs_cap * 2 : 16;
+            struct netdev *devs = realloc(r->devs, (size_t)cap * sizeof(*devs));
+            if(devs == NULL)
+                return;
+            r->devs = devs;
+            r->devs_cap = cap;
+        }
+        d = &r->devs[r->ndevs++];
+        memset(d, 0, sizeof(*d));
+        d->index = ifi->ifi_index;
+        d->flags = ifi->ifi_flags;
+        memcpy(d->name, name, sizeof(d->name));
+        r->generation++;
+        push_event(r, NETDEV_ADDED, d, NULL, NULL);
+        return;
+    }
+
+    // most link messages (statistics, wireless) change nothing we hold
+    if(name[0] != '\0' && strcmp(name, d->name) != 0){
+        char old_name[IF_NAMESIZE];
+        memcpy(old_name, d->name, sizeof(old_name));
+        memcpy(d->name, name, sizeof(d->name));
+        r->generation++;
+        push_event(r, NETDEV_RENAMED, d, NULL, old_name);
+    }
+    if(ifi->ifi_flags != d->flags){
+        int was_up = is_up(d->flags);
+        d->flags = ifi->ifi_flags;
+        r->generation++;
+        if(is_up(d->flags) != was_up)
+            push_event(r, was_up ? NETDEV_DOWN : NETDEV_UP, d, NULL, NULL);
+    }
+}
+
+static void apply_addr(struct netdev_registry *r, struct nlmsghdr *h){
+    struct ifaddrmsg *ifa = NLMSG_DATA(h);
+    if(h->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)) || (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6))
+        return;
+    struct netdev *d = find(r, (int)ifa->ifa_index);
+    if(d == NULL)
+        return;
+
+    struct netdev_addr addr = {ifa->ifa_family, ifa->ifa_prefixlen, 0, {0}, {0}};
+    size_t alen = ifa->ifa_family == AF_INET ? 4 : 16;
+    int has_local = 0, has_addr = 0;
+    int len = IFA_PAYLOAD(h);
+    for(struct rtattr *a = IFA_RTA(ifa); RTA_OK(a, len); a = RTA_NEXT(a, len)){
+        if(RTA_PAYLOAD(a) < alen)
+            continue;
+        // on point-to-point links IFA_ADDRESS is the peer and IFA_LOCAL our own address
+        if(a->rta_type == IFA_LOCAL){
+            memcpy(addr.addr, RTA_DATA(a), alen);
+            has_local = 1;
+        } else if(a->rta_type == IFA_ADDRESS && !has_local){
+            memcpy(addr.addr, RTA_DATA(a), alen);
+            has_addr = 1;
+        } else if(a->rta_type == IFA_BROADCAST){
+            memcpy(addr.broadcast, RTA_DATA(a), alen);
+            addr.has_broadcast = 1;
+        }
+    }
+    if(!has_local && !has_addr)
+        return;
+
+    int i = 0;
+    while(i < d->naddrs && !addr_eq(&d->addrs[i], &addr))
+        i++;
+
+    if(h->nlmsg_type == RTM_DELADDR){
+        if(i == d->naddrs)
+            return;
+        memmove(&d->addrs[i], &d->addrs[i + 1], (size_t)(d->naddrs - i - 1) * sizeof(addr));
+        d->naddrs--;
+        r->generation++;
+        push_event(r, NETDEV_ADDR_REMOVED, d, &addr, NULL);
+        return;
+    }
+
+    if(i < d->naddrs){
+        if(memcmp(&d->addrs[i], &addr, sizeof(addr)) != 0){
+            d->addrs[i] = addr;
+            r->generation++;
+        }
+        return;
+    }
+    if(d->naddrs == d->addrs_cap){
+        int cap = d->addrs_cap ? d->addrs_cap * 2 : 4;
+        struct netdev_addr *addrs = realloc(d->addrs, (size_t)cap * sizeof(*addrs));
+        if(addrs == NULL)
+            return;
+        d->addrs = addrs;
+        d->addrs_cap = cap;
+    }
+    d->addrs[d->naddrs++] = addr;
+    r->generation++;
+    push_event(r, NETDEV_ADDR_ADDED, d, &addr, NULL);
+}
+
+/*
+Apply every message in buf; *done is set at the end of a dump and *intr if the
+dump was interrupted by a change. Return 0, or -1 with errno from an error reply
+*/
+static int dispatch(struct netdev_registry *r, size_t len, int *done, int *intr){
+    for(struct nlmsghdr *h = (struct nlmsghdr *)r->buf; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)){
+        r->messages++;
+        if(h->nlmsg_flags & NLM_F_DUMP_INTR)
+            *intr = 1;
+        switch(h->nlmsg_type){
+        case NLMSG_DONE:
+            *done = 1;
+            break;
+        case NLMSG_ERROR: {
+            struct nlmsgerr *err = NLMSG_DATA(h);
+            if(err->error != 0){
+                errno = -err->error;
+                return -1;
+            }
+            break;
+        }
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            apply_link(r, h);
+            break;
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            apply_addr(r, h);
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+/*
+request a dump of type and apply the replies; Return 1 if it was interrupted or
+changes were lost while it ran, 0 when complete, -1 with errno set
+*/
+static int dump(struct netdev_registry *r, int type){
+    struct{
+        struct nlmsghdr h;
+        struct rtgenmsg g;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.h.nlmsg_len = NLMSG_LENGTH(sizeof(req.g));
+    req.h.nlmsg_type = type;
+    req.h.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.h.nlmsg_seq = ++r->seq;
+    req.g.rtgen_family = AF_UNSPEC;
+
+    if(send(r->fd, &req, req.h.nlmsg_len, 0) < 0)
+        return -1;
+
+    int done = 0, intr = 0;
+    while(!done){
+        struct pollfd pfd = {r->fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, NETDEV_DUMP_MS);
+        if(ready < 0 && errno == EINTR)
+            continue;
+        if(ready <= 0){
+            if(ready == 0)
+                errno = ETIMEDOUT;
+            return -1;
+        }
+        ssize_t n = recv(r->fd, r->buf, NETDEV_BUF, 0);
+        if(n < 0){
+            if(errno == EAGAIN || errno == EINTR)
+                continue;
+            // the socket overran and dropped changes, not the dump, which goes on; it is redone like an interrupted one
+            if(errno == ENOBUFS){
+                intr = 1;
+                continue;
+            }
+            return -1;
+        }
+        if(dispatch(r, (size_t)n, &done, &intr) != 0)
+            return -1;
+    }
+    return intr;
+}
+
+/*
+Replace the registry with a fresh dump and report how it differs from before
+
+Return 0, or -1 with errno set; the registry may then be incomplete
+*/
+static int resync(struct netdev_registry *r){
+    struct netdev *old = r->devs;
+    int nold = r->ndevs;
+    int res = 0;
+
+    for(int tries = 0; tries < NETDEV_DUMP_TRIES; tries++){
+        if(tries > 0)
+            free_devs(r->devs, r->ndevs);
+        r->devs = NULL;
+        r->ndevs = r->devs_cap = 0;
+        r->quiet = 1;
+        int a = dump(r, RTM_GETLINK);
+        int b = a < 0 ? a : dump(r, RTM_GETADDR);
+        r->quiet = 0;
+        res = a < 0 || b < 0 ? -1 : 0;
+        if(res != 0 || (a == 0 && b == 0))
+            break;
+    }
+
+    for(int i = 0; i < nold; i++){
+        if(find(r, old[i].index) == NULL)
+            push_event(r, NETDEV_REMOVED, &old[i], NULL, NULL);
+    }
+    for(int i = 0; i < r->ndevs; i++){
+        struct netdev *d = &r->devs[i];
+        const struct netdev *o = NULL;
+        for(int j = 0; j < nold && o == NULL; j++)
+            if(old[j].index == d->index)
+                o = &old[j];
+        if(o == NULL){
+            push_event(r, NETDEV_ADDED, d, NULL, NULL);
+            continue;
+        }
+        if(strcmp(o->name, d->name) != 0)
+            push_event(r, NETDEV_RENAMED, d, NULL, o->name);
+        if(is_up(o->flags) != is_up(d->flags))
+            push_event(r, is_up(d->flags) ? NETDEV_UP : NETDEV_DOWN, d, NULL, NULL);
+        for(int j = 0; j < o->naddrs; j++){
+            int k = 0;
+            while(k < d->naddrs && !addr_eq(&d->addrs[k], &o->addrs[j]))
+                k++;
+            if(k == d->naddrs)
+                push_event(r, NETDEV_ADDR_REMOVED, d, &o->addrs[j], NULL);
+        }
+        for(int k = 0; k < d->naddrs; k++){
+            int j = 0;
+            while(j < o->naddrs && !addr_eq(&d->addrs[k], &o->addrs[j]))
+                j++;
+            if(j == o->naddrs)
+                push_event(r, NETDEV_ADDR_ADDED, d, &d->addrs[k], NULL);
+        }
+    }
+
+    free_devs(old, nold);
+    r->generation++;
+    return res;
+}
+
+/* Return 0, or -1 with errno set */
+int netdev_open(struct netdev_registry *r){
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    r->events = calloc(NETDEV_EVENTS_MAX, sizeof(*r->events));
+    r->buf = malloc(NETDEV_BUF);
+    if(r->events == NULL || r->buf == NULL)
+        goto error;
+
+    r->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+    if(r->fd < 0)
+        goto error;
+    int rcvbuf = NETDEV_RCVBUF;
+    setsockopt(r->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)); // best effort, overruns resync
+
+    struct sockaddr_nl sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    if(bind(r->fd, (struct sockaddr *)&sa, sizeof(sa)) != 0)
+        goto error;
+
+    if(resync(r) != 0)
+        goto error;
+    r->nevents = 0; // everything is new on open; that is not news
+    r->resyncs = 0;
+    return 0;
+
+error:;
+    int saved = errno;
+    netdev_close(r);
+    errno = saved;
+    return -1;
+}
+
+void netdev_close(struct netdev_registry *r){
+    if(r->fd >= 0)
+        close(r->fd);
+    r->fd = -1;
+    free_devs(r->devs, r->ndevs);
+    r->devs = NULL;
+    r->ndevs = r->devs_cap = 0;
+    free(r->events);
+    r->events = NULL;
+    r->nevents = 0;
+    free(r->buf);
+    r->buf = NULL;
+}
+
+/* wait up to timeout_ms (-1: forever) for changes; Return 1 if there are some, 0 on timeout, -1 with errno set */
+int netdev_wait(const struct netdev_registry *r, int timeout_ms){
+    struct pollfd pfd = {r->fd, POLLIN, 0};
+    return poll(&pfd, 1, timeout_ms);
+}
+
+/* apply every change the kernel has sent so far, without blocking; Return 0, or -1 with errno set */
+int netdev_update(struct netdev_registry *r){
+    for(;;){
+        ssize_t n = recv(r->fd, r->buf, NETDEV_BUF, MSG_DONTWAIT);
+        if(n < 0){
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if(errno == EINTR)
+                continue;
+            if(errno == ENOBUFS){
+                // changes were lost; what they did can only be learnt from a new dump
+                r->resyncs++;
+                if(resync(r) != 0)
+                    return -1;
+                continue;
+            }
+            return -1;
+        }
+        int done = 0, intr = 0;
+        if(dispatch(r, (size_t)n, &done, &intr) != 0)
+            return -1;
+    }
+}
+
+static void counters_from_link(struct nlmsghdr *h, struct netdev_counters *c){
+    struct ifinfomsg *ifi = NLMSG_DATA(h);
+    memset(c, 0, sizeof(*c));
+    c->index = ifi->ifi_index;
+    int len = IFLA_PAYLOAD(h);
+    for(struct rtattr *a = IFLA_RTA(ifi); RTA_OK(a, len); a = RTA_NEXT(a, len)){
+        if(a->rta_type == IFLA_IFNAME){
+            size_t n = RTA_PAYLOAD(a) < IF_NAMESIZE ? RTA_PAYLOAD(a) : IF_NAMESIZE - 1;
+            memcpy(c->name, RTA_DATA(a), n);
+            c->name[n] = '\0';
+        } else if(a->rta_type == IFLA_STATS64 && RTA_PAYLOAD(a) >= sizeof(struct rtnl_link_stats64)){
+            struct rtnl_link_stats64 st;
+            memcpy(&st, RTA_DATA(a), sizeof(st)); // attributes are only 4 byte aligned
+            c->rx_packets = st.rx_packets;
+            c->tx_packets = st.tx_packets;
+            c->rx_bytes = st.rx_bytes;
+            c->tx_bytes = st.tx_bytes;
+            c->rx_errors = st.rx_errors;
+            c->tx_errors = st.tx_errors;
+            c->rx_dropped = st.rx_dropped;
+            c->tx_dropped = st.tx_dropped;
+            c->rx_missed = st.rx_missed_errors;
+            c->multicast = st.multicast;
+        }
+    }
+}
+
+/*
+Counters of every interface from a single RTM_GETLINK dump, stamped with
+CLOCK_MONOTONIC when the dump was requested; the kernel fills all of them
+from one walk of its device list, so there is no per-interface cost beyond
+the message itself. *out is malloc'd. Return 0, or -1 with errno set
+*/
+int netdev_read_counters(struct netdev_counters **out, int *n, uint64_t *ts_ns){
+    struct netdev_counters *cs = NULL;
+    int count = 0, cap = 0, res = -1;
+    unsigned char *buf = malloc(NETDEV_BUF);
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if(buf == NULL || fd < 0)
+        goto done;
+
+    struct{
+        struct nlmsghdr h;
+        struct ifinfomsg i;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.h.nlmsg_len = NLMSG_LENGTH(sizeof(req.i));
+    req.h.nlmsg_type = RTM_GETLINK;
+    req.h.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.h.nlmsg_seq = 1;
+    req.i.ifi_family = AF_UNSPEC;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    *ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    if(send(fd, &req, req.h.nlmsg_len, 0) < 0)
+        goto done;
+
+    for(int done = 0; !done;){
+        ssize_t len = recv(fd, buf, NETDEV_BUF, 0);
+        if(len < 0){
+            if(errno == EINTR)
+                continue;
+            goto done;
+        }
+        size_t left = (size_t)len;
+        for(struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, left); h = NLMSG_NEXT(h, left)){
+            if(h->nlmsg_type == NLMSG_DONE){
+                done = 1;
+                break;
+            }
+            if(h->nlmsg_type == NLMSG_ERROR){
+                struct nlmsgerr *err = NLMSG_DATA(h);
+                errno = err->error ? -err->error : EPROTO;
+                goto done;
+            }
+            if(h->nlmsg_type != RTM_NEWLINK || h->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+                continue;
+            if(count == cap){
+                cap = cap ? cap * 2 : 16;
+                struct netdev_counters *grown = realloc(cs, (size_t)cap * sizeof(*cs));
+                if(grown == NULL)
+                    goto done;
+                cs = grown;
+            }
+            counters_from_link(h, &cs[count++]);
+        }
+    }
+    res = 0;
+
+done:;
+    int saved = errno;
+    if(fd >= 0)
+        close(fd);
+    free(buf);
+    if(res != 0){
+        free(cs);
+        cs = NULL;
+        count = 0;
+    }
+    *out = cs;
+    *n = count;
+    errno = saved;
+    return res;
+}
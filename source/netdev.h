@@ -0,0 +1,97 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdint.h>
+#include <net/if.h>
+
+#define PYPCAP_NETDEV // header guard
+#define NETDEV_EVENTS_MAX 4096 // changes queued between two reads of the event list
+#define NETDEV_BUF 65536 // big enough for any one rtnetlink message
+
+/*
+Network interfaces kept up to date from rtnetlink
+
+One NETLINK_ROUTE socket subscribed to link and IPv4/IPv6 address groups.
+The registry is filled by a dump when opened and then only changed by the
+messages the kernel sends, so reading it costs nothing while interfaces stay
+as they are; generation is bumped whenever what it holds actually changes.
+If the kernel drops messages (the socket overran) the registry is dumped
+again and the difference reported as events, so no change goes unseen.
+
+Only kernel network interfaces are covered; pcap_findalldevs also lists
+pseudo devices such as "any" or usb/bluetooth monitors.
+*/
+struct netdev_addr{
+    int family; // AF_INET or AF_INET6
+    int prefixlen;
+    int has_broadcast;
+    unsigned char addr[16];
+    unsigned char broadcast[16];
+};
+
+struct netdev{
+    int index;
+    char name[IF_NAMESIZE];
+    unsigned int flags; // IFF_*
+    int naddrs;
+    int addrs_cap;
+    struct netdev_addr *addrs;
+};
+
+enum netdev_event_type{
+    NETDEV_ADDED,
+    NETDEV_REMOVED,
+    NETDEV_UP, // IFF_UP and IFF_RUNNING both set: administratively up with a carrier
+    NETDEV_DOWN,
+    NETDEV_RENAMED,
+    NETDEV_ADDR_ADDED,
+    NETDEV_ADDR_REMOVED,
+};
+
+struct netdev_event{
+    enum netdev_event_type type;
+    int index;
+    char name[IF_NAMESIZE];
+    char old_name[IF_NAMESIZE]; // NETDEV_RENAMED
+    unsigned int flags;
+    struct netdev_addr addr; // NETDEV_ADDR_*
+};
+
+struct netdev_registry{
+    int fd;
+    uint32_t seq;
+    int ndevs;
+    int devs_cap;
+    struct netdev *devs;
+    uint64_t generation;
+    int quiet; // set while dumping: changes are not events
+    int nevents;
+    struct netdev_event *events; // NETDEV_EVENTS_MAX
+    unsigned char *buf; // receive buffer, NETDEV_BUF bytes
+    uint64_t events_dropped;
+    uint64_t messages;
+    uint64_t resyncs;
+};
+
+/* kernel traffic counters of one interface, from IFLA_STATS64 */
+struct netdev_counters{
+    int index;
+    char name[IF_NAMESIZE];
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_errors;
+    uint64_t tx_errors;
+    uint64_t rx_dropped;
+    uint64_t tx_dropped;
+    uint64_t rx_missed; // dropped by the NIC for lack of ring buffers
+    uint64_t multicast;
+};
+
+extern const char *netdev_event_names[];
+
+int netdev_open(struct netdev_registry *r);
+void netdev_close(struct netdev_registry *r);
+int netdev_wait(const struct netdev_registry *r, int timeout_ms);
+int netdev_update(struct netdev_registry *r);
+int netdev_read_counters(struct netdev_counters **out, int *n, uint64_t *ts_ns);
@@ -0,0 +1,290 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#include <structmember.h>
+#include <pcap.h>
+
+#ifndef PYPCAP_BUFFER
+#include "buffer.h"
+#endif
+
+#ifndef PYPCAP_DISSECT
+#include "dissect.h"
+#endif
+
+#define PYPCAP_PACKET
+#define PACKET_FREELIST_MAX 1024
+
+/*
+A captured packet
+
+Fixed C fields instead of a __dict__; header fields are only dissected
+the first time one of the decoded properties is read.
+*/
+typedef struct{
+    PyObject_HEAD
+    long long ts_ns;
+    unsigned int caplen;
+    unsigned int wirelen;
+    int linktype;
+    int dissected;
+    PyObject *interface;
+    PyObject *data; // memoryview, created on first access
+    struct pkt_buf *buf;
+    size_t offset;
+    struct pkt_meta meta;
+} Packet;
+
+static PyTypeObject PacketType;
+
+/* dead Packet objects kept for reuse, so steady-state reading does no object allocations */
+static Packet *packet_freelist[PACKET_FREELIST_MAX];
+static int packet_freelist_len = 0;
+
+/*
+Return a new Packet over caplen bytes of buf at offset
+
+Takes a new reference on buf and on interface (which may be NULL for None)
+*/
+static PyObject *
+Packet_New(struct pkt_buf *buf, size_t offset, long long ts_ns, unsigned int caplen, unsigned int wirelen, int linktype, PyObject *interface)
+{
+    Packet *self;
+    if(packet_freelist_len > 0){
+        self = packet_freelist[--packet_freelist_len];
+        PyObject_Init((PyObject *)self, &PacketType);
+    } else {
+        self = PyObject_New(Packet, &PacketType);
+        if(self == NULL)
+            return NULL;
+    }
+
+    pkt_buf_incref(buf);
+    self->buf = buf;
+    self->offset = offset;
+    self->ts_ns = ts_ns;
+    self->caplen = caplen;
+    self->wirelen = wirelen;
+    self->linktype = linktype;
+    self->dissected = 0;
+    self->data = NULL;
+    Py_XINCREF(interface);
+    self->interface = interface;
+
+    return (PyObject *)self;
+}
+
+/* deallocation method, parks the object on the freelist when there is room */
+static void
+Packet_dealloc(Packet *self)
+{
+    Py_CLEAR(self->data);
+    Py_CLEAR(self->interface);
+    pkt_buf_decref(self->buf);
+    self->buf = NULL;
+
+    if(packet_freelist_len < PACKET_FREELIST_MAX){
+        packet_freelist[packet_freelist_len++] = self;
+        return;
+    }
+    PyObject_Free(self);
+}
+
+static const struct pkt_meta *
+Packet_meta(Packet *self)
+{
+    if(!self->dissected){
+        dissect_packet(self->linktype, self->buf->data + self->offset, self->caplen, &self->meta);
+        self->dissected = 1;
+    }
+    return &self->meta;
+}
+
+/* getters; fixed fields first, then the lazily dissected ones */
+static PyObject *
+Packet_get_timestamp(Packet *self, void *closure)
+{
+    return PyFloat_FromDouble((double)self->ts_ns / 1e9);
+}
+
+static PyObject *
+Packet_get_timestamp_ns(Packet *self, void *closure)
+{
+    return PyLong_FromLongLong(self->ts_ns);
+}
+
+static PyObject *
+Packet_get_caplen(Packet *self, void *closure)
+{
+    return PyLong_FromUnsignedLong(self->caplen);
+}
+
+static PyObject *
+Packet_get_wirelen(Packet *self, void *closure)
+{
+    return PyLong_FromUnsignedLong(self->wirelen);
+}
+
+static PyObject *
+Packet_get_linktype(Packet *self, void *closure)
+{
+    return PyLong_FromLong(self->linktype);
+}
+
+static PyObject *
+Packet_get_interface(Packet *self, void *closure)
+{
+    if(self->interface == NULL)
+        return Py_BuildValue("");
+    Py_INCREF(self->interface);
+    return self->interface;
+}
+
+static PyObject *
+Packet_get_data(Packet *self, void *closure)
+{
+    if(self->data == NULL){
+        self->data = PacketBuffer_MemoryView(self->buf, self->offset, self->caplen);
+        if(self->data == NULL)
+            return NULL;
+    }
+    Py_INCREF(self->data);
+    return self->data;
+}
+
+static PyObject *
+Packet_get_ethertype(Packet *self, void *closure)
+{
+    return PyLong_FromLong(Packet_meta(self)->ethertype);
+}
+
+static PyObject *
+Packet_get_vlan(Packet *self, void *closure)
+{
+    const struct pkt_meta *meta = Packet_meta(self);
+    if(meta->vlan == 0)
+        return Py_BuildValue("");
+    return PyLong_FromLong(meta->vlan);
+}
+
+static PyObject *
+Packet_get_ip_version(Packet *self, void *closure)
+{
+    const struct pkt_meta *meta = Packet_meta(self);
+    if(meta->l3_offset < 0)
+        return Py_BuildValue("");
+    return PyLong_FromLong(meta->ip_version);
+}
+
+static PyObject *
+Packet_get_addr(Packet *self, int which)
+{
+    const struct pkt_meta *meta = Packet_meta(self);
+    char host[INET6_ADDRSTRLEN];
+    if(meta->l3_offset < 0 || dissect_addr_string(meta, which ? meta->dst : meta->src, host, sizeof(host)) != 0)
+        return Py_BuildValue("");
+    return PyUnicode_FromString(host);
+}
+
+static PyObject *
+Packet_get_src(Packet *self, void *closure)
+{
+    return Packet_get_addr(self, 0);
+}
+
+static PyObject *
+Packet_get_dst(Packet *self, void *closure)
+{
+    return Packet_get_addr(self, 1);
+}
+
+static PyObject *
+Packet_get_protocol(Packet *self, void *closure)
+{
+    const struct pkt_meta *meta = Packet_meta(self);
+    if(meta->l3_offset < 0)
+        return Py_BuildValue("");
+    return PyLong_FromLong(meta->ip_proto);
+}
+
+static PyObject *
+Packet_get_ttl(Packet *self, void *closure)
+{
+    const struct pkt_meta *meta = Packet_meta(self);
+    if(meta->l3_offset < 0)
+        return Py_BuildValue("");
+    return PyLong_FromLong(meta->ttl);
+}
+
+static PyObject *
+Packet_get_sport(Packet *self, void *closure)
+{
+    const struct pkt_meta *meta = Packet_meta(self);
+    if(meta->l4_offset < 0 || (meta->sport == 0 && meta->dport == 0))
+        return Py_BuildValue("");
+    return PyLong_FromLong(meta->sport);
+}
+
+static PyObject *
+Packet_get_dport(Packet *self, void *closure)
+{
+    const struct pkt_meta *meta = Packet_meta(self);
+    if(meta->l4_offset < 0 || (meta->sport == 0 && meta->dport == 0))
+        return Py_BuildValue("");
+    return PyLong_FromLong(meta->dport);
+}
+
+static PyObject *
+Packet_get_payload(Packet *self, void *closure)
+{
+    const struct pkt_meta *meta = Packet_meta(self);
+    if(meta->payload_offset < 0)
+        return Py_BuildValue("");
+    return PacketBuffer_MemoryView(self->buf, self->offset + meta->payload_offset, self->caplen - meta->payload_offset);
+}
+
+static PyGetSetDef Packet_getsetters[] = {
+    {"timestamp", (getter) Packet_get_timestamp, NULL, "capture time in seconds since the epoch", NULL},
+    {"timestamp_ns", (getter) Packet_get_timestamp_ns, NULL, "capture time in nanoseconds since the epoch", NULL},
+    {"caplen", (getter) Packet_get_caplen, NULL, "number of bytes captured", NULL},
+    {"wirelen", (getter) Packet_get_wirelen, NULL, "length of the packet on the wire", NULL},
+    {"linktype", (getter) Packet_get_linktype, NULL, "link-layer header type of data", NULL},
+    {"interface", (getter) Packet_get_interface, NULL, "interface the packet was captured on, or None", NULL},
+    {"data", (getter) Packet_get_data, NULL, "memoryview of the captured bytes", NULL},
+    {"ethertype", (getter) Packet_get_ethertype, NULL, "ethertype of the network layer, 0 if unknown", NULL},
+    {"vlan", (getter) Packet_get_vlan, NULL, "outer vlan id, or None", NULL},
+    {"ip_version", (getter) Packet_get_ip_version, NULL, "4, 6, or None for non-IP packets", NULL},
+    {"src", (getter) Packet_get_src, NULL, "source IP address, or None", NULL},
+    {"dst", (getter) Packet_get_dst, NULL, "destination IP address, or None", NULL},
+    {"protocol", (getter) Packet_get_protocol, NULL, "IP protocol number, or None", NULL},
+    {"ttl", (getter) Packet_get_ttl, NULL, "IPv4 ttl / IPv6 hop limit, or None", NULL},
+    {"sport", (getter) Packet_get_sport, NULL, "TCP/UDP/SCTP source port, or None", NULL},
+    {"dport", (getter) Packet_get_dport, NULL, "TCP/UDP/SCTP destination port, or None", NULL},
+    {"payload", (getter) Packet_get_payload, NULL, "memoryview of the transport payload, or None", NULL},
+    {NULL}
+};
+
+static PyObject *
+Packet_repr(Packet *self)
+{
+    return PyUnicode_FromFormat("<pypcap.Packet timestamp_ns=%lld caplen=%u wirelen=%u>", self->ts_ns, self->caplen, self->wirelen);
+}
+
+/*
+Packet Type construction
+
+.tp_flags:
+    no Py_TPFLAGS_BASETYPE: the freelist assumes every instance is exactly a Packet
+    no Py_TPFLAGS_HAVE_GC: a Packet only references strings and memoryviews, so it can't be part of a cycle
+*/
+static PyTypeObject PacketType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.Packet",
+    .tp_doc = "A captured packet with lazily decoded header fields",
+    .tp_basicsize = sizeof(Packet),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor) Packet_dealloc,
+    .tp_repr = (reprfunc) Packet_repr,
+    .tp_getset = Packet_getsetters, // custom getter methods, all read-only
+};
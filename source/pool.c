@@ -0,0 +1,434 @@
+#ifndef PYPCAP_POOL
+#include "pool.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+#endif
+
+#ifndef PYPCAP_AFFINITY
+#include "affinity.h"
+#endif
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define PKT_POOL_REFILL 16 // buffers moved from a class free list into a thread cache at once
+
+static const size_t pkt_pool_sizes[PKT_POOL_NCLASSES] = {256, 2048, 16384, 65536, 262144};
+
+struct pkt_pool_class{
+    pthread_mutex_t lock;
+    struct pkt_buf *free;
+    uint64_t free_count;
+    uint64_t buffers;
+    uint64_t slabs;
+    uint64_t in_use; // atomic
+};
+
+struct pkt_pool{
+    int numa_node;
+    struct pkt_pool_class classes[PKT_POOL_NCLASSES];
+    /* atomic counters */
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t cache_hits;
+    uint64_t large_allocations;
+    uint64_t large_in_use;
+    uint64_t large_bytes_in_use;
+    uint64_t bytes_reserved;
+};
+
+/* one pool per numa node, index 0 is the "no preference" pool */
+static struct pkt_pool *pools[PKT_POOL_MAX_NODES + 1];
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* per-thread cache of free buffers, bound to the last pool the thread used */
+struct pkt_tcache{
+    struct pkt_pool *pool;
+    struct pkt_buf *head[PKT_POOL_NCLASSES];
+    unsigned int count[PKT_POOL_NCLASSES];
+};
+
+static __thread struct pkt_tcache tcache;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+
+#define ATOMIC_ADD(ptr, v) __atomic_fetch_add((ptr), (v), __ATOMIC_RELAXED)
+#define ATOMIC_SUB(ptr, v) __atomic_fetch_sub((ptr), (v), __ATOMIC_RELAXED)
+#define ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+
+static size_t page_round(size_t size){
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + page - 1) & ~(page - 1);
+}
+
+/*
+Map size bytes of anonymous memory, preferring pages from numa_node
+
+Return NULL on failure
+*/
+void *pool_region_alloc(size_t size, int numa_node){
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED)
+        return NULL;
+
+    // must happen before the pages are first touched
+    numa_bind_region(mem, size, numa_node);
+
+    return mem;
+}
+
+void pool_region_free(void *addr, size_t size){
+    if(addr != NULL)
+        munmap(addr, size);
+}
+
+size_t pkt_pool_class_size(int cls){
+    if(cls < 0 || cls >= PKT_POOL_NCLASSES)
+        return 0;
+    return pkt_pool_sizes[cls];
+}
+
+static int size_to_class(size_t size){
+    for(int cls = 0; cls < PKT_POOL_NCLASSES; cls++){
+        if(size <= pkt_pool_sizes[cls])
+            return cls;
+    }
+    return PKT_BUF_LARGE;
+}
+
+/*
+Return the shared pool for a numa node (-1 for no preference), creating it on first use
+*/
+struct pkt_pool *pkt_pool_get(int numa_node){
+    if(numa_node < -1 || numa_node >= PKT_POOL_MAX_NODES)
+        numa_node = -1;
+
+    struct pkt_pool *pool = __atomic_load_n(&pools[numa_node + 1], __ATOMIC_ACQUIRE);
+    if(pool != NULL)
+        return pool;
+
+    pthread_mutex_lock(&pools_lock);
+    pool = pools[numa_node + 1];
+    if(pool == NULL){
+        pool = calloc(1, sizeof(struct pkt_pool));
+        if(pool != NULL){
+            pool->numa_node = numa_node;
+            for(int cls = 0; cls < PKT_POOL_NCLASSES; cls++)
+                pthread_mutex_init(&pool->classes[cls].lock, NULL);
+            __atomic_store_n(&pools[numa_node + 1], pool, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&pools_lock);
+
+    return pool;
+}
+
+/* call fn on every pool created so far, stopping early if fn returns non-zero */
+int pkt_pool_each(int (*fn)(struct pkt_pool *pool, void *arg), void *arg){
+    for(int i = 0; i <= PKT_POOL_MAX_NODES; i++){
+        struct pkt_pool *pool = __atomic_load_n(&pools[i], __ATOMIC_ACQUIRE);
+        if(pool == NULL)
+            continue;
+        int res = fn(pool, arg);
+        if(res != 0)
+            return res;
+    }
+    return 0;
+}
+
+void pkt_pool_stats(struct pkt_pool *pool, struct pkt_pool_stats *stats){
+    memset(stats, 0, sizeof(*stats));
+    stats->numa_node = pool->numa_node;
+    stats->allocations = ATOMIC_LOAD(&pool->allocations);
+    stats->frees = ATOMIC_LOAD(&pool->frees);
+    stats->cache_hits = ATOMIC_LOAD(&pool->cache_hits);
+    stats->large_allocations = ATOMIC_LOAD(&pool->large_allocations);
+    stats->large_in_use = ATOMIC_LOAD(&pool->large_in_use);
+    stats->large_bytes_in_use = ATOMIC_LOAD(&pool->large_bytes_in_use);
+    stats->bytes_reserved = ATOMIC_LOAD(&pool->bytes_reserved);
+
+    for(int cls = 0; cls < PKT_POOL_NCLASSES; cls++){
+        struct pkt_pool_class *c = &pool->classes[cls];
+        pthread_mutex_lock(&c->lock);
+        stats->classes[cls].size = pkt_pool_sizes[cls];
+        stats->classes[cls].slabs = c->slabs;
+        stats->classes[cls].buffers = c->buffers;
+        stats->classes[cls].free = c->free_count;
+        pthread_mutex_unlock(&c->lock);
+        stats->classes[cls].in_use = ATOMIC_LOAD(&c->in_use);
+    }
+}
+
+/*
+Carve a fresh slab into buffers of class cls and push them on the free list
+
+Caller holds the class lock. Return 0 on success, -1 if no memory could be mapped
+*/
+static int slab_grow(struct pkt_pool *pool, int cls){
+    struct pkt_pool_class *c = &pool->classes[cls];
+    size_t stride = sizeof(struct pkt_buf) + pkt_pool_sizes[cls];
+    size_t count = PKT_POOL_SLAB_BYTES / stride;
+
+    unsigned char *slab = pool_region_alloc(PKT_POOL_SLAB_BYTES, pool->numa_node);
+    if(slab == NULL)
+        return -1;
+
+    for(size_t i = 0; i < count; i++){
+        struct pkt_buf *buf = (struct pkt_buf *)(slab + i * stride);
+        buf->pool = pool;
+        buf->data = (unsigned char *)(buf + 1);
+        buf->size = pkt_pool_sizes[cls];
+        buf->cls = cls;
+        buf->next = c->free;
+        c->free = buf;
+    }
+
+    c->free_count += count;
+    c->buffers += count;
+    c->slabs++;
+    ATOMIC_ADD(&pool->bytes_reserved, PKT_POOL_SLAB_BYTES);
+
+    return 0;
+}
+
+/* return everything above keep buffers of class cls from the thread cache to its pool */
+static void tcache_trim(struct pkt_tcache *tc, int cls, unsigned int keep){
+    if(tc->pool == NULL || tc->count[cls] <= keep)
+        return;
+
+    struct pkt_buf *head = tc->head[cls];
+    struct pkt_buf *tail = head;
+    unsigned int moved = 1;
+    while(tc->count[cls] - moved > keep){
+        tail = tail->next;
+        moved++;
+    }
+    tc->head[cls] = tail->next;
+    tc->count[cls] -= moved;
+
+    struct pkt_pool_class *c = &tc->pool->classes[cls];
+    pthread_mutex_lock(&c->lock);
+    tail->next = c->free;
+    c->free = head;
+    c->free_count += moved;
+    pthread_mutex_unlock(&c->lock);
+}
+
+static void tcache_flush(struct pkt_tcache *tc){
+    for(int cls = 0; cls < PKT_POOL_NCLASSES; cls++)
+        tcache_trim(tc, cls, 0);
+}
+
+/* pthread key destructor: hand the exiting thread's cached buffers back */
+static void tcache_destroy(void *arg){
+    tcache_flush((struct pkt_tcache *)arg);
+}
+
+static void tcache_key_init(void){
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/* bind the calling thread's cache to pool, flushing whatever it held for another pool */
+static struct pkt_tcache *tcache_for(struct pkt_pool *pool){
+    struct pkt_tcache *tc = &tcache;
+    if(tc->pool == pool)
+        return tc;
+
+    if(tc->pool == NULL){
+        pthread_once(&tcache_once, tcache_key_init);
+        pthread_setspecific(tcache_key, tc);
+    } else {
+        tcache_flush(tc);
+    }
+    tc->pool = pool;
+
+    return tc;
+}
+
+static struct pkt_buf *large_alloc(struct pkt_pool *pool, size_t size){
+    size_t mapped = page_round(sizeof(struct pkt_buf) + size);
+    struct pkt_buf *buf = pool_region_alloc(mapped, pool->numa_node);
+    if(buf == NULL)
+        return NULL;
+
+    buf->pool = pool;
+    buf->data = (unsigned char *)(buf + 1);
+    buf->size = mapped - sizeof(struct pkt_buf);
+    buf->cls = PKT_BUF_LARGE;
+
+    ATOMIC_ADD(&pool->large_allocations, 1);
+    ATOMIC_ADD(&pool->large_in_use, 1);
+    ATOMIC_ADD(&pool->large_bytes_in_use, mapped);
+
+    return buf;
+}
+
+/*
+Return a buffer with at least size bytes of data and a refcount of 1, or NULL if out of memory
+*/
+struct pkt_buf *pkt_buf_alloc(struct pkt_pool *pool, size_t size){
+    struct pkt_buf *buf;
+    int cls = size_to_class(size);
+
+    if(cls == PKT_BUF_LARGE){
+        buf = large_alloc(pool, size);
+        if(buf == NULL)
+            return NULL;
+    } else {
+        struct pkt_tcache *tc = tcache_for(pool);
+
+        if(tc->head[cls] != NULL){
+            ATOMIC_ADD(&pool->cache_hits, 1);
+        } else {
+            // refill the thread cache from the shared free list in one go
+            struct pkt_pool_class *c = &pool->classes[cls];
+            pthread_mutex_lock(&c->lock);
+            if(c->free == NULL && slab_grow(pool, cls) != 0){
+                pthread_mutex_unlock(&c->lock);
+                return NULL;
+            }
+            for(int i = 0; i < PKT_POOL_REFILL && c->free != NULL; i++){
+                struct pkt_buf *b = c->free;
+                c->free = b->next;
+                c->free_count--;
+                b->next = tc->head[cls];
+                tc->head[cls] = b;
+                tc->count[cls]++;
+            }
+            pthread_mutex_unlock(&c->lock);
+        }
+
+        buf = tc->head[cls];
+        tc->head[cls] = buf->next;
+        tc->count[cls]--;
+        ATOMIC_ADD(&pool->classes[cls].in_use, 1);
+    }
+
+    buf->next = NULL;
+    buf->len = 0;
+    buf->refcnt = 1;
+    ATOMIC_ADD(&pool->allocations, 1);
+
+    return buf;
+}
+
+/*
+Make buf hold at least size bytes, keeping its first buf->len bytes
+
+Only valid while the caller holds the sole reference. Return the (possibly moved) buffer,
+or NULL on failure, in which case buf is untouched
+*/
+struct pkt_buf *pkt_buf_grow(struct pkt_buf *buf, size_t size){
+    if(size <= buf->size)
+        return buf;
+
+    if(buf->cls == PKT_BUF_LARGE){
+        size_t old_mapped = sizeof(struct pkt_buf) + buf->size;
+        size_t mapped = page_round(sizeof(struct pkt_buf) + size);
+        // grow geometrically so repeated appends stay amortised O(1)
+        if(mapped < 2 * old_mapped)
+            mapped = page_round(2 * old_mapped);
+
+        struct pkt_buf *moved = mremap(buf, old_mapped, mapped, MREMAP_MAYMOVE);
+        if(moved == MAP_FAILED)
+            return NULL;
+        moved->data = (unsigned char *)(moved + 1);
+        moved->size = mapped - sizeof(struct pkt_buf);
+        ATOMIC_ADD(&moved->pool->large_bytes_in_use, mapped - old_mapped);
+        return moved;
+    }
+
+    struct pkt_buf *bigger = pkt_buf_alloc(buf->pool, size);
+    if(bigger == NULL)
+        return NULL;
+    memcpy(bigger->data, buf->data, buf->len);
+    bigger->len = buf->len;
+    pkt_buf_decref(buf);
+
+    return bigger;
+}
+
+/*
+Wrap memory owned elsewhere (e.g. a shared mapping) so it can be handed out like pooled memory
+
+release is called once the last reference is dropped
+*/
+struct pkt_buf *pkt_buf_external(unsigned char *data, size_t size, void (*release)(struct pkt_buf *), void *owner){
+    struct pkt_buf *buf = calloc(1, sizeof(struct pkt_buf));
+    if(buf == NULL)
+        return NULL;
+
+    buf->data = data;
+    buf->size = size;
+    buf->len = size;
+    buf->cls = PKT_BUF_EXTERNAL;
+    buf->refcnt = 1;
+    buf->release = release;
+    buf->owner = owner;
+
+    return buf;
+}
+
+void pkt_buf_incref(struct pkt_buf *buf){
+    __atomic_fetch_add(&buf->refcnt, 1, __ATOMIC_RELAXED);
+}
+
+void pkt_buf_decref(struct pkt_buf *buf){
+    if(buf == NULL)
+        return;
+    if(__atomic_sub_fetch(&buf->refcnt, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    if(buf->cls == PKT_BUF_EXTERNAL){
+        if(buf->release != NULL)
+            buf->release(buf);
+        free(buf);
+        return;
+    }
+
+    struct pkt_pool *pool = buf->pool;
+    ATOMIC_ADD(&pool->frees, 1);
+
+    if(buf->cls == PKT_BUF_LARGE){
+        size_t mapped = sizeof(struct pkt_buf) + buf->size;
+        ATOMIC_SUB(&pool->large_in_use, 1);
+        ATOMIC_SUB(&pool->large_bytes_in_use, mapped);
+        pool_region_free(buf, mapped);
+        return;
+    }
+
+    int cls = buf->cls;
+    ATOMIC_SUB(&pool->classes[cls].in_use, 1);
+
+    struct pkt_tcache *tc = tcache_for(pool);
+    buf->next = tc->head[cls];
+    tc->head[cls] = buf;
+    tc->count[cls]++;
+    if(tc->count[cls] > PKT_POOL_TCACHE_MAX)
+        tcache_trim(tc, cls, PKT_POOL_TCACHE_MAX / 2);
+}
+
+/*
+Copy len bytes into the shared chunk *chunk, starting a fresh chunk of chunk_size bytes when it is full
+
+Lets consecutive packets share one pooled buffer. *chunk holds the caller's reference.
+Return the chunk now holding the copy (borrowed) with its position in *offset, or NULL if out of memory
+*/
+struct pkt_buf *pkt_chunk_append(struct pkt_buf **chunk, struct pkt_pool *pool, size_t chunk_size, const void *data, size_t len, size_t *offset){
+    struct pkt_buf *c = *chunk;
+    if(c == NULL || c->size - c->len < len){
+        pkt_buf_decref(c);
+        *chunk = NULL;
+        c = pkt_buf_alloc(pool, len > chunk_size ? len : chunk_size);
+        if(c == NULL)
+            return NULL;
+        *chunk = c;
+    }
+
+    *offset = c->len;
+    memcpy(c->data + c->len, data, len);
+    c->len += len;
+
+    return c;
+}
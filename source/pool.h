@@ -0,0 +1,72 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PYPCAP_POOL // header guard
+
+/*
+Size classes served from slabs; anything larger is a "large" buffer mapped on its own
+*/
+#define PKT_POOL_NCLASSES 5
+#define PKT_POOL_SLAB_BYTES (2 * 1024 * 1024)
+#define PKT_POOL_TCACHE_MAX 64 // buffers per class kept in a thread's cache
+#define PKT_POOL_MAX_NODES 64
+
+#define PKT_BUF_LARGE PKT_POOL_NCLASSES
+#define PKT_BUF_EXTERNAL (PKT_POOL_NCLASSES + 1)
+
+struct pkt_pool;
+
+/*
+Refcounted packet memory
+
+Slab and large buffers carry their data right after this header.
+External buffers point at memory owned by someone else, and call release() on the last decref.
+*/
+struct pkt_buf{
+    struct pkt_buf *next; // free list link, only valid while the buffer is free
+    struct pkt_pool *pool;
+    unsigned char *data;
+    size_t size; // usable bytes at data
+    size_t len; // bytes in use, maintained by whoever fills the buffer
+    int cls;
+    int refcnt;
+    void (*release)(struct pkt_buf *buf);
+    void *owner;
+} __attribute__((aligned(64)));
+
+struct pkt_pool_class_stats{
+    size_t size;
+    uint64_t slabs;
+    uint64_t buffers;
+    uint64_t free;
+    uint64_t in_use;
+};
+
+struct pkt_pool_stats{
+    int numa_node;
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t cache_hits;
+    uint64_t large_allocations;
+    uint64_t large_in_use;
+    uint64_t large_bytes_in_use;
+    uint64_t bytes_reserved;
+    struct pkt_pool_class_stats classes[PKT_POOL_NCLASSES];
+};
+
+struct pkt_pool *pkt_pool_get(int numa_node);
+int pkt_pool_each(int (*fn)(struct pkt_pool *pool, void *arg), void *arg);
+void pkt_pool_stats(struct pkt_pool *pool, struct pkt_pool_stats *stats);
+size_t pkt_pool_class_size(int cls);
+
+struct pkt_buf *pkt_buf_alloc(struct pkt_pool *pool, size_t size);
+struct pkt_buf *pkt_buf_grow(struct pkt_buf *buf, size_t size);
+struct pkt_buf *pkt_buf_external(unsigned char *data, size_t size, void (*release)(struct pkt_buf *), void *owner);
+void pkt_buf_incref(struct pkt_buf *buf);
+void pkt_buf_decref(struct pkt_buf *buf);
+struct pkt_buf *pkt_chunk_append(struct pkt_buf **chunk, struct pkt_pool *pool, size_t chunk_size, const void *data, size_t len, size_t *offset);
+
+void *pool_region_alloc(size_t size, int numa_node);
+void pool_region_free(void *addr, size_t size);
@@ -13,6 +13,53 @@
 #include "capture.h"
 #endif
 
+#ifndef PYPCAP_BUFFER
+#include "buffer.h"
+#endif
+
+#ifndef PYPCAP_PACKET
+#include "packet.h"
+#endif
+
+#ifndef PYPCAP_GENERATOR
+#include "generator.h"
+#endif
+
+#ifndef PYPCAP_REPLAY
+#include "replay.h"
+#endif
+
+#ifndef PYPCAP_DEDUPLICATOR
+#include "deduplicator.h"
+#endif
+
+#ifndef PYPCAP_DEVMONITOR
+#include "devmonitor.h"
+#endif
+
+#ifndef PYPCAP_IFCOUNTERS
+#include "ifcounters.h"
+#endif
+
+#ifndef PYPCAP_TRAFFICSTATS
+#include "trafficstats.h"
+#endif
+
+#ifndef PYPCAP_CARDINALITY
+#include "cardinality.h"
+#endif
+
+#ifndef PYPCAP_BLOOM
+#include "bloom.h"
+#endif
+
+#ifndef PYPCAP_SHAREDREADER
+#include "sharedreader.h"
+#endif
+
+#include <arpa/inet.h>
+#include <errno.h>
+
 /*
 Methods to create python objects
 */
@@ -162,10 +209,25 @@ PyObject *Py_Build_Interface(pcap_if_t *iface){
 
 /*
 Return dict of all network devices on this machine
+
+With counters=True each device the kernel keeps traffic counters for also
+gets a "counters" dict, all read in one netlink dump
 */
 static PyObject *
-find_all_devs(PyObject *self, PyObject *args)
+find_all_devs(PyObject *self, PyObject *args, PyObject *kwds)
 {
+    static char *kwlist[] = {"counters", NULL};
+    int with_counters = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|p", kwlist, &with_counters))
+        return NULL;
+
+    PyObject *counters = NULL;
+    if(with_counters){
+        counters = PyObject_CallNoArgs((PyObject *)&InterfaceCountersType);
+        if(counters == NULL)
+            return NULL;
+    }
+
     // get ifaces
     char errbuf[1024] = "";
     pcap_if_t *iface = malloc(sizeof(pcap_if_t));
@@ -176,6 +238,7 @@ find_all_devs(PyObject *self, PyObject *args)
     int res = pcap_findalldevs(&iface, errbuf);
 
     if(res == -1){
+        Py_XDECREF(counters);
         PyErr_SetString(PyExc_SystemError, errbuf);
         return NULL;
     }
@@ -186,8 +249,16 @@ find_all_devs(PyObject *self, PyObject *args)
     for(pcap_if_t *i = iface; i != NULL; i = i->next){
         PyObject *idict = Py_Build_Interface(i);
         PyObject *iface_name = Py_BuildValue("s", i->name);
+        if(counters != NULL && idict != NULL){
+            const struct netdev_counters *c = InterfaceCounters_find((InterfaceCounters *)counters, i->name);
+            PyObject *cdict = c != NULL ? InterfaceCounters_entry(c) : NULL;
+            if(cdict != NULL)
+                PyDict_SetItemString(idict, "counters", cdict);
+            Py_XDECREF(cdict);
+        }
         PyDict_SetItem(iface_dict, iface_name, idict);
     }
+    Py_XDECREF(counters);
 
     // clean up iface objects
     pcap_freealldevs(iface);
@@ -195,11 +266,280 @@ find_all_devs(PyObject *self, PyObject *args)
     return iface_dict;
 };
 
+/*
+Append a dict describing one packet buffer pool to the list passed as arg
+*/
+static int
+pool_stats_append(struct pkt_pool *pool, void *arg)
+{
+    struct pkt_pool_stats st;
+    pkt_pool_stats(pool, &st);
+
+    PyObject *classes = PyList_New(PKT_POOL_NCLASSES);
+    if(classes == NULL)
+        return -1;
+    for(Py_ssize_t i=0; i<PKT_POOL_NCLASSES; i++){
+        PyObject *c = Py_BuildValue(
+            "{s:n, s:K, s:K, s:K, s:K}",
+            "size", (Py_ssize_t)st.classes[i].size,
+            "slabs", (unsigned long long)st.classes[i].slabs,
+            "buffers", (unsigned long long)st.classes[i].buffers,
+            "free", (unsigned long long)st.classes[i].free,
+            "in_use", (unsigned long long)st.classes[i].in_use
+        );
+        if(c == NULL){
+            Py_DECREF(classes);
+            return -1;
+        }
+        PyList_SET_ITEM(classes, i, c);
+    }
+
+    PyObject *pool_dict = Py_BuildValue(
+        "{s:i, s:K, s:K, s:K, s:K, s:K, s:K, s:K, s:N}",
+        "numa_node", st.numa_node,
+        "allocations", (unsigned long long)st.allocations,
+        "frees", (unsigned long long)st.frees,
+        "cache_hits", (unsigned long long)st.cache_hits,
+        "large_allocations", (unsigned long long)st.large_allocations,
+        "large_in_use", (unsigned long long)st.large_in_use,
+        "large_bytes_in_use", (unsigned long long)st.large_bytes_in_use,
+        "bytes_reserved", (unsigned long long)st.bytes_reserved,
+        "classes", classes
+    );
+    if(pool_dict == NULL)
+        return -1;
+
+    int res = PyList_Append((PyObject *)arg, pool_dict);
+    Py_DECREF(pool_dict);
+    return res;
+}
+
+/*
+Return a list of usage statistics, one dict per packet buffer pool (one pool per numa node)
+*/
+static PyObject *
+pool_stats(PyObject *self, PyObject *args)
+{
+    PyObject *pools = PyList_New(0);
+    if(pools == NULL)
+        return NULL;
+
+    if(pkt_pool_each(pool_stats_append, pools) != 0){
+        Py_DECREF(pools);
+        return NULL;
+    }
+
+    return pools;
+}
+
+/*
+Return merged hot-path latency histograms, one dict per stage, in nanoseconds
+*/
+static PyObject *
+metrics(PyObject *self, PyObject *args)
+{
+    static struct hist snap[METRICS_NSTAGES];
+    double ticks_per_ns = metrics_ticks_per_ns();
+    metrics_snapshot(snap);
+
+    PyObject *stages = PyDict_New();
+    if(stages == NULL)
+        return NULL;
+    for(int i=0; i<METRICS_NSTAGES; i++){
+        const struct hist *h = &snap[i];
+        PyObject *stage = Py_BuildValue(
+            "{s:K, s:d, s:d, s:d, s:d, s:d, s:d, s:d, s:d}",
+            "count", (unsigned long long)h->count,
+            "sum_ns", h->sum / ticks_per_ns,
+            "mean_ns", h->count ? h->sum / ticks_per_ns / h->count : 0.0,
+            "min_ns", h->count ? h->min / ticks_per_ns : 0.0,
+            "max_ns", h->max / ticks_per_ns,
+            "p50_ns", hist_quantile(h, 0.5) / ticks_per_ns,
+            "p90_ns", hist_quantile(h, 0.9) / ticks_per_ns,
+            "p99_ns", hist_quantile(h, 0.99) / ticks_per_ns,
+            "p999_ns", hist_quantile(h, 0.999) / ticks_per_ns
+        );
+        if(stage == NULL || PyDict_SetItemString(stages, metrics_stage_names[i], stage) != 0){
+            Py_XDECREF(stage);
+            Py_DECREF(stages);
+            return NULL;
+        }
+        Py_DECREF(stage);
+    }
+
+#ifdef PYPCAP_NO_METRICS
+    int enabled = 0;
+#else
+    int enabled = 1;
+#endif
+    return Py_BuildValue(
+        "{s:O, s:s, s:d, s:N}",
+        "enabled", enabled ? Py_True : Py_False,
+        "clock", metrics_uses_tsc() ? "tsc" : "monotonic",
+        "ticks_per_ns", ticks_per_ns,
+        "stages", stages
+    );
+}
+
+/*
+Return the stage histograms in Prometheus text exposition format
+
+Bucket bounds are fixed (100ns to 10s); counts come from the finer log-linear
+histograms, so a bucket is exact to within one sub-bucket of its bound.
+*/
+static PyObject *
+metrics_prometheus(PyObject *self, PyObject *args)
+{
+    static const double bounds_ns[] = {
+        100, 250, 500, 1e3, 2.5e3, 5e3, 1e4, 2.5e4, 5e4, 1e5, 2.5e5, 5e5,
+        1e6, 2.5e6, 5e6, 1e7, 2.5e7, 5e7, 1e8, 2.5e8, 5e8, 1e9, 1e10,
+    };
+    static struct hist snap[METRICS_NSTAGES];
+    double ticks_per_ns = metrics_ticks_per_ns();
+    metrics_snapshot(snap);
+
+    size_t cap = 65536, len = 0;
+    char *out = PyMem_Malloc(cap);
+    if(out == NULL)
+        return PyErr_NoMemory();
+
+#define EMIT(...) do{ \
+        int n = snprintf(out + len, cap - len, __VA_ARGS__); \
+        if(n > 0) len += ((size_t)n < cap - len) ? (size_t)n : cap - len - 1; \
+    }while(0)
+
+    EMIT("# HELP pypcap_stage_duration_seconds Time spent in instrumented native stages\n");
+    EMIT("# TYPE pypcap_stage_duration_seconds histogram\n");
+    for(int i=0; i<METRICS_NSTAGES; i++){
+        const struct hist *h = &snap[i];
+        const char *name = metrics_stage_names[i];
+        int b = 0;
+        uint64_t cumulative = 0;
+        for(size_t k=0; k<sizeof(bounds_ns)/sizeof(bounds_ns[0]); k++){
+            uint64_t limit = (uint64_t)(bounds_ns[k] * ticks_per_ns);
+            while(b < HIST_BUCKETS && hist_bucket_low(b) < limit)
+                cumulative += h->buckets[b++];
+            EMIT("pypcap_stage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n", name, bounds_ns[k] / 1e9, (unsigned long long)cumulative);
+        }
+        EMIT("pypcap_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n", name, (unsigned long long)h->count);
+        EMIT("pypcap_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n", name, h->sum / ticks_per_ns / 1e9);
+        EMIT("pypcap_stage_duration_seconds_count{stage=\"%s\"} %llu\n", name, (unsigned long long)h->count);
+    }
+#undef EMIT
+
+    PyObject *text = PyUnicode_FromStringAndSize(out, len);
+    PyMem_Free(out);
+    return text;
+}
+
+/* zero every stage histogram */
+static PyObject *
+metrics_reset_all(PyObject *self, PyObject *args)
+{
+    metrics_reset();
+    return Py_BuildValue("");
+}
+
+/*
+Return the paths whose .bloom sidecar says they may hold host and/or port
+
+A file without a sidecar, or whose sidecar predates its last change, can't
+be ruled out, so it is returned too; with both
+host and port given, a file must match both. Only the sidecars are read.
+*/
+static PyObject *
+index_query(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"paths", "host", "port", NULL};
+    PyObject *paths = NULL;
+    const char *host = NULL;
+    int port = -1;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|zi", kwlist, &paths, &host, &port))
+        return NULL;
+    if(host == NULL && port < 0){
+        PyErr_SetString(PyExc_ValueError, "index_query() needs a host, a port or both");
+        return NULL;
+    }
+    if(port > 65535){
+        PyErr_SetString(PyExc_ValueError, "port must be between 0 and 65535");
+        return NULL;
+    }
+
+    uint8_t host_key[17], port_key[3], addr[16];
+    size_t host_len = 0, port_len = 0;
+    if(host != NULL){
+        if(inet_pton(AF_INET, host, addr) == 1)
+            host_len = bloom_key_addr(host_key, addr, 4);
+        else if(inet_pton(AF_INET6, host, addr) == 1)
+            host_len = bloom_key_addr(host_key, addr, 16);
+        else
+            return PyErr_Format(PyExc_ValueError, "Could not parse %s as an IPv4 or IPv6 address", host);
+    }
+    if(port >= 0)
+        port_len = bloom_key_port(port_key, (uint16_t)port);
+
+    PyObject *iter = PyObject_GetIter(paths);
+    if(iter == NULL)
+        return NULL;
+    PyObject *matches = PyList_New(0);
+    if(matches == NULL){
+        Py_DECREF(iter);
+        return NULL;
+    }
+
+    PyObject *path;
+    while((path = PyIter_Next(iter)) != NULL){
+        PyObject *encoded = NULL;
+        if(!PyUnicode_FSConverter(path, &encoded))
+            goto error;
+
+        struct bloom b;
+        int res, err = 0, match = 1;
+        Py_BEGIN_ALLOW_THREADS
+        res = bloom_read(&b, PyBytes_AS_STRING(encoded));
+        if(res != 0)
+            err = errno;
+        else{
+            match = (host_len == 0 || bloom_check(&b, host_key, host_len))
+                && (port_len == 0 || bloom_check(&b, port_key, port_len));
+            bloom_free(&b);
+        }
+        Py_END_ALLOW_THREADS
+        Py_DECREF(encoded);
+
+        if(res != 0 && err != ENOENT && err != ESTALE){
+            errno = err;
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+            goto error;
+        }
+        if(match && PyList_Append(matches, path) != 0)
+            goto error;
+        Py_DECREF(path);
+    }
+    Py_DECREF(iter);
+    if(PyErr_Occurred()){
+        Py_DECREF(matches);
+        return NULL;
+    }
+    return matches;
+
+error:
+    Py_DECREF(path);
+    Py_DECREF(iter);
+    Py_DECREF(matches);
+    return NULL;
+}
+
 /*
 Define module-level methods
 */
 static PyMethodDef PyPcapMethods[] = {
-    {"find_all_devs" , find_all_devs, METH_VARARGS, "List all network devices on the system"},
+    {"find_all_devs" , (PyCFunction) find_all_devs, METH_VARARGS | METH_KEYWORDS, "List all network devices on the system, with their traffic counters if counters=True"},
+    {"pool_stats" , pool_stats, METH_NOARGS, "Usage statistics of the shared packet buffer pools"},
+    {"metrics" , metrics, METH_NOARGS, "Latency histograms of the native capture, dump, read and flush paths"},
+    {"metrics_prometheus" , metrics_prometheus, METH_NOARGS, "metrics() in Prometheus text exposition format"},
+    {"metrics_reset" , metrics_reset_all, METH_NOARGS, "Zero the latency histograms"},
+    {"index_query" , (PyCFunction) index_query, METH_VARARGS | METH_KEYWORDS, "Return the paths whose .bloom index may hold host and/or port; files without an up to date index are returned too"},
     {NULL, NULL, 0, NULL}
 };
 
@@ -229,8 +569,38 @@ PyInit_pypcap(void)
         return NULL;
     if (PyType_Ready(&PcapReaderType) < 0)
         return NULL;
+    if (PyType_Ready(&PcapArrowStreamType) < 0)
+        return NULL;
     if (PyType_Ready(&PcapCaptureType) < 0)
         return NULL;
+    if (PyType_Ready(&PacketBufferType) < 0)
+        return NULL;
+    if (PyType_Ready(&PacketType) < 0)
+        return NULL;
+    if (PyType_Ready(&CaptureReadyType) < 0)
+        return NULL;
+    if (PyType_Ready(&PacketBatchType) < 0)
+        return NULL;
+    if (PyType_Ready(&CaptureIteratorType) < 0)
+        return NULL;
+    if (PyType_Ready(&PcapGeneratorType) < 0)
+        return NULL;
+    if (PyType_Ready(&PcapReplayerType) < 0)
+        return NULL;
+    if (PyType_Ready(&PcapDeduplicatorType) < 0)
+        return NULL;
+    if (PyType_Ready(&DeviceMonitorType) < 0)
+        return NULL;
+    if (PyType_Ready(&InterfaceCountersType) < 0)
+        return NULL;
+    if (PyType_Ready(&TrafficStatsType) < 0)
+        return NULL;
+    if (PyType_Ready(&HyperLogLogType) < 0)
+        return NULL;
+    if (PyType_Ready(&CardinalityTrackerType) < 0)
+        return NULL;
+    if (PyType_Ready(&PcapSharedReaderType) < 0)
+        return NULL;
 
     m = PyModule_Create(&pypcap);
     if(m == NULL)
@@ -257,5 +627,89 @@ PyInit_pypcap(void)
         return NULL;
     };
 
+    Py_INCREF(&PacketBufferType);
+    if(PyModule_AddObject(m, "PacketBuffer", (PyObject *) &PacketBufferType) < 0){
+        Py_DECREF(&PacketBufferType);
+        Py_DECREF(m);
+        return NULL;
+    };
+
+    Py_INCREF(&PacketType);
+    if(PyModule_AddObject(m, "Packet", (PyObject *) &PacketType) < 0){
+        Py_DECREF(&PacketType);
+        Py_DECREF(m);
+        return NULL;
+    };
+
+    Py_INCREF(&PacketBatchType);
+    if(PyModule_AddObject(m, "PacketBatch", (PyObject *) &PacketBatchType) < 0){
+        Py_DECREF(&PacketBatchType);
+        Py_DECREF(m);
+        return NULL;
+    };
+
+    Py_INCREF(&PcapGeneratorType);
+    if(PyModule_AddObject(m, "PcapGenerator", (PyObject *) &PcapGeneratorType) < 0){
+        Py_DECREF(&PcapGeneratorType);
+        Py_DECREF(m);
+        return NULL;
+    };
+
+    Py_INCREF(&PcapReplayerType);
+    if(PyModule_AddObject(m, "PcapReplayer", (PyObject *) &PcapReplayerType) < 0){
+        Py_DECREF(&PcapReplayerType);
+        Py_DECREF(m);
+        return NULL;
+    };
+
+    Py_INCREF(&PcapDeduplicatorType);
+    if(PyModule_AddObject(m, "PcapDeduplicator", (PyObject *) &PcapDeduplicatorType) < 0){
+        Py_DECREF(&PcapDeduplicatorType);
+        Py_DECREF(m);
+        return NULL;
+    };
+
+    Py_INCREF(&DeviceMonitorType);
+    if(PyModule_AddObject(m, "DeviceMonitor", (PyObject *) &DeviceMonitorType) < 0){
+        Py_DECREF(&DeviceMonitorType);
+        Py_DECREF(m);
+        return NULL;
+    };
+
+    Py_INCREF(&InterfaceCountersType);
+    if(PyModule_AddObject(m, "InterfaceCounters", (PyObject *) &InterfaceCountersType) < 0){
+        Py_DECREF(&InterfaceCountersType);
+        Py_DECREF(m);
+        return NULL;
+    };
+
+    Py_INCREF(&TrafficStatsType);
+    if(PyModule_AddObject(m, "TrafficStats", (PyObject *) &TrafficStatsType) < 0){
+        Py_DECREF(&TrafficStatsType);
+        Py_DECREF(m);
+        return NULL;
+    };
+
+    Py_INCREF(&HyperLogLogType);
+    if(PyModule_AddObject(m, "HyperLogLog", (PyObject *) &HyperLogLogType) < 0){
+        Py_DECREF(&HyperLogLogType);
+        Py_DECREF(m);
+        return NULL;
+    };
+
+    Py_INCREF(&CardinalityTrackerType);
+    if(PyModule_AddObject(m, "CardinalityTracker", (PyObject *) &CardinalityTrackerType) < 0){
+        Py_DECREF(&CardinalityTrackerType);
+        Py_DECREF(m);
+        return NULL;
+    };
+
+    Py_INCREF(&PcapSharedReaderType);
+    if(PyModule_AddObject(m, "PcapSharedReader", (PyObject *) &PcapSharedReaderType) < 0){
+        Py_DECREF(&PcapSharedReaderType);
+        Py_DECREF(m);
+        return NULL;
+    };
+
     return m;
 };
@@ -4,4 +4,4 @@
 /*
 Module functions
 */
-static PyObject *find_all_devs(PyObject *self, PyObject *args);
+static PyObject *find_all_devs(PyObject *self, PyObject *args, PyObject *kwds);
@@ -5,12 +5,39 @@
 #include <structmember.h>
 #include <pcap.h>
 #include <errno.h>
+#include <unistd.h>
 
 #ifndef PYPCAP_UTIL
 #include "util.h"
 #endif
 
+#ifndef PYPCAP_PACKET
+#include "packet.h"
+#endif
+
+#ifndef PYPCAP_METRICS
+#include "metrics.h"
+#endif
+
+#ifndef PYPCAP_SAMPLING
+#include "sampling.h"
+#endif
+
+#ifndef PYPCAP_ARROW
+#include "arrow.h"
+#endif
+
+#ifndef PYPCAP_EXTRACT
+#include "extract.h"
+#endif
+
+#ifndef PYPCAP_RECOVER
+#include "recover.h"
+#endif
+
 #define PYPCAP_READER
+#define READER_CHUNK 262144 // bytes of pooled memory shared by consecutive packets
+#define READER_HEADERS 65536 // packets read_headers makes room for first, doubled as needed
 
 typedef struct{
     PyObject_HEAD
@@ -19,6 +46,13 @@ typedef struct{
     char *_errbuf;
     FILE *fp;
     pcap_t *_pcap;
+    int _linktype;
+    struct pkt_buf *_chunk;
+    struct sampler _sampler;
+    struct recover _recover; // buf is NULL unless reading with recover=True
+    int _busy; // a PcapReplayer is reading without the GIL, close() must not free _pcap
+    const u_char *_held; // a packet given back by PcapReader_unread, still in pcap's buffer
+    struct pcap_pkthdr _held_hdr;
 } PcapReader;
 
 /* creation method */
@@ -34,14 +68,19 @@ PcapReader_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 static int
 PcapReader_init(PcapReader *self, PyObject *args, PyObject *kwds)
 {
-    PyObject *stream=NULL, *tmp;
+    PyObject *stream=NULL, *sampling=NULL, *tmp;
+    int recover = 0;
 
-    static char *kwlist[] = {"stream", NULL};
+    static char *kwlist[] = {"stream", "sampling", "recover", NULL};
 
-    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &stream)){
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|Op", kwlist, &stream, &sampling, &recover)){
         return -1;
     }
 
+    // files are read with nanosecond precision, see pcap_fopen_offline_with_tstamp_precision below
+    if(sampler_parse(sampling, 1, &self->_sampler) != 0)
+        return -1;
+
     int fd = PyObject_AsFileDescriptor(stream);
     if(fd == -1){
         PyErr_SetString(PyExc_ValueError, "Could not obtain file descriptor from passed object");
@@ -82,6 +121,23 @@ PcapReader_init(PcapReader *self, PyObject *args, PyObject *kwds)
         return -1;
     }
     self->_pcap = pcap;
+    self->_linktype = pcap_datalink(pcap);
+    sampler_restart(&self->_sampler, self->_linktype);
+
+    // libpcap has read the file header; with recover, the records are read here instead
+    recover_free(&self->_recover);
+    if(recover){
+        int swapped;
+        int usec_ns = extract_file_format(fp, &swapped);
+        if(usec_ns == 0){
+            PyErr_SetString(PyExc_ValueError, "recover=True needs a classic pcap file that can be seeked, not pcapng or a pipe");
+            return -1;
+        }
+        if(recover_init(&self->_recover, fp, (uint32_t)pcap_snapshot(pcap), usec_ns, swapped) != 0){
+            PyErr_SetFromErrno(PyExc_OSError);
+            return -1;
+        }
+    }
 
     // Set PyObject attributes
     if(stream){
@@ -100,10 +156,18 @@ PcapReader_close(PcapReader *self, PyObject *Py_UNUSED(ignored))
 {
     if(self->fp == NULL)
         return Py_BuildValue("");
+    if(self->_busy){
+        PyErr_SetString(PyExc_SystemError, "Cannot close; pcap reader is being replayed.");
+        return NULL;
+    }
 
     pcap_close(self->_pcap); // todo: check errno, errbuf if this fails
     self->_pcap = NULL;
+    self->_held = NULL;
     self->fp = NULL;
+    pkt_buf_decref(self->_chunk);
+    self->_chunk = NULL;
+    recover_free(&self->_recover);
 
     return Py_BuildValue(""); // return None
 }
@@ -121,6 +185,64 @@ PcapReader_fileno(PcapReader *self, PyObject *Py_UNUSED(ignored))
     return PyLong_FromLong(fd);
 }
 
+/*
+next packet of the file, or NULL at end of file
+
+every read path of the reader goes through here, so packets dropped by the
+sampler never reach a Packet object or a writer, and a recovering reader
+skips corrupt records for all of them
+*/
+static const u_char *
+PcapReader_next(PcapReader *self, struct pcap_pkthdr *hdr)
+{
+    const u_char *data;
+    if(self->_held != NULL){
+        *hdr = self->_held_hdr;
+        data = self->_held;
+        self->_held = NULL;
+        return data;
+    }
+    do{
+        METRICS_BEGIN(t0);
+        if(self->_recover.buf != NULL)
+            data = recover_next(&self->_recover, hdr);
+        else
+            data = pcap_next(self->_pcap, hdr);
+        METRICS_END(METRICS_READER_NEXT, t0);
+    } while(data != NULL && !sampler_keep(&self->_sampler, hdr, data));
+    return data;
+}
+
+/*
+give back the packet PcapReader_next returned last, so the next read returns
+it again; its data stays valid because nothing is read in between
+*/
+static void
+PcapReader_unread(PcapReader *self, const struct pcap_pkthdr *hdr, const u_char *data)
+{
+    self->_held_hdr = *hdr;
+    self->_held = data;
+}
+
+/*
+Return a new Packet holding a copy of data
+
+packets are copied into a pooled chunk shared with the packets read before it,
+so reading costs a pool allocation every few hundred packets rather than one per packet
+*/
+static PyObject *
+PcapReader_packet(PcapReader *self, const struct pcap_pkthdr *hdr, const u_char *data)
+{
+    size_t offset;
+    struct pkt_buf *chunk = pkt_chunk_append(&self->_chunk, pkt_pool_get(-1), READER_CHUNK, data, hdr->caplen, &offset);
+    if(chunk == NULL)
+        return PyErr_NoMemory();
+
+    // reader is opened with nanosecond precision, so tv_usec holds nanoseconds
+    long long ts = (long long)hdr->ts.tv_sec * 1000000000LL + hdr->ts.tv_usec;
+    return Packet_New(chunk, offset, ts, hdr->caplen, hdr->len, self->_linktype, NULL);
+}
+
 /* read file */
 static PyObject *
 PcapReader_read(PcapReader *self, PyObject *Py_UNUSED(ignored))
@@ -133,13 +255,518 @@ PcapReader_read(PcapReader *self, PyObject *Py_UNUSED(ignored))
     long pcap_count = 0;
     struct pcap_pkthdr pktHeader;
 
-    while(pcap_next(self->_pcap, &pktHeader)){
+    while(PcapReader_next(self, &pktHeader)){
         pcap_count++; // somehow this is fine with stdout, but not with an open PyFile obj
     }   
 
     return PyLong_FromLong(pcap_count);
 }
 
+/* read up to max_packets packets as a list of Packet objects */
+static PyObject *
+PcapReader_read_batch(PcapReader *self, PyObject *args)
+{
+    int max_packets = 1024;
+    if(!PyArg_ParseTuple(args, "|i", &max_packets))
+        return NULL;
+
+    if(self->_pcap == NULL){
+        PyErr_SetString(PyExc_SystemError, "Cannot read; pcap reader is already closed.");
+        return NULL;
+    }
+    if(max_packets <= 0){
+        PyErr_SetString(PyExc_ValueError, "max_packets must be > 0");
+        return NULL;
+    }
+
+    PyObject *batch = PyList_New(0);
+    if(batch == NULL)
+        return NULL;
+
+    struct pcap_pkthdr hdr;
+    const u_char *data;
+
+    for(int i = 0; i < max_packets && (data = PcapReader_next(self, &hdr)); i++){
+        PyObject *pkt = PcapReader_packet(self, &hdr, data);
+        if(pkt == NULL || PyList_Append(batch, pkt) != 0){
+            Py_XDECREF(pkt);
+            Py_DECREF(batch);
+            return NULL;
+        }
+        Py_DECREF(pkt);
+    }
+
+    return batch;
+}
+
+/* iterator protocol: yield Packet objects until end of file */
+static PyObject *
+PcapReader_iter(PcapReader *self)
+{
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *
+PcapReader_iternext(PcapReader *self)
+{
+    if(self->_pcap == NULL){
+        PyErr_SetString(PyExc_SystemError, "Cannot read; pcap reader is already closed.");
+        return NULL;
+    }
+
+    struct pcap_pkthdr hdr;
+    const u_char *data = PcapReader_next(self, &hdr);
+    if(data == NULL)
+        return NULL; // StopIteration
+
+    return PcapReader_packet(self, &hdr, data);
+}
+
+/* sampling settings and how many packets were seen and kept */
+static PyObject *
+PcapReader_sampling_stats(PcapReader *self, PyObject *Py_UNUSED(ignored))
+{
+    return sampler_stats(&self->_sampler);
+}
+
+/* records read and the byte ranges skipped so far by a recover=True reader */
+static PyObject *
+PcapReader_recovery_stats(PcapReader *self, PyObject *Py_UNUSED(ignored))
+{
+    const struct recover *r = &self->_recover;
+    PyObject *skipped = PyList_New((Py_ssize_t)r->nranges);
+    if(skipped == NULL)
+        return NULL;
+    for(size_t i = 0; i < r->nranges; i++){
+        PyObject *range = Py_BuildValue("(KK)", (unsigned long long)r->ranges[i].start, (unsigned long long)r->ranges[i].end);
+        if(range == NULL){
+            Py_DECREF(skipped);
+            return NULL;
+        }
+        PyList_SET_ITEM(skipped, (Py_ssize_t)i, range);
+    }
+    return Py_BuildValue(
+        "{s:O, s:K, s:K, s:O, s:N}",
+        "recover", r->buf != NULL ? Py_True : Py_False,
+        "records", (unsigned long long)r->records,
+        "skipped_bytes", (unsigned long long)r->skipped_bytes,
+        "truncated", r->truncated ? Py_True : Py_False,
+        "skipped", skipped
+    );
+}
+
+/*
+timestamps (int64 ns), caplens and wirelens (uint32) of the next count packets,
+or of the rest of the file, as typed memoryviews; numpy.asarray() takes them
+without a copy
+
+No packet data is copied: classic pcap files are parsed directly, see
+extract_headers, and anything else (pcapng, pipes, a sampling or recovering
+reader) goes through PcapReader_next without making Packet objects.
+*/
+static PyObject *
+PcapReader_read_headers(PcapReader *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"count", NULL};
+    Py_ssize_t count = -1;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|n", kwlist, &count))
+        return NULL;
+
+    if(self->_pcap == NULL){
+        PyErr_SetString(PyExc_SystemError, "Cannot read; pcap reader is already closed.");
+        return NULL;
+    }
+
+    static const char *formats[3] = {"q", "I", "I"};
+    static const size_t sizes[3] = {sizeof(int64_t), sizeof(uint32_t), sizeof(uint32_t)};
+    size_t max = count < 0 ? SIZE_MAX : (size_t)count;
+    size_t cap = max < READER_HEADERS ? max : READER_HEADERS;
+    struct pkt_pool *pool = pkt_pool_get(-1);
+    struct pkt_buf *cols[3] = {NULL};
+    for(int k = 0; k < 3; k++)
+        if((cols[k] = pkt_buf_alloc(pool, (cap ? cap : 1) * sizes[k])) == NULL)
+            goto nomem;
+
+    size_t n = 0;
+    int direct = self->_sampler.mode == SAMPLING_NONE && self->_recover.buf == NULL;
+    while(n < max){
+        if(n == cap){
+            size_t grown = cap <= max / 2 ? cap * 2 : max;
+            for(int k = 0; k < 3; k++){
+                cols[k]->len = n * sizes[k];
+                struct pkt_buf *b = pkt_buf_grow(cols[k], grown * sizes[k]);
+                if(b == NULL)
+                    goto nomem;
+                cols[k] = b;
+            }
+            cap = grown;
+        }
+        int64_t *ts = (int64_t *)cols[0]->data;
+        uint32_t *caplen = (uint32_t *)cols[1]->data, *wirelen = (uint32_t *)cols[2]->data;
+
+        if(direct && self->_held == NULL){
+            long got = extract_headers(self->fp, ts + n, caplen + n, wirelen + n, cap - n);
+            if(got == -1){
+                PyErr_SetFromErrno(PyExc_OSError);
+                goto error;
+            }
+            if(got >= 0){
+                n += (size_t)got;
+                if(n < cap)
+                    break; // end of file
+                continue;
+            }
+            direct = 0;
+        }
+
+        struct pcap_pkthdr hdr;
+        if(PcapReader_next(self, &hdr) == NULL)
+            break;
+        ts[n] = (int64_t)hdr.ts.tv_sec * 1000000000LL + hdr.ts.tv_usec;
+        caplen[n] = hdr.caplen;
+        wirelen[n] = hdr.len;
+        n++;
+    }
+
+    PyObject *result = PyTuple_New(3);
+    if(result == NULL)
+        goto error;
+    for(int k = 0; k < 3; k++){
+        PyObject *pb = PacketBuffer_New(cols[k], 0, n, formats[k], sizes[k]);
+        PyObject *view = pb != NULL ? PyMemoryView_FromObject(pb) : NULL;
+        Py_XDECREF(pb);
+        if(view == NULL){
+            Py_DECREF(result);
+            goto error;
+        }
+        PyTuple_SET_ITEM(result, k, view);
+    }
+    for(int k = 0; k < 3; k++)
+        pkt_buf_decref(cols[k]);
+    return result;
+
+nomem:
+    PyErr_NoMemory();
+error:
+    for(int k = 0; k < 3; k++)
+        pkt_buf_decref(cols[k]);
+    return NULL;
+}
+
+/*
+Arrow export of packet metadata, see arrow.h
+
+arrow_stream() returns a PcapArrowStream. Whatever consumes it through the
+Arrow PyCapsule interface (pyarrow.RecordBatchReader.from_stream, polars,
+duckdb, ...) pulls record batches straight from the reader; no Packet objects
+are made along the way.
+*/
+typedef struct{
+    PyObject_HEAD
+    PcapReader *reader;
+    int _batch_size;
+    int _payload;
+} PcapArrowStream;
+
+static PyTypeObject PcapArrowStreamType;
+
+struct arrow_stream_private{
+    PcapReader *reader; // strong reference, dropped with the GIL held
+    struct arrow_batch batch;
+    char error[128];
+};
+
+static int
+PcapArrowStream_get_schema(struct ArrowArrayStream *s, struct ArrowSchema *out)
+{
+    struct arrow_stream_private *p = s->private_data;
+    return arrow_export_schema(p->batch.payload, out) == 0 ? 0 : errno;
+}
+
+/* consumers may call in from threads of their own, and the reader is a Python object */
+static int
+PcapArrowStream_get_next(struct ArrowArrayStream *s, struct ArrowArray *out)
+{
+    struct arrow_stream_private *p = s->private_data;
+    struct pcap_pkthdr hdr;
+    const u_char *data;
+    int res = 0;
+
+    PyGILState_STATE gil = PyGILState_Ensure();
+    if(p->reader->_pcap == NULL){
+        snprintf(p->error, sizeof(p->error), "pcap reader is already closed");
+        res = EINVAL;
+    }
+    while(res == 0 && p->batch.length < p->batch.capacity && (data = PcapReader_next(p->reader, &hdr)) != NULL){
+        if(arrow_batch_append(&p->batch, &hdr, data) != 0){
+            res = errno;
+            snprintf(p->error, sizeof(p->error), "could not add packet to batch: %s", strerror(res));
+        }
+    }
+    PyGILState_Release(gil);
+    if(res != 0)
+        return res;
+
+    if(p->batch.length == 0){
+        memset(out, 0, sizeof(*out)); // released array marks the end of the stream
+        return 0;
+    }
+    if(arrow_export_batch(&p->batch, out) != 0){
+        res = errno;
+        snprintf(p->error, sizeof(p->error), "could not export batch: %s", strerror(res));
+    }
+    return res;
+}
+
+static const char *
+PcapArrowStream_get_last_error(struct ArrowArrayStream *s)
+{
+    struct arrow_stream_private *p = s->private_data;
+    return p->error[0] != '\0' ? p->error : NULL;
+}
+
+static void
+PcapArrowStream_release(struct ArrowArrayStream *s)
+{
+    struct arrow_stream_private *p = s->private_data;
+    arrow_batch_free(&p->batch);
+    PyGILState_STATE gil = PyGILState_Ensure();
+    Py_DECREF(p->reader);
+    PyGILState_Release(gil);
+    free(p);
+    s->release = NULL;
+}
+
+static void
+PcapArrowStream_capsule_stream(PyObject *capsule)
+{
+    struct ArrowArrayStream *s = PyCapsule_GetPointer(capsule, "arrow_array_stream");
+    if(s->release != NULL)
+        s->release(s);
+    free(s);
+}
+
+static void
+PcapArrowStream_capsule_schema(PyObject *capsule)
+{
+    struct ArrowSchema *s = PyCapsule_GetPointer(capsule, "arrow_schema");
+    if(s->release != NULL)
+        s->release(s);
+    free(s);
+}
+
+/* Arrow PyCapsule interface: a stream reading on from the reader's position; requested_schema is not honoured, consumers cast */
+static PyObject *
+PcapArrowStream_arrow_c_stream(PcapArrowStream *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"requested_schema", NULL};
+    PyObject *requested_schema = NULL;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &requested_schema))
+        return NULL;
+
+    if(self->reader->_pcap == NULL){
+        PyErr_SetString(PyExc_SystemError, "Cannot read; pcap reader is already closed.");
+        return NULL;
+    }
+
+    struct ArrowArrayStream *s = calloc(1, sizeof(*s));
+    struct arrow_stream_private *p = calloc(1, sizeof(*p));
+    if(s == NULL || p == NULL || arrow_batch_init(&p->batch, self->_batch_size, self->reader->_linktype, self->_payload) != 0){
+        free(s);
+        free(p);
+        return PyErr_NoMemory();
+    }
+    Py_INCREF(self->reader);
+    p->reader = self->reader;
+    s->get_schema = PcapArrowStream_get_schema;
+    s->get_next = PcapArrowStream_get_next;
+    s->get_last_error = PcapArrowStream_get_last_error;
+    s->release = PcapArrowStream_release;
+    s->private_data = p;
+
+    PyObject *capsule = PyCapsule_New(s, "arrow_array_stream", PcapArrowStream_capsule_stream);
+    if(capsule == NULL){
+        s->release(s);
+        free(s);
+    }
+    return capsule;
+}
+
+static PyObject *
+PcapArrowStream_arrow_c_schema(PcapArrowStream *self, PyObject *Py_UNUSED(ignored))
+{
+    struct ArrowSchema *s = calloc(1, sizeof(*s));
+    if(s == NULL || arrow_export_schema(self->_payload, s) != 0){
+        free(s);
+        return PyErr_NoMemory();
+    }
+    PyObject *capsule = PyCapsule_New(s, "arrow_schema", PcapArrowStream_capsule_schema);
+    if(capsule == NULL){
+        s->release(s);
+        free(s);
+    }
+    return capsule;
+}
+
+static PyMethodDef PcapArrowStream_methods[] = {
+    {"__arrow_c_stream__", (PyCFunction) PcapArrowStream_arrow_c_stream, METH_VARARGS | METH_KEYWORDS, "Return an arrow_array_stream PyCapsule of packet metadata record batches"},
+    {"__arrow_c_schema__", (PyCFunction) PcapArrowStream_arrow_c_schema, METH_NOARGS, "Return an arrow_schema PyCapsule of the record batch schema"},
+    {NULL}
+};
+
+static int
+PcapArrowStream_traverse(PcapArrowStream *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->reader);
+    return 0;
+}
+
+static int
+PcapArrowStream_clear(PcapArrowStream *self)
+{
+    Py_CLEAR(self->reader);
+    return 0;
+}
+
+static void
+PcapArrowStream_dealloc(PcapArrowStream *self)
+{
+    PyObject_GC_UnTrack(self);
+    PcapArrowStream_clear(self);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyTypeObject PcapArrowStreamType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.PcapArrowStream",
+    .tp_doc = "Packet metadata of a PcapReader as Arrow record batches, through the Arrow PyCapsule interface",
+    .tp_basicsize = sizeof(PcapArrowStream),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_dealloc = (destructor) PcapArrowStream_dealloc,
+    .tp_methods = PcapArrowStream_methods,
+    .tp_traverse = (traverseproc) PcapArrowStream_traverse,
+    .tp_clear = (inquiry) PcapArrowStream_clear,
+};
+
+static int
+PcapReader_arrow_args(PcapReader *self, int batch_size, int payload)
+{
+    if(self->_pcap == NULL){
+        PyErr_SetString(PyExc_SystemError, "Cannot read; pcap reader is already closed.");
+        return -1;
+    }
+    if(batch_size <= 0){
+        PyErr_SetString(PyExc_ValueError, "batch_size must be > 0");
+        return -1;
+    }
+    if(payload < 0){
+        PyErr_SetString(PyExc_ValueError, "payload must be >= 0");
+        return -1;
+    }
+    return 0;
+}
+
+/* packet metadata as an Arrow stream; payload > 0 adds a column of the first payload bytes of each transport payload */
+static PyObject *
+PcapReader_arrow_stream(PcapReader *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"batch_size", "payload", NULL};
+    int batch_size = ARROW_BATCH_SIZE, payload = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|ii", kwlist, &batch_size, &payload))
+        return NULL;
+    if(PcapReader_arrow_args(self, batch_size, payload) != 0)
+        return NULL;
+
+    PcapArrowStream *stream = PyObject_GC_New(PcapArrowStream, &PcapArrowStreamType);
+    if(stream == NULL)
+        return NULL;
+    Py_INCREF(self);
+    stream->reader = self;
+    stream->_batch_size = batch_size;
+    stream->_payload = payload;
+    PyObject_GC_Track(stream);
+    return (PyObject *)stream;
+}
+
+/*
+write the rest of the file's packet metadata to stream in the Arrow IPC stream
+format and return the number of packets written
+
+pyarrow.ipc.open_stream, polars.read_ipc_stream and friends read it back; the
+schema is the one arrow_stream() gives
+*/
+static PyObject *
+PcapReader_write_arrow(PcapReader *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"stream", "batch_size", "payload", NULL};
+    PyObject *stream;
+    int batch_size = ARROW_BATCH_SIZE, payload = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|ii", kwlist, &stream, &batch_size, &payload))
+        return NULL;
+    if(PcapReader_arrow_args(self, batch_size, payload) != 0)
+        return NULL;
+
+    int fd = PyObject_AsFileDescriptor(stream);
+    if(fd == -1){
+        PyErr_SetString(PyExc_ValueError, "Could not obtain file descriptor from passed object");
+        return NULL;
+    }
+    // anything the file object still buffers goes first
+    if(PyObject_HasAttrString(stream, "flush")){
+        PyObject *res = PyObject_CallMethod(stream, "flush", NULL);
+        if(res == NULL)
+            return NULL;
+        Py_DECREF(res);
+    }
+
+    int dupfd = dup(fd);
+    FILE *fp = dupfd >= 0 ? fdopen(dupfd, "wb") : NULL;
+    if(fp == NULL){
+        if(dupfd >= 0)
+            close(dupfd);
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+
+    struct arrow_batch batch;
+    if(arrow_batch_init(&batch, batch_size, self->_linktype, payload) != 0){
+        fclose(fp);
+        return PyErr_NoMemory();
+    }
+
+    long long count = 0;
+    int res = arrow_ipc_write_schema(fp, payload);
+    struct pcap_pkthdr hdr;
+    const u_char *data;
+    while(res == 0 && (data = PcapReader_next(self, &hdr)) != NULL){
+        res = arrow_batch_append(&batch, &hdr, data);
+        if(res != 0)
+            break;
+        count++;
+        if(batch.length == batch.capacity){
+            res = arrow_ipc_write_batch(fp, &batch);
+            arrow_batch_clear(&batch);
+        }
+    }
+    if(res == 0 && batch.length > 0)
+        res = arrow_ipc_write_batch(fp, &batch);
+    if(res == 0)
+        res = arrow_ipc_write_end(fp);
+    int err = errno;
+    arrow_batch_free(&batch);
+    if(fclose(fp) != 0 && res == 0){
+        res = -1;
+        err = errno;
+    }
+
+    if(res != 0){
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    return PyLong_FromLongLong(count);
+}
+
 /* expose attributes as custom members */
 static PyMemberDef PcapReader_members[] = {
     {"_pcap", T_OBJECT_EX, offsetof(PcapReader, _pcap), 0, "pcap_t *pcap pointer"},
@@ -151,6 +778,12 @@ static PyMethodDef PcapReader_methods[] = {
     {"close", (PyCFunction) PcapReader_close, METH_NOARGS, "Close the object's file pointer"},
     {"fileno", (PyCFunction) PcapReader_fileno, METH_NOARGS, "Return file descriptor number of PcapReader object"},
     {"read", (PyCFunction) PcapReader_read, METH_NOARGS, "Read pcap file"},
+    {"read_batch", (PyCFunction) PcapReader_read_batch, METH_VARARGS, "Read up to max_packets packets as a list of Packet objects"},
+    {"sampling_stats", (PyCFunction) PcapReader_sampling_stats, METH_NOARGS, "Return the sampling mode, rate, and packets seen and kept"},
+    {"recovery_stats", (PyCFunction) PcapReader_recovery_stats, METH_NOARGS, "Return the records read and the (start, end) byte ranges skipped by a recover=True reader"},
+    {"read_headers", (PyCFunction) PcapReader_read_headers, METH_VARARGS | METH_KEYWORDS, "Read (timestamps, caplens, wirelens) of the next count packets, or all of them, as typed memoryviews"},
+    {"arrow_stream", (PyCFunction) PcapReader_arrow_stream, METH_VARARGS | METH_KEYWORDS, "Return the packet metadata as an Arrow stream (Arrow PyCapsule interface)"},
+    {"write_arrow", (PyCFunction) PcapReader_write_arrow, METH_VARARGS | METH_KEYWORDS, "Write the packet metadata to a file object in the Arrow IPC stream format"},
     {NULL}
 };
 
@@ -213,6 +846,9 @@ PcapReader_dealloc(PcapReader *self)
         self->_pcap = NULL;
         self->fp = NULL;
     }
+    pkt_buf_decref(self->_chunk);
+    self->_chunk = NULL;
+    recover_free(&self->_recover);
 
     /* dealloc with cyclic GC check */
     PyObject_GC_UnTrack(self);
@@ -245,4 +881,6 @@ static PyTypeObject PcapReaderType = {
     .tp_traverse = (traverseproc) PcapReader_traverse, // cyclic GC enable
     .tp_clear = (inquiry) PcapReader_clear,
     .tp_getset = PcapReader_getsetters, // custom getter/setter methods
+    .tp_iter = (getiterfunc) PcapReader_iter, // iterate over Packet objects
+    .tp_iternext = (iternextfunc) PcapReader_iternext,
 };
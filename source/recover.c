@@ -0,0 +1,290 @@
+#include "recover.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define RECOVER_PROBE (16 + RECOVER_MAX_CAPLEN + 16) // a candidate header, its data and the header after it
+
+/* on-disk record header of a classic pcap file */
+struct rec_hdr{
+    uint32_t sec;
+    uint32_t frac;
+    uint32_t caplen;
+    uint32_t len;
+};
+
+/* Return 0, or -1 with errno set */
+int recover_init(struct recover *r, FILE *in, uint32_t snaplen, int usec_ns, int swapped){
+    memset(r, 0, sizeof(*r));
+    off_t pos = ftello(in);
+    if(pos < 0)
+        return -1;
+    r->in = in;
+    r->pos = (uint64_t)pos;
+    r->snaplen = (snaplen == 0 || snaplen > RECOVER_MAX_CAPLEN) ? RECOVER_MAX_CAPLEN : snaplen;
+    r->usec_ns = usec_ns;
+    r->frac_limit = usec_ns == 1 ? 1000000000 : 1000000;
+    r->swapped = swapped;
+    r->cap = RECOVER_BLOCK; // > 2 * RECOVER_PROBE, so a refill always makes room for a probe
+    r->buf = malloc(r->cap);
+    if(r->buf == NULL){
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+void recover_free(struct recover *r){
+    free(r->buf);
+    free(r->ranges);
+    memset(r, 0, sizeof(*r));
+}
+
+/* make at least need bytes available from r->off, unless the file ends first; Return 0, or -1 on a read error */
+static int fill(struct recover *r, size_t need){
+    if(r->have - r->off >= need || r->eof)
+        return 0;
+    memmove(r->buf, r->buf + r->off, r->have - r->off);
+    r->pos += r->off;
+    r->have -= r->off;
+    r->off = 0;
+    while(r->have < need && !r->eof){
+        size_t want = r->cap - r->have;
+        size_t got = fread(r->buf + r->have, 1, want, r->in);
+        r->have += got;
+        if(got < want){
+            if(ferror(r->in))
+                return -1;
+            r->eof = 1;
+        }
+    }
+    return 0;
+}
+
+static void rec_at(const struct recover *r, const uint8_t *p, struct rec_hdr *h){
+    memcpy(h, p, sizeof(*h));
+    if(r->swapped){
+        h->sec = __builtin_bswap32(h->sec);
+        h->frac = __builtin_bswap32(h->frac);
+        h->caplen = __builtin_bswap32(h->caplen);
+        h->len = __builtin_bswap32(h->len);
+    }
+}
+
+/* seconds a record after one at ref may have, as sec - lo <= span in unsigned arithmetic */
+static void window(int64_t ref, int have_ref, uint32_t *lo, uint32_t *span){
+    if(!have_ref){
+        *lo = 0;
+        *span = UINT32_MAX;
+        return;
+    }
+    int64_t l = ref > RECOVER_BACK_SECONDS ? ref - RECOVER_BACK_SECONDS : 0;
+    int64_t h = ref + RECOVER_AHEAD_SECONDS;
+    *lo = (uint32_t)l;
+    *span = h - l > UINT32_MAX ? UINT32_MAX : (uint32_t)(h - l);
+}
+
+static int rec_ok(const struct recover *r, const struct rec_hdr *h, uint32_t lo, uint32_t span){
+    return h->len != 0 && h->caplen <= h->len && h->caplen <= r->snaplen
+        && h->frac < r->frac_limit && h->sec - lo <= span;
+}
+
+#ifdef __SSE2__
+static inline __m128i bswap32x4(__m128i x){
+    __m128i t = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)); // bytes within 16 bit halves
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(t, 0xb1), 0xb1); // then the halves
+}
+
+/* 4 bits to bits 0, 4, 8 and 12 */
+static const uint16_t spread[16] = {
+    0x0000, 0x0001, 0x0010, 0x0011, 0x0100, 0x0101, 0x0110, 0x0111,
+    0x1000, 0x1001, 0x1010, 0x1011, 0x1100, 0x1101, 0x1110, 0x1111,
+};
+#endif
+
+/*
+First i < n such that the header at p + i passes rec_ok, or n if none does;
+reads p[0, n + 15)
+
+With SSE2, 16 offsets are checked per step: for each shift s of 0..3, one
+unaligned load per header field covers the candidates at s, s + 4, s + 8 and
+s + 12, and unsigned compares are done as signed ones on values with the top
+bit flipped.
+*/
+static size_t scan(const struct recover *r, const uint8_t *p, size_t n, uint32_t lo, uint32_t span){
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i bias = _mm_set1_epi32((int)0x80000000);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vlo = _mm_set1_epi32((int)lo);
+    const __m128i vspan = _mm_xor_si128(_mm_set1_epi32((int)span), bias);
+    const __m128i vsnap = _mm_xor_si128(_mm_set1_epi32((int)r->snaplen), bias);
+    const __m128i vfrac = _mm_xor_si128(_mm_set1_epi32((int)(r->frac_limit - 1)), bias);
+    for(; i + 16 <= n; i += 16){
+        unsigned mask = 0;
+        for(int s = 0; s < 4; s++){
+            const uint8_t *q = p + i + s;
+            __m128i sec = _mm_loadu_si128((const __m128i *)q);
+            __m128i frac = _mm_loadu_si128((const __m128i *)(q + 4));
+            __m128i caplen = _mm_loadu_si128((const __m128i *)(q + 8));
+            __m128i len = _mm_loadu_si128((const __m128i *)(q + 12));
+            if(r->swapped){
+                sec = bswap32x4(sec);
+                frac = bswap32x4(frac);
+                caplen = bswap32x4(caplen);
+                len = bswap32x4(len);
+            }
+            __m128i bad = _mm_cmpeq_epi32(len, zero);
+            sec = _mm_xor_si128(_mm_sub_epi32(sec, vlo), bias);
+            frac = _mm_xor_si128(frac, bias);
+            caplen = _mm_xor_si128(caplen, bias);
+            len = _mm_xor_si128(len, bias);
+            bad = _mm_or_si128(bad, _mm_cmpgt_epi32(caplen, len));
+            bad = _mm_or_si128(bad, _mm_cmpgt_epi32(caplen, vsnap));
+            bad = _mm_or_si128(bad, _mm_cmpgt_epi32(frac, vfrac));
+            bad = _mm_or_si128(bad, _mm_cmpgt_epi32(sec, vspan));
+            int good = ~_mm_movemask_ps(_mm_castsi128_ps(bad)) & 0xf;
+            mask |= (unsigned)spread[good] << s;
+        }
+        if(mask != 0)
+            return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    for(; i < n; i++){
+        struct rec_hdr h;
+        rec_at(r, p + i, &h);
+        if(rec_ok(r, &h, lo, span))
+            return i;
+    }
+    return n;
+}
+
+/* note [start, end) as skipped, joined to the range before if they touch; Return 0, or -1 if out of memory */
+static int skip(struct recover *r, uint64_t start, uint64_t end){
+    if(end <= start)
+        return 0;
+    r->skipped_bytes += end - start;
+    if(r->nranges > 0 && r->ranges[r->nranges - 1].end == start){
+        r->ranges[r->nranges - 1].end = end;
+        return 0;
+    }
+    if(r->nranges == r->ranges_cap){
+        size_t cap = r->ranges_cap ? 2 * r->ranges_cap : 16;
+        struct recover_range *ranges = realloc(r->ranges, cap * sizeof(*ranges));
+        if(ranges == NULL){
+            errno = ENOMEM;
+            return -1;
+        }
+        r->ranges = ranges;
+        r->ranges_cap = cap;
+    }
+    r->ranges[r->nranges++] = (struct recover_range){start, end};
+    return 0;
+}
+
+/* the file ends inside the record at r->off */
+static void cut_tail(struct recover *r){
+    skip(r, r->pos + r->off, r->pos + r->have);
+    r->truncated = 1;
+    r->off = r->have;
+}
+
+/*
+Move r->off from the bad header there to the next header that passes rec_ok
+and is followed by another one, or by the end of the file
+
+Return 0, or -1 on a read error or out of memory
+*/
+static int resync(struct recover *r){
+    uint64_t start = r->pos + r->off;
+    r->off++;
+    for(;;){
+        if(fill(r, RECOVER_PROBE) != 0)
+            return -1;
+        size_t avail = r->have - r->off;
+        if(avail < sizeof(struct rec_hdr)){ // garbage to the end
+            r->off = r->have;
+            return skip(r, start, r->pos + r->have);
+        }
+
+        uint32_t lo, span;
+        window(r->last_sec, r->have_last, &lo, &span);
+        size_t n = avail - sizeof(struct rec_hdr) + 1;
+        size_t i = scan(r, r->buf + r->off, n, lo, span);
+        r->off += i;
+        if(i == n)
+            continue;
+
+        struct rec_hdr h;
+        rec_at(r, r->buf + r->off, &h);
+        // the probe was made room for where the scan started, the candidate may run past it
+        if(fill(r, 2 * sizeof(h) + h.caplen) != 0)
+            return -1;
+        size_t next = r->off + sizeof(h) + h.caplen;
+        int ok;
+        if(next + sizeof(h) <= r->have){
+            struct rec_hdr after;
+            rec_at(r, r->buf + next, &after);
+            window(h.sec, 1, &lo, &span);
+            ok = rec_ok(r, &after, lo, span);
+        } else{
+            ok = r->eof; // fill() made room for the candidate, so the file ends there
+        }
+        if(ok)
+            return skip(r, start, r->pos + r->off);
+        r->off++;
+    }
+}
+
+/*
+Next valid record, with hdr->ts.tv_usec in nanoseconds, or NULL at the end of
+the file or on a read error. Data stays valid until the next call
+*/
+const u_char *recover_next(struct recover *r, struct pcap_pkthdr *hdr){
+    for(;;){
+        if(fill(r, sizeof(struct rec_hdr)) != 0)
+            return NULL;
+        size_t avail = r->have - r->off;
+        if(avail == 0)
+            return NULL;
+        if(avail < sizeof(struct rec_hdr)){
+            cut_tail(r);
+            return NULL;
+        }
+
+        uint32_t lo, span;
+        window(r->last_sec, r->have_last, &lo, &span);
+        struct rec_hdr h;
+        rec_at(r, r->buf + r->off, &h);
+        if(!rec_ok(r, &h, lo, span)){
+            if(resync(r) != 0)
+                return NULL;
+            continue;
+        }
+
+        size_t size = sizeof(h) + h.caplen;
+        if(fill(r, size) != 0)
+            return NULL;
+        if(r->have - r->off < size){
+            cut_tail(r);
+            return NULL;
+        }
+
+        hdr->ts.tv_sec = h.sec;
+        hdr->ts.tv_usec = (suseconds_t)h.frac * r->usec_ns;
+        hdr->caplen = h.caplen;
+        hdr->len = h.len;
+        const u_char *data = r->buf + r->off + sizeof(h);
+        r->off += size;
+        r->last_sec = h.sec;
+        r->have_last = 1;
+        r->records++;
+        return data;
+    }
+}
@@ -0,0 +1,58 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pcap.h>
+
+#define PYPCAP_RECOVER // header guard
+#define RECOVER_MAX_CAPLEN 262144 // libpcap's limit, used when the file's snaplen is unset or beyond it
+#define RECOVER_BLOCK 1048576 // bytes read at a time, at least
+#define RECOVER_BACK_SECONDS 3600 // how far a record may go back in time from the one before
+#define RECOVER_AHEAD_SECONDS 86400 // and how far ahead
+
+/*
+Reading a classic pcap file past corrupt records
+
+Each record header is checked before its record is used: caplen <= snaplen,
+a nonzero len no smaller than caplen, a sub-second part in range, and a time
+within RECOVER_BACK_SECONDS before to RECOVER_AHEAD_SECONDS after the record
+before it. A header that fails starts a scan for the next offset holding a
+valid header that is followed by another valid header (or by the end of the
+file), where reading resumes; the bytes in between are recorded as a skipped
+range. The scan checks 16 candidate offsets at a time with SSE2 where the
+compiler targets it. A record cut short by the end of the file, as a killed
+writer leaves it, is a skipped range too.
+*/
+struct recover_range{
+    uint64_t start; // file offsets, end exclusive
+    uint64_t end;
+};
+
+struct recover{
+    FILE *in; // not owned
+    uint8_t *buf;
+    size_t cap;
+    size_t have; // bytes in buf
+    size_t off; // next record in buf
+    uint64_t pos; // file offset of buf[0]
+    int eof;
+
+    uint32_t snaplen;
+    uint32_t frac_limit; // 1e9 or 1e6, per the file's timestamp unit
+    int usec_ns; // nanoseconds per timestamp unit
+    int swapped;
+    int64_t last_sec;
+    int have_last;
+
+    uint64_t records;
+    uint64_t skipped_bytes;
+    int truncated; // the file ends inside a record
+    struct recover_range *ranges;
+    size_t nranges;
+    size_t ranges_cap;
+};
+
+int recover_init(struct recover *r, FILE *in, uint32_t snaplen, int usec_ns, int swapped);
+void recover_free(struct recover *r);
+const u_char *recover_next(struct recover *r, struct pcap_pkthdr *hdr);
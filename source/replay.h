@@ -0,0 +1,618 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#include <structmember.h>
+#include <pcap.h>
+
+#ifndef PYPCAP_UTIL
+#include "util.h"
+#endif
+
+#ifndef PYPCAP_READER
+#include "reader.h"
+#endif
+
+#ifndef PYPCAP_POOL
+#include "pool.h"
+#endif
+
+#ifndef PYPCAP_INJECT
+#include "inject.h"
+#endif
+
+#ifndef PYPCAP_HIST
+#include "hist.h"
+#endif
+
+#define PYPCAP_REPLAY
+#define REPLAY_STAGE_BYTES (4 * 1024 * 1024) // packet copies for one sendmmsg batch
+#define REPLAY_SLICE_NS 50000000ULL // how long run() goes without the GIL between signal checks
+#define REPLAY_SPIN_NS 100000ULL // covers the default 50us timer slack plus wakeup latency
+
+enum replay_mode{
+    REPLAY_ORIGINAL,
+    REPLAY_SCALED,
+    REPLAY_PPS,
+    REPLAY_TOP,
+};
+
+static const char *replay_mode_names[] = {"original", "scaled", "pps", "top", NULL};
+
+/*
+Retransmits a PcapReader's packets on an interface
+
+Each packet gets a due time from the mode: its capture timestamp relative to
+the first packet (original, or divided by speed for scaled), a fixed spacing
+(pps), or the moment it was read (top). The replayer sleeps/spins until the first packet of a
+batch is due, then sends it together with every following packet that is
+already due in one sendmmsg. Lateness of each send against its due time is
+kept in a histogram and reported as jitter.
+*/
+typedef struct{
+    PyObject_HEAD
+    /* C-style properties*/
+    char *_interface_name;
+    int _mode;
+    double _speed;
+    long _pps;
+    int _batch_size;
+    uint64_t _spin_ns;
+    struct inject _inject;
+    int _opened;
+    unsigned char *_stage;
+    int _eof;
+    int _pending; // a packet copied to the start of _stage that hasn't been sent yet
+    struct pcap_pkthdr _pending_hdr;
+    uint64_t _pending_due;
+    long long _first_ts_ns;
+    uint64_t _start_ns;
+    uint64_t _stop_ns; // when the last run() returned, to take the pause out of the due times
+    uint64_t _index; // packets scheduled so far
+    struct hist _jitter;
+    /* Python properties */
+    PyObject *reader;
+    PyObject *interface_name;
+    PyObject *mode;
+    PyObject *speed;
+    PyObject *pps;
+    PyObject *batch_size;
+    PyObject *busy_poll;
+} PcapReplayer;
+
+/* creation method */
+static PyObject *
+PcapReplayer_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PcapReplayer *self;
+    self = (PcapReplayer *) type->tp_alloc(type,0);
+    if(self != NULL)
+        self->_inject.fd = -1;
+    return (PyObject *) self;
+}
+
+/* initialization method */
+static int
+PcapReplayer_init(PcapReplayer *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"reader", "interface_name", "mode", "speed", "pps", "batch_size", "busy_poll", NULL};
+    PyObject *reader = NULL, *interface_name = NULL, *tmp;
+    const char *mode = "original";
+    double speed = 1.0;
+    long pps = 0;
+    int batch_size = 64, busy_poll = 0;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "OO|sdlip", kwlist, &reader, &interface_name, &mode, &speed, &pps, &batch_size, &busy_poll))
+        return -1;
+
+    if(self->_opened){
+        PyErr_SetString(PyExc_SystemError, "PcapReplayer is already initialized");
+        return -1;
+    }
+    if(!PyObject_TypeCheck(reader, &PcapReaderType)){
+        PyErr_SetString(PyExc_TypeError, "reader must be a PcapReader");
+        return -1;
+    }
+
+    int m;
+    for(m = 0; replay_mode_names[m] != NULL; m++)
+        if(strcmp(mode, replay_mode_names[m]) == 0)
+            break;
+    if(replay_mode_names[m] == NULL){
+        PyErr_Format(PyExc_ValueError, "mode must be one of original, scaled, pps, top, not %s", mode);
+        return -1;
+    }
+    if(m == REPLAY_SCALED && !(speed > 0)){
+        PyErr_SetString(PyExc_ValueError, "scaled mode needs speed > 0");
+        return -1;
+    }
+    if(m == REPLAY_PPS && pps <= 0){
+        PyErr_SetString(PyExc_ValueError, "pps mode needs pps > 0");
+        return -1;
+    }
+    if(batch_size <= 0 || batch_size > 1024){
+        PyErr_SetString(PyExc_ValueError, "batch_size must be between 1 and 1024");
+        return -1;
+    }
+
+    char *iface_name = PyUnicode_ToString(interface_name);
+    if(iface_name == NULL){
+        PyErr_SetString(PyExc_ValueError, "Could not convert interface_name into C string");
+        return -1;
+    }
+    self->_interface_name = iface_name;
+    self->_mode = m;
+    self->_speed = (m == REPLAY_SCALED) ? speed : 1.0;
+    self->_pps = pps;
+    self->_batch_size = batch_size;
+    // busy_poll never sleeps: sub-microsecond pacing for the price of a core
+    self->_spin_ns = busy_poll ? UINT64_MAX : REPLAY_SPIN_NS;
+    hist_reset(&self->_jitter);
+
+    // set pyobject attributes
+    tmp = self->reader;
+    Py_INCREF(reader);
+    self->reader = reader;
+    Py_XDECREF(tmp);
+
+    tmp = self->interface_name;
+    Py_INCREF(interface_name);
+    self->interface_name = interface_name;
+    Py_XDECREF(tmp);
+
+    tmp = self->mode;
+    self->mode = PyUnicode_FromString(replay_mode_names[m]);
+    Py_XDECREF(tmp);
+
+    tmp = self->speed;
+    self->speed = PyFloat_FromDouble(self->_speed);
+    Py_XDECREF(tmp);
+
+    tmp = self->pps;
+    self->pps = PyLong_FromLong(pps);
+    Py_XDECREF(tmp);
+
+    tmp = self->batch_size;
+    self->batch_size = PyLong_FromLong(batch_size);
+    Py_XDECREF(tmp);
+
+    tmp = self->busy_poll;
+    self->busy_poll = PyBool_FromLong(busy_poll);
+    Py_XDECREF(tmp);
+
+    return 0;
+}
+
+static int
+PcapReplayer_open(PcapReplayer *self)
+{
+    if(self->_opened)
+        return 0;
+
+    char errbuf[INJECT_ERRBUF_SIZE];
+    if(inject_open(&self->_inject, self->_interface_name, self->_batch_size, errbuf) != 0){
+        PyErr_SetString(PyExc_OSError, errbuf);
+        return -1;
+    }
+    self->_stage = pool_region_alloc(REPLAY_STAGE_BYTES, -1);
+    if(self->_stage == NULL){
+        inject_close(&self->_inject);
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->_opened = 1;
+    return 0;
+}
+
+/* when the next packet should leave, on the CLOCK_MONOTONIC timeline */
+static uint64_t
+PcapReplayer_due(PcapReplayer *self, const struct pcap_pkthdr *hdr)
+{
+    if(self->_index == 0)
+        self->_start_ns = inject_now_ns();
+
+    switch(self->_mode){
+    case REPLAY_TOP:
+        return inject_now_ns();
+    case REPLAY_PPS:
+        return self->_start_ns + (uint64_t)((unsigned __int128)self->_index * 1000000000ULL / self->_pps);
+    default: {
+        // reader is opened with nanosecond precision, so tv_usec holds nanoseconds
+        long long ts = (long long)hdr->ts.tv_sec * 1000000000LL + hdr->ts.tv_usec;
+        if(self->_index == 0)
+            self->_first_ts_ns = ts;
+        long long rel = ts - self->_first_ts_ns;
+        if(rel < 0) // out of order capture, send right away
+            rel = 0;
+        return self->_start_ns + (uint64_t)(rel / self->_speed);
+    }
+    }
+}
+
+/*
+replay up to limit packets (-1 for all), stopping at deadline_ns
+
+Called without the GIL. Returns packets handed to the kernel, or -1 with errno set.
+*/
+static long
+PcapReplayer_send(PcapReplayer *self, PcapReader *reader, long limit, uint64_t deadline_ns)
+{
+    struct inject *inj = &self->_inject;
+    uint64_t dues[1024];
+    long done = 0;
+
+    while(limit < 0 || done < limit){
+        unsigned int want = self->_batch_size;
+        if(limit >= 0 && limit - done < (long)want)
+            want = (unsigned int)(limit - done);
+
+        // first packet of the batch: the one left over from last time, or the next one
+        if(!self->_pending){
+            const u_char *data = PcapReader_next(reader, &self->_pending_hdr);
+            if(data == NULL){
+                self->_eof = 1;
+                break;
+            }
+            memcpy(self->_stage, data, self->_pending_hdr.caplen);
+            self->_pending_due = PcapReplayer_due(self, &self->_pending_hdr);
+            self->_index++;
+            self->_pending = 1;
+        }
+        if(self->_pending_due >= deadline_ns){
+            // a long gap in the capture: sit out the rest of the slice
+            inject_wait_until(deadline_ns, self->_spin_ns);
+            break;
+        }
+        inject_wait_until(self->_pending_due, self->_spin_ns);
+
+        unsigned int n = 0;
+        size_t used = self->_pending_hdr.caplen;
+        inj->iov[0].iov_base = self->_stage;
+        inj->iov[0].iov_len = used;
+        dues[n++] = self->_pending_due;
+        self->_pending = 0;
+
+        // everything else that is already due goes out in the same sendmmsg
+        struct pcap_pkthdr hdr;
+        const u_char *next = NULL;
+        uint64_t next_due = 0;
+        uint64_t now = inject_now_ns();
+        while(n < want){
+            const u_char *data = PcapReader_next(reader, &hdr);
+            if(data == NULL){
+                self->_eof = 1;
+                break;
+            }
+            uint64_t due = PcapReplayer_due(self, &hdr);
+            self->_index++;
+            if(due > now || used + hdr.caplen > REPLAY_STAGE_BYTES){
+                next = data;
+                next_due = due;
+                break;
+            }
+            memcpy(self->_stage + used, data, hdr.caplen);
+            inj->iov[n].iov_base = self->_stage + used;
+            inj->iov[n].iov_len = hdr.caplen;
+            dues[n++] = due;
+            used += hdr.caplen;
+            now = inject_now_ns();
+        }
+
+        uint64_t sent_at = inject_now_ns();
+        for(unsigned int i = 0; i < n; i++)
+            hist_record(&self->_jitter, sent_at > dues[i] ? sent_at - dues[i] : 0);
+        if(inject_send(inj, n) < 0)
+            return -1;
+        done += n;
+
+        // the packet that wasn't due yet starts the next batch; its bytes are
+        // still valid in pcap's buffer because nothing was read since
+        if(next != NULL){
+            memcpy(self->_stage, next, hdr.caplen);
+            self->_pending_hdr = hdr;
+            self->_pending_due = next_due;
+            self->_pending = 1;
+        }
+        if(self->_eof)
+            break;
+    }
+    return done;
+}
+
+/*
+Replay the reader's packets, or the next count of them
+
+Returns packets_sent, bytes_sent, send_errors, seconds, achieved_pps,
+achieved_bps, cpu_ns_per_packet and jitter_ns, the lateness of each send
+against its due time (mean, p50, p90, p99, p999, max). Can be called again
+to continue where the last call stopped; the pause in between is left out of
+the schedule, so the packets after it keep their spacing. The reader can't be
+closed while a call is running.
+*/
+static PyObject *
+PcapReplayer_run(PcapReplayer *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"count", NULL};
+    long count = 0;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|l", kwlist, &count))
+        return NULL;
+    if(count < 0){
+        PyErr_SetString(PyExc_ValueError, "count must be >= 0, 0 for the whole reader");
+        return NULL;
+    }
+    PcapReader *reader = (PcapReader *)self->reader;
+    if(reader->_pcap == NULL){
+        PyErr_SetString(PyExc_SystemError, "Cannot replay; pcap reader is already closed.");
+        return NULL;
+    }
+    if(reader->_busy){
+        PyErr_SetString(PyExc_SystemError, "Cannot replay; pcap reader is already being replayed.");
+        return NULL;
+    }
+    if(PcapReplayer_open(self) != 0)
+        return NULL;
+
+    // resuming: the time spent paused is not owed, so shift the schedule by it
+    // rather than sending everything that fell due meanwhile in one burst
+    if(self->_index > 0){
+        uint64_t paused = inject_now_ns() - self->_stop_ns;
+        self->_start_ns += paused;
+        self->_pending_due += paused;
+    }
+
+    // keep the reader alive, in place and open while the GIL is released
+    Py_INCREF(reader);
+    reader->_busy = 1;
+    uint64_t sent_before = self->_inject.sent;
+    uint64_t bytes_before = self->_inject.bytes;
+    uint64_t errors_before = self->_inject.errors;
+    uint64_t cpu_start = inject_thread_cpu_ns();
+    uint64_t start = inject_now_ns();
+    hist_reset(&self->_jitter);
+    long remaining = count > 0 ? count : -1;
+    int err = 0;
+
+    while(remaining != 0 && (!self->_eof || self->_pending)){
+        long sent;
+        uint64_t slice_end = inject_now_ns() + REPLAY_SLICE_NS;
+        Py_BEGIN_ALLOW_THREADS
+        sent = PcapReplayer_send(self, reader, remaining, slice_end);
+        Py_END_ALLOW_THREADS
+        if(sent < 0){
+            err = errno;
+            break;
+        }
+        if(remaining > 0)
+            remaining -= sent;
+        if(PyErr_CheckSignals() != 0){
+            self->_stop_ns = inject_now_ns();
+            reader->_busy = 0;
+            Py_DECREF(reader);
+            return NULL;
+        }
+    }
+    self->_stop_ns = inject_now_ns();
+    reader->_busy = 0;
+    Py_DECREF(reader);
+
+    uint64_t elapsed = inject_now_ns() - start;
+    uint64_t cpu = inject_thread_cpu_ns() - cpu_start;
+    if(err != 0){
+        errno = err;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+
+    const struct hist *j = &self->_jitter;
+    uint64_t packets = self->_inject.sent - sent_before;
+    uint64_t bytes = self->_inject.bytes - bytes_before;
+    double seconds = elapsed / 1e9;
+    return Py_BuildValue(
+        "{s:K, s:K, s:K, s:d, s:d, s:d, s:d, s:{s:d, s:K, s:K, s:K, s:K, s:K}}",
+        "packets_sent", (unsigned long long)packets,
+        "bytes_sent", (unsigned long long)bytes,
+        "send_errors", (unsigned long long)(self->_inject.errors - errors_before),
+        "seconds", seconds,
+        "achieved_pps", seconds > 0 ? packets / seconds : 0.0,
+        "achieved_bps", seconds > 0 ? bytes * 8 / seconds : 0.0,
+        "cpu_ns_per_packet", packets ? (double)cpu / packets : 0.0,
+        "jitter_ns",
+            "mean", j->count ? (double)j->sum / j->count : 0.0,
+            "p50", (unsigned long long)hist_quantile(j, 0.5),
+            "p90", (unsigned long long)hist_quantile(j, 0.9),
+            "p99", (unsigned long long)hist_quantile(j, 0.99),
+            "p999", (unsigned long long)hist_quantile(j, 0.999),
+            "max", (unsigned long long)j->max
+    );
+}
+
+/* close method */
+static PyObject *
+PcapReplayer_close(PcapReplayer *self, PyObject *Py_UNUSED(ignored))
+{
+    inject_close(&self->_inject);
+    if(self->_stage != NULL){
+        pool_region_free(self->_stage, REPLAY_STAGE_BYTES);
+        self->_stage = NULL;
+    }
+    self->_opened = 0;
+    self->_pending = 0;
+    return Py_BuildValue("");
+}
+
+static PyMethodDef PcapReplayer_methods[] = {
+    {"run", (PyCFunction) PcapReplayer_run, METH_VARARGS | METH_KEYWORDS, "Replay the reader's packets (or the next count of them) and return the achieved rate and jitter"},
+    {"close", (PyCFunction) PcapReplayer_close, METH_NOARGS, "Close the raw socket"},
+    {NULL}
+};
+
+/* custom getter/setter methods to control member types */
+static PyObject *
+PcapReplayer_get_reader(PcapReplayer *self, void *closure)
+{
+    Py_INCREF(self->reader);
+    return self->reader;
+}
+
+static int
+PcapReplayer_set_reader(PcapReplayer *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "reader attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapReplayer_get_interface_name(PcapReplayer *self, void *closure)
+{
+    Py_INCREF(self->interface_name);
+    return self->interface_name;
+}
+
+static int
+PcapReplayer_set_interface_name(PcapReplayer *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "interface_name attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapReplayer_get_mode(PcapReplayer *self, void *closure)
+{
+    Py_INCREF(self->mode);
+    return self->mode;
+}
+
+static int
+PcapReplayer_set_mode(PcapReplayer *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "mode attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapReplayer_get_speed(PcapReplayer *self, void *closure)
+{
+    Py_INCREF(self->speed);
+    return self->speed;
+}
+
+static int
+PcapReplayer_set_speed(PcapReplayer *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "speed attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapReplayer_get_pps(PcapReplayer *self, void *closure)
+{
+    Py_INCREF(self->pps);
+    return self->pps;
+}
+
+static int
+PcapReplayer_set_pps(PcapReplayer *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "pps attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapReplayer_get_batch_size(PcapReplayer *self, void *closure)
+{
+    Py_INCREF(self->batch_size);
+    return self->batch_size;
+}
+
+static int
+PcapReplayer_set_batch_size(PcapReplayer *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "batch_size attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapReplayer_get_busy_poll(PcapReplayer *self, void *closure)
+{
+    Py_INCREF(self->busy_poll);
+    return self->busy_poll;
+}
+
+static int
+PcapReplayer_set_busy_poll(PcapReplayer *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "busy_poll attribute is read-only");
+    return -1;
+}
+
+static PyGetSetDef PcapReplayer_getsetters[] = {
+    {"reader", (getter) PcapReplayer_get_reader, (setter) PcapReplayer_set_reader, "reader", NULL},
+    {"interface_name", (getter) PcapReplayer_get_interface_name, (setter) PcapReplayer_set_interface_name, "interface_name", NULL},
+    {"mode", (getter) PcapReplayer_get_mode, (setter) PcapReplayer_set_mode, "mode", NULL},
+    {"speed", (getter) PcapReplayer_get_speed, (setter) PcapReplayer_set_speed, "speed", NULL},
+    {"pps", (getter) PcapReplayer_get_pps, (setter) PcapReplayer_set_pps, "pps", NULL},
+    {"batch_size", (getter) PcapReplayer_get_batch_size, (setter) PcapReplayer_set_batch_size, "batch_size", NULL},
+    {"busy_poll", (getter) PcapReplayer_get_busy_poll, (setter) PcapReplayer_set_busy_poll, "busy_poll", NULL},
+    {NULL}
+};
+
+/* avoid cyclic references / enable cyclic GC */
+static int
+PcapReplayer_traverse(PcapReplayer *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->reader);
+    Py_VISIT(self->interface_name);
+    Py_VISIT(self->mode);
+    Py_VISIT(self->speed);
+    Py_VISIT(self->pps);
+    Py_VISIT(self->batch_size);
+    Py_VISIT(self->busy_poll);
+    return 0;
+}
+
+static int
+PcapReplayer_clear(PcapReplayer *self)
+{
+    Py_CLEAR(self->reader);
+    Py_CLEAR(self->interface_name);
+    Py_CLEAR(self->mode);
+    Py_CLEAR(self->speed);
+    Py_CLEAR(self->pps);
+    Py_CLEAR(self->batch_size);
+    Py_CLEAR(self->busy_poll);
+    return 0;
+}
+
+/* deallocation method */
+static void
+PcapReplayer_dealloc(PcapReplayer *self)
+{
+    /* close all C objects */
+    inject_close(&self->_inject);
+    if(self->_stage != NULL)
+        pool_region_free(self->_stage, REPLAY_STAGE_BYTES);
+    self->_stage = NULL;
+
+    /* dealloc with cyclic GC check */
+    PyObject_GC_UnTrack(self);
+    PcapReplayer_clear(self);
+
+    /* deallocate the object itself */
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/*
+PcapReplayer Type construction
+
+.tp_flags:
+    Py_TPFLAGS_DEFAULT = always use
+    Py_TPFLAGS_BASETYPE = allows to be subclassed. do this only if methods don't care about type of object created/used
+    Py_TPFLAGS_HAVE_GC = cyclic GC causes segfault if this isn't set
+*/
+static PyTypeObject PcapReplayerType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.PcapReplayer",
+    .tp_doc = "Retransmits the packets of a PcapReader on an interface",
+    .tp_basicsize = sizeof(PcapReplayer),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_new = PcapReplayer_new,
+    .tp_dealloc = (destructor) PcapReplayer_dealloc,
+    .tp_init = (initproc) PcapReplayer_init,
+    .tp_methods = PcapReplayer_methods, // expose custom methods
+    .tp_traverse = (traverseproc) PcapReplayer_traverse, // cyclic GC enable
+    .tp_clear = (inquiry) PcapReplayer_clear,
+    .tp_getset = PcapReplayer_getsetters, // custom getter/setter methods
+};
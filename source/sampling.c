@@ -0,0 +1,218 @@
+#include "sampling.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef PYPCAP_DISSECT
+#include "dissect.h"
+#endif
+
+static const char *mode_names[] = {"none", "count", "random", "flow", "window"};
+
+/* probability p in (0, 1] as a threshold on a uniform 64 bit value */
+static uint64_t probability_threshold(double p){
+    if(p >= 1.0)
+        return UINT64_MAX;
+    return (uint64_t)(p * 18446744073709551616.0);
+}
+
+static uint64_t mix64(uint64_t h, uint64_t v){
+    h ^= v;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+/*
+Hash of the packet's flow, the same for both directions
+
+The key is the unordered pair of (address, port) endpoints plus the IP
+protocol. Packets without an IP header are keyed by ethertype alone, and
+non-first IP fragments (no ports) by their addresses and protocol.
+*/
+uint64_t sampler_flow_hash(const struct sampler *s, const u_char *data, size_t caplen){
+    struct pkt_meta meta;
+    uint64_t h = s->seed ^ 0x9e3779b97f4a7c15ULL;
+
+    if(dissect_packet(s->linktype, data, caplen, &meta) != 0)
+        return mix64(h, meta.ethertype);
+
+    const uint8_t *a = meta.src, *b = meta.dst;
+    uint16_t pa = meta.sport, pb = meta.dport;
+    int c = memcmp(a, b, meta.addr_len);
+    if(c > 0 || (c == 0 && pa > pb)){
+        a = meta.dst; b = meta.src;
+        pa = meta.dport; pb = meta.sport;
+    }
+
+    for(int i = 0; i < meta.addr_len; i += 8){
+        uint64_t wa = 0, wb = 0;
+        int len = meta.addr_len - i < 8 ? meta.addr_len - i : 8;
+        memcpy(&wa, a + i, len);
+        memcpy(&wb, b + i, len);
+        h = mix64(h, wa);
+        h = mix64(h, wb);
+    }
+    return mix64(h, ((uint64_t)pa << 32) | ((uint64_t)pb << 16) | meta.ip_proto);
+}
+
+/* start over from the seed, for a handle that has just been (re)opened */
+void sampler_restart(struct sampler *s, int linktype){
+    s->linktype = linktype;
+    s->state = (s->mode == SAMPLING_RANDOM) ? s->seed : 0;
+    s->seen = 0;
+    s->kept = 0;
+}
+
+static int parse_probability(PyObject *spec, Py_ssize_t size, const char *mode, struct sampler *s){
+    if(size < 2 || size > 3){
+        PyErr_Format(PyExc_ValueError, "sampling must be (\"%s\", probability[, seed])", mode);
+        return -1;
+    }
+    double p = PyFloat_AsDouble(PyTuple_GET_ITEM(spec, 1));
+    if(p == -1.0 && PyErr_Occurred())
+        return -1;
+    if(!(p > 0.0 && p <= 1.0)){
+        PyErr_SetString(PyExc_ValueError, "sampling probability must be in (0, 1]");
+        return -1;
+    }
+    if(size == 3){
+        unsigned long long seed = PyLong_AsUnsignedLongLongMask(PyTuple_GET_ITEM(spec, 2));
+        if(seed == (unsigned long long)-1 && PyErr_Occurred())
+            return -1;
+        s->seed = seed;
+    }
+    s->rate = p;
+    s->threshold = probability_threshold(p);
+    return 0;
+}
+
+/*
+Fill s from a python sampling spec, see sampling.h; None disables sampling
+
+Return 0 on success, -1 with a python exception set
+*/
+int sampler_parse(PyObject *spec, int usec_ns, struct sampler *s){
+    memset(s, 0, sizeof(*s));
+    s->mode = SAMPLING_NONE;
+    s->rate = 1.0;
+    s->usec_ns = usec_ns;
+
+    if(spec == NULL || spec == Py_None)
+        return 0;
+
+    if(!PyTuple_Check(spec) || PyTuple_GET_SIZE(spec) < 2 || !PyUnicode_Check(PyTuple_GET_ITEM(spec, 0))){
+        PyErr_SetString(PyExc_TypeError, "sampling must be None or a tuple (mode, parameters...)");
+        return -1;
+    }
+    Py_ssize_t size = PyTuple_GET_SIZE(spec);
+    const char *mode = PyUnicode_AsUTF8(PyTuple_GET_ITEM(spec, 0));
+    if(mode == NULL)
+        return -1;
+
+    if(strcmp(mode, "count") == 0){
+        if(size != 2){
+            PyErr_SetString(PyExc_ValueError, "sampling must be (\"count\", n)");
+            return -1;
+        }
+        long long n = PyLong_AsLongLong(PyTuple_GET_ITEM(spec, 1));
+        if(n == -1 && PyErr_Occurred())
+            return -1;
+        if(n <= 0){
+            PyErr_SetString(PyExc_ValueError, "count sampling n must be > 0");
+            return -1;
+        }
+        s->mode = SAMPLING_COUNT;
+        s->n = (uint64_t)n;
+        s->rate = 1.0 / (double)n;
+    } else if(strcmp(mode, "random") == 0){
+        if(parse_probability(spec, size, mode, s) != 0)
+            return -1;
+        s->mode = SAMPLING_RANDOM;
+    } else if(strcmp(mode, "flow") == 0){
+        if(parse_probability(spec, size, mode, s) != 0)
+            return -1;
+        s->mode = SAMPLING_FLOW;
+    } else if(strcmp(mode, "window") == 0){
+        if(size != 3){
+            PyErr_SetString(PyExc_ValueError, "sampling must be (\"window\", keep_seconds, period_seconds)");
+            return -1;
+        }
+        double keep = PyFloat_AsDouble(PyTuple_GET_ITEM(spec, 1));
+        double period = PyFloat_AsDouble(PyTuple_GET_ITEM(spec, 2));
+        if(PyErr_Occurred())
+            return -1;
+        if(!(period > 0.0 && keep > 0.0 && keep <= period)){
+            PyErr_SetString(PyExc_ValueError, "window sampling needs 0 < keep_seconds <= period_seconds");
+            return -1;
+        }
+        s->mode = SAMPLING_WINDOW;
+        s->window_ns = (uint64_t)(keep * 1e9);
+        s->period_ns = (uint64_t)(period * 1e9);
+        if(s->period_ns == 0){
+            PyErr_SetString(PyExc_ValueError, "window sampling period must be at least 1ns");
+            return -1;
+        }
+        s->rate = keep / period;
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown sampling mode '%s', expected count, random, flow or window", mode);
+        return -1;
+    }
+
+    sampler_restart(s, s->linktype);
+    return 0;
+}
+
+/* scale factor to turn kept counts back into totals: measured when possible, nominal otherwise */
+static double sampler_scale(const struct sampler *s){
+    if(s->kept > 0)
+        return (double)s->seen / (double)s->kept;
+    return 1.0 / s->rate;
+}
+
+/* sampling settings and counters as a dict */
+PyObject *sampler_stats(const struct sampler *s){
+    return Py_BuildValue(
+        "{s:s, s:d, s:K, s:K, s:d, s:K, s:K}",
+        "mode", mode_names[s->mode],
+        "rate", s->rate,
+        "packets_seen", (unsigned long long)s->seen,
+        "packets_kept", (unsigned long long)s->kept,
+        "scale", sampler_scale(s),
+        "n", (unsigned long long)s->n,
+        "seed", (unsigned long long)s->seed
+    );
+}
+
+/*
+Record the sampling settings next to a pcap file, as <pcap_path>.sampling.json
+
+pcap files have no room for metadata, so downstream tools multiply counts taken
+from the file by "scale" to estimate the unsampled totals.
+Return 0 on success (or if sampling is off), -1 with errno set
+*/
+int sampler_write_meta(const struct sampler *s, const char *pcap_path){
+    if(s->mode == SAMPLING_NONE)
+        return 0;
+
+    char path[4096];
+    if(snprintf(path, sizeof(path), "%s.sampling.json", pcap_path) >= (int)sizeof(path)){
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    FILE *fp = fopen(path, "w");
+    if(fp == NULL)
+        return -1;
+
+    fprintf(fp, "{\"mode\": \"%s\", \"rate\": %.17g, \"n\": %llu, \"seed\": %llu, "
+        "\"window_seconds\": %.9f, \"period_seconds\": %.9f, "
+        "\"packets_seen\": %llu, \"packets_kept\": %llu, \"scale\": %.17g}\n",
+        mode_names[s->mode], s->rate, (unsigned long long)s->n, (unsigned long long)s->seed,
+        s->window_ns / 1e9, s->period_ns / 1e9,
+        (unsigned long long)s->seen, (unsigned long long)s->kept, sampler_scale(s));
+
+    if(fclose(fp) != 0)
+        return -1;
+    return 0;
+}
@@ -0,0 +1,87 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdint.h>
+#include <pcap.h>
+
+#define PYPCAP_SAMPLING // header guard
+
+/*
+Packet sampling applied in C before a packet is dumped or turned into a Packet
+
+    ("count", n)                    every n-th packet, starting with the first
+    ("random", p[, seed])           each packet with probability p
+    ("flow", p[, seed])             all packets of a fraction p of flows; the
+                                    flow key is the unordered 5-tuple, so both
+                                    directions of a flow share one decision
+    ("window", keep_s, period_s)    packets whose timestamp falls in the first
+                                    keep_s seconds of every period_s seconds
+                                    (aligned to the epoch, so sensors agree)
+
+Decisions are deterministic for a given seed, so two runs over the same input keep the same packets.
+*/
+enum sampling_mode{
+    SAMPLING_NONE,
+    SAMPLING_COUNT,
+    SAMPLING_RANDOM,
+    SAMPLING_FLOW,
+    SAMPLING_WINDOW,
+};
+
+struct sampler{
+    enum sampling_mode mode;
+    double rate; // nominal fraction of packets kept
+    uint64_t n; // count mode
+    uint64_t threshold; // random/flow: keep when a 64 bit draw or hash is <= threshold
+    uint64_t seed;
+    uint64_t state; // random number state, or packets counted in count mode
+    uint64_t window_ns; // window mode
+    uint64_t period_ns;
+    int linktype; // for the flow key, set by the owner once the handle is open
+    int usec_ns; // nanoseconds per pcap_pkthdr ts.tv_usec unit: 1000, or 1 for nano precision
+    uint64_t seen;
+    uint64_t kept;
+};
+
+int sampler_parse(PyObject *spec, int usec_ns, struct sampler *s);
+void sampler_restart(struct sampler *s, int linktype);
+uint64_t sampler_flow_hash(const struct sampler *s, const u_char *data, size_t caplen);
+PyObject *sampler_stats(const struct sampler *s);
+int sampler_write_meta(const struct sampler *s, const char *pcap_path);
+
+/* splitmix64 step, the random source of random mode */
+static inline uint64_t
+sampler_next(struct sampler *s)
+{
+    uint64_t z = (s->state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* Return 1 if the packet is sampled, 0 if it should be dropped */
+static inline int
+sampler_keep(struct sampler *s, const struct pcap_pkthdr *hdr, const u_char *data)
+{
+    int keep = 1;
+    switch(s->mode){
+    case SAMPLING_NONE:
+        break;
+    case SAMPLING_COUNT:
+        keep = (s->state++ % s->n) == 0;
+        break;
+    case SAMPLING_RANDOM:
+        keep = sampler_next(s) <= s->threshold;
+        break;
+    case SAMPLING_FLOW:
+        keep = sampler_flow_hash(s, data, hdr->caplen) <= s->threshold;
+        break;
+    case SAMPLING_WINDOW: {
+        uint64_t ts = (uint64_t)hdr->ts.tv_sec * 1000000000ULL + (uint64_t)hdr->ts.tv_usec * s->usec_ns;
+        keep = ts % s->period_ns < s->window_ns;
+        break;
+    }
+    }
+    s->seen++;
+    s->kept += keep;
+    return keep;
+}
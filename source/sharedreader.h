@@ -0,0 +1,408 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <structmember.h>
+
+#ifndef PYPCAP_POOL
+#include "pool.h"
+#endif
+
+#ifndef PYPCAP_PACKET
+#include "packet.h"
+#endif
+
+#ifndef PYPCAP_SHMRING
+#include "shmring.h"
+#endif
+
+#define PYPCAP_SHAREDREADER
+#define SHARED_CHUNK 262144 // bytes of pooled memory shared by consecutive copied packets
+#define SHARED_POLL_NS 100000 // sleep between looks at the ring while waiting for packets
+
+/*
+Consumer of a PcapCapture(shared_ring=name) packet bus
+
+Each reader has its own position in the ring and starts at the newest end.
+Packets are views straight into the shared mapping, which stays mapped for
+as long as any of them is alive; their bytes are only good until the
+producer wraps around onto them, so a consumer that keeps packets longer
+than the ring lasts should pass copy=True. A reader that falls behind by a
+whole ring loses the oldest packets instead of holding up the capture, and
+stats() counts them.
+*/
+typedef struct{
+    PyObject_HEAD
+    /* C-style properties*/
+    const struct shm_ring_hdr *_hdr; // NULL once closed
+    struct pkt_buf *_map; // the whole mapping, shared with the Packets handed out
+    struct shm_cursor _cursor;
+    int _copy;
+    struct pkt_buf *_chunk;
+    /* Python properties */
+    PyObject *name;
+    PyObject *interface_name;
+} PcapSharedReader;
+
+/* creation method */
+static PyObject *
+PcapSharedReader_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PcapSharedReader *self;
+    self = (PcapSharedReader *) type->tp_alloc(type,0);
+    return (PyObject *) self;
+}
+
+/* unmap once the reader and every Packet viewing the ring are gone */
+static void
+shared_map_release(struct pkt_buf *buf)
+{
+    munmap(buf->data, buf->size);
+}
+
+/* initialization method */
+static int
+PcapSharedReader_init(PcapSharedReader *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"name", "copy", NULL};
+    PyObject *name=NULL, *tmp;
+    int copy = 0;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "U|p", kwlist, &name, &copy))
+        return -1;
+    if(self->_hdr != NULL){
+        PyErr_SetString(PyExc_SystemError, "PcapSharedReader is already initialized");
+        return -1;
+    }
+
+    const char *s = PyUnicode_AsUTF8(name);
+    if(s == NULL)
+        return -1;
+    if(*s == '\0' || strchr(s, '/') != NULL || strlen(s) >= NAME_MAX){
+        PyErr_SetString(PyExc_ValueError, "name must be a nonempty file name without /");
+        return -1;
+    }
+    size_t mapped;
+    struct shm_ring_hdr *hdr = shm_ring_attach(s, &mapped);
+    if(hdr == NULL){
+        if(errno == EINVAL)
+            PyErr_Format(PyExc_ValueError, "%s is not a pypcap shared ring", s);
+        else
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, name);
+        return -1;
+    }
+    self->_map = pkt_buf_external((unsigned char *)hdr, mapped, shared_map_release, NULL);
+    if(self->_map == NULL){
+        munmap(hdr, mapped);
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->_hdr = hdr;
+    self->_copy = copy;
+    shm_cursor_init(hdr, &self->_cursor);
+
+    tmp = self->name;
+    Py_INCREF(name);
+    self->name = name;
+    Py_XDECREF(tmp);
+
+    tmp = self->interface_name;
+    self->interface_name = PyUnicode_DecodeUTF8(hdr->interface, strnlen(hdr->interface, sizeof(hdr->interface)), "replace");
+    Py_XDECREF(tmp);
+    if(self->interface_name == NULL)
+        return -1;
+
+    return 0;
+}
+
+static int
+PcapSharedReader_ready(PcapSharedReader *self)
+{
+    if(self->_hdr == NULL){
+        PyErr_SetString(PyExc_SystemError, "Cannot read; shared reader is already closed.");
+        return -1;
+    }
+    return 0;
+}
+
+/* Return the next packet in the ring, None if there is none yet, or NULL with a python exception set */
+static PyObject *
+PcapSharedReader_next(PcapSharedReader *self)
+{
+    int linktype = __atomic_load_n(&self->_hdr->linktype, __ATOMIC_RELAXED);
+    for(;;){
+        struct shm_rec rec;
+        const struct shm_rec *p = shm_ring_next(self->_hdr, &self->_cursor, &rec);
+        if(p == NULL)
+            return Py_BuildValue("");
+
+        if(!self->_copy){
+            size_t offset = (size_t)((const unsigned char *)(p + 1) - self->_map->data);
+            return Packet_New(self->_map, offset, rec.ts_ns, rec.caplen, rec.len, linktype, self->interface_name);
+        }
+
+        size_t offset;
+        struct pkt_buf *chunk = pkt_chunk_append(&self->_chunk, pkt_pool_get(-1), SHARED_CHUNK, p + 1, rec.caplen, &offset);
+        if(chunk == NULL)
+            return PyErr_NoMemory();
+        // a copy the producer wrote over while it was made is dropped, not returned torn
+        if(shm_cursor_intact(self->_hdr, &self->_cursor))
+            return Packet_New(chunk, offset, rec.ts_ns, rec.caplen, rec.len, linktype, self->interface_name);
+        self->_cursor.received--;
+        self->_cursor.dropped++;
+    }
+}
+
+/*
+wait until the ring has packets for self, the producer is done or timeout_ms
+passes (forever if negative)
+
+Return 1 if there are packets, 0 if not, -1 with a python exception set
+*/
+static int
+PcapSharedReader_wait(PcapSharedReader *self, long long timeout_ms)
+{
+    const struct shm_ring_hdr *h = self->_hdr;
+    struct timespec pause = {0, SHARED_POLL_NS};
+    long long waited_ns = 0;
+    for(;;){
+        if(__atomic_load_n(&h->head, __ATOMIC_ACQUIRE) > self->_cursor.pos)
+            return 1;
+        if(__atomic_load_n(&h->closed, __ATOMIC_ACQUIRE))
+            return __atomic_load_n(&h->head, __ATOMIC_ACQUIRE) > self->_cursor.pos;
+        if(timeout_ms >= 0 && waited_ns >= timeout_ms * 1000000LL)
+            return 0;
+        Py_BEGIN_ALLOW_THREADS
+        nanosleep(&pause, NULL);
+        Py_END_ALLOW_THREADS
+        waited_ns += SHARED_POLL_NS;
+        if(waited_ns % 1000000LL == 0 && PyErr_CheckSignals() != 0)
+            return -1;
+    }
+}
+
+/* Return up to max_packets Packets published since the last read, waiting up to timeout seconds for the first */
+static PyObject *
+PcapSharedReader_read(PcapSharedReader *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"max_packets", "timeout", NULL};
+    Py_ssize_t max_packets = 0;
+    PyObject *timeout = NULL;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|nO", kwlist, &max_packets, &timeout))
+        return NULL;
+    if(PcapSharedReader_ready(self) != 0)
+        return NULL;
+
+    long long timeout_ms = 0;
+    if(timeout == Py_None){
+        timeout_ms = -1;
+    } else if(timeout != NULL){
+        double t = PyFloat_AsDouble(timeout);
+        if(t == -1.0 && PyErr_Occurred())
+            return NULL;
+        if(!(t >= 0.0) || t > INT_MAX / 1000){
+            PyErr_SetString(PyExc_ValueError, "timeout must be None or between 0 and 2147483 seconds");
+            return NULL;
+        }
+        timeout_ms = (long long)(t * 1000);
+    }
+    if(PcapSharedReader_wait(self, timeout_ms) < 0)
+        return NULL;
+
+    PyObject *packets = PyList_New(0);
+    if(packets == NULL)
+        return NULL;
+    while(max_packets <= 0 || PyList_GET_SIZE(packets) < max_packets){
+        PyObject *pkt = PcapSharedReader_next(self);
+        if(pkt == NULL){
+            Py_DECREF(packets);
+            return NULL;
+        }
+        if(pkt == Py_None){
+            Py_DECREF(pkt);
+            break;
+        }
+        int res = PyList_Append(packets, pkt);
+        Py_DECREF(pkt);
+        if(res != 0){
+            Py_DECREF(packets);
+            return NULL;
+        }
+    }
+    return packets;
+}
+
+/* iterator protocol: wait for packets until the producer closes the ring */
+static PyObject *
+PcapSharedReader_iter(PcapSharedReader *self)
+{
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *
+PcapSharedReader_iternext(PcapSharedReader *self)
+{
+    if(PcapSharedReader_ready(self) != 0)
+        return NULL;
+    for(;;){
+        int ready = PcapSharedReader_wait(self, -1);
+        if(ready <= 0)
+            return NULL; // StopIteration, or the exception set by a signal handler
+        PyObject *pkt = PcapSharedReader_next(self);
+        if(pkt != Py_None)
+            return pkt;
+        Py_DECREF(pkt); // the packets seen were lost to the producer wrapping around
+    }
+}
+
+/* packets read and lost so far, and how far behind the producer the reader is */
+static PyObject *
+PcapSharedReader_stats(PcapSharedReader *self, PyObject *Py_UNUSED(ignored))
+{
+    if(PcapSharedReader_ready(self) != 0)
+        return NULL;
+    const struct shm_ring_hdr *h = self->_hdr;
+    uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+    return Py_BuildValue(
+        "{s:K, s:K, s:K, s:K, s:O}",
+        "packets_received", (unsigned long long)self->_cursor.received,
+        "packets_dropped", (unsigned long long)self->_cursor.dropped,
+        "lag_bytes", (unsigned long long)(head > self->_cursor.pos ? head - self->_cursor.pos : 0),
+        "ring_bytes", (unsigned long long)h->size,
+        "closed", __atomic_load_n(&h->closed, __ATOMIC_ACQUIRE) ? Py_True : Py_False
+    );
+}
+
+/* let go of the ring; it is unmapped once no Packet views it either */
+static PyObject *
+PcapSharedReader_close(PcapSharedReader *self, PyObject *Py_UNUSED(ignored))
+{
+    self->_hdr = NULL;
+    pkt_buf_decref(self->_map);
+    self->_map = NULL;
+    pkt_buf_decref(self->_chunk);
+    self->_chunk = NULL;
+    return Py_BuildValue("");
+}
+
+/* expose methods */
+static PyMethodDef PcapSharedReader_methods[] = {
+    {"read", (PyCFunction) PcapSharedReader_read, METH_VARARGS | METH_KEYWORDS, "Return up to max_packets (all, if 0) new Packets, waiting up to timeout seconds (forever if None) for the first"},
+    {"stats", (PyCFunction) PcapSharedReader_stats, METH_NOARGS, "Return packets received and dropped, and bytes behind the producer"},
+    {"close", (PyCFunction) PcapSharedReader_close, METH_NOARGS, "Detach from the ring"},
+    {NULL}
+};
+
+/* custom getter/setter methods to control member types */
+static PyObject *
+PcapSharedReader_get_name(PcapSharedReader *self, void *closure)
+{
+    Py_INCREF(self->name);
+    return self->name;
+}
+
+static int
+PcapSharedReader_set_name(PcapSharedReader *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "name attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapSharedReader_get_interface_name(PcapSharedReader *self, void *closure)
+{
+    Py_INCREF(self->interface_name);
+    return self->interface_name;
+}
+
+static int
+PcapSharedReader_set_interface_name(PcapSharedReader *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "interface_name attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapSharedReader_get_linktype(PcapSharedReader *self, void *closure)
+{
+    if(PcapSharedReader_ready(self) != 0)
+        return NULL;
+    return PyLong_FromLong(__atomic_load_n(&self->_hdr->linktype, __ATOMIC_RELAXED));
+}
+
+static int
+PcapSharedReader_set_linktype(PcapSharedReader *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "linktype attribute is read-only");
+    return -1;
+}
+
+static PyGetSetDef PcapSharedReader_getsetters[] = {
+    {"name", (getter) PcapSharedReader_get_name, (setter) PcapSharedReader_set_name, "name", NULL},
+    {"interface_name", (getter) PcapSharedReader_get_interface_name, (setter) PcapSharedReader_set_interface_name, "interface_name", NULL},
+    {"linktype", (getter) PcapSharedReader_get_linktype, (setter) PcapSharedReader_set_linktype, "linktype", NULL},
+    {NULL}
+};
+
+/* avoid cyclic references / enable cyclic GC */
+static int
+PcapSharedReader_traverse(PcapSharedReader *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->name);
+    Py_VISIT(self->interface_name);
+    return 0;
+}
+
+static int
+PcapSharedReader_clear(PcapSharedReader *self)
+{
+    Py_CLEAR(self->name);
+    Py_CLEAR(self->interface_name);
+    return 0;
+}
+
+/* deallocation method */
+static void
+PcapSharedReader_dealloc(PcapSharedReader *self)
+{
+    /* close all C objects */
+    pkt_buf_decref(self->_map);
+    self->_map = NULL;
+    pkt_buf_decref(self->_chunk);
+    self->_chunk = NULL;
+
+    /* dealloc with cyclic GC check */
+    PyObject_GC_UnTrack(self);
+    PcapSharedReader_clear(self);
+
+    /* deallocate the object itself */
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/*
+PcapSharedReader Type construction
+
+.tp_flags:
+    Py_TPFLAGS_DEFAULT = always use
+    Py_TPFLAGS_BASETYPE = allows to be subclassed. do this only if methods don't care about type of object created/used
+    Py_TPFLAGS_HAVE_GC = cyclic GC causes segfault if this isn't set
+*/
+static PyTypeObject PcapSharedReaderType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.PcapSharedReader",
+    .tp_doc = "Reader of packets a PcapCapture publishes to a named shared-memory ring",
+    .tp_basicsize = sizeof(PcapSharedReader),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_new = PcapSharedReader_new,
+    .tp_dealloc = (destructor) PcapSharedReader_dealloc,
+    .tp_init = (initproc) PcapSharedReader_init,
+    .tp_methods = PcapSharedReader_methods, // expose custom methods
+    .tp_traverse = (traverseproc) PcapSharedReader_traverse, // cyclic GC enable
+    .tp_clear = (inquiry) PcapSharedReader_clear,
+    .tp_getset = PcapSharedReader_getsetters, // custom getter/setter methods
+    .tp_iter = (getiterfunc) PcapSharedReader_iter, // iterate over Packet objects
+    .tp_iternext = (iternextfunc) PcapSharedReader_iternext,
+};
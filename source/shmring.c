@@ -0,0 +1,280 @@
+#include "shmring.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHM_RING_ALIGN 8
+
+static size_t rec_bytes(uint32_t caplen){
+    return (sizeof(struct shm_rec) + caplen + SHM_RING_ALIGN - 1) & ~(size_t)(SHM_RING_ALIGN - 1);
+}
+
+/* "/name", as shm_open wants it */
+static int shm_path(const char *name, char *path, size_t len){
+    if(snprintf(path, len, "/%s", name) >= (int)len){
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+Fill r from a python shared_ring spec: None, a name, or (name, size in bytes)
+
+Return 0 on success, -1 with a python exception set
+*/
+int shm_ring_parse(PyObject *spec, struct shm_ring *r){
+    memset(r, 0, sizeof(*r));
+    if(spec == NULL || spec == Py_None)
+        return 0;
+
+    PyObject *name = spec;
+    Py_ssize_t size = SHM_RING_BYTES;
+    if(PyTuple_Check(spec)){
+        if(!PyArg_ParseTuple(spec, "Un", &name, &size))
+            return -1;
+    } else if(!PyUnicode_Check(spec)){
+        PyErr_SetString(PyExc_TypeError, "shared_ring must be None, a name or (name, size in bytes)");
+        return -1;
+    }
+
+    const char *s = PyUnicode_AsUTF8(name);
+    if(s == NULL)
+        return -1;
+    if(*s == '\0' || strchr(s, '/') != NULL || strlen(s) >= NAME_MAX){
+        PyErr_SetString(PyExc_ValueError, "shared_ring name must be a nonempty file name without /");
+        return -1;
+    }
+    if(size < SHM_RING_MIN_BYTES){
+        PyErr_Format(PyExc_ValueError, "shared_ring size must be at least %d bytes", SHM_RING_MIN_BYTES);
+        return -1;
+    }
+    r->name = strdup(s);
+    if(r->name == NULL){
+        PyErr_NoMemory();
+        return -1;
+    }
+    r->size = ((size_t)size + SHM_RING_ALIGN - 1) & ~(size_t)(SHM_RING_ALIGN - 1);
+    return 0;
+}
+
+/*
+Create the ring named r->name, replacing any left by an earlier producer;
+consumers still attached to an old one keep it until they detach
+
+Return 0 on success, -1 with errno set
+*/
+int shm_ring_create(struct shm_ring *r, const char *interface, int linktype, int usec_ns){
+    char path[NAME_MAX + 2];
+    if(shm_path(r->name, path, sizeof(path)) != 0)
+        return -1;
+    shm_unlink(path);
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0640);
+    if(fd < 0)
+        return -1;
+    size_t mapped = SHM_RING_DATA + r->size;
+    if(ftruncate(fd, (off_t)mapped) != 0){
+        int err = errno;
+        close(fd);
+        shm_unlink(path);
+        errno = err;
+        return -1;
+    }
+    void *mem = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED){
+        int err = errno;
+        shm_unlink(path);
+        errno = err;
+        return -1;
+    }
+
+    r->hdr = (struct shm_ring_hdr *)mem;
+    r->mem = (unsigned char *)mem + SHM_RING_DATA;
+    r->head = r->tail = r->seq = 0;
+    r->usec_ns = usec_ns;
+    r->oversized = 0;
+    r->hdr->version = SHM_RING_VERSION;
+    r->hdr->size = r->size;
+    r->hdr->linktype = linktype;
+    snprintf(r->hdr->interface, sizeof(r->hdr->interface), "%s", interface ? interface : "");
+    // consumers check the magic, so it goes last
+    __atomic_store_n(&r->hdr->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* bytes from pos to the next record, pos holding a record or the padding at the end of the region */
+static size_t rec_skip(const struct shm_ring *r, uint64_t pos){
+    size_t off = pos % r->size;
+    size_t room = r->size - off;
+    if(room < sizeof(struct shm_rec))
+        return room;
+    const struct shm_rec *rec = (const struct shm_rec *)(r->mem + off);
+    return rec->caplen == SHM_RING_PAD ? room : rec_bytes(rec->caplen);
+}
+
+/* publish one packet, overwriting the oldest records as needed; never waits for consumers */
+void shm_ring_publish(struct shm_ring *r, const struct pcap_pkthdr *hdr, const u_char *data){
+    size_t n = rec_bytes(hdr->caplen);
+    if(n > r->size / 2){
+        r->oversized++;
+        return;
+    }
+    uint64_t start = r->head;
+    size_t off = start % r->size;
+    size_t room = r->size - off;
+    if(room < n)
+        start += room;
+    uint64_t end = start + n;
+
+    // take what is about to be overwritten away from consumers before touching it
+    uint64_t tail = r->tail;
+    while(tail + r->size < end)
+        tail += rec_skip(r, tail);
+    if(tail != r->tail){
+        r->tail = tail;
+        __atomic_store_n(&r->hdr->tail, tail, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    if(room < n && room >= sizeof(struct shm_rec))
+        ((struct shm_rec *)(r->mem + off))->caplen = SHM_RING_PAD;
+    struct shm_rec *rec = (struct shm_rec *)(r->mem + start % r->size);
+    rec->seq = r->seq++;
+    rec->ts_ns = (int64_t)hdr->ts.tv_sec * 1000000000LL + (int64_t)hdr->ts.tv_usec * r->usec_ns;
+    rec->caplen = hdr->caplen;
+    rec->len = hdr->len;
+    memcpy(rec + 1, data, hdr->caplen);
+
+    r->head = end;
+    __atomic_store_n(&r->hdr->seq, r->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->hdr->head, end, __ATOMIC_RELEASE);
+}
+
+/* tell consumers no more packets are coming, and take the name away for the next producer */
+void shm_ring_close(struct shm_ring *r){
+    if(r->hdr == NULL)
+        return;
+    __atomic_store_n(&r->hdr->closed, 1, __ATOMIC_RELEASE);
+    munmap(r->hdr, SHM_RING_DATA + r->size);
+    r->hdr = NULL;
+    r->mem = NULL;
+
+    char path[NAME_MAX + 2];
+    if(shm_path(r->name, path, sizeof(path)) == 0)
+        shm_unlink(path);
+}
+
+void shm_ring_free(struct shm_ring *r){
+    shm_ring_close(r);
+    free(r->name);
+    memset(r, 0, sizeof(*r));
+}
+
+/*
+Map the ring named name read-only, the whole mapping being *mapped bytes
+
+Return its header, or NULL with errno set (EINVAL if it isn't a ring)
+*/
+struct shm_ring_hdr *shm_ring_attach(const char *name, size_t *mapped){
+    char path[NAME_MAX + 2];
+    if(shm_path(name, path, sizeof(path)) != 0)
+        return NULL;
+    int fd = shm_open(path, O_RDONLY, 0);
+    if(fd < 0)
+        return NULL;
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        int err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    if((size_t)st.st_size < SHM_RING_DATA){
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    void *mem = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED)
+        return NULL;
+
+    struct shm_ring_hdr *h = (struct shm_ring_hdr *)mem;
+    if(__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC || h->version != SHM_RING_VERSION
+        || h->size + SHM_RING_DATA > (uint64_t)st.st_size){
+        munmap(mem, (size_t)st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+    *mapped = (size_t)st.st_size;
+    return h;
+}
+
+/* start c at the newest end of the ring: it sees packets published from now on */
+void shm_cursor_init(const struct shm_ring_hdr *h, struct shm_cursor *c){
+    memset(c, 0, sizeof(*c));
+    c->pos = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+    // at least the sequence number of the record at pos, so drops are never overcounted
+    c->next_seq = __atomic_load_n(&h->seq, __ATOMIC_RELAXED);
+}
+
+/*
+Next record for c, its header copied to *rec and its data following the
+returned pointer in the mapping, or NULL if c has caught up with the producer
+
+The data stays intact until the producer wraps around onto it
+*/
+const struct shm_rec *shm_ring_next(const struct shm_ring_hdr *h, struct shm_cursor *c, struct shm_rec *rec){
+    const unsigned char *mem = (const unsigned char *)h + SHM_RING_DATA;
+    size_t size = h->size;
+    for(;;){
+        uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+        if(c->pos >= head)
+            return NULL;
+        uint64_t tail = __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE);
+        if(c->pos < tail)
+            c->pos = tail; // lapped, the sequence numbers tell how much was missed
+
+        size_t off = c->pos % size;
+        size_t room = size - off;
+        if(room < sizeof(struct shm_rec)){
+            c->pos += room;
+            continue;
+        }
+        const struct shm_rec *p = (const struct shm_rec *)(mem + off);
+        memcpy(rec, p, sizeof(*rec));
+        // the header is only good if the producer hadn't started overwriting it
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&h->tail, __ATOMIC_RELAXED) > c->pos)
+            continue;
+        if(rec->caplen == SHM_RING_PAD){
+            c->pos += room;
+            continue;
+        }
+        if(sizeof(*rec) + (size_t)rec->caplen > room){ // can't happen with a well-behaved producer
+            c->pos = head;
+            continue;
+        }
+
+        if(rec->seq > c->next_seq)
+            c->dropped += rec->seq - c->next_seq;
+        c->next_seq = rec->seq + 1;
+        c->received++;
+        c->last = c->pos;
+        c->pos += rec_bytes(rec->caplen);
+        return p;
+    }
+}
+
+/* Return 1 if the producer hasn't started overwriting the record shm_ring_next returned last, 0 if it has */
+int shm_cursor_intact(const struct shm_ring_hdr *h, const struct shm_cursor *c){
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&h->tail, __ATOMIC_RELAXED) <= c->last;
+}
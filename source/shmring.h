@@ -0,0 +1,82 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pcap.h>
+
+#define PYPCAP_SHMRING // header guard
+#define SHM_RING_BYTES (64 * 1024 * 1024) // default ring size
+#define SHM_RING_MIN_BYTES (1024 * 1024) // room for several packets of any size
+#define SHM_RING_MAGIC 0x52485350 // "PSHR"
+#define SHM_RING_VERSION 1
+#define SHM_RING_DATA 4096 // offset of the records in the mapping, past the header
+
+/*
+Shared-memory packet bus: one producer, any number of consumers
+
+A named POSIX shared memory object (/dev/shm/<name>) holds a header and then
+whole records back to back, laid out like the flight recorder ring: a record
+that would straddle the end starts over at the front, positions only grow
+and position % size is the physical offset.
+
+The producer never waits for consumers. Before overwriting anything it moves
+tail past the records it is about to reuse, then writes, then moves head; a
+consumer keeps its own position, reads a record between tail and head and
+checks tail again afterwards, so a record overwritten while it was being
+read is seen as dropped rather than returned torn. A consumer that falls
+more than a ring behind skips to tail, counting the sequence numbers it
+missed. The producer only ever writes the mapping, consumers only read it.
+*/
+struct shm_ring_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size; // bytes of records from SHM_RING_DATA on
+    int32_t linktype; // -1 until the capture is open
+    uint32_t closed; // set once the producer is done
+    char interface[64];
+    uint64_t head __attribute__((aligned(64))); // end of the last record published
+    uint64_t seq; // records published, moved just before head
+    uint64_t tail __attribute__((aligned(64))); // start of the oldest record not being overwritten
+};
+
+struct shm_rec{
+    uint64_t seq; // numbers records in the order published
+    int64_t ts_ns;
+    uint32_t caplen; // SHM_RING_PAD marks the unused end of the region
+    uint32_t len;
+};
+
+#define SHM_RING_PAD UINT32_MAX
+
+/* producer side */
+struct shm_ring{
+    char *name; // NULL unless publishing
+    size_t size;
+    struct shm_ring_hdr *hdr;
+    unsigned char *mem;
+    uint64_t head; // local copies, only the producer moves them
+    uint64_t tail;
+    uint64_t seq;
+    int usec_ns; // nanoseconds per pcap_pkthdr ts.tv_usec unit of the capture
+    uint64_t oversized; // packets bigger than half the ring, never published
+};
+
+/* consumer side, one per reader */
+struct shm_cursor{
+    uint64_t pos;
+    uint64_t last; // position of the record shm_ring_next returned last
+    uint64_t next_seq;
+    uint64_t received;
+    uint64_t dropped; // records overwritten before this reader got to them
+};
+
+int shm_ring_parse(PyObject *spec, struct shm_ring *r);
+int shm_ring_create(struct shm_ring *r, const char *interface, int linktype, int usec_ns);
+void shm_ring_publish(struct shm_ring *r, const struct pcap_pkthdr *hdr, const u_char *data);
+void shm_ring_close(struct shm_ring *r);
+void shm_ring_free(struct shm_ring *r);
+
+struct shm_ring_hdr *shm_ring_attach(const char *name, size_t *mapped);
+void shm_cursor_init(const struct shm_ring_hdr *h, struct shm_cursor *c);
+const struct shm_rec *shm_ring_next(const struct shm_ring_hdr *h, struct shm_cursor *c, struct shm_rec *rec);
+int shm_cursor_intact(const struct shm_ring_hdr *h, const struct shm_cursor *c);
@@ -0,0 +1,281 @@
+#include "stats.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PYPCAP_DISSECT
+#include "dissect.h"
+#endif
+
+/* lower bound of each size bin: tiny, ..., full ethernet frames, jumbo, beyond jumbo */
+const uint32_t stats_size_edges[STATS_SIZE_BINS] = {0, 64, 128, 256, 512, 1024, 1519, 4096, 9217};
+
+static uint32_t pow2_at_least(uint32_t n){
+    uint32_t p = 1;
+    while(p < n)
+        p <<= 1;
+    return p;
+}
+
+/* Return 0, or -1 if out of memory */
+int stats_init(struct stats *s, int64_t bucket_ns, uint32_t nbuckets, uint32_t k, uint32_t width, uint32_t depth){
+    memset(s, 0, sizeof(*s));
+    s->bucket_ns = bucket_ns;
+    s->nbuckets = nbuckets;
+    s->width = pow2_at_least(width);
+    s->depth = depth;
+    s->k = k;
+    s->index_mask = pow2_at_least(2 * k + 1) - 1; // never more than half full
+
+    s->bucket_packets = calloc(nbuckets, sizeof(uint64_t));
+    s->bucket_bytes = calloc(nbuckets, sizeof(uint64_t));
+    s->sketch = calloc((size_t)s->width * depth, sizeof(uint64_t));
+    s->heap = calloc(k ? k : 1, sizeof(struct stats_talker));
+    s->index = calloc((size_t)s->index_mask + 1, sizeof(uint32_t));
+    if(s->bucket_packets == NULL || s->bucket_bytes == NULL || s->sketch == NULL || s->heap == NULL || s->index == NULL){
+        stats_free(s);
+        return -1;
+    }
+    return 0;
+}
+
+void stats_free(struct stats *s){
+    free(s->bucket_packets);
+    free(s->bucket_bytes);
+    free(s->sketch);
+    free(s->heap);
+    free(s->index);
+    memset(s, 0, sizeof(*s));
+}
+
+void stats_reset(struct stats *s){
+    memset(s->bucket_packets, 0, s->nbuckets * sizeof(uint64_t));
+    memset(s->bucket_bytes, 0, s->nbuckets * sizeof(uint64_t));
+    memset(s->sketch, 0, (size_t)s->width * s->depth * sizeof(uint64_t));
+    memset(s->index, 0, ((size_t)s->index_mask + 1) * sizeof(uint32_t));
+    s->head = s->first = 0;
+    s->packets = s->bytes = s->late = 0;
+    memset(s->sizes, 0, sizeof(s->sizes));
+    memset(s->proto_packets, 0, sizeof(s->proto_packets));
+    memset(s->proto_bytes, 0, sizeof(s->proto_bytes));
+    s->non_ip_packets = s->non_ip_bytes = 0;
+    s->ntalkers = 0;
+}
+
+static int64_t floor_div(int64_t a, int64_t b){
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+static uint32_t ring_slot(const struct stats *s, int64_t bucket){
+    int64_t m = bucket % (int64_t)s->nbuckets;
+    return (uint32_t)(m < 0 ? m + s->nbuckets : m);
+}
+
+/* count one packet in its bucket; called before s->packets counts it */
+static void stats_bucket(struct stats *s, int64_t ts_ns, uint32_t bytes){
+    int64_t b = floor_div(ts_ns, s->bucket_ns);
+    if(s->packets == 0){
+        s->head = s->first = b;
+    } else if(b > s->head){
+        // buckets nobody sent anything in are zeroed as the ring moves over them
+        int64_t clear = b - s->head < (int64_t)s->nbuckets ? b - s->head : s->nbuckets;
+        for(int64_t i = 1; i <= clear; i++){
+            uint32_t slot = ring_slot(s, s->head + i);
+            s->bucket_packets[slot] = 0;
+            s->bucket_bytes[slot] = 0;
+        }
+        s->head = b;
+    } else if(b <= s->head - (int64_t)s->nbuckets){
+        s->late++;
+        return;
+    }
+    if(b < s->first)
+        s->first = b;
+    uint32_t slot = ring_slot(s, b);
+    s->bucket_packets[slot]++;
+    s->bucket_bytes[slot] += bytes;
+}
+
+static uint64_t key_hash(const struct stats_key *k){
+    uint64_t a, b;
+    memcpy(&a, k->addr, 8);
+    memcpy(&b, k->addr + 8, 8);
+    uint64_t h = (a ^ (0x9E3779B97F4A7C15ULL * k->addr_len)) * 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h = (h ^ b) * 0xC4CEB9FE1A85EC53ULL;
+    return h ^ (h >> 33);
+}
+
+/* conservative update: only the counters below the new estimate are raised to it */
+static uint64_t sketch_add(struct stats *s, uint64_t h, uint64_t bytes){
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+    uint32_t mask = s->width - 1;
+    uint64_t est = UINT64_MAX;
+    for(uint32_t i = 0; i < s->depth; i++){
+        uint64_t c = s->sketch[(size_t)i * s->width + ((h1 + i * h2) & mask)];
+        if(c < est)
+            est = c;
+    }
+    est += bytes;
+    for(uint32_t i = 0; i < s->depth; i++){
+        uint64_t *c = &s->sketch[(size_t)i * s->width + ((h1 + i * h2) & mask)];
+        if(*c < est)
+            *c = est;
+    }
+    return est;
+}
+
+/* index slot holding key, or the empty slot where it would go */
+static uint32_t index_find(const struct stats *s, const struct stats_key *key, uint64_t h){
+    uint32_t slot = (uint32_t)h & s->index_mask;
+    while(s->index[slot] != 0){
+        const struct stats_talker *t = &s->heap[s->index[slot] - 1];
+        if(t->key.addr_len == key->addr_len && memcmp(t->key.addr, key->addr, sizeof(key->addr)) == 0)
+            break;
+        slot = (slot + 1) & s->index_mask;
+    }
+    return slot;
+}
+
+/* linear probing delete: pull later entries of the probe run back into the hole */
+static void index_remove(struct stats *s, uint32_t hole){
+    uint32_t j = hole;
+    for(;;){
+        j = (j + 1) & s->index_mask;
+        if(s->index[j] == 0)
+            break;
+        uint32_t home = (uint32_t)key_hash(&s->heap[s->index[j] - 1].key) & s->index_mask;
+        int stays = hole <= j ? (hole < home && home <= j) : (hole < home || home <= j);
+        if(stays)
+            continue;
+        s->index[hole] = s->index[j];
+        s->heap[s->index[hole] - 1].slot = hole;
+        hole = j;
+    }
+    s->index[hole] = 0;
+}
+
+static void heap_swap(struct stats *s, uint32_t a, uint32_t b){
+    struct stats_talker t = s->heap[a];
+    s->heap[a] = s->heap[b];
+    s->heap[b] = t;
+    s->index[s->heap[a].slot] = a + 1;
+    s->index[s->heap[b].slot] = b + 1;
+}
+
+static void heap_down(struct stats *s, uint32_t i){
+    for(;;){
+        uint32_t l = 2 * i + 1, r = l + 1, m = i;
+        if(l < s->ntalkers && s->heap[l].bytes < s->heap[m].bytes)
+            m = l;
+        if(r < s->ntalkers && s->heap[r].bytes < s->heap[m].bytes)
+            m = r;
+        if(m == i)
+            return;
+        heap_swap(s, i, m);
+        i = m;
+    }
+}
+
+static void heap_up(struct stats *s, uint32_t i){
+    while(i > 0){
+        uint32_t p = (i - 1) / 2;
+        if(s->heap[p].bytes <= s->heap[i].bytes)
+            return;
+        heap_swap(s, i, p);
+        i = p;
+    }
+}
+
+static void talker_add(struct stats *s, const struct stats_key *key, uint32_t bytes){
+    if(s->k == 0)
+        return;
+    uint64_t h = key_hash(key);
+    uint64_t est = sketch_add(s, h, bytes);
+    uint32_t slot = index_find(s, key, h);
+
+    if(s->index[slot] != 0){
+        uint32_t pos = s->index[slot] - 1;
+        s->heap[pos].bytes = est;
+        heap_down(s, pos);
+        return;
+    }
+    if(s->ntalkers < s->k){
+        uint32_t pos = s->ntalkers++;
+        s->heap[pos] = (struct stats_talker){*key, est, slot};
+        s->index[slot] = pos + 1;
+        heap_up(s, pos);
+        return;
+    }
+    if(est <= s->heap[0].bytes)
+        return;
+
+    // displace the smallest talker; removing it may move the slot key belongs in
+    index_remove(s, s->heap[0].slot);
+    slot = index_find(s, key, h);
+    s->heap[0] = (struct stats_talker){*key, est, slot};
+    s->index[slot] = 1;
+    heap_down(s, 0);
+}
+
+/* add one packet already dissected into meta */
+void stats_add_meta(struct stats *s, int64_t ts_ns, uint32_t wirelen, const struct pkt_meta *meta){
+    stats_bucket(s, ts_ns, wirelen);
+    s->packets++;
+    s->bytes += wirelen;
+
+    int bin = STATS_SIZE_BINS - 1;
+    while(wirelen < stats_size_edges[bin])
+        bin--;
+    s->sizes[bin]++;
+
+    if(meta->l3_offset < 0){
+        s->non_ip_packets++;
+        s->non_ip_bytes += wirelen;
+        return;
+    }
+    s->proto_packets[meta->ip_proto]++;
+    s->proto_bytes[meta->ip_proto] += wirelen;
+
+    struct stats_key key = {0};
+    key.addr_len = meta->addr_len;
+    memcpy(key.addr, meta->src, meta->addr_len <= sizeof(key.addr) ? meta->addr_len : sizeof(key.addr));
+    talker_add(s, &key, wirelen);
+}
+
+void stats_add(struct stats *s, int linktype, int64_t ts_ns, const unsigned char *data, uint32_t caplen, uint32_t wirelen){
+    struct pkt_meta meta;
+    dissect_packet(linktype, data, caplen, &meta);
+    stats_add_meta(s, ts_ns, wirelen, &meta);
+}
+
+/* number of the oldest bucket still in the ring */
+int64_t stats_first_bucket(const struct stats *s){
+    int64_t oldest = s->head - (int64_t)s->nbuckets + 1;
+    return s->first > oldest ? s->first : oldest;
+}
+
+/* copy the buckets in the ring, oldest first; Return how many */
+uint32_t stats_buckets(const struct stats *s, uint64_t *packets, uint64_t *bytes){
+    if(s->packets == 0)
+        return 0;
+    uint32_t n = 0;
+    for(int64_t b = stats_first_bucket(s); b <= s->head; b++, n++){
+        packets[n] = s->bucket_packets[ring_slot(s, b)];
+        bytes[n] = s->bucket_bytes[ring_slot(s, b)];
+    }
+    return n;
+}
+
+static int talker_cmp(const void *a, const void *b){
+    uint64_t x = ((const struct stats_talker *)a)->bytes, y = ((const struct stats_talker *)b)->bytes;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/* copy the top talkers, most bytes first, into out (room for k); Return how many */
+uint32_t stats_top(const struct stats *s, struct stats_talker *out){
+    memcpy(out, s->heap, s->ntalkers * sizeof(*out));
+    qsort(out, s->ntalkers, sizeof(*out), talker_cmp);
+    return s->ntalkers;
+}
@@ -0,0 +1,70 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PYPCAP_STATS // header guard
+#define STATS_SIZE_BINS 9 // packet size histogram bins, see stats_size_edges
+
+/*
+Time-bucketed traffic statistics with bounded memory
+
+Packets and bytes are counted per bucket of bucket_ns, in a ring holding the
+latest nbuckets buckets; packets older than the ring are still counted in the
+totals but not in any bucket. Alongside the buckets: a wire size histogram,
+packets and bytes per IP protocol, and the top-K source addresses by bytes,
+estimated with a Count-Min Sketch (conservative update) and kept in a min-heap
+indexed by a small open-addressing table, so finding a talker is O(1) and
+replacing the smallest one O(log K).
+*/
+struct pkt_meta;
+
+struct stats_key{
+    uint8_t addr_len; // 4 or 16
+    uint8_t addr[16];
+};
+
+struct stats_talker{
+    struct stats_key key;
+    uint64_t bytes; // sketch estimate, an upper bound
+    uint32_t slot; // position in the index
+};
+
+struct stats{
+    int64_t bucket_ns;
+    uint32_t nbuckets;
+    int64_t head; // number of the newest bucket, valid once packets > 0
+    int64_t first; // number of the oldest bucket a packet went into
+    uint64_t *bucket_packets;
+    uint64_t *bucket_bytes;
+
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t late; // packets older than the ring
+    uint64_t sizes[STATS_SIZE_BINS];
+    uint64_t proto_packets[256];
+    uint64_t proto_bytes[256];
+    uint64_t non_ip_packets;
+    uint64_t non_ip_bytes;
+
+    uint32_t width; // sketch columns, a power of two
+    uint32_t depth;
+    uint64_t *sketch;
+
+    uint32_t k;
+    uint32_t ntalkers;
+    struct stats_talker *heap; // min-heap on bytes
+    uint32_t *index; // heap position + 1 per slot, 0 for empty
+    uint32_t index_mask;
+};
+
+extern const uint32_t stats_size_edges[STATS_SIZE_BINS];
+
+int stats_init(struct stats *s, int64_t bucket_ns, uint32_t nbuckets, uint32_t k, uint32_t width, uint32_t depth);
+void stats_free(struct stats *s);
+void stats_reset(struct stats *s);
+void stats_add(struct stats *s, int linktype, int64_t ts_ns, const unsigned char *data, uint32_t caplen, uint32_t wirelen);
+void stats_add_meta(struct stats *s, int64_t ts_ns, uint32_t wirelen, const struct pkt_meta *meta);
+int64_t stats_first_bucket(const struct stats *s);
+uint32_t stats_buckets(const struct stats *s, uint64_t *packets, uint64_t *bytes);
+uint32_t stats_top(const struct stats *s, struct stats_talker *out);
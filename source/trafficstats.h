@@ -0,0 +1,443 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <math.h>
+#include <string.h>
+#include <structmember.h>
+
+#ifndef PYPCAP_STATS
+#include "stats.h"
+#endif
+
+#ifndef PYPCAP_READER
+#include "reader.h"
+#endif
+
+#ifndef PYPCAP_BATCH
+#include "batch.h"
+#endif
+
+#define PYPCAP_TRAFFICSTATS
+#define TRAFFICSTATS_BUCKETS 3600 // an hour of one-second buckets
+#define TRAFFICSTATS_MAX_BUCKETS (1 << 24)
+#define TRAFFICSTATS_MAX_TOP 65536
+
+/*
+Packet and byte rates, size histogram, protocol mix and top talkers, counted in C
+
+Fed with update(): a PcapReader is read to its end without making Packet
+objects, and Packets and PacketBatches (as PcapCapture hands them out) are
+counted as they are. Memory is fixed when the object is created, see stats.h.
+*/
+typedef struct{
+    PyObject_HEAD
+    /* C-style properties*/
+    struct stats _stats;
+    /* Python properties */
+    PyObject *interval;
+    PyObject *buckets;
+    PyObject *top;
+} TrafficStats;
+
+/* creation method */
+static PyObject *
+TrafficStats_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    TrafficStats *self;
+    self = (TrafficStats *) type->tp_alloc(type,0);
+    return (PyObject *) self;
+}
+
+/* initialization method */
+static int
+TrafficStats_init(TrafficStats *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"interval", "buckets", "top", "width", "depth", NULL};
+    double interval = 1.0;
+    int buckets = TRAFFICSTATS_BUCKETS, top = 10, width = 2048, depth = 4;
+    PyObject *tmp;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|diiii", kwlist, &interval, &buckets, &top, &width, &depth))
+        return -1;
+
+    if(self->_stats.sketch != NULL){
+        PyErr_SetString(PyExc_SystemError, "TrafficStats is already initialized");
+        return -1;
+    }
+    if(!(interval >= 1e-6) || interval > 86400.0){
+        PyErr_SetString(PyExc_ValueError, "interval must be between 1e-6 and 86400 seconds");
+        return -1;
+    }
+    if(buckets <= 0 || buckets > TRAFFICSTATS_MAX_BUCKETS){
+        PyErr_Format(PyExc_ValueError, "buckets must be between 1 and %d", TRAFFICSTATS_MAX_BUCKETS);
+        return -1;
+    }
+    if(top < 0 || top > TRAFFICSTATS_MAX_TOP){
+        PyErr_Format(PyExc_ValueError, "top must be between 0 and %d", TRAFFICSTATS_MAX_TOP);
+        return -1;
+    }
+    if(width <= 0 || width > (1 << 24) || depth <= 0 || depth > 16){
+        PyErr_SetString(PyExc_ValueError, "width must be between 1 and 2**24 and depth between 1 and 16");
+        return -1;
+    }
+
+    if(stats_init(&self->_stats, llround(interval * 1e9), (uint32_t)buckets, (uint32_t)top, (uint32_t)width, (uint32_t)depth) != 0){
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    tmp = self->interval;
+    self->interval = PyFloat_FromDouble(interval);
+    Py_XDECREF(tmp);
+
+    tmp = self->buckets;
+    self->buckets = PyLong_FromLong(buckets);
+    Py_XDECREF(tmp);
+
+    tmp = self->top;
+    self->top = PyLong_FromLong(top);
+    Py_XDECREF(tmp);
+
+    return 0;
+}
+
+static int
+TrafficStats_ready(TrafficStats *self)
+{
+    if(self->_stats.sketch == NULL){
+        PyErr_SetString(PyExc_SystemError, "TrafficStats is not initialized");
+        return -1;
+    }
+    return 0;
+}
+
+/* count a Packet or the packets of a PacketBatch; Return how many, or -1 with a python exception set */
+static Py_ssize_t
+TrafficStats_add_one(TrafficStats *self, PyObject *obj)
+{
+    if(PyObject_TypeCheck(obj, &PacketType)){
+        Packet *pkt = (Packet *)obj;
+        stats_add_meta(&self->_stats, pkt->ts_ns, pkt->wirelen, Packet_meta(pkt));
+        return 1;
+    }
+    if(PyObject_TypeCheck(obj, &PacketBatchType)){
+        PacketBatch *batch = (PacketBatch *)obj;
+        struct batch_columns cols;
+        batch_columns_map(batch->columns, batch->capacity, &cols);
+        for(Py_ssize_t i = 0; i < batch->count; i++)
+            stats_add(&self->_stats, batch->linktype, cols.ts[i], batch->data->data + cols.offset[i], cols.caplen[i], cols.wirelen[i]);
+        return batch->count;
+    }
+    PyErr_SetString(PyExc_TypeError, "TrafficStats counts Packet and PacketBatch objects");
+    return -1;
+}
+
+/*
+count packets from a PcapReader (read to its end), a Packet, a PacketBatch,
+or an iterable of Packets and PacketBatches; Return the number counted
+*/
+static PyObject *
+TrafficStats_update(TrafficStats *self, PyObject *source)
+{
+    if(TrafficStats_ready(self) != 0)
+        return NULL;
+
+    if(PyObject_TypeCheck(source, &PcapReaderType)){
+        PcapReader *reader = (PcapReader *)source;
+        if(reader->_pcap == NULL){
+            PyErr_SetString(PyExc_SystemError, "Cannot read; pcap reader is already closed.");
+            return NULL;
+        }
+        long long count = 0;
+        struct pcap_pkthdr hdr;
+        const u_char *data;
+        while((data = PcapReader_next(reader, &hdr)) != NULL){
+            // reader is opened with nanosecond precision, so tv_usec holds nanoseconds
+            stats_add(&self->_stats, reader->_linktype, (int64_t)hdr.ts.tv_sec * 1000000000LL + hdr.ts.tv_usec, data, hdr.caplen, hdr.len);
+            count++;
+        }
+        return PyLong_FromLongLong(count);
+    }
+
+    if(PyObject_TypeCheck(source, &PacketType) || PyObject_TypeCheck(source, &PacketBatchType)){
+        Py_ssize_t n = TrafficStats_add_one(self, source);
+        return n < 0 ? NULL : PyLong_FromSsize_t(n);
+    }
+
+    PyObject *iter = PyObject_GetIter(source);
+    if(iter == NULL)
+        return NULL;
+    long long count = 0;
+    PyObject *item;
+    while((item = PyIter_Next(iter)) != NULL){
+        Py_ssize_t n = TrafficStats_add_one(self, item);
+        Py_DECREF(item);
+        if(n < 0){
+            Py_DECREF(iter);
+            return NULL;
+        }
+        count += n;
+    }
+    Py_DECREF(iter);
+    if(PyErr_Occurred())
+        return NULL;
+    return PyLong_FromLongLong(count);
+}
+
+/* typed memoryview over a pooled copy of n items at src */
+static PyObject *
+TrafficStats_array(const void *src, size_t n, const char *format, size_t itemsize)
+{
+    struct pkt_buf *buf = pkt_buf_alloc(pkt_pool_get(-1), (n ? n : 1) * itemsize);
+    if(buf == NULL)
+        return PyErr_NoMemory();
+    memcpy(buf->data, src, n * itemsize);
+    buf->len = n * itemsize;
+
+    PyObject *pb = PacketBuffer_New(buf, 0, n, format, itemsize);
+    pkt_buf_decref(buf);
+    if(pb == NULL)
+        return NULL;
+    PyObject *view = PyMemoryView_FromObject(pb);
+    Py_DECREF(pb);
+    return view;
+}
+
+static PyObject *
+TrafficStats_buckets_dict(const struct stats *s)
+{
+    uint64_t *packets = malloc(s->nbuckets * sizeof(uint64_t));
+    uint64_t *bytes = malloc(s->nbuckets * sizeof(uint64_t));
+    int64_t *starts = malloc(s->nbuckets * sizeof(int64_t));
+    if(packets == NULL || bytes == NULL || starts == NULL){
+        free(packets);
+        free(bytes);
+        free(starts);
+        return PyErr_NoMemory();
+    }
+    uint32_t n = stats_buckets(s, packets, bytes);
+    int64_t first = stats_first_bucket(s);
+    for(uint32_t i = 0; i < n; i++)
+        starts[i] = (first + i) * s->bucket_ns;
+
+    PyObject *d = Py_BuildValue(
+        "{s:N, s:N, s:N}",
+        "timestamps", TrafficStats_array(starts, n, "q", sizeof(int64_t)),
+        "packets", TrafficStats_array(packets, n, "Q", sizeof(uint64_t)),
+        "bytes", TrafficStats_array(bytes, n, "Q", sizeof(uint64_t))
+    );
+    free(packets);
+    free(bytes);
+    free(starts);
+    return d;
+}
+
+static PyObject *
+TrafficStats_protocols(const struct stats *s)
+{
+    PyObject *d = PyDict_New();
+    if(d == NULL)
+        return NULL;
+    for(int p = 0; p < 256; p++){
+        if(s->proto_packets[p] == 0)
+            continue;
+        PyObject *key = PyLong_FromLong(p);
+        PyObject *value = Py_BuildValue("(KK)", (unsigned long long)s->proto_packets[p], (unsigned long long)s->proto_bytes[p]);
+        if(key == NULL || value == NULL || PyDict_SetItem(d, key, value) != 0){
+            Py_XDECREF(key);
+            Py_XDECREF(value);
+            Py_DECREF(d);
+            return NULL;
+        }
+        Py_DECREF(key);
+        Py_DECREF(value);
+    }
+    return d;
+}
+
+static PyObject *
+TrafficStats_talkers(const struct stats *s)
+{
+    struct stats_talker *top = malloc((s->k ? s->k : 1) * sizeof(*top));
+    if(top == NULL)
+        return PyErr_NoMemory();
+    uint32_t n = stats_top(s, top);
+
+    PyObject *list = PyList_New(n);
+    for(uint32_t i = 0; list != NULL && i < n; i++){
+        struct pkt_meta meta = {.addr_len = top[i].key.addr_len};
+        char host[64];
+        PyObject *item = NULL;
+        if(dissect_addr_string(&meta, top[i].key.addr, host, sizeof(host)) == 0)
+            item = Py_BuildValue("(sK)", host, (unsigned long long)top[i].bytes);
+        else
+            PyErr_SetString(PyExc_SystemError, "Could not format talker address");
+        if(item == NULL){
+            Py_CLEAR(list);
+            break;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    free(top);
+    return list;
+}
+
+/*
+Everything counted so far as a dict
+
+Bucket columns (timestamps in ns of each bucket's start, packets, bytes) are
+typed memoryviews, oldest first; top is [(address, bytes)] with the largest
+first, bytes being a Count-Min Sketch estimate that can only overcount.
+*/
+static PyObject *
+TrafficStats_snapshot(TrafficStats *self, PyObject *Py_UNUSED(ignored))
+{
+    if(TrafficStats_ready(self) != 0)
+        return NULL;
+    const struct stats *s = &self->_stats;
+
+    PyObject *edges = PyTuple_New(STATS_SIZE_BINS);
+    for(int i = 0; edges != NULL && i < STATS_SIZE_BINS; i++){
+        PyObject *e = PyLong_FromUnsignedLong(stats_size_edges[i]);
+        if(e == NULL)
+            Py_CLEAR(edges);
+        else
+            PyTuple_SET_ITEM(edges, i, e);
+    }
+
+    return Py_BuildValue(
+        "{s:O, s:N, s:K, s:K, s:K, s:N, s:N, s:N, s:(KK), s:N}",
+        "interval", self->interval,
+        "buckets", TrafficStats_buckets_dict(s),
+        "packets", (unsigned long long)s->packets,
+        "bytes", (unsigned long long)s->bytes,
+        "late", (unsigned long long)s->late,
+        "size_edges", edges,
+        "sizes", TrafficStats_array(s->sizes, STATS_SIZE_BINS, "Q", sizeof(uint64_t)),
+        "protocols", TrafficStats_protocols(s),
+        "non_ip", (unsigned long long)s->non_ip_packets, (unsigned long long)s->non_ip_bytes,
+        "top", TrafficStats_talkers(s)
+    );
+}
+
+/* forget everything counted so far */
+static PyObject *
+TrafficStats_reset(TrafficStats *self, PyObject *Py_UNUSED(ignored))
+{
+    if(TrafficStats_ready(self) != 0)
+        return NULL;
+    stats_reset(&self->_stats);
+    return Py_BuildValue("");
+}
+
+/* expose methods */
+static PyMethodDef TrafficStats_methods[] = {
+    {"update", (PyCFunction) TrafficStats_update, METH_O, "Count the packets of a PcapReader, Packet, PacketBatch or iterable of them; Return how many"},
+    {"snapshot", (PyCFunction) TrafficStats_snapshot, METH_NOARGS, "Return bucketed rates, size histogram, protocol mix and top talkers as a dict"},
+    {"reset", (PyCFunction) TrafficStats_reset, METH_NOARGS, "Forget everything counted so far"},
+    {NULL}
+};
+
+/* custom getter/setter methods to control member types */
+static PyObject *
+TrafficStats_get_interval(TrafficStats *self, void *closure)
+{
+    Py_INCREF(self->interval);
+    return self->interval;
+}
+
+static int
+TrafficStats_set_interval(TrafficStats *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "interval attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+TrafficStats_get_buckets(TrafficStats *self, void *closure)
+{
+    Py_INCREF(self->buckets);
+    return self->buckets;
+}
+
+static int
+TrafficStats_set_buckets(TrafficStats *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "buckets attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+TrafficStats_get_top(TrafficStats *self, void *closure)
+{
+    Py_INCREF(self->top);
+    return self->top;
+}
+
+static int
+TrafficStats_set_top(TrafficStats *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "top attribute is read-only");
+    return -1;
+}
+
+static PyGetSetDef TrafficStats_getsetters[] = {
+    {"interval", (getter) TrafficStats_get_interval, (setter) TrafficStats_set_interval, "bucket width in seconds", NULL},
+    {"buckets", (getter) TrafficStats_get_buckets, (setter) TrafficStats_set_buckets, "number of most recent buckets kept", NULL},
+    {"top", (getter) TrafficStats_get_top, (setter) TrafficStats_set_top, "number of top talkers tracked", NULL},
+    {NULL}
+};
+
+/* avoid cyclic references / enable cyclic GC */
+static int
+TrafficStats_traverse(TrafficStats *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->interval);
+    Py_VISIT(self->buckets);
+    Py_VISIT(self->top);
+    return 0;
+}
+
+static int
+TrafficStats_clear(TrafficStats *self)
+{
+    Py_CLEAR(self->interval);
+    Py_CLEAR(self->buckets);
+    Py_CLEAR(self->top);
+    return 0;
+}
+
+/* deallocation method */
+static void
+TrafficStats_dealloc(TrafficStats *self)
+{
+    /* close all C objects */
+    stats_free(&self->_stats);
+
+    /* dealloc with cyclic GC check */
+    PyObject_GC_UnTrack(self);
+    TrafficStats_clear(self);
+
+    /* deallocate the object itself */
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/*
+TrafficStats Type construction
+
+.tp_flags:
+    Py_TPFLAGS_DEFAULT = always use
+    Py_TPFLAGS_BASETYPE = allows to be subclassed. do this only if methods don't care about type of object created/used
+    Py_TPFLAGS_HAVE_GC = cyclic GC causes segfault if this isn't set
+*/
+static PyTypeObject TrafficStatsType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pypcap.TrafficStats",
+    .tp_doc = "Time-bucketed packet and byte counts, size histogram, protocol mix and top talkers with bounded memory",
+    .tp_basicsize = sizeof(TrafficStats),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_new = TrafficStats_new,
+    .tp_dealloc = (destructor) TrafficStats_dealloc,
+    .tp_init = (initproc) TrafficStats_init,
+    .tp_methods = TrafficStats_methods, // expose custom methods
+    .tp_traverse = (traverseproc) TrafficStats_traverse, // cyclic GC enable
+    .tp_clear = (inquiry) TrafficStats_clear,
+    .tp_getset = TrafficStats_getsetters, // custom getter/setter methods
+};
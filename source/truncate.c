@@ -0,0 +1,189 @@
+#include "truncate.h" // first, so Python.h sets _GNU_SOURCE before libc headers
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PYPCAP_DISSECT
+#include "dissect.h"
+#endif
+
+/* the transports dissect_packet finds the payload of; others only ever match "other" */
+static const struct{
+    const char *name;
+    int proto;
+    int ports;
+} proto_names[] = {
+    {"icmp", 1, 0},
+    {"tcp", 6, 1},
+    {"udp", 17, 1},
+    {"icmpv6", 58, 0},
+    {"sctp", 132, 1},
+};
+
+#define NPROTOS (sizeof(proto_names) / sizeof(proto_names[0]))
+
+/* index in proto_names of a protocol name or number, -1 if neither or not a transport rules can apply to */
+static int parse_proto(const char *s, size_t len){
+    for(size_t i = 0; i < NPROTOS; i++)
+        if(strlen(proto_names[i].name) == len && strncmp(proto_names[i].name, s, len) == 0)
+            return (int)i;
+
+    char buf[8];
+    if(len == 0 || len >= sizeof(buf))
+        return -1;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    char *end;
+    long v = strtol(buf, &end, 10);
+    if(*end != '\0')
+        return -1;
+    for(size_t i = 0; i < NPROTOS; i++)
+        if(proto_names[i].proto == v)
+            return (int)i;
+    return -1;
+}
+
+/* payload byte count of a rule value: None for everything, or an int >= 0 */
+static int parse_payload(PyObject *value, const char *key, int32_t *payload){
+    if(value == Py_None){
+        *payload = TRUNCATE_ALL;
+        return 0;
+    }
+    long v = PyLong_AsLong(value);
+    if(v == -1 && PyErr_Occurred()){
+        PyErr_Format(PyExc_TypeError, "truncate['%s'] must be None or an int", key);
+        return -1;
+    }
+    if(v < 0 || v > 65535){
+        PyErr_Format(PyExc_ValueError, "truncate['%s'] must be between 0 and 65535", key);
+        return -1;
+    }
+    *payload = (int32_t)v;
+    return 0;
+}
+
+/*
+Fill t from a python truncation dict, see truncate.h; None disables truncation
+
+Return 0 on success, -1 with a python exception set
+*/
+int truncator_parse(PyObject *spec, struct truncator *t){
+    memset(t, 0, sizeof(*t));
+    for(int i = 0; i < 256; i++)
+        t->proto_payload[i] = TRUNCATE_UNSET;
+    t->default_payload = TRUNCATE_ALL;
+    t->other_payload = TRUNCATE_ALL;
+
+    if(spec == NULL || spec == Py_None)
+        return 0;
+    if(!PyDict_Check(spec)){
+        PyErr_SetString(PyExc_TypeError, "truncate must be None or a dict of protocol rules");
+        return -1;
+    }
+
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    while(PyDict_Next(spec, &pos, &key, &value)){
+        if(!PyUnicode_Check(key)){
+            PyErr_SetString(PyExc_TypeError, "truncate keys must be strings");
+            return -1;
+        }
+        const char *k = PyUnicode_AsUTF8(key);
+        if(k == NULL)
+            return -1;
+
+        int32_t payload;
+        if(parse_payload(value, k, &payload) != 0)
+            return -1;
+
+        if(strcmp(k, "default") == 0){
+            t->default_payload = payload;
+            continue;
+        }
+        if(strcmp(k, "other") == 0){
+            t->other_payload = payload;
+            continue;
+        }
+
+        const char *slash = strchr(k, '/');
+        int i = parse_proto(k, slash ? (size_t)(slash - k) : strlen(k));
+        if(i < 0){
+            PyErr_Format(PyExc_ValueError, "truncate key '%s' is not tcp, udp, sctp, icmp, icmpv6, one of them with a port, 'default' or 'other'", k);
+            return -1;
+        }
+        int proto = proto_names[i].proto;
+        if(slash == NULL){
+            t->proto_payload[proto] = payload;
+            continue;
+        }
+        if(!proto_names[i].ports){
+            PyErr_Format(PyExc_ValueError, "truncate key '%s' has a port, but %s has none", k, proto_names[i].name);
+            return -1;
+        }
+
+        char *end;
+        long port = strtol(slash + 1, &end, 10);
+        if(slash[1] == '\0' || *end != '\0' || port < 0 || port > 65535){
+            PyErr_Format(PyExc_ValueError, "truncate key '%s' has an invalid port", k);
+            return -1;
+        }
+        if(t->nrules >= TRUNCATE_MAX_RULES){
+            PyErr_Format(PyExc_ValueError, "truncate supports at most %d protocol/port rules", TRUNCATE_MAX_RULES);
+            return -1;
+        }
+        t->rules[t->nrules].proto = (uint8_t)proto;
+        t->rules[t->nrules].port = (uint16_t)port;
+        t->rules[t->nrules].payload = payload;
+        t->nrules++;
+    }
+
+    t->enabled = 1;
+    return 0;
+}
+
+/* number of bytes of a caplen byte packet that t keeps */
+uint32_t truncator_caplen(const struct truncator *t, const u_char *data, uint32_t caplen){
+    struct pkt_meta meta;
+    int32_t payload = TRUNCATE_UNSET;
+
+    dissect_packet(t->linktype, data, caplen, &meta);
+    if(meta.payload_offset < 0){
+        payload = t->other_payload;
+        if(payload == TRUNCATE_ALL || (uint32_t)payload >= caplen)
+            return caplen;
+        return (uint32_t)payload;
+    }
+
+    // port rules only apply to transports that have ports
+    if(meta.sport != 0 || meta.dport != 0){
+        for(int i = 0; i < t->nrules; i++){
+            const struct truncate_rule *r = &t->rules[i];
+            if(r->proto == meta.ip_proto && (r->port == meta.sport || r->port == meta.dport)){
+                payload = r->payload;
+                break;
+            }
+        }
+    }
+    if(payload == TRUNCATE_UNSET)
+        payload = t->proto_payload[meta.ip_proto];
+    if(payload == TRUNCATE_UNSET)
+        payload = t->default_payload;
+
+    if(payload == TRUNCATE_ALL)
+        return caplen;
+    uint32_t keep = (uint32_t)meta.payload_offset + (uint32_t)payload;
+    return keep < caplen ? keep : caplen;
+}
+
+/* packets and bytes before and after truncation */
+PyObject *truncator_stats(const struct truncator *t){
+    return Py_BuildValue(
+        "{s:O, s:K, s:K, s:K, s:K, s:d}",
+        "enabled", t->enabled ? Py_True : Py_False,
+        "packets", (unsigned long long)t->packets,
+        "packets_truncated", (unsigned long long)t->packets_truncated,
+        "bytes_in", (unsigned long long)t->bytes_in,
+        "bytes_out", (unsigned long long)t->bytes_out,
+        "ratio", t->bytes_out > 0 ? (double)t->bytes_in / (double)t->bytes_out : 1.0
+    );
+}
@@ -0,0 +1,66 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdint.h>
+#include <pcap.h>
+
+#define PYPCAP_TRUNCATE // header guard
+#define TRUNCATE_MAX_RULES 64 // protocol/port rules per truncator
+#define TRUNCATE_ALL -1 // keep the whole packet
+#define TRUNCATE_UNSET -2
+
+/*
+Per-protocol truncation of packets before they are written
+
+Packets keep their full L2-L4 headers plus a number of payload bytes chosen by
+the most specific matching key of a dict such as
+
+    {"udp/53": None, "tcp/443": 64, "tcp": 128, "default": 0, "other": None}
+
+    "<proto>/<port>"   tcp, udp or sctp and either source or destination port
+    "<proto>"          transport protocol: tcp, udp, sctp, icmp or icmpv6, by
+                       name or number
+    "default"          any other packet whose headers were parsed
+    "other"            packets whose headers could not be parsed: non-IP,
+                       non-first fragments, unknown transports; here the
+                       count is of bytes from the start of the frame
+
+None keeps the whole packet and is what unmatched packets get. The original
+length stays in the record's wirelen, so sizes and byte counts remain exact.
+*/
+struct truncate_rule{
+    uint8_t proto;
+    uint16_t port;
+    int32_t payload;
+};
+
+struct truncator{
+    int enabled;
+    int linktype;
+    int nrules;
+    struct truncate_rule rules[TRUNCATE_MAX_RULES];
+    int32_t proto_payload[256];
+    int32_t default_payload;
+    int32_t other_payload;
+    uint64_t packets;
+    uint64_t packets_truncated;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+};
+
+int truncator_parse(PyObject *spec, struct truncator *t);
+uint32_t truncator_caplen(const struct truncator *t, const u_char *data, uint32_t caplen);
+PyObject *truncator_stats(const struct truncator *t);
+
+/* shorten hdr->caplen to what t keeps of data; wirelen is left alone */
+static inline void
+truncator_apply(struct truncator *t, struct pcap_pkthdr *hdr, const u_char *data)
+{
+    if(!t->enabled)
+        return;
+    uint32_t caplen = truncator_caplen(t, data, hdr->caplen);
+    t->packets++;
+    t->packets_truncated += caplen < hdr->caplen;
+    t->bytes_in += hdr->caplen;
+    t->bytes_out += caplen;
+    hdr->caplen = caplen;
+}
@@ -8,6 +8,10 @@
 #include "util.h"
 #endif
 
+#ifndef PYPCAP_METRICS
+#include "metrics.h"
+#endif
+
 char *af_to_string(int domain){
     if(domain == AF_INET){
         return "IPV4";
@@ -106,6 +110,18 @@ PyUnicode_ToString(PyObject *obj){
 
 /* dumps pcaps to file as they are received by pcap_loop or pcap_dispatch */
 void pcap_dump_handler(u_char *args, const struct pcap_pkthdr *hdr, const u_char *packet){
-    // pcap_dumper_t *args
-    pcap_dump(args, hdr, packet);
+    struct dump_target *target = (struct dump_target *)args;
+    METRICS_BEGIN(t0);
+    target->packets++;
+    if(sampler_keep(target->sampler, hdr, packet)){
+        if(target->shm != NULL)
+            shm_ring_publish(target->shm, hdr, packet);
+        struct pcap_pkthdr h = *hdr;
+        truncator_apply(target->truncator, &h, packet);
+        pcap_dump((u_char *)target->dumper, &h, packet);
+        if(target->bloom != NULL)
+            bloom_add_packet(target->bloom, packet, h.caplen);
+        METRICS_END(METRICS_DUMP, t0);
+    }
+    METRICS_END(METRICS_CAPTURE_CALLBACK, t0);
 }
@@ -3,6 +3,22 @@
 #include <sys/socket.h>
 #include <pcap.h>
 
+#ifndef PYPCAP_SAMPLING
+#include "sampling.h"
+#endif
+
+#ifndef PYPCAP_TRUNCATE
+#include "truncate.h"
+#endif
+
+#ifndef PYPCAP_BLOOM
+#include "bloom.h"
+#endif
+
+#ifndef PYPCAP_SHMRING
+#include "shmring.h"
+#endif
+
 #define PYPCAP_UTIL // header guard
 #define PCAP_FLAG_MAX 4 // no type safety with this macro
 
@@ -14,6 +30,16 @@ struct pflags{
 char *af_to_string(int domain);
 int sockaddr_addr(struct sockaddr *sockaddr, char *host);
 struct pflags pcap_flags(bpf_u_int32 flags);
+/* what pcap_dump_handler writes to, passed as its u_char *args */
+struct dump_target{
+    pcap_dumper_t *dumper;
+    struct sampler *sampler;
+    struct truncator *truncator;
+    struct bloom *bloom; // NULL unless indexing
+    struct shm_ring *shm; // NULL unless publishing to a shared ring
+    long packets; // handled so far, kept by sampling or not
+};
+
 void pcap_dump_handler(u_char *args, const struct pcap_pkthdr *hdr, const u_char *packet);
 // IP address and nmask return 0, which cannot be correct
 // should use system libs like in https://stackoverflow.com/questions/2283494/get-ip-address-of-an-interface-on-linux
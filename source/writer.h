@@ -10,6 +10,18 @@
 #include "util.h"
 #endif
 
+#ifndef PYPCAP_DEDUPLICATOR
+#include "deduplicator.h"
+#endif
+
+#ifndef PYPCAP_EXTRACT
+#include "extract.h"
+#endif
+
+#ifndef PYPCAP_BLOOM
+#include "bloom.h"
+#endif
+
 #define PYPCAP_WRITER
 #define LINKTYPE_ETHERNET 1
 
@@ -24,6 +36,12 @@ typedef struct{
     PyObject *stream;
     pcap_t *_pcap;
     pcap_dumper_t *_pcap_dumper;
+    struct truncator _truncator;
+    struct bloom _bloom; // bits is NULL unless indexing
+    int _linktype; // -1 until given or taken from the first reader copied
+    uint32_t _snaplen; // 0 until given or taken from the first reader copied
+    int _usec_ns; // nanoseconds per timestamp unit of the file
+    unsigned long long _unconverted; // packets left out for lack of a conversion to _linktype
 } PcapWriter;
 
 /* creation method */
@@ -35,17 +53,84 @@ PcapWriter_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     return (PyObject *) self;
 }
 
+/*
+write the file header, unless it is written already; linktype and snaplen
+apply where the writer wasn't given its own
+
+Return 0, or -1 with a python exception set
+*/
+static int
+PcapWriter_start(PcapWriter *self, int linktype, uint32_t snaplen)
+{
+    if(self->_pcap_dumper != NULL)
+        return 0;
+    if(self->_linktype < 0)
+        self->_linktype = linktype;
+    if(self->_snaplen == 0)
+        self->_snaplen = snaplen ? snaplen : MAX_PACKET_SIZE;
+
+    // create pcap writer
+    pcap_t *pcap = pcap_open_dead_with_tstamp_precision(
+        self->_linktype,
+        (int)(self->_snaplen > INT_MAX ? INT_MAX : self->_snaplen),
+        self->_usec_ns == 1 ? PCAP_TSTAMP_PRECISION_NANO : PCAP_TSTAMP_PRECISION_MICRO
+    );
+    if(pcap == NULL){
+        PyErr_SetString(PyExc_SystemError, "Could not open pcap object for writing");
+        return -1;
+    }
+    self->_pcap = pcap;
+
+    // create pcap dumper, which writes the file header
+    pcap_dumper_t *pcap_dumper = pcap_dump_fopen(pcap, self->fp);
+    if(pcap_dumper == NULL){
+        PyErr_SetString(PyExc_SystemError, "Could not create pcap file writer");
+        return -1;
+    }
+    self->_pcap_dumper = pcap_dumper;
+    return 0;
+}
+
 /* initialization method */
 static int
 PcapWriter_init(PcapWriter *self, PyObject *args, PyObject *kwds)
 {
-    static char *kwlist[] = {"stream", NULL};
-    PyObject *stream=NULL, *tmp;
+    static char *kwlist[] = {"stream", "truncate", "index", "linktype", "snaplen", "precision", NULL};
+    PyObject *stream=NULL, *truncate=NULL, *index=NULL, *linktype=Py_None, *tmp;
+    Py_ssize_t snaplen = 0;
+    const char *precision = "nano";
 
-    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &stream)){
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|OOOns", kwlist, &stream, &truncate, &index, &linktype, &snaplen, &precision)){
         return -1;
     }
 
+    // without a link type the file header waits for the first reader copied, whose link type and snaplen it takes
+    self->_linktype = -1;
+    if(linktype != Py_None && encap_parse_linktype(linktype, &self->_linktype) != 0)
+        return -1;
+    if(snaplen < 0 || snaplen > UINT32_MAX){
+        PyErr_SetString(PyExc_ValueError, "snaplen must be between 0 (unset) and 2**32-1");
+        return -1;
+    }
+    self->_snaplen = (uint32_t)snaplen;
+    if(strcmp(precision, "nano") == 0)
+        self->_usec_ns = 1;
+    else if(strcmp(precision, "micro") == 0)
+        self->_usec_ns = 1000;
+    else{
+        PyErr_SetString(PyExc_ValueError, "precision must be 'nano' or 'micro'");
+        return -1;
+    }
+
+    // addresses and ports of the packets copied from readers, written next to the file on close()
+    bloom_free(&self->_bloom);
+    if(bloom_parse(index, &self->_bloom) != 0)
+        return -1;
+
+    // applies to packets copied from a reader; write() takes raw bytes and is left alone
+    if(truncator_parse(truncate, &self->_truncator) != 0)
+        return -1;
+
     // check stream is in wb mode
     PyObject *mode = PyObject_GetAttrString(stream, "mode");
     if(mode == NULL){
@@ -71,25 +156,6 @@ PcapWriter_init(PcapWriter *self, PyObject *args, PyObject *kwds)
     }
     self->fp = fp;
 
-    // create pcap writer
-    pcap_t *pcap;
-    pcap_dumper_t *pcap_dumper;
-    pcap = pcap_open_dead_with_tstamp_precision(LINKTYPE_ETHERNET, MAX_PACKET_SIZE, PCAP_TSTAMP_PRECISION_NANO);
-
-    if(pcap == NULL){
-        PyErr_SetString(PyExc_SystemError, "Could not open pcap object for writing");
-        return -1;
-    }
-    self->_pcap = pcap;
-
-    // create pcap dumper
-    pcap_dumper = pcap_dump_fopen(pcap, self->fp);
-    if(pcap_dumper == NULL){
-        PyErr_SetString(PyExc_SystemError, "Could not create pcap file writer");
-        return -1;
-    }
-    self->_pcap_dumper = pcap_dumper;
-
     // set pyobject attributes
     if(stream){
         tmp = self->stream;
@@ -98,6 +164,20 @@ PcapWriter_init(PcapWriter *self, PyObject *args, PyObject *kwds)
         Py_XDECREF(tmp);
     }
 
+    // the file starts over, so an index left next to it by an earlier writer no longer describes it
+    PyObject *name = PyObject_GetAttrString(stream, "name");
+    if(name == NULL)
+        PyErr_Clear();
+    else if(PyUnicode_Check(name) && bloom_remove(PyUnicode_AsUTF8(name)) != 0){
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, name);
+        Py_DECREF(name);
+        return -1;
+    }
+    Py_XDECREF(name);
+
+    if(self->_linktype >= 0 && PcapWriter_start(self, self->_linktype, MAX_PACKET_SIZE) != 0)
+        return -1;
+
     return 0;
 }
 
@@ -118,6 +198,10 @@ PcapWriter_write(PcapWriter *self, PyObject *args)
         PyErr_SetString(PyExc_AttributeError, "write method requires a Bytes-like argument");
         return NULL;
     }
+    if(PcapWriter_start(self, LINKTYPE_ETHERNET, MAX_PACKET_SIZE) != 0)
+        return NULL;
+    // an index missing these packets would rule the file out for their hosts, so there is none
+    bloom_free(&self->_bloom);
 
     // get size of buffer
     Py_ssize_t size = PyBytes_Size(py_bytes);
@@ -131,18 +215,48 @@ PcapWriter_write(PcapWriter *self, PyObject *args)
 
 /* write from PcapReader */
 static PyObject *
-PcapWriter_write_from_pcap_reader(PcapWriter *self, PyObject *args){
+PcapWriter_write_from_pcap_reader(PcapWriter *self, PyObject *args, PyObject *kwds){
     if(self->fp == NULL)
         return PyErr_Format(PyExc_SystemError, "Cannot perform write operation on closed file");
 
     // obtain PcapReader argument
+    static char *kwlist[] = {"pcap_reader", "dedup", "start", "end", "first", "count", "filter", "snaplen", NULL};
     PcapReader *pcap_reader;
-    if(!PyArg_ParseTuple(args, "O", &pcap_reader)){
+    PyObject *dedup_obj = Py_None, *start = NULL, *end = NULL;
+    Py_ssize_t first = 0, count = -1, snaplen = 0;
+    const char *filter = NULL;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|OOOnnzn", kwlist, &pcap_reader, &dedup_obj, &start, &end, &first, &count, &filter, &snaplen)){
         PyErr_SetString(PyExc_ValueError, "write_from_pcap_reader method requires a PcapReader argument");
         return NULL;
     }
-    // TODO: check that pcap_reader is a PcapReader object
-    Py_INCREF(pcap_reader);
+    if(first < 0 || snaplen < 0 || snaplen > UINT32_MAX){
+        PyErr_SetString(PyExc_ValueError, "first must not be negative and snaplen must be between 0 and 2**32-1");
+        return NULL;
+    }
+
+    struct extract x = {0};
+    x.first = (uint64_t)first;
+    x.last = count < 0 ? UINT64_MAX : x.first + (uint64_t)count;
+    x.snaplen = (uint32_t)snaplen;
+    x.truncator = &self->_truncator;
+    if(extract_parse_time(start, INT64_MIN, &x.start_ns) != 0 || extract_parse_time(end, INT64_MAX, &x.end_ns) != 0)
+        return NULL;
+    if(dedup_obj != Py_None){
+        if(!PyObject_TypeCheck(dedup_obj, &PcapDeduplicatorType)){
+            PyErr_SetString(PyExc_TypeError, "dedup must be a PcapDeduplicator");
+            return NULL;
+        }
+        x.dedup = &((PcapDeduplicator *)dedup_obj)->_dedup;
+        if(x.dedup->table == NULL){
+            PyErr_SetString(PyExc_SystemError, "PcapDeduplicator is not initialized");
+            return NULL;
+        }
+    }
+    // the bulk path reads the reader's file directly, so it has to be one
+    if(!PyObject_TypeCheck((PyObject *)pcap_reader, &PcapReaderType)){
+        PyErr_SetString(PyExc_TypeError, "write_from_pcap_reader method requires a PcapReader argument");
+        return NULL;
+    }
 
     // copy reader to writer
     pcap_t *pcap = pcap_reader->_pcap;
@@ -151,15 +265,79 @@ PcapWriter_write_from_pcap_reader(PcapWriter *self, PyObject *args){
         return NULL;
     }
 
-    struct pcap_pkthdr pkt_header;
-    const uint8_t *packetData;
-    long pkt_count = 0;
+    // an unset link type or snaplen is the reader's; packets of another link type are converted as they are copied
+    if(PcapWriter_start(self, pcap_reader->_linktype, (uint32_t)pcap_snapshot(pcap)) != 0)
+        return NULL;
+    if(!encap_supported(pcap_reader->_linktype, self->_linktype)){
+        PyErr_Format(PyExc_ValueError, "Cannot convert packets of link type %d to %d", pcap_reader->_linktype, self->_linktype);
+        return NULL;
+    }
+    x.out_linktype = self->_linktype;
+    x.out_usec_ns = self->_usec_ns;
+    if(x.snaplen == 0 || x.snaplen > self->_snaplen)
+        x.snaplen = self->_snaplen;
+
+    if(filter != NULL){
+        if(pcap_compile(pcap, &x.filter, filter, 1, PCAP_NETMASK_UNKNOWN) != 0){
+            PyErr_Format(PyExc_ValueError, "Could not compile filter: %s", pcap_geterr(pcap));
+            return NULL;
+        }
+        x.has_filter = 1;
+    }
+    x.linktype = pcap_reader->_linktype;
+    self->_truncator.linktype = pcap_reader->_linktype;
 
-    while((packetData = pcap_next(pcap, &pkt_header))){
-        pcap_dump((uint8_t *)self->_pcap_dumper, &pkt_header, packetData);
-        pkt_count++;
+    if(self->_bloom.bits != NULL){
+        self->_bloom.linktype = pcap_reader->_linktype;
+        x.bloom = &self->_bloom;
     }
 
+    // plain pcap files are copied record by record without libpcap; sampling and recovery need the reader's own path
+    long pkt_count = -2;
+    if(pcap_reader->_sampler.mode == SAMPLING_NONE && pcap_reader->_recover.buf == NULL && pcap_reader->_held == NULL)
+        pkt_count = extract_bulk(&x, pcap_reader->fp, self->fp);
+
+    if(pkt_count == -2){
+        struct pcap_pkthdr pkt_header;
+        const uint8_t *packetData;
+        pkt_count = 0;
+        // reader timestamps are nanosecond precision, as extract_packet expects
+        while((packetData = PcapReader_next(pcap_reader, &pkt_header))){
+            enum extract_verdict v = extract_packet(&x, &pkt_header, packetData);
+            if(v == EXTRACT_STOP){
+                // not consumed, as in extract_bulk: the reader returns it next
+                PcapReader_unread(pcap_reader, &pkt_header, packetData);
+                break;
+            }
+            if(v == EXTRACT_SKIP)
+                continue;
+            METRICS_BEGIN(t0);
+            int w = extract_write(&x, self->fp, &pkt_header, packetData);
+            METRICS_END(METRICS_DUMP, t0);
+            if(w < 0){
+                pkt_count = -1;
+                break;
+            }
+            pkt_count += w;
+        }
+    }
+
+    if(x.has_filter)
+        pcap_freecode(&x.filter);
+    self->_unconverted += x.unconverted;
+    if(pkt_count < 0)
+        return PyErr_SetFromErrno(PyExc_OSError);
+
+    // a sampled reader produces a sampled file; record that next to it when the stream has a path
+    PyObject *name = PyObject_GetAttrString(self->stream, "name");
+    if(name == NULL)
+        PyErr_Clear();
+    else if(PyUnicode_Check(name) && sampler_write_meta(&pcap_reader->_sampler, PyUnicode_AsUTF8(name)) != 0){
+        Py_DECREF(name);
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    Py_XDECREF(name);
+
     return PyLong_FromLong(pkt_count);
 }
 
@@ -180,17 +358,43 @@ PcapWriter_fileno(PcapWriter *self, PyObject *Py_UNUSED(ignored))
 static PyObject *
 PcapWriter_close(PcapWriter *self, PyObject *Py_UNUSED(ignored))
 {
-    if(self->_pcap_dumper == NULL)
+    if(self->fp == NULL)
         return Py_BuildValue("");
+    // a file nothing was written to still gets a header
+    if(PcapWriter_start(self, LINKTYPE_ETHERNET, MAX_PACKET_SIZE) != 0)
+        return NULL;
 
+    METRICS_BEGIN(t0);
     pcap_dump_close(self->_pcap_dumper);
+    METRICS_END(METRICS_FLUSH, t0);
+    pcap_close(self->_pcap);
     self->_pcap_dumper = NULL;
     self->_pcap = NULL;
     self->fp = NULL;
 
+    // the index describes the finished file, so it is written once the file is
+    if(self->_bloom.bits != NULL){
+        PyObject *name = PyObject_GetAttrString(self->stream, "name");
+        if(name == NULL)
+            PyErr_Clear();
+        else if(PyUnicode_Check(name) && bloom_write(&self->_bloom, PyUnicode_AsUTF8(name)) != 0){
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, name);
+            Py_DECREF(name);
+            return NULL;
+        }
+        Py_XDECREF(name);
+    }
+
     return Py_BuildValue(""); // return None
 }
 
+/* packets and bytes copied from readers before and after truncation */
+static PyObject *
+PcapWriter_truncation_stats(PcapWriter *self, PyObject *Py_UNUSED(ignored))
+{
+    return truncator_stats(&self->_truncator);
+}
+
 /* expose attributes as custom members */
 static PyMemberDef PcapWriter_members[] = {
     {NULL}
@@ -200,8 +404,9 @@ static PyMemberDef PcapWriter_members[] = {
 static PyMethodDef PcapWriter_methods[] = {
     {"close", (PyCFunction) PcapWriter_close, METH_NOARGS, "Close the object's file pointer"},
     {"write", (PyCFunction) PcapWriter_write, METH_VARARGS, "Write PyBytes object to file"},
-    {"write_from_pcap_reader", (PyCFunction) PcapWriter_write_from_pcap_reader, METH_VARARGS, "Write a PcapReader object to file"},
+    {"write_from_pcap_reader", (PyCFunction) PcapWriter_write_from_pcap_reader, METH_VARARGS | METH_KEYWORDS, "Write a PcapReader object to file, optionally only packets first..first+count, with timestamps in [start, end), matching a BPF filter, cut to snaplen and without duplicates found by a PcapDeduplicator dedup; packets are converted to the writer's link type"},
     {"fileno", (PyCFunction) PcapWriter_fileno, METH_VARARGS, "Get file descriptor attached to open file"},
+    {"truncation_stats", (PyCFunction) PcapWriter_truncation_stats, METH_NOARGS, "Return packets and bytes copied before and after truncation"},
     {NULL}
 };
 
@@ -232,9 +437,61 @@ PcapWriter_set_stream(PcapWriter *self, PyObject *value, void *closure){
     return -1;
 }
 
+static PyObject *
+PcapWriter_get_linktype(PcapWriter *self, void *closure){
+    if(self->_linktype < 0)
+        return Py_BuildValue(""); // not known until a reader is copied
+    return PyLong_FromLong(self->_linktype);
+}
+
+static int
+PcapWriter_set_linktype(PcapWriter *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "linktype attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapWriter_get_snaplen(PcapWriter *self, void *closure){
+    if(self->_snaplen == 0)
+        return Py_BuildValue("");
+    return PyLong_FromUnsignedLong(self->_snaplen);
+}
+
+static int
+PcapWriter_set_snaplen(PcapWriter *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "snaplen attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapWriter_get_precision(PcapWriter *self, void *closure){
+    return PyUnicode_FromString(self->_usec_ns == 1 ? "nano" : "micro");
+}
+
+static int
+PcapWriter_set_precision(PcapWriter *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "precision attribute is read-only");
+    return -1;
+}
+
+static PyObject *
+PcapWriter_get_unconverted(PcapWriter *self, void *closure){
+    return PyLong_FromUnsignedLongLong(self->_unconverted);
+}
+
+static int
+PcapWriter_set_unconverted(PcapWriter *self, PyObject *value, void *closure){
+    PyErr_SetString(PyExc_AttributeError, "unconverted attribute is read-only");
+    return -1;
+}
+
 static PyGetSetDef PcapWriter_getsetters[] = {
     {"stream", (getter) PcapWriter_get_stream, (setter) PcapWriter_set_stream, "stream", NULL},
     {"closed", (getter) PcapWriter_get_closed, (setter) PcapWriter_set_closed, "closed", NULL},
+    {"linktype", (getter) PcapWriter_get_linktype, (setter) PcapWriter_set_linktype, "link type of the file, None until known", NULL},
+    {"snaplen", (getter) PcapWriter_get_snaplen, (setter) PcapWriter_set_snaplen, "snapshot length of the file, None until known", NULL},
+    {"precision", (getter) PcapWriter_get_precision, (setter) PcapWriter_set_precision, "timestamp precision of the file, 'nano' or 'micro'", NULL},
+    {"unconverted", (getter) PcapWriter_get_unconverted, (setter) PcapWriter_set_unconverted, "packets left out because they could not be converted to the file's link type", NULL},
     {NULL}
 };
 
@@ -260,6 +517,7 @@ PcapWriter_dealloc(PcapWriter *self)
     /* close the file pointer */
     if(self->fp != NULL)
         fclose(self->fp);
+    bloom_free(&self->_bloom);
 
     /* dealloc with cyclic GC check */
     PyObject_GC_UnTrack(self);
@@ -0,0 +1,15 @@
+""" packet and capture file builders shared by the tests """
+import struct
+
+def write_pcap(path, records):
+    """ write (timestamp_ns, bytes) records to a nanosecond ethernet pcap """
+    with open(path, 'wb') as f:
+        f.write(struct.pack('<IHHiIII', 0xa1b23c4d, 2, 4, 0, 0, 65535, 1))
+        for ts, data in records:
+            f.write(struct.pack('<IIII', ts // 10**9, ts % 10**9, len(data), len(data)))
+            f.write(data)
+
+def udp(src, sport=1000, dport=53, size=60):
+    """ ethernet/IPv4/UDP packet from the 32 bit address src to 10.0.0.1:dport, size bytes long """
+    ip = struct.pack('!BBHHHBBH4s4s', 0x45, 0, size - 14, 0, 0, 64, 17, 0, struct.pack('!I', src), bytes([10, 0, 0, 1]))
+    return b'\x00' * 12 + b'\x08\x00' + ip + struct.pack('!HHHH', sport, dport, size - 34, 0) + b'x' * (size - 42)
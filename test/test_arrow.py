@@ -0,0 +1,91 @@
+import pypcap
+import unittest
+import os
+import struct
+import tempfile
+
+try:
+    import pyarrow
+    import pyarrow.ipc
+except ImportError:
+    pyarrow = None
+
+FILENAME = 'pcap_test.pcap'
+PACKET_COUNT = 764 # so happens that packet count was 764
+COLUMNS = ['timestamp', 'caplen', 'wirelen', 'ip_version', 'protocol', 'src', 'dst', 'sport', 'dport', 'vlan']
+
+class TestArrow(unittest.TestCase):
+    def setUp(self):
+        self.f = os.path.join(os.path.dirname(__file__), FILENAME)
+
+    def packets(self):
+        return list(pypcap.PcapReader(open(self.f, 'rb')))
+
+    def write_ipc(self, **kwargs):
+        out = tempfile.TemporaryFile()
+        n = pypcap.PcapReader(open(self.f, 'rb')).write_arrow(out, **kwargs)
+        out.seek(0)
+        return n, out
+
+    def test_ipc_framing(self):
+        n, out = self.write_ipc(batch_size=100)
+        assert(n == PACKET_COUNT)
+        data = out.read()
+        # schema message first, end-of-stream marker last
+        cont, length = struct.unpack('<Ii', data[:8])
+        assert(cont == 0xFFFFFFFF and length > 0 and length % 8 == 0)
+        assert(data[-8:] == b'\xff\xff\xff\xff\x00\x00\x00\x00')
+        assert(len(data) % 8 == 0)
+
+        # the reader was used up; a second call writes just a schema and the end marker
+        r = pypcap.PcapReader(open(self.f, 'rb'))
+        r.read()
+        empty = tempfile.TemporaryFile()
+        assert(r.write_arrow(empty) == 0)
+        empty.seek(0)
+        assert(empty.read() == data[:8 + length] + data[-8:])
+
+    def test_arrow_args(self):
+        r = pypcap.PcapReader(open(self.f, 'rb'))
+        self.assertRaises(ValueError, r.arrow_stream, batch_size=0)
+        self.assertRaises(ValueError, r.write_arrow, tempfile.TemporaryFile(), payload=-1)
+        s = r.arrow_stream()
+        assert(hasattr(s, '__arrow_c_stream__') and hasattr(s, '__arrow_c_schema__'))
+        r.close()
+        self.assertRaises(SystemError, s.__arrow_c_stream__)
+
+    @unittest.skipUnless(pyarrow, 'pyarrow is not installed')
+    def test_ipc_pyarrow(self):
+        n, out = self.write_ipc(batch_size=100, payload=8)
+        table = pyarrow.ipc.open_stream(out).read_all()
+        assert(table.num_rows == n == PACKET_COUNT)
+        assert(table.column_names == COLUMNS + ['payload'])
+        self.check_table(table, payload=8)
+
+    @unittest.skipUnless(pyarrow, 'pyarrow is not installed')
+    def test_c_stream_pyarrow(self):
+        r = pypcap.PcapReader(open(self.f, 'rb'))
+        reader = pyarrow.RecordBatchReader.from_stream(r.arrow_stream(batch_size=500))
+        batches = list(reader)
+        assert([b.num_rows for b in batches] == [500, PACKET_COUNT - 500])
+        table = pyarrow.Table.from_batches(batches)
+        assert(table.column_names == COLUMNS)
+        assert(pyarrow.schema(r.arrow_stream()) == table.schema)
+        self.check_table(table)
+
+    def check_table(self, table, payload=0):
+        rows = table.to_pylist()
+        ts = table.column('timestamp').cast(pyarrow.int64()).to_pylist()
+        for pkt, row, ns in zip(self.packets(), rows, ts):
+            assert(ns / 1e9 == pkt.timestamp)
+            assert(row['caplen'] == pkt.caplen and row['wirelen'] == pkt.wirelen)
+            assert(row['protocol'] == pkt.protocol)
+            assert(row['src'] == pkt.src and row['dst'] == pkt.dst)
+            assert(row['sport'] == pkt.sport and row['dport'] == pkt.dport)
+            if payload:
+                exp = bytes(pkt.payload[:payload]) if pkt.payload is not None else None
+                assert(row['payload'] == exp)
+        assert(table.column('protocol').to_pylist().count(17) == 517)
+
+if __name__ == '__main__':
+    unittest.main()
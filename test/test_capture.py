@@ -1,7 +1,17 @@
 import pypcap
+import asyncio
 import unittest
 import os
+import signal
 import subprocess
+import tempfile
+import threading
+import time
+
+FILENAME = os.path.join(os.path.dirname(__file__), 'pcap_test.pcap')
+
+def packets(path):
+    return [(p.timestamp_ns, bytes(p.data)) for p in pypcap.PcapReader(open(path, 'rb'))]
 
 class TestCapture(unittest.TestCase):
     def test_create(self):
@@ -18,3 +28,252 @@ class TestCapture(unittest.TestCase):
         assert(c.timeout_ms == 1000)
         assert(c.packet_length == 65535)
 
+    def test_placement_defaults(self):
+        c = pypcap.PcapCapture("lo", "foo.pcap", 10)
+        assert(c.cpu_affinity is None)
+        assert(c.numa_node == -1)
+
+        stats = c.stats()
+        assert(stats["packets_received"] == 0)
+        assert(stats["cpu_affinity"] is None)
+        assert(stats["cpu"] is None)
+        assert(stats["packets_captured"] == 0)
+        assert(stats["cpu_ns_per_packet"] == 0)
+
+    def test_cpu_affinity(self):
+        c = pypcap.PcapCapture("lo", "foo.pcap", 10, cpu_affinity=0)
+        assert(c.cpu_affinity == (0,))
+
+        c = pypcap.PcapCapture("lo", "foo.pcap", 10, cpu_affinity=[0])
+        assert(c.stats()["cpu_affinity"] == (0,))
+
+    def test_bad_placement(self):
+        def bad_cpu():
+            pypcap.PcapCapture("lo", "foo.pcap", 10, cpu_affinity=[-1])
+        def bad_node():
+            pypcap.PcapCapture("lo", "foo.pcap", 10, numa_node=4096)
+        self.assertRaises(ValueError, bad_cpu)
+        self.assertRaises(ValueError, bad_node)
+
+    def test_sampling(self):
+        c = pypcap.PcapCapture("lo", "foo.pcap", 10, sampling=("flow", 0.25))
+        stats = c.sampling_stats()
+        assert(stats['mode'] == 'flow')
+        assert(stats['rate'] == 0.25)
+        assert(stats['packets_seen'] == 0)
+        self.assertRaises(ValueError, pypcap.PcapCapture, "lo", "foo.pcap", 10, sampling=("count", -1))
+
+    def test_timestamps(self):
+        c = pypcap.PcapCapture("lo", "foo.pcap", 10)
+        assert(c.precision == 'nano')
+        assert(c.tstamp_type is None)
+
+        c = pypcap.PcapCapture("lo", "foo.pcap", 10, precision='micro', tstamp_type='adapter')
+        assert(c.precision == 'micro')
+        assert(c.tstamp_type == 'adapter')
+        self.assertRaises(ValueError, pypcap.PcapCapture, "lo", "foo.pcap", 10, precision='pico')
+        self.assertRaises(ValueError, pypcap.PcapCapture, "lo", "foo.pcap", 10, tstamp_type='sundial')
+
+    def test_record_args(self):
+        c = pypcap.PcapCapture("lo", None, 10)
+        self.assertRaises(ValueError, c.record)
+        c = pypcap.PcapCapture("lo", "foo.pcap", 10)
+        self.assertRaises(ValueError, c.record, ring_bytes=1024)
+        self.assertRaises(ValueError, c.record, ring_seconds=-1)
+        self.assertRaises(ValueError, c.record, trigger_signal=-1)
+        # triggers may arrive before or after record() runs
+        assert(c.trigger() is None)
+        assert(c.stop() is None)
+
+    def recorder(self, tmp):
+        """ a capture replaying the test file as a live interface, or skip if live capture is unavailable """
+        c = pypcap.PcapCapture('fake:' + FILENAME, os.path.join(tmp, 'ring.pcap'), 10)
+        try:
+            c.fileno()
+        except SystemError:
+            self.skipTest('live capture is unavailable')
+        c.close()
+        return c
+
+    def test_record_trigger(self):
+        orig = packets(FILENAME)
+        with tempfile.TemporaryDirectory() as tmp:
+            # a trigger made before record() runs is not lost
+            c = self.recorder(tmp)
+            c.trigger()
+            res = c.record(max_dumps=1)
+            assert(len(res['dumps']) == 1)
+            dump = res['dumps'][0]
+            assert(dump['reason'] == 'call')
+            assert(dump['path'] == os.path.join(tmp, 'ring-0001.pcap'))
+            got = packets(dump['path'])
+            assert(len(got) == dump['packets'])
+            assert(0 < len(got) <= 10)
+            assert(got == orig[:len(got)])
+
+            # post_trigger_seconds of traffic follow the trigger, at 1000 packets a second
+            c = self.recorder(tmp)
+            c.trigger()
+            dump = c.record(max_dumps=1, post_trigger_seconds=0.3)['dumps'][0]
+            got = packets(dump['path'])
+            assert(150 <= len(got) < len(orig))
+            assert(got == orig[:len(got)])
+
+            # neither carries over to the next record()
+            c = self.recorder(tmp)
+            assert(c.record(duration=0.05)['dumps'] == [])
+
+    def test_record_signal(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            # one signal reaches every recorder waiting for it, and none that isn't
+            self.recorder(tmp)
+            results = {}
+            def record(name, **kwargs):
+                os.mkdir(os.path.join(tmp, name))
+                results[name] = self.recorder(os.path.join(tmp, name)).record(duration=2, **kwargs)
+            threads = [
+                threading.Thread(target=record, args=('a',), kwargs=dict(trigger_signal=signal.SIGUSR1, max_dumps=1)),
+                threading.Thread(target=record, args=('b',), kwargs=dict(trigger_signal=signal.SIGUSR1, max_dumps=1)),
+                threading.Thread(target=record, args=('c',)),
+            ]
+            for t in threads:
+                t.start()
+            time.sleep(0.3)
+            os.kill(os.getpid(), signal.SIGUSR1)
+            for t in threads:
+                t.join()
+            for name in ('a', 'b'):
+                assert([d['reason'] for d in results[name]['dumps']] == ['signal'])
+            assert(results['c']['dumps'] == [])
+
+    def test_record_filter(self):
+        orig = packets(FILENAME)
+        first_tcp = [p.protocol for p in pypcap.PcapReader(open(FILENAME, 'rb'))].index(6)
+        with tempfile.TemporaryDirectory() as tmp:
+            c = self.recorder(tmp)
+            res = c.record(trigger_filter='tcp', max_dumps=1)
+            dump = res['dumps'][0]
+            assert(dump['reason'] == 'filter')
+            got = packets(dump['path'])
+            # the dump ends with the burst holding the packet that matched
+            assert(first_tcp < len(got) <= first_tcp + 5)
+            assert(got == orig[:len(got)])
+            assert(res['packets_seen'] == len(got))
+
+    def test_record_stop(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            c = self.recorder(tmp)
+            c.stop()
+            start = time.time()
+            assert(c.record()['dumps'] == [])
+            assert(time.time() - start < 1)
+
+            # and from another thread while it runs
+            threading.Timer(0.1, c.stop).start()
+            start = time.time()
+            res = c.record()
+            assert(time.time() - start < 2)
+            assert(res['packets_seen'] > 0)
+
+    def live(self, output_filename=None, max_packets=764):
+        """ a capture replaying the test file as a live interface, or skip if live capture is unavailable """
+        c = pypcap.PcapCapture('fake:' + FILENAME, output_filename, max_packets)
+        try:
+            c.fileno()
+        except SystemError:
+            self.skipTest('live capture is unavailable')
+        return c
+
+    def test_tstamp_fallback(self):
+        # refused when set, on activation with a warning, or on activation with an error
+        for asked in ('host_hiprec', 'adapter', 'adapter_unsynced'):
+            c = pypcap.PcapCapture('fake:' + FILENAME, None, 10, tstamp_type=asked)
+            try:
+                c.fileno()
+            except SystemError:
+                self.skipTest('live capture is unavailable')
+            assert(c.tstamp_type == 'host')
+            c.close()
+            # a reopen asks for the same source again
+            c.fileno()
+            assert(c.tstamp_type == 'host')
+            c.close()
+
+    def test_start_dump(self):
+        orig = packets(FILENAME)
+        with tempfile.TemporaryDirectory() as tmp:
+            out = os.path.join(tmp, 'out.pcap')
+            c = self.live(out, max_packets=100)
+            c.start()
+            c.close()
+            assert(packets(out) == orig[:100])
+            assert(c.stats()['packets_captured'] == 100)
+
+            # a capture that ends before max_packets counts what it got
+            c = self.live(out, max_packets=10000)
+            c.start()
+            c.close()
+            assert(packets(out) == orig)
+            assert(c.stats()['packets_captured'] == len(orig))
+
+    def test_start_callback(self):
+        orig = packets(FILENAME)
+        with tempfile.TemporaryDirectory() as tmp:
+            out = os.path.join(tmp, 'out.pcap')
+            c = self.live(out)
+            got, sizes = [], []
+            def callback(batch):
+                sizes.append(len(batch))
+                assert(len(batch.timestamps) == len(batch))
+                got.extend((p.timestamp_ns, bytes(p.data)) for p in batch)
+            c.start(callback, batch_size=50)
+            c.close()
+            assert(got == orig)
+            assert(max(sizes) == 50)
+            # the output file is written too
+            assert(packets(out) == orig)
+
+            # batches also go out every batch_timeout_ms, at 1000 packets a second here
+            c = self.live(max_packets=200)
+            sizes = []
+            c.start(lambda batch: sizes.append(len(batch)), batch_size=1000, batch_timeout_ms=20)
+            assert(sum(sizes) == 200)
+            assert(len(sizes) > 2)
+
+    def test_start_callback_raises(self):
+        c = self.live()
+        def callback(batch):
+            raise KeyError('stop')
+        self.assertRaises(KeyError, c.start, callback, batch_size=10)
+        assert(c.stats()['packets_captured'] == 10)
+
+    def test_async_delivery(self):
+        orig = packets(FILENAME)
+        async def collect(source):
+            return [(p.timestamp_ns, bytes(p.data)) async for p in source]
+        assert(asyncio.run(collect(self.live())) == orig)
+        assert(asyncio.run(collect(self.live(max_packets=100).packets(batch_size=16))) == orig[:100])
+
+    def test_async_iterator(self):
+        c = pypcap.PcapCapture("lo", None, 10)
+        assert(c.output_filename is None)
+        it = c.__aiter__()
+        assert(type(it).__name__ == "CaptureIterator")
+        assert(it.__aiter__() is it)
+        self.assertRaises(ValueError, c.packets, batch_size=0)
+
+    def test_start_needs_output(self):
+        c = pypcap.PcapCapture("lo", None, 10)
+        self.assertRaises(ValueError, c.start)
+
+    def test_start_callback_args(self):
+        c = pypcap.PcapCapture("lo", None, 10)
+        self.assertRaises(TypeError, c.start, 5)
+        self.assertRaises(ValueError, c.start, print, batch_size=0)
+        self.assertRaises(ValueError, c.start, print, batch_timeout_ms=0)
+
+    def test_packet_batch_type(self):
+        assert(pypcap.PacketBatch.__name__ == "PacketBatch")
+        def create():
+            pypcap.PacketBatch()
+        self.assertRaises(TypeError, create)
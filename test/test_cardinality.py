@@ -0,0 +1,98 @@
+import pypcap
+import unittest
+import os
+import socket
+import struct
+import tempfile
+
+from helpers import udp, write_pcap
+
+PCAP_FILE = 'pcap_test.pcap'
+PACKET_COUNT = 764
+
+class TestHyperLogLog(unittest.TestCase):
+    def test_estimate(self):
+        h = pypcap.HyperLogLog()
+        assert(h.precision == 14 and len(h) == 0)
+        for i in range(100000):
+            h.add(struct.pack('!I', i))
+        h.add(struct.pack('!I', 5)) # repeats don't count
+        assert(abs(h.estimate() - 100000) < 100000 * 0.03)
+        # small counts are close to exact
+        s = pypcap.HyperLogLog()
+        for i in range(100):
+            s.add('host-%d' % i)
+        assert(abs(len(s) - 100) <= 2)
+        s.reset()
+        assert(len(s) == 0)
+
+    def test_merge_and_serialize(self):
+        a, b = pypcap.HyperLogLog(precision=12), pypcap.HyperLogLog(precision=12)
+        for i in range(30000):
+            a.add(struct.pack('!I', i))
+        for i in range(20000, 50000):
+            b.add(struct.pack('!I', i))
+        wire = b.to_bytes()
+        assert(len(wire) == 8 + 4096)
+        c = pypcap.HyperLogLog.from_bytes(wire)
+        assert(c.precision == 12 and c.to_bytes() == wire)
+        a.merge(c)
+        assert(abs(a.estimate() - 50000) < 50000 * 0.06)
+        self.assertRaises(ValueError, a.merge, pypcap.HyperLogLog(precision=10))
+        self.assertRaises(ValueError, pypcap.HyperLogLog.from_bytes, wire[:-1])
+        self.assertRaises(ValueError, pypcap.HyperLogLog.from_bytes, b'x' * len(wire))
+        self.assertRaises(ValueError, pypcap.HyperLogLog, precision=3)
+        self.assertRaises(TypeError, a.add, 1)
+
+class TestCardinalityTracker(unittest.TestCase):
+    def setUp(self):
+        self.p = os.path.join(os.path.dirname(__file__), PCAP_FILE)
+
+    def test_reader(self):
+        pkts = list(pypcap.PcapReader(open(self.p, 'rb')))
+        srcs = set(p.src for p in pkts if p.src is not None)
+        flows = set((p.src, p.dst, p.protocol, p.sport, p.dport) for p in pkts if p.src is not None)
+
+        t = pypcap.CardinalityTracker()
+        assert(t.update(pypcap.PcapReader(open(self.p, 'rb'))) == PACKET_COUNT)
+        est = t.estimate()
+        assert(est['packets'] == PACKET_COUNT)
+        assert(abs(est['sources'] - len(srcs)) <= 1)
+        assert(abs(est['flows'] - len(flows)) <= max(2, len(flows) * 0.02))
+
+        # the tracker hashes packed addresses, as HyperLogLog.add does
+        h = pypcap.HyperLogLog()
+        for s in srcs:
+            h.add(socket.inet_pton(socket.AF_INET6 if ':' in s else socket.AF_INET, s))
+        assert(t.sketches()['sources'].to_bytes() == h.to_bytes())
+
+        # Packets and PacketBatches count the same as the reader
+        u = pypcap.CardinalityTracker()
+        r = pypcap.PcapReader(open(self.p, 'rb'))
+        u.update(r.read_batch(10))
+        u.update(r)
+        for k in ['sources', 'ports', 'flows']:
+            assert(u.sketches()[k].to_bytes() == t.sketches()[k].to_bytes())
+
+    def test_windows(self):
+        s = 10**9
+        records = [(100 * s + i, udp(0x0a000000 + i, dport=80)) for i in range(50)] # 50 hosts to one port
+        records += [(101 * s + i, udp(0x0b000001, dport=1 + i)) for i in range(1000)] # a port scan
+        records += [(103 * s, udp(0x0b000001, dport=80))]
+        with tempfile.TemporaryDirectory() as d:
+            path = os.path.join(d, 'scan.pcap')
+            write_pcap(path, records)
+            t = pypcap.CardinalityTracker(interval=1.0)
+            t.update(pypcap.PcapReader(open(path, 'rb')))
+        w = t.windows()
+        assert([x['start'] for x in w] == [100.0, 101.0])
+        assert(abs(w[0]['sources'].estimate() - 50) <= 1 and abs(w[0]['ports'].estimate() - 1) < 0.5)
+        assert(abs(w[1]['sources'].estimate() - 1) < 0.5 and abs(w[1]['ports'].estimate() - 1000) < 30)
+        assert(w[1]['packets'] == 1000)
+        assert(t.windows() == [])
+        last = t.windows(flush=True)
+        assert(len(last) == 1 and last[0]['start'] == 103.0 and last[0]['packets'] == 1)
+        assert(t.estimate()['packets'] == 0)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,99 @@
+import pypcap
+import unittest
+import os
+import tempfile
+
+from helpers import write_pcap
+
+PCAP_FILE = 'pcap_test.pcap'
+PACKET_COUNT = 764
+
+def retapped(data):
+    """ the same packet as another tap would see it: one hop further, with a different checksum """
+    data = bytearray(data)
+    if data[12:14] == b'\x08\x00':
+        data[22] -= 1
+        data[24] ^= 0xff
+    elif data[12:14] == b'\x86\xdd':
+        data[21] -= 1
+    return bytes(data)
+
+class TestDedup(unittest.TestCase):
+    def setUp(self):
+        self.p = os.path.join(os.path.dirname(__file__), PCAP_FILE)
+        self.dir = tempfile.TemporaryDirectory()
+        self.merged = os.path.join(self.dir.name, 'merged.pcap')
+        self.packets = list(pypcap.PcapReader(open(self.p, 'rb')))
+        # distinct packets in the original file, which may legitimately repeat itself
+        self.unique = len(pypcap.PcapDeduplicator().filter(self.packets))
+
+    def tearDown(self):
+        self.dir.cleanup()
+
+    def merge(self, delay_ns):
+        records = []
+        for pkt in self.packets:
+            records.append((pkt.timestamp_ns, bytes(pkt.data)))
+            records.append((pkt.timestamp_ns + delay_ns, retapped(pkt.data)))
+        write_pcap(self.merged, records)
+        return list(pypcap.PcapReader(open(self.merged, 'rb')))
+
+    def test_filter(self):
+        merged = self.merge(100)
+        d = pypcap.PcapDeduplicator(window=0.001)
+        kept = d.filter(merged)
+        assert(len(kept) == self.unique)
+        stats = d.stats()
+        assert(stats['packets'] == 2 * PACKET_COUNT)
+        assert(stats['unique'] == self.unique)
+        assert(stats['duplicates'] == 2 * PACKET_COUNT - self.unique)
+
+    def test_is_duplicate(self):
+        d = pypcap.PcapDeduplicator(window=0.001)
+        first, second = self.merge(500000)[:2]
+        assert(not d.is_duplicate(first))
+        assert(d.is_duplicate(second))
+        d.reset()
+        assert(d.stats()['packets'] == 0)
+        assert(not d.is_duplicate(second))
+
+    def test_outside_window(self):
+        merged = self.merge(2000000)
+        d = pypcap.PcapDeduplicator(window=0.001)
+        first, second = merged[:2]
+        assert(not d.is_duplicate(first))
+        assert(not d.is_duplicate(second))
+
+    def test_different_payload(self):
+        first = self.packets[0]
+        data = bytearray(first.data)
+        data[-1] ^= 0xff
+        write_pcap(self.merged, [(first.timestamp_ns, bytes(first.data)), (first.timestamp_ns, bytes(data))])
+        d = pypcap.PcapDeduplicator()
+        assert(len(d.filter(pypcap.PcapReader(open(self.merged, 'rb')))) == 2)
+
+    def test_writer(self):
+        self.merge(100)
+        out = os.path.join(self.dir.name, 'dedup.pcap')
+        d = pypcap.PcapDeduplicator(window=0.001, capacity=4096)
+        w = pypcap.PcapWriter(open(out, 'wb'))
+        assert(w.write_from_pcap_reader(pypcap.PcapReader(open(self.merged, 'rb')), dedup=d) == self.unique)
+        w.close()
+        assert(len(list(pypcap.PcapReader(open(out, 'rb')))) == self.unique)
+        assert(d.capacity == 4096)
+
+    def test_args(self):
+        d = pypcap.PcapDeduplicator(capacity=1000)
+        assert(d.capacity == 1024)
+        assert(d.window == 0.001)
+        self.assertRaises(ValueError, pypcap.PcapDeduplicator, window=-1)
+        self.assertRaises(ValueError, pypcap.PcapDeduplicator, capacity=0)
+        self.assertRaises(TypeError, d.is_duplicate, b'not a packet')
+        self.assertRaises(TypeError, d.filter, [self.packets[0], 1])
+        self.assertRaises(AttributeError, setattr, d, 'window', 1.0)
+        w = pypcap.PcapWriter(open(os.path.join(self.dir.name, 'x.pcap'), 'wb'))
+        self.assertRaises(TypeError, w.write_from_pcap_reader, pypcap.PcapReader(open(self.p, 'rb')), dedup=1)
+        w.close()
+
+if __name__ == '__main__':
+    unittest.main()
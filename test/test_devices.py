@@ -1,6 +1,8 @@
 import pypcap
 import unittest
+import operator
 import os
+import socket
 import subprocess
 
 DEFAULT_MODE = 'rb'
@@ -14,3 +16,102 @@ class TestDevices(unittest.TestCase):
         for dev_name, dev_details in devices.items():
             for e in exp_keys:
                 assert(e in dev_details)
+
+    def test_monitor_devices(self):
+        m = pypcap.DeviceMonitor()
+        devices = m.devices()
+        assert('lo' in devices)
+        lo = devices['lo']
+        assert(lo['name'] == 'lo' and lo['index'] > 0)
+        assert('LOOPBACK' in lo['flags'])
+        for exp in ['name', 'description', 'flags', 'flags_int', 'addresses']:
+            assert(exp in lo)
+        for addr in lo['addresses']:
+            assert(addr['af'] in ('IPV4', 'IPV6'))
+        if any(a['af'] == 'IPV4' for a in lo['addresses']):
+            assert('127.0.0.1' in [a['addr'] for a in lo['addresses']])
+
+        # unchanged interfaces give back the same read-only snapshot
+        assert(m.devices() is devices)
+        self.assertRaises(TypeError, operator.setitem, devices, 'x', 1)
+        self.assertRaises(TypeError, operator.setitem, lo, 'name', 'x')
+        assert(m.stats()['devices'] == len(devices))
+        m.close()
+        assert(m.closed)
+        self.assertRaises(SystemError, m.devices)
+
+    def test_interface_counters(self):
+        fields = ['rx_packets', 'tx_packets', 'rx_bytes', 'tx_bytes', 'rx_dropped', 'tx_dropped']
+        old = pypcap.InterfaceCounters()
+        assert('lo' in old.counters())
+        for f in fields:
+            assert(f in old['lo'])
+        assert(len(old) == len(old.counters()))
+        self.assertRaises(KeyError, old.__getitem__, 'no-such-interface')
+
+        # traffic on lo shows up in the next snapshot's counters and rates
+        s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        for _ in range(10):
+            s.sendto(b'x' * 100, ('127.0.0.1', 9))
+        s.close()
+        new = pypcap.InterfaceCounters()
+        assert(new.timestamp > old.timestamp)
+        assert(new['lo']['tx_packets'] >= old['lo']['tx_packets'] + 10)
+        rates = new.rates(old)
+        assert(rates['lo']['tx_packets'] > 0)
+        assert(set(rates['lo']) == set(new['lo']))
+        self.assertRaises(ValueError, old.rates, new)
+        self.assertRaises(TypeError, new.rates, {})
+
+    def test_find_all_devs_counters(self):
+        devices = pypcap.find_all_devs(counters=True)
+        for name, dev in devices.items():
+            if name == 'lo':
+                assert(dev['counters']['rx_packets'] >= 0)
+        assert('counters' not in pypcap.find_all_devs().get('lo', {}))
+
+    def test_monitor_subscriber_raises(self):
+        m = pypcap.DeviceMonitor()
+        m.poll(0)
+        add = subprocess.run(['ip', 'addr', 'add', '127.0.0.77/8', 'dev', 'lo'], capture_output=True)
+        if add.returncode != 0:
+            m.close()
+            self.skipTest('cannot add an address to lo')
+        try:
+            seen, raised = [], []
+            def flaky(event):
+                if not raised:
+                    raised.append(event)
+                    raise KeyError('flaky')
+            m.subscribe(flaky)
+            m.subscribe(seen.append)
+            self.assertRaises(KeyError, m.poll, 1)
+            # the event is still pending, for every subscriber
+            events = m.poll(0)
+            assert([e['event'] for e in events] == ['address_added'])
+            assert(events[0]['address']['addr'] == '127.0.0.77')
+            assert(seen == events)
+            assert(m.poll(0) == [])
+
+            # a subscriber can't poll the monitor that is calling it
+            m.unsubscribe(flaky)
+            m.subscribe(lambda event: m.poll(0))
+            subprocess.run(['ip', 'addr', 'del', '127.0.0.77/8', 'dev', 'lo'], capture_output=True)
+            self.assertRaises(RuntimeError, m.poll, 1)
+        finally:
+            subprocess.run(['ip', 'addr', 'del', '127.0.0.77/8', 'dev', 'lo'], capture_output=True)
+            m.close()
+
+    def test_monitor_poll(self):
+        m = pypcap.DeviceMonitor()
+        assert(isinstance(m.fileno(), int))
+        seen = []
+        m.subscribe(seen.append)
+        events = m.poll(0.01)
+        assert(isinstance(events, list))
+        assert(seen == events)
+        m.unsubscribe(seen.append)
+        self.assertRaises(ValueError, m.unsubscribe, seen.append)
+        self.assertRaises(TypeError, m.subscribe, 1)
+        self.assertRaises(ValueError, m.poll, -1)
+        m.close()
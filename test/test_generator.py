@@ -0,0 +1,39 @@
+import pypcap
+import unittest
+
+class TestGenerator(unittest.TestCase):
+    def test_create(self):
+        g = pypcap.PcapGenerator("lo")
+        assert(g.interface_name == "lo")
+        assert(g.sizes == (64,))
+        assert(g.rate_pps == 0)
+        assert(g.flows == 1)
+        assert(g.batch_size == 64)
+
+        g = pypcap.PcapGenerator("lo", sizes=[64, 594, 1518], rate_pps=1000, flows=16, batch_size=32)
+        assert(g.sizes == (64, 594, 1518))
+        assert(g.rate_pps == 1000)
+        assert(g.flows == 16)
+        assert(g.batch_size == 32)
+
+    def test_read_only(self):
+        g = pypcap.PcapGenerator("lo")
+        def set_rate():
+            g.rate_pps = 5
+        self.assertRaises(AttributeError, set_rate)
+
+    def test_bad_args(self):
+        self.assertRaises(ValueError, pypcap.PcapGenerator, "lo", sizes=[10])
+        self.assertRaises(ValueError, pypcap.PcapGenerator, "lo", sizes=[])
+        self.assertRaises(ValueError, pypcap.PcapGenerator, "lo", rate_pps=-1)
+        self.assertRaises(ValueError, pypcap.PcapGenerator, "lo", flows=0)
+        self.assertRaises(ValueError, pypcap.PcapGenerator, "lo", batch_size=0)
+
+    def test_run_needs_limit(self):
+        g = pypcap.PcapGenerator("lo")
+        self.assertRaises(ValueError, g.run)
+        self.assertRaises(ValueError, g.run, count=-1)
+
+    def test_bad_interface(self):
+        g = pypcap.PcapGenerator("no-such-interface0")
+        self.assertRaises(OSError, g.run, count=1)
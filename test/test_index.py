@@ -0,0 +1,121 @@
+import pypcap
+import unittest
+import os
+import socket
+import struct
+import tempfile
+
+from helpers import udp, write_pcap
+
+FILENAME = os.path.join(os.path.dirname(__file__), 'pcap_test.pcap')
+
+def addr(src):
+    return socket.inet_ntoa(struct.pack('!I', src))
+
+class TestIndex(unittest.TestCase):
+    def setUp(self):
+        self.tmp = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        self.tmp.cleanup()
+
+    def copy(self, name, records, index=True):
+        """ write records to a pcap and copy it through an indexing PcapWriter, returning the copy's path """
+        src = os.path.join(self.tmp.name, name + '.src')
+        dst = os.path.join(self.tmp.name, name)
+        write_pcap(src, records)
+        writer = pypcap.PcapWriter(open(dst, 'wb'), index=index)
+        writer.write_from_pcap_reader(pypcap.PcapReader(open(src, 'rb')))
+        writer.close()
+        return dst
+
+    def test_query(self):
+        base = 0x0a010000
+        a = self.copy('a.pcap', [(i, udp(base + i, 5000 + i, 53)) for i in range(100)])
+        b = self.copy('b.pcap', [(i, udp(base + 1000 + i, 6000 + i, 443)) for i in range(100)])
+        assert(os.path.exists(a + '.bloom') and os.path.exists(b + '.bloom'))
+        paths = [a, b]
+
+        # no false negatives
+        for i in range(100):
+            assert(a in pypcap.index_query(paths, host=addr(base + i)))
+            assert(b in pypcap.index_query(paths, host=addr(base + 1000 + i)))
+        assert(pypcap.index_query(paths, host='10.0.0.1') == paths)
+        assert(pypcap.index_query(paths, port=53) == [a])
+        assert(pypcap.index_query(paths, port=6042) == [b])
+        assert(pypcap.index_query(paths, host=addr(base + 7), port=443) == [])
+        assert(pypcap.index_query(paths, host=addr(base + 7), port=5007) == [a])
+
+        # hosts in neither file rarely match
+        false = sum(len(pypcap.index_query(paths, host=addr(0xc0a80000 + i))) for i in range(1000))
+        assert(false < 40)
+        assert(pypcap.index_query(paths, host='::1') == [])
+
+    def test_unindexed(self):
+        a = self.copy('a.pcap', [(0, udp(0x0a000002, 1, 2))])
+        plain = self.copy('plain.pcap', [(0, udp(0x0a000002, 1, 2))], index=False)
+        assert(not os.path.exists(plain + '.bloom'))
+        # a file without an index can't be ruled out
+        assert(pypcap.index_query([a, plain], host='192.0.2.1') == [plain])
+
+        with open(a + '.bloom', 'wb') as f:
+            f.write(b'not an index')
+        self.assertRaises(OSError, pypcap.index_query, [a], port=1)
+
+    def test_raw_write(self):
+        # write() takes raw records the index can't see, so the file goes unindexed
+        a = self.copy('a.pcap', [(0, udp(0x0a000002, 1, 2))])
+        assert(os.path.exists(a + '.bloom'))
+        data = udp(0x0a090909, 7, 8)
+        writer = pypcap.PcapWriter(open(a, 'wb'), index=True)
+        writer.write(struct.pack('<IIII', 0, 0, len(data), len(data)) + data)
+        writer.close()
+        assert(not os.path.exists(a + '.bloom'))
+        assert(pypcap.index_query([a], host='10.9.9.9') == [a])
+
+    def test_stale(self):
+        a = self.copy('a.pcap', [(0, udp(0x0a000002, 1, 2))])
+        assert(pypcap.index_query([a], host='10.9.9.9') == [])
+        # a file that changed since it was indexed may hold anything
+        with open(a, 'ab') as f:
+            f.write(b'\0' * 16)
+        assert(pypcap.index_query([a], host='10.9.9.9') == [a])
+
+        # a writer without an index drops the one left by an earlier writer
+        a = self.copy('a.pcap', [(0, udp(0x0a000002, 1, 2))])
+        plain = self.copy('a.pcap', [(0, udp(0x0a090909, 1, 2))], index=False)
+        assert(not os.path.exists(plain + '.bloom'))
+        assert(pypcap.index_query([plain], host='10.9.9.9') == [plain])
+
+    def test_capture(self):
+        out = os.path.join(self.tmp.name, 'out.pcap')
+        c = pypcap.PcapCapture('fake:' + FILENAME, out, 100, index=True)
+        try:
+            c.fileno()
+        except SystemError:
+            self.skipTest('live capture is unavailable')
+        c.start()
+        # a capture collected without close() still leaves its index
+        del c
+        assert(os.path.exists(out + '.bloom'))
+        assert(pypcap.index_query([out], host='192.0.2.1') == [])
+
+        c = pypcap.PcapCapture('fake:' + FILENAME, out, 10)
+        c.fileno()
+        assert(not os.path.exists(out + '.bloom'))
+        c.start()
+        c.close()
+        assert(pypcap.index_query([out], host='192.0.2.1') == [out])
+
+    def test_args(self):
+        path = os.path.join(self.tmp.name, 'x.pcap')
+        self.assertRaises(ValueError, pypcap.index_query, [path])
+        self.assertRaises(ValueError, pypcap.index_query, [path], host='not an address')
+        self.assertRaises(ValueError, pypcap.index_query, [path], port=70000)
+        self.assertRaises(ValueError, pypcap.PcapWriter, open(path, 'wb'), index=0)
+        self.assertRaises(TypeError, pypcap.PcapWriter, open(path, 'wb'), index='yes')
+        self.assertRaises(ValueError, pypcap.PcapCapture, "lo", "foo.pcap", 10, index=-1)
+        pypcap.PcapCapture("lo", "foo.pcap", 10, index=1000)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,75 @@
+import pypcap
+import unittest
+import os
+import threading
+
+FILENAME = 'pcap_test.pcap'
+PACKET_COUNT = 764
+STAGES = ('capture_callback', 'dump', 'reader_next', 'flush')
+
+class TestMetrics(unittest.TestCase):
+    def setUp(self):
+        self.f = os.path.join(
+            os.path.dirname(__file__),
+            FILENAME,
+        )
+
+    def read_all(self):
+        r = pypcap.PcapReader(open(self.f, 'rb'))
+        r.read()
+        r.close()
+
+    def test_stages(self):
+        m = pypcap.metrics()
+        assert(m['clock'] in ('tsc', 'monotonic'))
+        assert(m['ticks_per_ns'] > 0)
+        for stage in STAGES:
+            assert(stage in m['stages'])
+
+    def test_reader_next(self):
+        if not pypcap.metrics()['enabled']:
+            self.skipTest('built with PYPCAP_NO_METRICS')
+        pypcap.metrics_reset()
+        self.read_all()
+        s = pypcap.metrics()['stages']['reader_next']
+        assert(s['count'] >= PACKET_COUNT)
+        assert(0 < s['min_ns'] <= s['p50_ns'] <= s['p99_ns'] <= s['max_ns'])
+
+    def test_reset(self):
+        self.read_all()
+        pypcap.metrics_reset()
+        for stage in pypcap.metrics()['stages'].values():
+            assert(stage['count'] == 0)
+
+    def test_reset_other_thread(self):
+        if not pypcap.metrics()['enabled']:
+            self.skipTest('built with PYPCAP_NO_METRICS')
+        # a live thread's samples from before the reset are gone once it records again
+        read, reset, again = threading.Event(), threading.Event(), threading.Event()
+        def reader():
+            self.read_all()
+            read.set()
+            reset.wait()
+            self.read_all()
+            again.set()
+        t = threading.Thread(target=reader)
+        pypcap.metrics_reset()
+        t.start()
+        read.wait()
+        assert(pypcap.metrics()['stages']['reader_next']['count'] >= PACKET_COUNT)
+        pypcap.metrics_reset()
+        assert(pypcap.metrics()['stages']['reader_next']['count'] == 0)
+        reset.set()
+        again.wait()
+        t.join()
+        assert(PACKET_COUNT <= pypcap.metrics()['stages']['reader_next']['count'] < 2 * PACKET_COUNT)
+
+    def test_prometheus(self):
+        self.read_all()
+        text = pypcap.metrics_prometheus()
+        assert('# TYPE pypcap_stage_duration_seconds histogram' in text)
+        assert('pypcap_stage_duration_seconds_bucket{stage="reader_next",le="+Inf"}' in text)
+        assert('pypcap_stage_duration_seconds_count{stage="flush"}' in text)
+
+if __name__ == '__main__':
+    unittest.main()
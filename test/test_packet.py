@@ -0,0 +1,63 @@
+import pypcap
+import unittest
+import os
+
+PCAP_FILE = 'pcap_test.pcap'
+PACKET_COUNT = 764
+
+class TestPacket(unittest.TestCase):
+    def setUp(self):
+        self.p = os.path.join(os.path.dirname(__file__), PCAP_FILE)
+
+    def create_reader(self):
+        return pypcap.PcapReader(open(self.p, 'rb'))
+
+    def test_iterate(self):
+        reader = self.create_reader()
+        count = 0
+        for pkt in reader:
+            assert(isinstance(pkt, pypcap.Packet))
+            count += 1
+        assert(count == PACKET_COUNT)
+
+    def test_fields(self):
+        pkt = next(iter(self.create_reader()))
+        assert(pkt.caplen == 94)
+        assert(pkt.wirelen == 94)
+        assert(pkt.linktype == 1)
+        assert(pkt.interface is None)
+        assert(pkt.timestamp_ns == 1619461818 * 10**9 + 934246 * 1000)
+        assert(abs(pkt.timestamp - 1619461818.934246) < 1e-6)
+        assert(len(pkt.data) == pkt.caplen)
+
+    def test_dissect(self):
+        pkt = next(iter(self.create_reader()))
+        assert(pkt.ethertype == 0x0800)
+        assert(pkt.ip_version == 4)
+        assert(pkt.protocol == 17)
+        assert(pkt.src == '99.77.153.40')
+        assert(pkt.dst == '10.0.0.115')
+        assert(pkt.sport == 22466)
+        assert(pkt.dport == 57841)
+        assert(len(pkt.payload) == pkt.caplen - 14 - 20 - 8)
+
+    def test_protocol_mix(self):
+        protos = {}
+        for pkt in self.create_reader():
+            protos[pkt.protocol] = protos.get(pkt.protocol, 0) + 1
+        assert(protos[17] == 517)
+        assert(protos[6] == 241)
+
+    def test_read_only(self):
+        pkt = next(iter(self.create_reader()))
+        def set_caplen():
+            pkt.caplen = 1
+        self.assertRaises(AttributeError, set_caplen)
+
+    def test_outlives_reader(self):
+        reader = self.create_reader()
+        pkts = reader.read_batch(10)
+        reader.close()
+        del reader
+        assert(len(pkts) == 10)
+        assert(bytes(pkts[9].data[:6]) == bytes(pkts[9].data)[:6])
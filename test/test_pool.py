@@ -0,0 +1,51 @@
+import pypcap
+import unittest
+import os
+
+PCAP_FILE = 'pcap_test.pcap'
+PACKET_COUNT = 764
+
+class TestPool(unittest.TestCase):
+    def setUp(self):
+        self.p = os.path.join(os.path.dirname(__file__), PCAP_FILE)
+
+    def in_use(self):
+        total = 0
+        for pool in pypcap.pool_stats():
+            total += sum(c['in_use'] for c in pool['classes'])
+            total += pool['large_in_use']
+        return total
+
+    def test_read_batch(self):
+        reader = pypcap.PcapReader(open(self.p, 'rb'))
+        count = 0
+        while True:
+            batch = reader.read_batch(100)
+            if not batch:
+                break
+            for pkt in batch:
+                assert(isinstance(pkt.data, memoryview))
+                assert(pkt.data.readonly)
+                assert(0 < len(pkt.data) <= pkt.wirelen)
+            count += len(batch)
+        assert(count == PACKET_COUNT)
+
+    def test_buffers_returned(self):
+        reader = pypcap.PcapReader(open(self.p, 'rb'))
+        before = self.in_use()
+        batch = reader.read_batch(PACKET_COUNT)
+        assert(self.in_use() > before)
+
+        first = bytes(batch[0].data)
+        del batch
+        reader.close() # reader keeps its current chunk until closed
+        assert(self.in_use() == before)
+        assert(len(first) > 0)
+
+    def test_stats_keys(self):
+        reader = pypcap.PcapReader(open(self.p, 'rb'))
+        reader.read_batch(1)
+        pools = pypcap.pool_stats()
+        assert(len(pools) >= 1)
+        for key in ['numa_node', 'allocations', 'frees', 'cache_hits', 'bytes_reserved', 'classes']:
+            assert(key in pools[0])
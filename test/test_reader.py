@@ -1,7 +1,10 @@
 import pypcap
 import unittest
 import os
+import random
+import struct
 import subprocess
+import tempfile
 
 DEFAULT_MODE = 'rb'
 FILENAME = 'pcap_test.pcap'
@@ -63,6 +66,123 @@ class TestWriter(unittest.TestCase):
         assert(fd == p_fd)
         assert(reader.read() == PACKET_COUNT)
 
+    def test_read_headers(self):
+        pkts = list(pypcap.PcapReader(open(self.f, 'rb')))
+        exp = ([p.timestamp for p in pkts], [p.caplen for p in pkts], [p.wirelen for p in pkts])
+
+        ts, caplens, wirelens = pypcap.PcapReader(open(self.f, 'rb')).read_headers()
+        assert((ts.format, caplens.format, wirelens.format) == ('q', 'I', 'I'))
+        assert(len(ts) == len(caplens) == len(wirelens) == PACKET_COUNT)
+        assert(([t / 1e9 for t in ts], caplens.tolist(), wirelens.tolist()) == exp)
+
+        # in chunks, carrying on where the last call stopped, and with Packet reads in between
+        r = pypcap.PcapReader(open(self.f, 'rb'))
+        first = r.read_headers(100)
+        pkt = next(r)
+        rest = r.read_headers(count=-1)
+        assert(len(first[0]) == 100 and len(rest[0]) == PACKET_COUNT - 101)
+        assert(pkt.caplen == exp[1][100])
+        assert(rest[1].tolist() == exp[1][101:])
+        assert(len(r.read_headers()[0]) == 0)
+
+        # sampled readers go through libpcap
+        ts, caplens, _ = pypcap.PcapReader(open(self.f, 'rb'), sampling=('count', 2)).read_headers()
+        assert(caplens.tolist() == exp[1][::2])
+
+    def test_read_headers_swapped(self):
+        # big-endian microsecond file with one packet too large to fit in a read block
+        records = [(5, 10, b'a' * 60), (6, 20, b'b' * 200000), (7, 30, b'c' * 60)]
+        with tempfile.NamedTemporaryFile(suffix='.pcap') as f:
+            f.write(struct.pack('>IHHiIII', 0xa1b2c3d4, 2, 4, 0, 0, 262144, 1))
+            for sec, usec, data in records * 8:
+                f.write(struct.pack('>IIII', sec, usec, len(data), len(data) + 4))
+                f.write(data)
+            f.write(struct.pack('>IIII', 8, 0, 100, 100) + b'x' * 10) # truncated
+            f.flush()
+            ts, caplens, wirelens = pypcap.PcapReader(open(f.name, 'rb')).read_headers()
+        assert(ts.tolist() == [sec * 10**9 + usec * 1000 for sec, usec, _ in records] * 8)
+        assert(caplens.tolist() == [len(d) for _, _, d in records] * 8)
+        assert(wirelens.tolist() == [len(d) + 4 for _, _, d in records] * 8)
+
+    def write_damaged(self, path, order='<', magic=0xa1b23c4d, frac=1000):
+        """ write 200 records with garbage after the 50th, a garbled 100th header and a cut last record; return the expected records and skipped ranges """
+        rng = random.Random(7)
+        records = [(1700000000 + i, i * frac, bytes([i]) * (60 + i % 50)) for i in range(200)]
+        with open(path, 'wb') as f:
+            f.write(struct.pack(order + 'IHHiIII', magic, 2, 4, 0, 0, 65535, 1))
+            skipped = []
+            for i, (sec, sub, data) in enumerate(records):
+                start = f.tell()
+                if i == 100:
+                    f.write(rng.randbytes(16) + data)
+                    skipped.append((start, f.tell()))
+                    continue
+                f.write(struct.pack(order + 'IIII', sec, sub, len(data), len(data)))
+                if i == 199:
+                    f.write(data[:10])
+                    skipped.append((start, f.tell()))
+                    continue
+                f.write(data)
+                if i == 50: # bigger than a read block
+                    f.write(rng.randbytes(1500000))
+                    skipped.append((start + 16 + len(data), f.tell()))
+        return records[:100] + records[101:199], skipped
+
+    def test_recover(self):
+        with tempfile.TemporaryDirectory() as d:
+            path = os.path.join(d, 'damaged.pcap')
+            expected, skipped = self.write_damaged(path)
+
+            r = pypcap.PcapReader(open(path, 'rb'), recover=True)
+            pkts = list(r)
+            assert([(p.caplen, p.wirelen) for p in pkts] == [(len(d), len(d)) for _, _, d in expected])
+            assert(bytes(pkts[150].data) == expected[150][2])
+            stats = r.recovery_stats()
+            assert(stats['recover'] and stats['truncated'])
+            assert(stats['records'] == len(expected))
+            assert(stats['skipped'] == skipped)
+            assert(stats['skipped_bytes'] == sum(end - start for start, end in skipped))
+
+            # every read path goes through the recovering reader
+            ts, caplens, _ = pypcap.PcapReader(open(path, 'rb'), recover=True).read_headers()
+            assert(ts.tolist() == [sec * 10**9 + sub for sec, sub, _ in expected])
+            assert(caplens.tolist() == [len(d) for _, _, d in expected])
+            out = os.path.join(d, 'out.pcap')
+            w = pypcap.PcapWriter(open(out, 'wb'))
+            assert(w.write_from_pcap_reader(pypcap.PcapReader(open(path, 'rb'), recover=True)) == len(expected))
+            w.close()
+            assert(pypcap.PcapReader(open(out, 'rb')).read() == len(expected))
+
+        # an intact file reads the same either way
+        r = pypcap.PcapReader(open(self.f, 'rb'), recover=True)
+        assert(r.read() == PACKET_COUNT)
+        assert(r.recovery_stats()['skipped'] == [])
+        assert(not pypcap.PcapReader(open(self.f, 'rb')).recovery_stats()['recover'])
+
+    def test_recover_block_end(self):
+        # a record found by the scan close to the end of a read block is still checked against the one after it
+        data = b'x' * 200
+        record = struct.pack('<IIII', 1700000000, 0, len(data), len(data)) + data
+        with tempfile.TemporaryDirectory() as d:
+            path = os.path.join(d, 'damaged.pcap')
+            with open(path, 'wb') as f:
+                f.write(struct.pack('<IHHiIII', 0xa1b23c4d, 2, 4, 0, 0, 65535, 1))
+                f.write(record)
+                f.write(bytes(24 + (1 << 20) - 100 - f.tell()))
+                f.write(record * 10)
+            r = pypcap.PcapReader(open(path, 'rb'), recover=True)
+            assert(r.read() == 11)
+            assert(r.recovery_stats()['skipped'] == [(24 + len(record), 24 + (1 << 20) - 100)])
+
+    def test_recover_swapped(self):
+        with tempfile.TemporaryDirectory() as d:
+            path = os.path.join(d, 'damaged.pcap')
+            expected, skipped = self.write_damaged(path, order='>', magic=0xa1b2c3d4, frac=1)
+            r = pypcap.PcapReader(open(path, 'rb'), recover=True)
+            ts, caplens, _ = r.read_headers()
+            assert(ts.tolist() == [sec * 10**9 + usec * 1000 for sec, usec, _ in expected])
+            assert(r.recovery_stats()['skipped'] == skipped)
+
     def test_open_in_r_mode(self):
         def open_r():
             fp = open(self.f, 'r')
@@ -0,0 +1,95 @@
+import pypcap
+import unittest
+import os
+import threading
+import time
+
+PCAP_FILE = 'pcap_test.pcap'
+
+class TestReplay(unittest.TestCase):
+    def setUp(self):
+        self.p = os.path.join(os.path.dirname(__file__), PCAP_FILE)
+        self.reader = pypcap.PcapReader(open(self.p, 'rb'))
+
+    def tearDown(self):
+        self.reader.close()
+
+    def test_create(self):
+        r = pypcap.PcapReplayer(self.reader, "lo")
+        assert(r.reader is self.reader)
+        assert(r.interface_name == "lo")
+        assert(r.mode == "original")
+        assert(r.speed == 1.0)
+        assert(r.pps == 0)
+        assert(r.batch_size == 64)
+        assert(r.busy_poll == False)
+
+        r = pypcap.PcapReplayer(self.reader, "lo", mode="scaled", speed=2.5, busy_poll=True)
+        assert(r.mode == "scaled")
+        assert(r.speed == 2.5)
+        assert(r.busy_poll == True)
+
+        r = pypcap.PcapReplayer(self.reader, "lo", mode="pps", pps=1000, batch_size=8)
+        assert(r.pps == 1000)
+        assert(r.batch_size == 8)
+
+    def test_bad_args(self):
+        self.assertRaises(TypeError, pypcap.PcapReplayer, "not a reader", "lo")
+        self.assertRaises(ValueError, pypcap.PcapReplayer, self.reader, "lo", mode="warp")
+        self.assertRaises(ValueError, pypcap.PcapReplayer, self.reader, "lo", mode="scaled", speed=0)
+        self.assertRaises(ValueError, pypcap.PcapReplayer, self.reader, "lo", mode="pps")
+        self.assertRaises(ValueError, pypcap.PcapReplayer, self.reader, "lo", batch_size=0)
+
+    def test_read_only(self):
+        r = pypcap.PcapReplayer(self.reader, "lo", mode="top")
+        def set_mode():
+            r.mode = "original"
+        self.assertRaises(AttributeError, set_mode)
+
+    def replayer(self, **kwargs):
+        """ a replayer onto the loopback interface, or skip if raw sockets are unavailable """
+        r = pypcap.PcapReplayer(self.reader, "lo", **kwargs)
+        try:
+            r.run(count=1)
+        except OSError:
+            self.skipTest('raw sockets are unavailable')
+        return r
+
+    def test_pacing(self):
+        r = self.replayer(mode="pps", pps=200)
+        start = time.time()
+        stats = r.run(count=20)
+        elapsed = time.time() - start
+        assert(stats['packets_sent'] == 20)
+        assert(stats['send_errors'] == 0)
+        # 20 packets 5ms apart, the first one due right away
+        assert(0.09 <= elapsed < 0.5)
+        assert(150 < stats['achieved_pps'] < 250)
+
+        # a pause is not made up for in a burst
+        time.sleep(0.2)
+        start = time.time()
+        stats = r.run(count=20)
+        assert(stats['packets_sent'] == 20)
+        assert(time.time() - start >= 0.09)
+
+        # the rest of the file, the first packet having gone out in replayer()
+        stats = self.replayer(mode="top").run()
+        assert(stats['packets_sent'] == 764 - 41 - 1)
+        r.close()
+
+    def test_close_while_replaying(self):
+        r = self.replayer(mode="pps", pps=100)
+        t = threading.Thread(target=r.run, kwargs={'count': 30})
+        t.start()
+        time.sleep(0.1)
+        self.assertRaises(SystemError, self.reader.close)
+        self.assertRaises(SystemError, r.run)
+        t.join()
+        self.reader.close()
+        r.close()
+
+    def test_bad_interface(self):
+        r = pypcap.PcapReplayer(self.reader, "no-such-interface0", mode="top")
+        self.assertRaises(OSError, r.run)
+        self.assertRaises(ValueError, r.run, count=-1)
@@ -0,0 +1,82 @@
+import pypcap
+import unittest
+import os
+import json
+import tempfile
+
+PCAP_FILE = 'pcap_test.pcap'
+PACKET_COUNT = 764
+
+class TestSampling(unittest.TestCase):
+    def setUp(self):
+        self.p = os.path.join(os.path.dirname(__file__), PCAP_FILE)
+
+    def create_reader(self, sampling):
+        return pypcap.PcapReader(open(self.p, 'rb'), sampling=sampling)
+
+    def flow(self, pkt):
+        return (pkt.protocol,) + tuple(sorted([(pkt.src, pkt.sport), (pkt.dst, pkt.dport)], key=str))
+
+    def test_none(self):
+        r = self.create_reader(None)
+        assert(r.read() == PACKET_COUNT)
+        stats = r.sampling_stats()
+        assert(stats['mode'] == 'none')
+        assert(stats['packets_kept'] == PACKET_COUNT)
+
+    def test_count(self):
+        r = self.create_reader(('count', 10))
+        assert(r.read() == (PACKET_COUNT + 9) // 10)
+        stats = r.sampling_stats()
+        assert(stats['packets_seen'] == PACKET_COUNT)
+        assert(stats['rate'] == 0.1)
+
+    def test_count_keeps_every_nth(self):
+        every = [pkt.timestamp_ns for pkt in self.create_reader(None)]
+        sampled = [pkt.timestamp_ns for pkt in self.create_reader(('count', 7))]
+        assert(sampled == every[::7])
+
+    def test_random_is_deterministic(self):
+        a = [pkt.timestamp_ns for pkt in self.create_reader(('random', 0.3, 42))]
+        b = [pkt.timestamp_ns for pkt in self.create_reader(('random', 0.3, 42))]
+        assert(a == b)
+        assert(0 < len(a) < PACKET_COUNT)
+
+    def test_flow_keeps_whole_flows(self):
+        kept = set(self.flow(pkt) for pkt in self.create_reader(('flow', 0.5, 1)))
+        assert(len(kept) > 0)
+        sampled = [self.flow(pkt) for pkt in self.create_reader(('flow', 0.5, 1))]
+        everything = [self.flow(pkt) for pkt in self.create_reader(None)]
+        assert(0 < len(sampled) < len(everything))
+        assert(len(sampled) == sum(1 for f in everything if f in kept))
+
+    def test_window(self):
+        # the file spans about 5 seconds; keep the first half of every second
+        kept = [pkt.timestamp_ns for pkt in self.create_reader(('window', 0.5, 1.0))]
+        assert(0 < len(kept) < PACKET_COUNT)
+        assert(all(ts % 10**9 < 5 * 10**8 for ts in kept))
+
+    def test_invalid(self):
+        self.assertRaises(TypeError, self.create_reader, 'count')
+        self.assertRaises(ValueError, self.create_reader, ('count', 0))
+        self.assertRaises(ValueError, self.create_reader, ('random', 1.5))
+        self.assertRaises(ValueError, self.create_reader, ('window', 2.0, 1.0))
+        self.assertRaises(ValueError, self.create_reader, ('bogus', 1))
+
+    def test_writer_metadata(self):
+        with tempfile.TemporaryDirectory() as d:
+            out = os.path.join(d, 'sampled.pcap')
+            r = self.create_reader(('count', 4))
+            w = pypcap.PcapWriter(open(out, 'wb'))
+            assert(w.write_from_pcap_reader(r) == PACKET_COUNT // 4)
+            w.close()
+            with open(out + '.sampling.json') as fp:
+                meta = json.load(fp)
+            assert(meta['mode'] == 'count')
+            assert(meta['n'] == 4)
+            assert(meta['packets_seen'] == PACKET_COUNT)
+            assert(meta['packets_kept'] == PACKET_COUNT // 4)
+            assert(meta['scale'] == PACKET_COUNT / (PACKET_COUNT // 4))
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,100 @@
+import pypcap
+import unittest
+import os
+import tempfile
+import time
+
+from helpers import write_pcap
+
+FILENAME = os.path.join(os.path.dirname(__file__), 'pcap_test.pcap')
+
+def drain(capture, count):
+    """ dispatch count packets from a nonblocking capture """
+    got = 0
+    deadline = time.time() + 10
+    while got < count and time.time() < deadline:
+        n = len(capture.dispatch(64))
+        if n == 0:
+            time.sleep(0.002)
+        got += n
+    return got
+
+class TestShared(unittest.TestCase):
+    def setUp(self):
+        self.name = 'pypcap-test-%d' % os.getpid()
+
+    def live(self, path, size=None):
+        """ a capture replaying path to the ring, open in nonblocking mode, or skip if live capture is unavailable """
+        ring = self.name if size is None else (self.name, size)
+        c = pypcap.PcapCapture('fake:' + path, None, 100000, shared_ring=ring)
+        try:
+            c.fileno()
+        except SystemError:
+            self.skipTest('live capture is unavailable')
+        return c
+
+    def test_args(self):
+        self.assertRaises(ValueError, pypcap.PcapCapture, "lo", None, 10, shared_ring='a/b')
+        self.assertRaises(ValueError, pypcap.PcapCapture, "lo", None, 10, shared_ring='')
+        self.assertRaises(ValueError, pypcap.PcapCapture, "lo", None, 10, shared_ring=(self.name, 4096))
+        self.assertRaises(TypeError, pypcap.PcapCapture, "lo", None, 10, shared_ring=5)
+        pypcap.PcapCapture("lo", None, 10, shared_ring=(self.name, 1 << 20))
+        # the ring only exists while the capture is open
+        self.assertRaises(FileNotFoundError, pypcap.PcapSharedReader, self.name)
+        self.assertRaises(ValueError, pypcap.PcapSharedReader, 'a/b')
+
+    def test_consumers(self):
+        expected = [(p.timestamp, bytes(p.data)) for p in pypcap.PcapReader(open(FILENAME, 'rb'))]
+        c = self.live(FILENAME)
+        views = pypcap.PcapSharedReader(self.name)
+        copies = pypcap.PcapSharedReader(self.name, copy=True)
+        assert(views.interface_name == 'fake:' + FILENAME)
+        assert(views.linktype == 1)
+        assert(views.read() == [])
+
+        assert(drain(c, len(expected)) == len(expected))
+        assert(c.stats()['packets_shared'] == len(expected))
+        packets = views.read()
+        assert(len(packets) == len(expected))
+        copied = copies.read(max_packets=100)
+        assert(len(copied) == 100)
+        copied += list(copies.read())
+        c.close()
+
+        # views outlive both the capture and the reader
+        views.close()
+        for got in (packets, copied):
+            assert([(p.timestamp, bytes(p.data)) for p in got] == expected)
+        assert(packets[0].ethertype == 0x0800)
+
+        stats = copies.stats()
+        assert(stats['packets_received'] == len(expected))
+        assert(stats['packets_dropped'] == 0)
+        assert(stats['lag_bytes'] == 0)
+        assert(stats['closed'])
+        # a closed ring ends iteration
+        assert(list(copies) == [])
+        assert(copies.read(timeout=None) == [])
+
+    def test_slow_consumer(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, 'big.pcap')
+            # 300 packets, each filled with its index mod 256
+            write_pcap(path, [((1000 + i) * 10**9, bytes([i % 256]) * 9000) for i in range(300)])
+            c = self.live(path, 1 << 20)
+            r = pypcap.PcapSharedReader(self.name, copy=True)
+            # the producer goes on without waiting for the reader
+            assert(drain(c, 300) == 300)
+            packets = r.read()
+            stats = r.stats()
+            assert(0 < len(packets) < 300)
+            assert(stats['packets_dropped'] == 300 - len(packets))
+            # what is left is the newest packets, in order and intact
+            first = 300 - len(packets)
+            for i, p in enumerate(packets, first):
+                assert(int(p.timestamp) == 1000 + i)
+                assert(bytes(p.data) == bytes([i % 256]) * 9000)
+            c.close()
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,92 @@
+import pypcap
+import unittest
+import os
+import tempfile
+
+from helpers import udp, write_pcap
+
+PCAP_FILE = 'pcap_test.pcap'
+PACKET_COUNT = 764
+
+NET = 0x0a000000 # 10.0.0.0
+
+class TestTrafficStats(unittest.TestCase):
+    def setUp(self):
+        self.p = os.path.join(os.path.dirname(__file__), PCAP_FILE)
+
+    def test_reader(self):
+        pkts = list(pypcap.PcapReader(open(self.p, 'rb')))
+        s = pypcap.TrafficStats(interval=1.0, top=5)
+        assert(s.update(pypcap.PcapReader(open(self.p, 'rb'))) == PACKET_COUNT)
+        snap = s.snapshot()
+
+        assert(snap['packets'] == PACKET_COUNT)
+        assert(snap['bytes'] == sum(p.wirelen for p in pkts))
+        b = snap['buckets']
+        assert(sum(b['packets']) == PACKET_COUNT and sum(b['bytes']) == snap['bytes'])
+        first = int(pkts[0].timestamp_ns // 10**9 * 10**9)
+        assert(b['timestamps'][0] == first)
+        assert(list(b['timestamps']) == [first + i * 10**9 for i in range(len(b['timestamps']))])
+
+        assert(snap['protocols'][17][0] == 517)
+        assert(sum(p for p, _ in snap['protocols'].values()) + snap['non_ip'][0] == PACKET_COUNT)
+        assert(sum(snap['sizes']) == PACKET_COUNT and len(snap['sizes']) == len(snap['size_edges']))
+
+        # the sketch can only overcount, and top talkers come out largest first
+        exact = {}
+        for p in pkts:
+            if p.src is not None:
+                exact[p.src] = exact.get(p.src, 0) + p.wirelen
+        top = snap['top']
+        assert(0 < len(top) <= 5)
+        assert([t[1] for t in top] == sorted((t[1] for t in top), reverse=True))
+        assert(top[0][0] == max(exact, key=exact.get))
+        for addr, est in top:
+            assert(est >= exact[addr])
+
+    def test_packets_and_batches(self):
+        a, b = pypcap.TrafficStats(), pypcap.TrafficStats()
+        a.update(pypcap.PcapReader(open(self.p, 'rb')))
+        r = pypcap.PcapReader(open(self.p, 'rb'))
+        assert(b.update(r.read_batch(100)) == 100)
+        assert(b.update(next(r)) == 1)
+        assert(b.update(r) == PACKET_COUNT - 101)
+        sa, sb = a.snapshot(), b.snapshot()
+        for k in ['packets', 'bytes', 'protocols', 'non_ip', 'top']:
+            assert(sa[k] == sb[k])
+        assert(list(sa['sizes']) == list(sb['sizes']))
+        self.assertRaises(TypeError, b.update, [1])
+        b.reset()
+        assert(b.snapshot()['packets'] == 0 and len(b.snapshot()['buckets']['packets']) == 0)
+
+    def test_ring_and_top(self):
+        s = 10**9
+        records = [(100 * s, udp(NET + 1, size=100)), (101 * s, udp(NET + 2, size=100)), (105 * s, udp(NET + 1, size=200)), (101 * s, udp(NET + 3, size=100))]
+        records += [(106 * s, udp(NET + i, size=100)) for i in range(10, 20)] # small talkers after the big ones
+        records += [(106 * s, udp(NET + 2, size=1500))] * 3
+        with tempfile.TemporaryDirectory() as d:
+            path = os.path.join(d, 'ring.pcap')
+            write_pcap(path, records)
+            st = pypcap.TrafficStats(interval=1.0, buckets=4, top=2, width=4096)
+            st.update(pypcap.PcapReader(open(path, 'rb')))
+        snap = st.snapshot()
+        # 4 buckets end at 106: 100 and 101 fell out of the ring, and the second 101 came in too late for it
+        b = snap['buckets']
+        assert(list(b['timestamps']) == [103 * s, 104 * s, 105 * s, 106 * s])
+        assert(list(b['packets']) == [0, 0, 1, 13])
+        assert(snap['late'] == 1 and snap['packets'] == len(records))
+        assert([t[0] for t in snap['top']] == ['10.0.0.2', '10.0.0.1'])
+        assert(snap['top'][0][1] == 100 + 3 * 1500)
+
+    def test_args(self):
+        self.assertRaises(ValueError, pypcap.TrafficStats, interval=0)
+        self.assertRaises(ValueError, pypcap.TrafficStats, buckets=0)
+        self.assertRaises(ValueError, pypcap.TrafficStats, top=-1)
+        self.assertRaises(ValueError, pypcap.TrafficStats, depth=17)
+        s = pypcap.TrafficStats(top=0)
+        s.update(pypcap.PcapReader(open(self.p, 'rb')))
+        assert(s.snapshot()['top'] == [] and s.top == 0 and s.buckets == 3600)
+        self.assertRaises(AttributeError, setattr, s, 'interval', 2.0)
+
+if __name__ == '__main__':
+    unittest.main()
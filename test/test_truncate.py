@@ -0,0 +1,71 @@
+import pypcap
+import unittest
+import os
+import tempfile
+
+PCAP_FILE = 'pcap_test.pcap'
+PACKET_COUNT = 764
+
+class TestTruncate(unittest.TestCase):
+    def setUp(self):
+        self.p = os.path.join(os.path.dirname(__file__), PCAP_FILE)
+        self.dir = tempfile.TemporaryDirectory()
+        self.out = os.path.join(self.dir.name, 'truncated.pcap')
+
+    def tearDown(self):
+        self.dir.cleanup()
+
+    def packets(self, path):
+        return list(pypcap.PcapReader(open(path, 'rb')))
+
+    def write(self, truncate):
+        w = pypcap.PcapWriter(open(self.out, 'wb'), truncate=truncate)
+        assert(w.write_from_pcap_reader(pypcap.PcapReader(open(self.p, 'rb'))) == PACKET_COUNT)
+        stats = w.truncation_stats()
+        w.close()
+        return stats
+
+    def test_headers_only(self):
+        stats = self.write({'default': 0})
+        assert(stats['packets'] == PACKET_COUNT)
+        assert(stats['bytes_out'] < stats['bytes_in'])
+        for orig, cut in zip(self.packets(self.p), self.packets(self.out)):
+            assert(cut.wirelen == orig.wirelen)
+            assert(cut.sport == orig.sport and cut.dport == orig.dport)
+            if orig.payload is not None:
+                assert(len(cut.payload) == 0)
+                assert(cut.caplen == orig.caplen - len(orig.payload))
+
+    def test_per_protocol(self):
+        self.write({'tcp/443': 16, 'udp': None, 'default': 0})
+        for orig, cut in zip(self.packets(self.p), self.packets(self.out)):
+            if orig.payload is None:
+                continue
+            if orig.protocol == 17:
+                assert(cut.caplen == orig.caplen)
+            elif orig.protocol == 6 and 443 in (orig.sport, orig.dport):
+                assert(len(cut.payload) == min(16, len(orig.payload)))
+            else:
+                assert(len(cut.payload) == 0)
+
+    def test_disabled(self):
+        stats = self.write(None)
+        assert(not stats['enabled'])
+        assert([p.caplen for p in self.packets(self.out)] == [p.caplen for p in self.packets(self.p)])
+
+    def test_invalid(self):
+        for spec, exc in [
+            (['tcp'], TypeError),
+            ({'tcp': -1}, ValueError),
+            ({'tcp': 'all'}, TypeError),
+            ({'quic': 0}, ValueError),
+            ({'tcp/70000': 0}, ValueError),
+            # only transports whose headers are parsed, and ports only where there are any
+            ({'gre': 0}, ValueError),
+            ({'50': 0}, ValueError),
+            ({'icmp/8': 0}, ValueError),
+        ]:
+            self.assertRaises(exc, pypcap.PcapWriter, open(self.out, 'wb'), truncate=spec)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -1,7 +1,10 @@
 import pypcap
 import unittest
 import os
+import shutil
+import struct
 import subprocess
+import sys
 
 FILENAME = 'foo'
 PCAP_FILE = 'pcap_test.pcap'
@@ -99,6 +102,152 @@ class TestWriter(unittest.TestCase):
         e_pkt_count = res + res2
         assert(pkt_count == e_pkt_count)
 
+    def packets(self, path):
+        return [(p.timestamp_ns, p.wirelen, bytes(p.data)) for p in pypcap.PcapReader(open(path, 'rb'))]
+
+    def extract(self, reader=None, **kwargs):
+        writer = self.create_writer()
+        n = writer.write_from_pcap_reader(reader or self.create_reader(), **kwargs)
+        writer.close()
+        return n
+
+    def test_extract_range(self):
+        assert(self.extract(first=10, count=20) == 20)
+        assert(self.packets(self.f) == self.packets(self.p)[10:30])
+        assert(self.extract(first=self.exp_count + 1) == 0)
+
+    def test_extract_time(self):
+        orig = self.packets(self.p)
+        start, end = orig[100][0], orig[200][0]
+        assert(self.extract(start=start / 1e9, end=end / 1e9) == 100)
+        assert(self.packets(self.f) == orig[100:200])
+        assert(self.extract(end=orig[0][0] / 1e9) == 0)
+
+    def test_extract_filter_snaplen(self):
+        orig = list(pypcap.PcapReader(open(self.p, 'rb')))
+        udp = [p for p in orig if p.protocol == 17]
+        assert(self.extract(filter='udp', snaplen=80) == len(udp))
+        got = self.packets(self.f)
+        assert([(ts, wirelen) for ts, wirelen, _ in got] == [(p.timestamp_ns, p.wirelen) for p in udp])
+        assert(all(data == bytes(p.data)[:80] for (_, _, data), p in zip(got, udp)))
+        self.assertRaises(ValueError, self.extract, filter='not a filter')
+        self.assertRaises(ValueError, self.extract, snaplen=-1)
+        self.assertRaises(TypeError, self.extract, start='now')
+
+    def test_extract_reader_continues(self):
+        reader = self.create_reader()
+        assert(self.extract(reader, count=10) == 10)
+        assert(reader.read() == self.exp_count - 10)
+
+        # the packet that ended the copy is the next one read on the per-packet path too
+        orig = self.packets(self.p)
+        for kwargs in (dict(sampling=('count', 1)), dict(recover=True)):
+            reader = pypcap.PcapReader(open(self.p, 'rb'), **kwargs)
+            assert(self.extract(reader, count=10) == 10)
+            assert(self.extract(reader, count=10) == 10)
+            assert(self.packets(self.f) == orig[10:20])
+            ts, _, _ = reader.read_headers()
+            assert(ts.tolist() == [t for t, _, _ in orig[20:]])
+
+    def test_extract_keeps_no_reference(self):
+        reader = self.create_reader()
+        refs = sys.getrefcount(reader)
+        self.extract(reader, count=10)
+        self.extract(reader, filter='reject')
+        assert(sys.getrefcount(reader) == refs)
+
+    def test_extract_paths_agree(self):
+        """ the bulk copy writes the same file as copying through libpcap, which sampling forces """
+        kwargs = dict(first=5, start=self.packets(self.p)[50][0] / 1e9, snaplen=100, filter='tcp')
+        self.extract(**kwargs)
+        bulk = open(self.f, 'rb').read()
+        self.extract(pypcap.PcapReader(open(self.p, 'rb'), sampling=('count', 1)), **kwargs)
+        assert(open(self.f, 'rb').read() == bulk)
+
+        # a nanosecond file is copied verbatim
+        copy = os.path.join(self.d, 'copy.pcap')
+        os.rename(self.f, copy)
+        try:
+            self.extract(pypcap.PcapReader(open(copy, 'rb')))
+            assert(open(self.f, 'rb').read() == bulk)
+        finally:
+            os.remove(copy)
+
+    def file_header(self, path):
+        with open(path, 'rb') as f:
+            magic, _, _, _, _, snaplen, linktype = struct.unpack('<IHHiIII', f.read(24))
+        return magic, snaplen, linktype
+
+    def write_as(self, reader=None, **kwargs):
+        """ copy reader to a writer made with kwargs; return the count and the writer's linktype, snaplen and unconverted """
+        writer = pypcap.PcapWriter(self.open_file(), **kwargs)
+        n = writer.write_from_pcap_reader(reader or self.create_reader())
+        attrs = (writer.linktype, writer.snaplen, writer.unconverted)
+        writer.close()
+        return n, attrs
+
+    def test_linktype_inherited(self):
+        sll = os.path.join(self.d, 'sll.pcap')
+        ip = bytes([0x45, 0, 0, 28, 0, 0, 0, 0, 64, 17, 0, 0, 10, 0, 0, 1, 10, 0, 0, 2]) + bytes(8)
+        with open(sll, 'wb') as f:
+            f.write(struct.pack('<IHHiIII', 0xa1b23c4d, 2, 4, 0, 0, 9000, 113))
+            for i in range(3):
+                f.write(struct.pack('<IIII', i, 0, 16 + len(ip), 16 + len(ip)))
+                f.write(bytes(14) + b'\x08\x00' + ip)
+        try:
+            writer = self.create_writer()
+            assert(writer.linktype is None and writer.snaplen is None)
+            writer.close()
+            assert(self.write_as(pypcap.PcapReader(open(sll, 'rb'))) == (3, (113, 9000, 0)))
+            assert(self.file_header(self.f) == (0xa1b23c4d, 9000, 113))
+
+            # and converted to the link type asked for
+            assert(self.write_as(pypcap.PcapReader(open(sll, 'rb')), linktype='ethernet') == (3, (1, 65535, 0)))
+            assert(self.file_header(self.f) == (0xa1b23c4d, 65535, 1))
+            assert([data for _, _, data in self.packets(self.f)] == [bytes(12) + b'\x08\x00' + ip] * 3)
+        finally:
+            os.remove(sll)
+
+    def test_linktype_convert(self):
+        orig = self.packets(self.p)
+        assert(self.write_as(linktype='raw', snaplen=9000) == (len(orig), (101, 9000, 0)))
+        assert(self.file_header(self.f) == (0xa1b23c4d, 9000, 101))
+        assert(self.packets(self.f) == [(ts, wirelen - 14, data[14:]) for ts, wirelen, data in orig])
+
+        # the per-packet path, which sampling forces, writes the same file
+        bulk = open(self.f, 'rb').read()
+        self.write_as(pypcap.PcapReader(open(self.p, 'rb'), sampling=('count', 1)), linktype=101, snaplen=9000)
+        assert(open(self.f, 'rb').read() == bulk)
+
+        # snaplen holds for the converted records, whichever way the link header changed size
+        raw = os.path.join(self.d, 'raw.pcap')
+        shutil.copyfile(self.f, raw)
+        try:
+            assert(self.write_as(pypcap.PcapReader(open(raw, 'rb')), linktype='ethernet', snaplen=100)[0] == len(orig))
+            assert(self.packets(self.f) == [(ts, wirelen, (bytes(12) + data[12:])[:100]) for ts, wirelen, data in orig])
+            assert(pypcap.PcapReader(open(self.f, 'rb'), recover=True).read() == len(orig))
+        finally:
+            os.remove(raw)
+        self.write_as(linktype='raw', snaplen=100)
+        assert(self.packets(self.f) == [(ts, wirelen - 14, data[14:114]) for ts, wirelen, data in orig])
+
+        # packets of the wrong IP version are left out
+        v6 = sum(1 for p in pypcap.PcapReader(open(self.p, 'rb')) if p.ip_version == 6)
+        assert(self.write_as(linktype='ipv6') == (v6, (229, 65535, len(orig) - v6)))
+
+        self.assertRaises(ValueError, self.write_as, linktype=147)
+        self.assertRaises(ValueError, self.write_as, linktype='token ring')
+
+    def test_precision(self):
+        orig = self.packets(self.p)
+        writer = pypcap.PcapWriter(self.open_file(), precision='micro')
+        assert(writer.precision == 'micro')
+        writer.close()
+        self.write_as(precision='micro')
+        assert(self.file_header(self.f)[0] == 0xa1b2c3d4)
+        assert(self.packets(self.f) == [(ts // 1000 * 1000, wirelen, data) for ts, wirelen, data in orig])
+        self.assertRaises(ValueError, self.write_as, precision='pico')
+
     def test_subprocess(self):
         """
         Test that PcapWriter can read from stdout correctly